@@ -0,0 +1,173 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "async_loader.h"
+#include "parallel.h"
+
+AsyncLoader::AsyncLoader() : m_runningJobs(0), m_stopping(false)
+{
+}
+
+AsyncLoader::~AsyncLoader()
+{
+    stop();
+}
+
+void AsyncLoader::start(int threadCount)
+{
+    // By default one thread is left for the main loop.
+
+    if (threadCount <= 0)
+        threadCount = Parallel::getThreadCount() - 1;
+
+    if (threadCount < 1)
+        threadCount = 1;
+
+    stop();
+    m_stopping = false;
+    m_threads.reserve(threadCount);
+
+    for (int i = 0; i < threadCount; ++i)
+        m_threads.push_back(std::thread(&AsyncLoader::run, this));
+}
+
+void AsyncLoader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_stopping = true;
+        m_jobs.clear();
+        m_uploads.clear();
+    }
+
+    m_jobQueued.notify_all();
+
+    for (int i = 0; i < static_cast<int>(m_threads.size()); ++i)
+        m_threads[i].join();
+
+    m_threads.clear();
+
+    // Jobs that were running may have queued uploads on their way out.
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_uploads.clear();
+}
+
+void AsyncLoader::queueUpload(const Function &upload, size_t bytes)
+{
+    Upload entry;
+
+    entry.function = upload;
+    entry.bytes = bytes;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_stopping)
+        m_uploads.push_back(entry);
+}
+
+int AsyncLoader::processUploads(size_t budgetBytes)
+{
+    size_t spentBytes = 0;
+    int count = 0;
+
+    while (count == 0 || spentBytes < budgetBytes)
+    {
+        Upload upload;
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+
+            if (m_uploads.empty())
+                break;
+
+            upload = m_uploads.front();
+            m_uploads.pop_front();
+        }
+
+        upload.function();
+        spentBytes += upload.bytes;
+        ++count;
+    }
+
+    return count;
+}
+
+int AsyncLoader::getNumberOfPendingJobs() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_jobs.size()) + m_runningJobs;
+}
+
+int AsyncLoader::getNumberOfPendingUploads() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_uploads.size());
+}
+
+int AsyncLoader::getNumberOfThreads() const
+{
+    return static_cast<int>(m_threads.size());
+}
+
+void AsyncLoader::push(const Function &job)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_stopping)
+            return;
+
+        m_jobs.push_back(job);
+    }
+
+    m_jobQueued.notify_one();
+}
+
+void AsyncLoader::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    while (true)
+    {
+        while (!m_stopping && m_jobs.empty())
+            m_jobQueued.wait(lock);
+
+        if (m_stopping)
+            break;
+
+        Function job = m_jobs.front();
+
+        m_jobs.pop_front();
+        ++m_runningJobs;
+        lock.unlock();
+
+        // Jobs created by submit() catch their own exceptions and store them
+        // in their futures.
+
+        job();
+
+        lock.lock();
+        --m_runningJobs;
+    }
+}
@@ -0,0 +1,127 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(ASYNC_LOADER_H)
+#define ASYNC_LOADER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Background loading on a pool of worker threads.
+//
+// submit() queues a job and returns a future for its result. Jobs are run in
+// the order they were submitted by however many worker threads are free, so
+// independent files are parsed and decoded at the same time. A job may
+// submit further jobs. An exception thrown by a job is stored in its future
+// and rethrown by future::get(). isReady() polls a future without blocking,
+// which is how the main loop finds out that something has finished loading.
+//
+// OpenGL calls have to be made on the thread that owns the context, so jobs
+// hand their results to the main thread with queueUpload(). The main thread
+// calls processUploads() once per frame, which runs queued uploads in order
+// until the frame's byte budget has been spent. At least one upload is run
+// every frame so large uploads still get through. Exceptions thrown by an
+// upload are passed on to the caller of processUploads().
+//
+// stop() discards jobs and uploads that haven't started yet and waits for the
+// running jobs to finish. Futures of discarded jobs report a broken promise.
+// The destructor calls stop().
+//-----------------------------------------------------------------------------
+
+class AsyncLoader
+{
+public:
+    typedef std::function<void ()> Function;
+
+    AsyncLoader();
+    ~AsyncLoader();
+
+    void start(int threadCount = 0);
+    void stop();
+
+    template <typename Result>
+    std::future<Result> submit(const std::function<Result ()> &job);
+
+    void queueUpload(const Function &upload, size_t bytes);
+    int processUploads(size_t budgetBytes);
+
+    template <typename Result>
+    static bool isReady(const std::future<Result> &future);
+
+    // Getter methods.
+
+    int getNumberOfPendingJobs() const;
+    int getNumberOfPendingUploads() const;
+    int getNumberOfThreads() const;
+
+private:
+    struct Upload
+    {
+        Function function;
+        size_t bytes;
+    };
+
+    AsyncLoader(const AsyncLoader &);
+    AsyncLoader &operator=(const AsyncLoader &);
+
+    void push(const Function &job);
+    void run();
+
+    std::vector<std::thread> m_threads;
+    std::deque<Function> m_jobs;
+    std::deque<Upload> m_uploads;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_jobQueued;
+    int m_runningJobs;
+    bool m_stopping;
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename Result>
+std::future<Result> AsyncLoader::submit(const std::function<Result ()> &job)
+{
+    // packaged_task can't be copied, so the queued function shares it.
+
+    std::shared_ptr<std::packaged_task<Result ()> > pTask(new std::packaged_task<Result ()>(job));
+    std::future<Result> future = pTask->get_future();
+
+    push([pTask]() { (*pTask)(); });
+    return future;
+}
+
+template <typename Result>
+bool AsyncLoader::isReady(const std::future<Result> &future)
+{
+    return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+#endif
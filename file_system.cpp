@@ -0,0 +1,211 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if defined(_WIN32)
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "file_system.h"
+#include "mapped_file.h"
+
+namespace
+{
+    const unsigned long long PRIME64_1 = 0x9E3779B185EBCA87ULL;
+    const unsigned long long PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+    const unsigned long long PRIME64_3 = 0x165667B19E3779F9ULL;
+    const unsigned long long PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+    const unsigned long long PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+    inline unsigned long long RotateLeft(unsigned long long x, int bits)
+    {
+        return (x << bits) | (x >> (64 - bits));
+    }
+
+    inline unsigned long long Read64(const unsigned char *p)
+    {
+        unsigned long long value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline unsigned int Read32(const unsigned char *p)
+    {
+        unsigned int value;
+        memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline unsigned long long Round(unsigned long long acc, unsigned long long input)
+    {
+        acc += input * PRIME64_2;
+        acc = RotateLeft(acc, 31);
+        return acc * PRIME64_1;
+    }
+
+    inline unsigned long long MergeRound(unsigned long long acc, unsigned long long value)
+    {
+        acc ^= Round(0, value);
+        return acc * PRIME64_1 + PRIME64_4;
+    }
+}
+
+bool FileSystem::getCanonicalPath(const char *pszFilename, std::string &path)
+{
+#if defined(_WIN32)
+    char szPath[MAX_PATH];
+    DWORD length = GetFullPathNameA(pszFilename, MAX_PATH, szPath, 0);
+
+    if (length == 0 || length >= MAX_PATH)
+        return false;
+
+    CharLowerBuffA(szPath, length);
+
+    for (DWORD i = 0; i < length; ++i)
+    {
+        if (szPath[i] == '/')
+            szPath[i] = '\\';
+    }
+
+    path.assign(szPath, length);
+    return true;
+#else
+    char *pszPath = realpath(pszFilename, 0);
+
+    if (!pszPath)
+        return false;
+
+    path = pszPath;
+    free(pszPath);
+    return true;
+#endif
+}
+
+bool FileSystem::getFileInfo(const char *pszFilename, FileInfo &info)
+{
+#if defined(_WIN32)
+    struct __stat64 fileInfo;
+
+    if (_stat64(pszFilename, &fileInfo) != 0)
+        return false;
+#else
+    struct stat fileInfo;
+
+    if (stat(pszFilename, &fileInfo) != 0)
+        return false;
+#endif
+
+    info.size = static_cast<unsigned long long>(fileInfo.st_size);
+    info.modificationTime = static_cast<long long>(fileInfo.st_mtime);
+    return true;
+}
+
+unsigned long long FileSystem::hashBytes(const void *pData, size_t size)
+{
+    const unsigned char *p = static_cast<const unsigned char *>(pData);
+    const unsigned char *pEnd = p + size;
+    unsigned long long h = 0;
+
+    if (size >= 32)
+    {
+        const unsigned char *pLimit = pEnd - 32;
+        unsigned long long v1 = PRIME64_1 + PRIME64_2;
+        unsigned long long v2 = PRIME64_2;
+        unsigned long long v3 = 0;
+        unsigned long long v4 = 0 - PRIME64_1;
+
+        do
+        {
+            v1 = Round(v1, Read64(p));
+            v2 = Round(v2, Read64(p + 8));
+            v3 = Round(v3, Read64(p + 16));
+            v4 = Round(v4, Read64(p + 24));
+            p += 32;
+        } while (p <= pLimit);
+
+        h = RotateLeft(v1, 1) + RotateLeft(v2, 7) + RotateLeft(v3, 12) + RotateLeft(v4, 18);
+        h = MergeRound(h, v1);
+        h = MergeRound(h, v2);
+        h = MergeRound(h, v3);
+        h = MergeRound(h, v4);
+    }
+    else
+    {
+        h = PRIME64_5;
+    }
+
+    h += static_cast<unsigned long long>(size);
+
+    for (; p + 8 <= pEnd; p += 8)
+    {
+        h ^= Round(0, Read64(p));
+        h = RotateLeft(h, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+    if (p + 4 <= pEnd)
+    {
+        h ^= static_cast<unsigned long long>(Read32(p)) * PRIME64_1;
+        h = RotateLeft(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+
+    for (; p < pEnd; ++p)
+    {
+        h ^= (*p) * PRIME64_5;
+        h = RotateLeft(h, 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
+
+bool FileSystem::hashFile(const char *pszFilename, unsigned long long &hash)
+{
+    MappedFile file;
+
+    if (!file.open(pszFilename))
+        return false;
+
+    hash = hashBytes(file.getData(), file.getSize());
+    return true;
+}
+
+bool FileSystem::replaceFile(const char *pszSourceFilename, const char *pszDestFilename)
+{
+#if defined(_WIN32)
+    return MoveFileExA(pszSourceFilename, pszDestFilename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    return rename(pszSourceFilename, pszDestFilename) == 0;
+#endif
+}
@@ -0,0 +1,63 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(FILE_SYSTEM_H)
+#define FILE_SYSTEM_H
+
+#include <cstddef>
+#include <string>
+
+//-----------------------------------------------------------------------------
+// Small collection of portable file helpers.
+//
+// getCanonicalPath() turns a relative or otherwise non unique path into an
+// absolute one that's the same for every way of naming the file. On Windows
+// the path is also lower cased because file names aren't case sensitive.
+//
+// getFileInfo() returns a file's size and last modification time. The time is
+// only meant to be compared against earlier results for the same file.
+//
+// hashBytes() and hashFile() compute the 64-bit XXH64 hash (seed 0) of a block
+// of memory or of a file's contents. The hash is used to detect whether a file
+// has really changed when its modification time alone says it may have.
+//
+// replaceFile() renames a file over an existing one. Writers use it to publish
+// a completely written temporary file so readers never see a partial file.
+//-----------------------------------------------------------------------------
+
+class FileSystem
+{
+public:
+    struct FileInfo
+    {
+        unsigned long long size;
+        long long modificationTime;
+    };
+
+    static bool getCanonicalPath(const char *pszFilename, std::string &path);
+    static bool getFileInfo(const char *pszFilename, FileInfo &info);
+    static unsigned long long hashBytes(const void *pData, size_t size);
+    static bool hashFile(const char *pszFilename, unsigned long long &hash);
+    static bool replaceFile(const char *pszSourceFilename, const char *pszDestFilename);
+};
+
+#endif
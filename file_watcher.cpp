@@ -0,0 +1,382 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if defined(_WIN32)
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <cerrno>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+#include "file_system.h"
+#include "file_watcher.h"
+
+namespace
+{
+#if defined(_WIN32)
+    const char PATH_SEPARATOR = '\\';
+
+    // ReadDirectoryChangesW() fails for buffers over 64 KB on network drives.
+    const DWORD NOTIFY_BUFFER_SIZE = 64 * 1024;
+    const DWORD NOTIFY_FILTER = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE;
+#else
+    const char PATH_SEPARATOR = '/';
+#endif
+
+#if defined(__linux__)
+    const unsigned int WATCH_EVENTS = IN_CLOSE_WRITE | IN_MOVED_TO;
+#endif
+
+    void TrimPathSeparators(std::string &path)
+    {
+        while (path.size() > 1 && (path[path.size() - 1] == '/' || path[path.size() - 1] == '\\'))
+            path.erase(path.size() - 1);
+    }
+}
+
+#if defined(_WIN32)
+
+struct FileWatcher::Directory
+{
+    std::string path;
+    HANDLE hDirectory;
+    OVERLAPPED overlapped;
+    bool watching;
+    DWORD buffer[NOTIFY_BUFFER_SIZE / sizeof(DWORD)];
+};
+
+#else
+
+struct FileWatcher::Directory
+{
+    std::string path;
+    int watch;
+};
+
+#endif
+
+FileWatcher::FileWatcher() : m_descriptor(-1)
+{
+}
+
+FileWatcher::~FileWatcher()
+{
+    clear();
+}
+
+void FileWatcher::addPendingFile(const Directory &directory, const char *pszName, size_t length)
+{
+    // A file that changes again before it has been reported waits for the
+    // new change to settle. An empty name stands for the whole directory.
+
+    std::string path(directory.path);
+
+    if (length > 0)
+    {
+        path += PATH_SEPARATOR;
+        path.append(pszName, length);
+    }
+
+    m_pendingFiles[path] = Clock::now();
+}
+
+int FileWatcher::getNumberOfDirectories() const
+{
+    return static_cast<int>(m_directories.size());
+}
+
+int FileWatcher::poll(std::vector<std::string> &changedFiles, float settleSeconds)
+{
+    changedFiles.clear();
+    readChanges();
+
+    Clock::time_point now = Clock::now();
+    Clock::duration settle = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<float>(settleSeconds));
+
+    for (PendingFiles::iterator i = m_pendingFiles.begin(); i != m_pendingFiles.end();)
+    {
+        if (now - i->second >= settle)
+        {
+            changedFiles.push_back(i->first);
+            m_pendingFiles.erase(i++);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return static_cast<int>(changedFiles.size());
+}
+
+#if defined(_WIN32)
+
+void FileWatcher::clear()
+{
+    for (size_t i = 0; i < m_directories.size(); ++i)
+    {
+        Directory *pDirectory = m_directories[i];
+
+        // The buffer mustn't be freed while the system can still write to it,
+        // so wait for the cancelled read to finish.
+
+        if (pDirectory->watching)
+        {
+            DWORD bytes = 0;
+
+            CancelIo(pDirectory->hDirectory);
+            GetOverlappedResult(pDirectory->hDirectory, &pDirectory->overlapped, &bytes, TRUE);
+        }
+
+        CloseHandle(pDirectory->hDirectory);
+        delete pDirectory;
+    }
+
+    m_directories.clear();
+    m_pendingFiles.clear();
+}
+
+void FileWatcher::readChanges()
+{
+    for (size_t i = 0; i < m_directories.size(); ++i)
+    {
+        Directory *pDirectory = m_directories[i];
+        DWORD bytes = 0;
+
+        if (!pDirectory->watching)
+            continue;
+
+        if (!GetOverlappedResult(pDirectory->hDirectory, &pDirectory->overlapped, &bytes, FALSE))
+        {
+            if (GetLastError() == ERROR_IO_INCOMPLETE)
+                continue;
+
+            bytes = 0;
+        }
+
+        if (bytes == 0)
+        {
+            // The buffer overflowed or the read failed. The changes are lost.
+            addPendingFile(*pDirectory, "", 0);
+        }
+        else
+        {
+            const unsigned char *pEntry = reinterpret_cast<const unsigned char *>(pDirectory->buffer);
+
+            while (true)
+            {
+                const FILE_NOTIFY_INFORMATION *pInfo = reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(pEntry);
+
+                if (pInfo->Action == FILE_ACTION_ADDED || pInfo->Action == FILE_ACTION_MODIFIED ||
+                    pInfo->Action == FILE_ACTION_RENAMED_NEW_NAME)
+                {
+                    // Lower cased like the paths from FileSystem::getCanonicalPath().
+
+                    char szName[MAX_PATH];
+                    int length = WideCharToMultiByte(CP_ACP, 0, pInfo->FileName,
+                                     static_cast<int>(pInfo->FileNameLength / sizeof(WCHAR)),
+                                     szName, sizeof(szName), 0, 0);
+
+                    if (length > 0)
+                    {
+                        CharLowerBuffA(szName, length);
+                        addPendingFile(*pDirectory, szName, length);
+                    }
+                }
+
+                if (pInfo->NextEntryOffset == 0)
+                    break;
+
+                pEntry += pInfo->NextEntryOffset;
+            }
+        }
+
+        memset(&pDirectory->overlapped, 0, sizeof(pDirectory->overlapped));
+
+        pDirectory->watching = ReadDirectoryChangesW(pDirectory->hDirectory, pDirectory->buffer,
+                                   sizeof(pDirectory->buffer), FALSE, NOTIFY_FILTER, 0,
+                                   &pDirectory->overlapped, 0) != FALSE;
+    }
+}
+
+bool FileWatcher::watchDirectory(const char *pszPath)
+{
+    std::string path;
+
+    if (!FileSystem::getCanonicalPath(pszPath, path))
+        return false;
+
+    TrimPathSeparators(path);
+
+    for (size_t i = 0; i < m_directories.size(); ++i)
+    {
+        if (m_directories[i]->path == path)
+            return true;
+    }
+
+    HANDLE hDirectory = CreateFileA(path.c_str(), FILE_LIST_DIRECTORY,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, 0, OPEN_EXISTING,
+                            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, 0);
+
+    if (hDirectory == INVALID_HANDLE_VALUE)
+        return false;
+
+    Directory *pDirectory = new Directory;
+
+    pDirectory->path = path;
+    pDirectory->hDirectory = hDirectory;
+    memset(&pDirectory->overlapped, 0, sizeof(pDirectory->overlapped));
+
+    if (!ReadDirectoryChangesW(hDirectory, pDirectory->buffer, sizeof(pDirectory->buffer), FALSE,
+                               NOTIFY_FILTER, 0, &pDirectory->overlapped, 0))
+    {
+        CloseHandle(hDirectory);
+        delete pDirectory;
+        return false;
+    }
+
+    pDirectory->watching = true;
+    m_directories.push_back(pDirectory);
+    return true;
+}
+
+#elif defined(__linux__)
+
+void FileWatcher::clear()
+{
+    // Closing the inotify instance removes all of its watches.
+
+    if (m_descriptor != -1)
+    {
+        close(m_descriptor);
+        m_descriptor = -1;
+    }
+
+    for (size_t i = 0; i < m_directories.size(); ++i)
+        delete m_directories[i];
+
+    m_directories.clear();
+    m_pendingFiles.clear();
+}
+
+void FileWatcher::readChanges()
+{
+    if (m_descriptor == -1)
+        return;
+
+    // long long keeps the events suitably aligned.
+
+    long long buffer[2048];
+
+    while (true)
+    {
+        ssize_t length = read(m_descriptor, buffer, sizeof(buffer));
+
+        if (length == -1 && errno == EINTR)
+            continue;
+
+        if (length <= 0)
+            break;
+
+        const char *pBegin = reinterpret_cast<const char *>(buffer);
+
+        for (const char *pEntry = pBegin; pEntry < pBegin + length;)
+        {
+            const struct inotify_event *pEvent = reinterpret_cast<const struct inotify_event *>(pEntry);
+
+            if (pEvent->mask & IN_Q_OVERFLOW)
+            {
+                for (size_t i = 0; i < m_directories.size(); ++i)
+                    addPendingFile(*m_directories[i], "", 0);
+            }
+            else if ((pEvent->mask & WATCH_EVENTS) && !(pEvent->mask & IN_ISDIR) && pEvent->len > 0)
+            {
+                for (size_t i = 0; i < m_directories.size(); ++i)
+                {
+                    if (m_directories[i]->watch == pEvent->wd)
+                    {
+                        addPendingFile(*m_directories[i], pEvent->name, strlen(pEvent->name));
+                        break;
+                    }
+                }
+            }
+
+            pEntry += sizeof(struct inotify_event) + pEvent->len;
+        }
+    }
+}
+
+bool FileWatcher::watchDirectory(const char *pszPath)
+{
+    std::string path;
+
+    if (!FileSystem::getCanonicalPath(pszPath, path))
+        return false;
+
+    TrimPathSeparators(path);
+
+    if (m_descriptor == -1 && (m_descriptor = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+        return false;
+
+    // Watching a directory a second time returns its existing watch.
+
+    int watch = inotify_add_watch(m_descriptor, path.c_str(), WATCH_EVENTS | IN_ONLYDIR);
+
+    if (watch == -1)
+        return false;
+
+    for (size_t i = 0; i < m_directories.size(); ++i)
+    {
+        if (m_directories[i]->watch == watch)
+            return true;
+    }
+
+    Directory *pDirectory = new Directory;
+
+    pDirectory->path = path;
+    pDirectory->watch = watch;
+    m_directories.push_back(pDirectory);
+    return true;
+}
+
+#else
+
+void FileWatcher::clear()
+{
+    m_pendingFiles.clear();
+}
+
+void FileWatcher::readChanges()
+{
+}
+
+bool FileWatcher::watchDirectory(const char *)
+{
+    return false;
+}
+
+#endif
@@ -0,0 +1,85 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(FILE_WATCHER_H)
+#define FILE_WATCHER_H
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Watches directories for files that are written or replaced so that assets
+// can be reloaded while the application is running.
+//
+// watchDirectory() starts watching one directory. Its subdirectories aren't
+// watched. poll() never blocks. It returns the files in the watched
+// directories that have been written, created, or renamed into place since
+// the last call. A file's path is the canonical path of its directory (see
+// FileSystem::getCanonicalPath()) joined with its name, so it can be compared
+// against the canonical paths of the files that were loaded.
+//
+// Editors often save a file with several writes, or write a temporary file
+// and then rename it. A file is only reported once nothing has happened to it
+// for settleSeconds, and it's reported once however many changes were seen.
+// If the operating system drops changes because too many happened at once,
+// the directory's own path is reported instead. Every file in it should then
+// be treated as changed.
+//
+// On Windows the directories are watched with ReadDirectoryChangesW() and on
+// Linux with inotify. On other platforms watchDirectory() fails. A FileWatcher
+// must only be used by one thread at a time.
+//-----------------------------------------------------------------------------
+
+class FileWatcher
+{
+public:
+    FileWatcher();
+    ~FileWatcher();
+
+    void clear();
+    int poll(std::vector<std::string> &changedFiles, float settleSeconds = 0.0f);
+    bool watchDirectory(const char *pszPath);
+
+    // Getter methods.
+
+    int getNumberOfDirectories() const;
+
+private:
+    struct Directory;
+
+    typedef std::chrono::steady_clock Clock;
+    typedef std::map<std::string, Clock::time_point> PendingFiles;
+
+    FileWatcher(const FileWatcher &);
+    FileWatcher &operator=(const FileWatcher &);
+
+    void addPendingFile(const Directory &directory, const char *pszName, size_t length);
+    void readChanges();
+
+    std::vector<Directory *> m_directories;
+    PendingFiles m_pendingFiles;
+    int m_descriptor;
+};
+
+#endif
@@ -0,0 +1,210 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "linear_allocator.h"
+
+LinearAllocator::LinearAllocator(size_t blockSize)
+{
+    m_blockSize = (blockSize > 0) ? blockSize : DEFAULT_BLOCK_SIZE;
+    m_limit = 0;
+    m_reservedBytes = 0;
+    m_usedBytes = 0;
+    m_peakBytes = 0;
+    m_totalBytes = 0;
+    m_offset = 0;
+    m_currentBlock = 0;
+}
+
+LinearAllocator::~LinearAllocator()
+{
+    release();
+}
+
+void *LinearAllocator::allocate(size_t size, size_t alignment)
+{
+    // Returns size bytes aligned to alignment, which must be a power of two,
+    // or null if a new block is needed and it would go over the limit.
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    size_t length = (size > 0) ? size : 1;
+
+    if (alignment == 0)
+        alignment = 1;
+
+    while (true)
+    {
+        if (m_currentBlock < static_cast<int>(m_blocks.size()))
+        {
+            const Block &block = m_blocks[m_currentBlock];
+            size_t address = reinterpret_cast<size_t>(block.pData) + m_offset;
+            size_t start = m_offset + (((address + alignment - 1) & ~(alignment - 1)) - address);
+
+            if (start <= block.size && length <= block.size - start)
+            {
+                m_offset = start + length;
+                m_usedBytes += size;
+                m_totalBytes += size;
+
+                if (m_usedBytes > m_peakBytes)
+                    m_peakBytes = m_usedBytes;
+
+                return block.pData + start;
+            }
+
+            // Blocks kept from before the last reset() that are too small are
+            // skipped over until the next reset().
+
+            if (m_currentBlock + 1 < static_cast<int>(m_blocks.size()))
+            {
+                ++m_currentBlock;
+                m_offset = 0;
+                continue;
+            }
+        }
+
+        // Each new block is at least as large as all the existing blocks
+        // together. This keeps the number of blocks logarithmic in the
+        // number of bytes allocated.
+
+        size_t needed = length + alignment - 1;
+        size_t blockSize = (m_reservedBytes > m_blockSize) ? m_reservedBytes : m_blockSize;
+
+        if (blockSize < needed)
+            blockSize = needed;
+
+        if (m_limit > 0)
+        {
+            if (m_reservedBytes >= m_limit || needed > m_limit - m_reservedBytes)
+                return 0;
+
+            if (blockSize > m_limit - m_reservedBytes)
+                blockSize = m_limit - m_reservedBytes;
+        }
+
+        Block block;
+
+        block.pData = new (std::nothrow) char[blockSize];
+        block.size = blockSize;
+
+        if (!block.pData)
+            return 0;
+
+        m_blocks.push_back(block);
+        m_reservedBytes += blockSize;
+        m_currentBlock = static_cast<int>(m_blocks.size()) - 1;
+        m_offset = 0;
+    }
+}
+
+void LinearAllocator::deallocate(void *p, size_t size)
+{
+    // Only the most recent allocation gives its memory back. Every other
+    // allocation is reclaimed by reset().
+
+    if (!p)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    if (m_currentBlock < static_cast<int>(m_blocks.size()))
+    {
+        const Block &block = m_blocks[m_currentBlock];
+        char *pBytes = static_cast<char *>(p);
+        size_t length = (size > 0) ? size : 1;
+
+        if (pBytes >= block.pData && pBytes + length == block.pData + m_offset)
+        {
+            m_offset = pBytes - block.pData;
+            m_usedBytes -= (size < m_usedBytes) ? size : m_usedBytes;
+        }
+    }
+}
+
+void LinearAllocator::release()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    for (int i = 0; i < static_cast<int>(m_blocks.size()); ++i)
+        delete[] m_blocks[i].pData;
+
+    m_blocks.clear();
+    m_reservedBytes = 0;
+    m_usedBytes = 0;
+    m_peakBytes = 0;
+    m_totalBytes = 0;
+    m_offset = 0;
+    m_currentBlock = 0;
+}
+
+void LinearAllocator::reset()
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+
+    m_usedBytes = 0;
+    m_peakBytes = 0;
+    m_totalBytes = 0;
+    m_offset = 0;
+    m_currentBlock = 0;
+}
+
+size_t LinearAllocator::getLimit() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_limit;
+}
+
+int LinearAllocator::getNumberOfBlocks() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return static_cast<int>(m_blocks.size());
+}
+
+size_t LinearAllocator::getPeakBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_peakBytes;
+}
+
+size_t LinearAllocator::getReservedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_reservedBytes;
+}
+
+size_t LinearAllocator::getTotalBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_totalBytes;
+}
+
+size_t LinearAllocator::getUsedBytes() const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    return m_usedBytes;
+}
+
+void LinearAllocator::setLimit(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_limit = bytes;
+}
@@ -0,0 +1,198 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(LINEAR_ALLOCATOR_H)
+#define LINEAR_ALLOCATOR_H
+
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <new>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Linear (arena) allocator for short lived allocations.
+//
+// Memory is handed out from a few large blocks by bumping an offset. Freeing
+// an individual allocation only gives its memory back if it was the most
+// recent one. Everything else is reclaimed at once by reset(), which takes
+// constant time and keeps the blocks around for the next round of
+// allocations. release() returns the blocks to the system.
+//
+// Each new block is at least as large as all the existing blocks together,
+// so even large workloads end up in a handful of blocks. setLimit() caps the
+// number of bytes held in blocks. Allocations that would go over the limit
+// fail: allocate() returns null and LinearAllocatorAdapter throws
+// std::bad_alloc.
+//
+// The allocator keeps these statistics, all of which reset() clears:
+//  getUsedBytes()  - bytes currently allocated. Freed allocations that
+//                    weren't the most recent one still count, since their
+//                    memory can't be used again until reset().
+//  getPeakBytes()  - the most bytes allocated at any one time.
+//  getTotalBytes() - bytes allocated in total, including freed allocations.
+// getReservedBytes() is the size of all the blocks, which is what setLimit()
+// caps. It's more than getPeakBytes() by the alignment padding and the unused
+// ends of blocks, and release() clears it instead of reset().
+//
+// allocate() and deallocate() may be called from several threads at once.
+// reset() and release() must not run while other threads are allocating.
+//
+// LinearAllocatorAdapter lets the standard containers allocate from a
+// LinearAllocator. A default constructed adapter uses operator new.
+//-----------------------------------------------------------------------------
+
+class LinearAllocator
+{
+public:
+    static const size_t DEFAULT_BLOCK_SIZE = 1024 * 1024;
+
+    explicit LinearAllocator(size_t blockSize = DEFAULT_BLOCK_SIZE);
+    ~LinearAllocator();
+
+    void *allocate(size_t size, size_t alignment = 16);
+    void deallocate(void *p, size_t size);
+    void release();
+    void reset();
+
+    // Getter methods.
+
+    size_t getBlockSize() const;
+    size_t getLimit() const;
+    int getNumberOfBlocks() const;
+    size_t getPeakBytes() const;
+    size_t getReservedBytes() const;
+    size_t getTotalBytes() const;
+    size_t getUsedBytes() const;
+
+    // Setter methods.
+
+    void setLimit(size_t bytes);
+
+private:
+    struct Block
+    {
+        char *pData;
+        size_t size;
+    };
+
+    LinearAllocator(const LinearAllocator &);
+    LinearAllocator &operator=(const LinearAllocator &);
+
+    size_t m_blockSize;
+    size_t m_limit;
+    size_t m_reservedBytes;
+    size_t m_usedBytes;
+    size_t m_peakBytes;
+    size_t m_totalBytes;
+    size_t m_offset;
+    int m_currentBlock;
+    std::vector<Block> m_blocks;
+    mutable std::mutex m_lock;
+};
+
+//-----------------------------------------------------------------------------
+
+template <typename T>
+class LinearAllocatorAdapter
+{
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind
+    {
+        typedef LinearAllocatorAdapter<U> other;
+    };
+
+    LinearAllocatorAdapter() : m_pAllocator(0) {}
+    explicit LinearAllocatorAdapter(LinearAllocator *pAllocator) : m_pAllocator(pAllocator) {}
+
+    template <typename U>
+    LinearAllocatorAdapter(const LinearAllocatorAdapter<U> &other) : m_pAllocator(other.getAllocator()) {}
+
+    pointer address(reference x) const
+    { return &x; }
+
+    const_pointer address(const_reference x) const
+    { return &x; }
+
+    pointer allocate(size_type n, const void * = 0)
+    {
+        if (n > max_size())
+            throw std::bad_alloc();
+
+        if (!m_pAllocator)
+            return static_cast<pointer>(::operator new(n * sizeof(T)));
+
+        void *p = m_pAllocator->allocate(n * sizeof(T));
+
+        if (!p)
+            throw std::bad_alloc();
+
+        return static_cast<pointer>(p);
+    }
+
+    void deallocate(pointer p, size_type n)
+    {
+        if (!m_pAllocator)
+            ::operator delete(p);
+        else
+            m_pAllocator->deallocate(p, n * sizeof(T));
+    }
+
+    size_type max_size() const
+    { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+    void construct(pointer p, const T &value)
+    { new (static_cast<void *>(p)) T(value); }
+
+    void destroy(pointer p)
+    { p->~T(); }
+
+    LinearAllocator *getAllocator() const
+    { return m_pAllocator; }
+
+private:
+    LinearAllocator *m_pAllocator;
+};
+
+template <typename T, typename U>
+inline bool operator==(const LinearAllocatorAdapter<T> &lhs, const LinearAllocatorAdapter<U> &rhs)
+{ return lhs.getAllocator() == rhs.getAllocator(); }
+
+template <typename T, typename U>
+inline bool operator!=(const LinearAllocatorAdapter<T> &lhs, const LinearAllocatorAdapter<U> &rhs)
+{ return lhs.getAllocator() != rhs.getAllocator(); }
+
+//-----------------------------------------------------------------------------
+
+inline size_t LinearAllocator::getBlockSize() const
+{ return m_blockSize; }
+
+#endif
@@ -72,14 +72,20 @@
 #endif
 
 #include <windows.h>
+#include <objbase.h>
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <cassert>
+#include <cstring>
+#include <deque>
 #include <iomanip>
 #include <map>
+#include <memory>
+#include <set>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 #if defined(_DEBUG)
 #include <crtdbg.h>
@@ -87,14 +93,22 @@
 
 #include "GL_ARB_multitexture.h"
 #include "WGL_ARB_multisample.h"
+#include "async_loader.h"
 #include "bitmap.h"
 #include "camera.h"
+#include "file_system.h"
+#include "file_watcher.h"
 #include "gl_font.h"
 #include "input.h"
+#include "material_table.h"
 #include "mathlib.h"
+#include "mesh_bvh.h"
+#include "model_cache.h"
 #include "model_obj.h"
 #include <string>
 #include "Plane.h"
+#include "static_batch.h"
+#include "vertex_quantizer.h"
 
 //-----------------------------------------------------------------------------
 // Constants.
@@ -111,6 +125,51 @@ const float     FLOOR_HEIGHT = 8.0f;
 const float     FLOOR_TILE_S = 8.0f;
 const float     FLOOR_TILE_T = 8.0f;
 
+// Fractions of a model's triangles kept by each level of detail, and the
+// largest on screen error in pixels that a level of detail may have.
+const float     MODEL_LOD_RATIOS[] = {0.5f, 0.25f, 0.125f};
+const int       MODEL_LOD_COUNT = sizeof(MODEL_LOD_RATIOS) / sizeof(MODEL_LOD_RATIOS[0]);
+const float     MODEL_LOD_PIXEL_ERROR = 1.0f;
+
+// Largest differences between vertices that are welded together after a model
+// is imported. The position tolerance is a fraction of the model's size.
+const float     MODEL_WELD_POSITION_TOLERANCE = 0.00001f;
+const float     MODEL_WELD_TEXCOORD_TOLERANCE = 0.00001f;
+const float     MODEL_WELD_NORMAL_TOLERANCE = 0.001f;
+
+// Imported models are drawn from 16 byte quantized vertices unless that would
+// move an attribute further than these bounds. The position bound is a
+// fraction of the model's size, the texture coordinate bound is in texture
+// units, and the normal bound is in radians.
+const bool      MODEL_QUANTIZE_VERTICES = true;
+const float     MODEL_QUANTIZE_POSITION_ERROR = 0.0001f;
+const float     MODEL_QUANTIZE_TEXCOORD_ERROR = 0.001f;
+const float     MODEL_QUANTIZE_NORMAL_ERROR = 0.01f;
+
+// Most temporary memory a single model import may use. Several models can be
+// imported at once on the loader's worker threads.
+const size_t    MODEL_IMPORT_MEMORY_LIMIT = 512 * 1024 * 1024;
+
+// Bytes of texture data uploaded to OpenGL per frame while loading. At least
+// one texture is uploaded every frame no matter how big it is.
+const size_t    LOAD_UPLOAD_BUDGET_BYTES = 4 * 1024 * 1024;
+
+// Directories watched for saved models, materials, and textures, and how long
+// a saved file must stay untouched before it's reloaded.
+const char      *const HOT_RELOAD_DIRECTORIES[] = {"Content/Models", "Content/Textures"};
+const int       HOT_RELOAD_DIRECTORY_COUNT = sizeof(HOT_RELOAD_DIRECTORIES) / sizeof(HOT_RELOAD_DIRECTORIES[0]);
+const float     HOT_RELOAD_SETTLE_SECONDS = 0.1f;
+
+const char      CLUSTER_BENCHMARK_MODEL[] = "Content/Models/bigship2.obj";
+const float     CLUSTER_BENCHMARK_ELEVATIONS[] = {-60.0f, -30.0f, 0.0f, 30.0f, 60.0f};
+const int       CLUSTER_BENCHMARK_ELEVATION_COUNT = sizeof(CLUSTER_BENCHMARK_ELEVATIONS) / sizeof(CLUSTER_BENCHMARK_ELEVATIONS[0]);
+const int       CLUSTER_BENCHMARK_DISTANCE_COUNT = 3;
+const int       CLUSTER_BENCHMARK_STEPS = 360;
+
+const int       STATIC_BATCH_BENCHMARK_PROPS = 10000;
+const int       STATIC_BATCH_BENCHMARK_MAX_VERTICES = 4 * 1024 * 1024;
+const float     STATIC_BATCH_BENCHMARK_SPACING = 3.0f;
+
 const float     CAMERA_FOVX = 90.0f;
 const float     CAMERA_ZFAR = 100.0f;
 const float     CAMERA_ZNEAR = 0.1f;
@@ -122,7 +181,47 @@ const float     CAMERA_SPEED_ORBIT_ROLL = 100.0f;
 
 const Vector3   CAMERA_ACCELERATION(4.0f, 4.0f, 4.0f);
 const Vector3   CAMERA_VELOCITY(1.0f, 1.0f, 1.0f);
+
+const float     MODEL_TINT_WHITE[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+const float     MODEL_TINT_PLAYER[4] = {0.8f, 0.9f, 1.0f, 1.0f};
 float a = 0.0f , b = 0.0f;
+//-----------------------------------------------------------------------------
+// Types.
+//-----------------------------------------------------------------------------
+
+// Integer handles for the render state of one of a model's materials. They're
+// resolved once when the model is loaded so drawing never looks up names.
+// material is the handle of the material's lighting parameters and texture
+// the handle of its color map (-1 for none) in g_materialTable. Both are
+// shared by every model, and texture also indexes g_textures.
+struct MaterialState
+{
+    int material;
+    int texture;
+};
+
+// A placed copy of a model. The geometry is shared through the model cache
+// and is never changed. Everything that differs between copies lives here.
+// The model is null until the loader threads have finished loading it, and
+// is replaced by a new model when its files are saved.
+struct ModelInstance
+{
+    std::string filename;
+    ModelCache::Handle model;
+    std::future<ModelCache::Handle> loading;
+    Quaternion orientation;
+    Vector3 position;
+    float tint[4];
+};
+
+// A texture loaded from an image file. hash is the hash of the image that's
+// in the texture so saving the file unchanged doesn't load it again.
+struct TextureFile
+{
+    GLuint *pTexture;
+    unsigned long long hash;
+};
+
 //-----------------------------------------------------------------------------
 // Globals.
 //-----------------------------------------------------------------------------
@@ -144,18 +243,40 @@ bool                g_hasFocus;
 bool                g_enableVerticalSync;
 bool                g_displayHelp;
 Camera              g_camera;
-Quaternion          g_meshOrientation;
-Vector3             g_meshPosition;
-ModelOBJ            g_model1;
-ModelOBJ &g_model = g_model1;
-ModelOBJ            g_model2;
-ModelOBJ &g_model0 = g_model2;
+AsyncLoader         g_loader;
+ModelCache          g_modelCache;
+ModelInstance       g_model;
+ModelInstance       g_model0;
 GLFont              g_font;
 Vector3             g_cameraBoundsMax;
 Vector3             g_cameraBoundsMin;
 
-typedef std::map<std::string, GLuint> ModelTextures;
-ModelTextures       g_modelTextures;
+MaterialTable       g_materialTable;
+std::deque<GLuint>  g_textures;
+
+// Every texture loaded by LoadTextureAsync(), keyed by file name, so saved
+// images can be loaded into the same texture again.
+typedef std::map<std::string, TextureFile> TextureFiles;
+TextureFiles        g_textureFiles;
+FileWatcher         g_fileWatcher;
+
+typedef std::map<const ModelOBJ *, std::vector<MaterialState> > ModelMaterialStates;
+ModelMaterialStates g_modelMaterialStates;
+int                 g_stateChanges;
+int                 g_stateChangesAvoided;
+typedef std::map<std::string, std::string> ModelStatistics;
+ModelStatistics     g_modelStatistics;
+std::string         g_clusterBenchmark;
+std::string         g_staticBatchBenchmark;
+int                 g_clustersDrawn;
+int                 g_clustersTested;
+int                 g_meshesDrawn;
+int                 g_meshesTested;
+
+typedef std::map<const ModelOBJ *, std::shared_ptr<const MeshBVH> > ModelBVHs;
+ModelBVHs           g_modelBVHs;
+int                 g_pickTriangle;
+float               g_pickDistance;
 Vector3 direction;
 Vector3 player2_location;
 Plane player1;
@@ -164,37 +285,51 @@ Plane player1;
 // Functions Prototypes.
 //-----------------------------------------------------------------------------
 
+void    BenchmarkClusterCulling();
+void    BenchmarkStaticBatch();
 void    BindTexture(GLuint texture, int unit, GLuint shader, const char *pszSamplerName);
 void    ChangeCameraBehavior(Camera::CameraBehavior behavior);
 void    Cleanup();
 void    CleanupApp();
+GLuint  CreateTexture(const Bitmap &bitmap);
+GLuint  CreateTexture(const Bitmap &bitmap, GLint magFilter, GLint minFilter, GLint wrapS, GLint wrapT);
 HWND    CreateAppWindow(const WNDCLASSEX &wcl, const char *pszTitle);
+void    DrawModelTriangles(const ModelOBJ &model, int startIndex, int triangleCount);
 void    EnableVerticalSync(bool enableVerticalSync);
 bool    ExtensionSupported(const char *pszExtensionName);
+void    ExtractFrustumPlanes(const Matrix4 &viewProjection, float planes[6][4]);
 float   GetElapsedTimeInSeconds();
 void    GetMovementDirection(Vector3 &direction);
+bool    HasFileChanged(const std::set<std::string> &changedFiles, const std::string &filename);
 bool    Init();
 void    InitApp();
 void    InitCamera();
 void    InitFloor();
 void    InitFont();
-void    InitModel(ModelOBJ &g_model, const char *name);
+bool    InitModel(ModelOBJ &g_model, const char *name);
+void    InitModelInstance(ModelInstance &instance, const char *pszFilename, const float tint[4]);
 void    InitGL();
-GLuint  LoadTexture(const char *pszFilename);
-GLuint  LoadTexture(const char *pszFilename, GLint magFilter, GLint minFilter, GLint wrapS, GLint wrapT);
+bool    IsMeshOutsideFrustum(const ModelOBJ::Mesh &mesh, const float planes[6][4]);
+void    LoadTextureAsync(const std::string &filename, GLuint *pTexture);
 void    Log(const char *pszMessage);
 void    PerformCameraCollisionDetection();
+void    PickModel(const ModelOBJ &model, const Matrix4 &eyeToModel);
 void    ProcessUserInput();
 void    ReadTextFile(const char *pszFilename, std::string &buffer);
+void    ReloadModel(ModelInstance &instance);
 void    RenderFloor();
 void    RenderFrame();
-void    RenderModel(ModelOBJ &g_model);
+void    RenderModel(const ModelInstance &instance);
 void    RenderText();
+void    ReplaceModel(ModelInstance &instance, const ModelCache::Handle &pModel);
+int     SelectModelLod(const ModelOBJ &model);
 void    SetProcessorAffinity();
 void    ToggleFullScreen();
 void    UpdateCamera(float elapsedTimeSec);
 void    UpdateFrame(float elapsedTimeSec);
 void    UpdateFrameRate(float elapsedTimeSec);
+void    UpdateHotReload();
+void    UpdateLoads();
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 void	Player2Move(float x, float y, float z);
 
@@ -323,6 +458,176 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
     return DefWindowProc(hWnd, msg, wParam, lParam);
 }
 
+void BenchmarkClusterCulling()
+{
+    // Measures how much of CLUSTER_BENCHMARK_MODEL the cluster tests in
+    // RenderModel() reject while an orbit camera circles it. The camera looks
+    // at the model's center from CLUSTER_BENCHMARK_STEPS positions around
+    // each orbit, one orbit for every combination of elevation and distance
+    // between CAMERA_ZOOM_MIN and CAMERA_ZOOM_MAX. The results are shown with
+    // the model statistics.
+
+    ModelOBJ model;
+    std::string cacheFilename = std::string(CLUSTER_BENCHMARK_MODEL) + ".cache";
+
+    if (!model.loadCache(cacheFilename.c_str(), CLUSTER_BENCHMARK_MODEL) && !model.import(CLUSTER_BENCHMARK_MODEL))
+    {
+        g_clusterBenchmark = std::string("  Failed to load ") + CLUSTER_BENCHMARK_MODEL + "\n";
+        return;
+    }
+
+    if (!model.hasClusters())
+    {
+        model.optimizeVertexCache();
+        model.buildClusters();
+    }
+
+    model.normalize();
+
+    float aspect = static_cast<float>(g_windowWidth) / static_cast<float>(g_windowHeight);
+    int clusterCount = model.getNumberOfClusters();
+    int viewCount = 0;
+    INT64 frustumRejected = 0;
+    INT64 coneRejected = 0;
+    INT64 trianglesTested = 0;
+    INT64 trianglesRejected = 0;
+    INT64 freq = 0;
+    INT64 testTime = 0;
+    INT64 startTime = 0;
+    INT64 endTime = 0;
+    Camera camera;
+
+    QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&freq));
+    camera.perspective(CAMERA_FOVX, aspect, CAMERA_ZNEAR, CAMERA_ZFAR);
+
+    for (int i = 0; i < CLUSTER_BENCHMARK_ELEVATION_COUNT; ++i)
+    {
+        float elevation = Math::degreesToRadians(CLUSTER_BENCHMARK_ELEVATIONS[i]);
+
+        for (int j = 0; j < CLUSTER_BENCHMARK_DISTANCE_COUNT; ++j)
+        {
+            float distance = CAMERA_ZOOM_MIN + (CAMERA_ZOOM_MAX - CAMERA_ZOOM_MIN) *
+                static_cast<float>(j) / static_cast<float>(CLUSTER_BENCHMARK_DISTANCE_COUNT - 1);
+
+            for (int k = 0; k < CLUSTER_BENCHMARK_STEPS; ++k)
+            {
+                float azimuth = Math::TWO_PI * static_cast<float>(k) / static_cast<float>(CLUSTER_BENCHMARK_STEPS);
+                Vector3 eye(distance * cosf(elevation) * sinf(azimuth),
+                            distance * sinf(elevation),
+                            distance * cosf(elevation) * cosf(azimuth));
+                float eyePosition[3] = {eye.x, eye.y, eye.z};
+                float planes[6][4];
+
+                camera.lookAt(eye, Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f));
+
+                QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&startTime));
+
+                ExtractFrustumPlanes(camera.getViewMatrix() * camera.getProjectionMatrix(), planes);
+
+                for (int c = 0; c < clusterCount; ++c)
+                {
+                    const ModelOBJ::Cluster &cluster = model.getCluster(c);
+
+                    trianglesTested += cluster.triangleCount;
+
+                    if (MeshClusterizer::isOutsideFrustum(cluster, planes))
+                    {
+                        ++frustumRejected;
+                        trianglesRejected += cluster.triangleCount;
+                    }
+                    else if (MeshClusterizer::isBackFacing(cluster, eyePosition))
+                    {
+                        ++coneRejected;
+                        trianglesRejected += cluster.triangleCount;
+                    }
+                }
+
+                QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&endTime));
+                testTime += endTime - startTime;
+                ++viewCount;
+            }
+        }
+    }
+
+    float clustersTested = static_cast<float>(clusterCount) * static_cast<float>(viewCount);
+    std::ostringstream output;
+
+    output.setf(std::ios::fixed, std::ios::floatfield);
+    output << std::setprecision(1)
+        << "  Cluster culling: " << CLUSTER_BENCHMARK_MODEL << std::endl
+        << "    " << clusterCount << " clusters, " << viewCount << " orbit views" << std::endl
+        << "    Frustum rejected: " << 100.0f * frustumRejected / clustersTested << "%" << std::endl
+        << "    Cone rejected: " << 100.0f * coneRejected / clustersTested << "%" << std::endl
+        << "    Triangles rejected: " << 100.0f * trianglesRejected / static_cast<float>(trianglesTested) << "%" << std::endl
+        << std::setprecision(2)
+        << "    Test time: " << 1000000.0f * testTime / freq / viewCount << " us per view" << std::endl;
+
+    g_clusterBenchmark = output.str();
+}
+
+void BenchmarkStaticBatch()
+{
+    // Builds a StaticBatch from a grid of copies of the loaded model, each
+    // with its own rotation, and times the build. The number of copies is
+    // STATIC_BATCH_BENCHMARK_PROPS unless that would exceed
+    // STATIC_BATCH_BENCHMARK_MAX_VERTICES. The results are shown with the
+    // model statistics.
+
+    if (!g_model.model)
+    {
+        g_staticBatchBenchmark = "  Static batch: model not loaded yet\n";
+        return;
+    }
+
+    const ModelOBJ &model = *g_model.model;
+    int propCount = STATIC_BATCH_BENCHMARK_PROPS;
+
+    if (model.getNumberOfVertices() > 0 && propCount > STATIC_BATCH_BENCHMARK_MAX_VERTICES / model.getNumberOfVertices())
+        propCount = STATIC_BATCH_BENCHMARK_MAX_VERTICES / model.getNumberOfVertices();
+
+    if (propCount < 1)
+        propCount = 1;
+
+    int columns = static_cast<int>(ceilf(sqrtf(static_cast<float>(propCount))));
+    std::vector<StaticBatch::Item> items(propCount);
+
+    for (int i = 0; i < propCount; ++i)
+    {
+        Matrix4 rotation;
+        Matrix4 translation;
+
+        rotation.rotate(Vector3(0.0f, 1.0f, 0.0f), 360.0f * static_cast<float>(i) / static_cast<float>(propCount));
+        translation.translate(STATIC_BATCH_BENCHMARK_SPACING * static_cast<float>(i % columns), 0.0f,
+            STATIC_BATCH_BENCHMARK_SPACING * static_cast<float>(i / columns));
+
+        items[i].pModel = &model;
+        items[i].transform = rotation * translation;
+    }
+
+    INT64 freq = 0;
+    INT64 startTime = 0;
+    INT64 endTime = 0;
+    StaticBatch batch;
+
+    QueryPerformanceFrequency(reinterpret_cast<LARGE_INTEGER*>(&freq));
+    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&startTime));
+
+    batch.build(&items[0], propCount);
+
+    QueryPerformanceCounter(reinterpret_cast<LARGE_INTEGER*>(&endTime));
+
+    std::ostringstream output;
+
+    output.setf(std::ios::fixed, std::ios::floatfield);
+    output << std::setprecision(2)
+        << "  Static batch: " << propCount << " copies" << std::endl
+        << "    " << batch.getNumberOfVertices() << " vertices, " << batch.getNumberOfTriangles() << " triangles" << std::endl
+        << "    Draw ranges: " << batch.getNumberOfRanges() << " (was " << propCount * model.getNumberOfMeshes() << " meshes)" << std::endl
+        << "    Build time: " << 1000.0f * (endTime - startTime) / freq << " ms" << std::endl;
+
+    g_staticBatchBenchmark = output.str();
+}
+
 void ChangeCameraBehavior(Camera::CameraBehavior behavior)
 {
     if (g_camera.getBehavior() == behavior)
@@ -330,8 +635,8 @@ void ChangeCameraBehavior(Camera::CameraBehavior behavior)
 
     if (behavior == Camera::CAMERA_BEHAVIOR_ORBIT)
     {
-        g_meshPosition = g_camera.getPosition();
-        g_meshOrientation = g_camera.getOrientation().inverse();
+        g_model.position = g_model0.position = g_camera.getPosition();
+        g_model.orientation = g_model0.orientation = g_camera.getOrientation().inverse();
     }
 
     g_camera.setBehavior(behavior);
@@ -360,12 +665,23 @@ void Cleanup()
 
 void CleanupApp()
 {
-    for (std::map<std::string, GLuint>::iterator i = g_modelTextures.begin(); i != g_modelTextures.end(); ++i)
+    // Stop the loader threads first so nothing is handed to the main thread
+    // while everything is being destroyed.
+
+    g_loader.stop();
+    g_fileWatcher.clear();
+
+    for (std::deque<GLuint>::iterator i = g_textures.begin(); i != g_textures.end(); ++i)
     {
-        GLuint texture = i->second;
+        GLuint texture = *i;
         glDeleteTextures(1, &texture);
     }
 
+    g_textures.clear();
+    g_textureFiles.clear();
+    g_materialTable.clear();
+    g_modelMaterialStates.clear();
+
     if (g_floorColorMapTexture)
     {
         glDeleteTextures(1, &g_floorColorMapTexture);
@@ -384,6 +700,10 @@ void CleanupApp()
         g_floorDisplayList = 0;
     }
 
+    g_model.model.reset();
+    g_model0.model.reset();
+    g_modelCache.clear();
+    g_modelBVHs.clear();
     g_font.destroy();
 }
 
@@ -421,6 +741,50 @@ HWND CreateAppWindow(const WNDCLASSEX &wcl, const char *pszTitle)
     return hWnd;
 }
 
+GLuint CreateTexture(const Bitmap &bitmap)
+{
+    return CreateTexture(bitmap, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT);
+}
+
+GLuint CreateTexture(const Bitmap &bitmap, GLint magFilter, GLint minFilter,
+                     GLint wrapS, GLint wrapT)
+{
+    GLuint id = 0;
+
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+
+    if (g_maxAnisotrophy > 1)
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_maxAnisotrophy);
+
+    gluBuild2DMipmaps(GL_TEXTURE_2D, 4, bitmap.width, bitmap.height,
+        GL_BGRA_EXT, GL_UNSIGNED_BYTE, bitmap.getPixels());
+
+    return id;
+}
+
+void DrawModelTriangles(const ModelOBJ &model, int startIndex, int triangleCount)
+{
+    if (triangleCount == 0)
+        return;
+
+    if (model.getIndexSize() == 2)
+    {
+        glDrawElements(GL_TRIANGLES, triangleCount * 3,
+            GL_UNSIGNED_SHORT, model.getShortIndexBuffer() + startIndex);
+    }
+    else
+    {
+        glDrawElements(GL_TRIANGLES, triangleCount * 3,
+            GL_UNSIGNED_INT, model.getIndexBuffer() + startIndex);
+    }
+}
+
 void EnableVerticalSync(bool enableVerticalSync)
 {
     // WGL_EXT_swap_control.
@@ -469,6 +833,30 @@ bool ExtensionSupported(const char *pszExtensionName)
     return true;
 }
 
+void ExtractFrustumPlanes(const Matrix4 &viewProjection, float planes[6][4])
+{
+    // Gribb and Hartmann's method for row vectors. Each plane is a sum or
+    // difference of the w column and the x, y, or z column of the combined
+    // matrix. The planes are normalized and point into the frustum, in the
+    // order left, right, bottom, top, near, far.
+
+    for (int i = 0; i < 6; ++i)
+    {
+        int column = i / 2;
+        float sign = (i % 2 == 0) ? 1.0f : -1.0f;
+
+        for (int j = 0; j < 4; ++j)
+            planes[i][j] = viewProjection[j][3] + sign * viewProjection[j][column];
+
+        float length = sqrtf(planes[i][0] * planes[i][0] +
+                             planes[i][1] * planes[i][1] +
+                             planes[i][2] * planes[i][2]);
+
+        for (int j = 0; j < 4; ++j)
+            planes[i][j] /= length;
+    }
+}
+
 float GetElapsedTimeInSeconds()
 {
     // Returns the elapsed time (in seconds) since the last time this function
@@ -654,6 +1042,22 @@ void GetMovementDirection(Vector3 &direction)
     }*/
 }
 
+bool HasFileChanged(const std::set<std::string> &changedFiles, const std::string &filename)
+{
+    // True if the file watcher has reported the file, or the directory it's
+    // in when changes in the directory were lost.
+
+    std::string path;
+
+    if (!FileSystem::getCanonicalPath(filename.c_str(), path))
+        return false;
+
+    std::string::size_type separator = path.find_last_of("/\\");
+
+    return changedFiles.count(path) != 0 ||
+        (separator != std::string::npos && changedFiles.count(path.substr(0, separator)) != 0);
+}
+
 bool Init()
 {
     try
@@ -685,8 +1089,19 @@ bool Init()
 void InitApp()
 {
 	
-    InitModel(g_model,"Content/Models/bigship1.obj");
-	InitModel(g_model0,"Content/Models/bigship1.obj");
+    // Models and textures are loaded by the loader threads and show up once
+    // they're ready so the window doesn't have to wait for them. Both ships
+    // share one copy of the geometry, its textures, and its BVH. Files saved
+    // while the demo is running are reloaded by UpdateHotReload(). Hot reload
+    // is just left off if the directories can't be watched.
+
+    for (int i = 0; i < HOT_RELOAD_DIRECTORY_COUNT; ++i)
+        g_fileWatcher.watchDirectory(HOT_RELOAD_DIRECTORIES[i]);
+
+    g_loader.start();
+    g_modelCache.setPrepareFunction(InitModel);
+    InitModelInstance(g_model, "Content/Models/bigship1.obj", MODEL_TINT_WHITE);
+    InitModelInstance(g_model0, "Content/Models/bigship1.obj", MODEL_TINT_PLAYER);
     InitFloor();
     InitFont();
     InitCamera();
@@ -698,9 +1113,10 @@ void InitCamera()
         static_cast<float>(g_windowWidth) / static_cast<float>(g_windowHeight),
         CAMERA_ZNEAR, CAMERA_ZFAR);
 
-    float cameraOffset = g_model.getHeight() * 0.5f;
+    // The camera is kept above half the ship's height once the ship has been
+    // loaded (see UpdateLoads()).
 
-    g_camera.setPosition(Vector3(0.0f, cameraOffset, 0.0f));
+    g_camera.setPosition(Vector3(0.0f, 0.0f, 0.0f));
     g_camera.setOrbitMinZoom(CAMERA_ZOOM_MIN);
     g_camera.setOrbitMaxZoom(CAMERA_ZOOM_MAX);
     g_camera.setOrbitOffsetDistance(CAMERA_ZOOM_MIN + (CAMERA_ZOOM_MAX - CAMERA_ZOOM_MIN) * 0.3f);
@@ -714,16 +1130,13 @@ void InitCamera()
     Mouse::instance().setPosition(g_windowWidth / 2, g_windowHeight / 2);
 
     g_cameraBoundsMax.set(FLOOR_WIDTH / 2.0f, 4.0f, FLOOR_HEIGHT / 2.0f);
-    g_cameraBoundsMin.set(-FLOOR_WIDTH / 2.0f, cameraOffset, -FLOOR_HEIGHT / 2.0f);
+    g_cameraBoundsMin.set(-FLOOR_WIDTH / 2.0f, 0.0f, -FLOOR_HEIGHT / 2.0f);
 }
 
 void InitFloor()
 {
-    if (!(g_floorColorMapTexture = LoadTexture("Content/Textures/floor_color_map.tga")))
-        throw std::runtime_error("Failed to load floor color map texture.");
-
-    if (!(g_floorLightMapTexture = LoadTexture("Content/Textures/floor_light_map.tga")))
-        throw std::runtime_error("Failed to load floor light map texture.");
+    LoadTextureAsync("Content/Textures/floor_color_map.tga", &g_floorColorMapTexture);
+    LoadTextureAsync("Content/Textures/floor_light_map.tga", &g_floorLightMapTexture);
 
     g_floorDisplayList = glGenLists(1);
     glNewList(g_floorDisplayList, GL_COMPILE);
@@ -806,67 +1219,296 @@ void InitGL()
         g_maxAnisotrophy = 1;
 }
 
-void InitModel(ModelOBJ &g_model, const char *name)
+bool InitModel(ModelOBJ &g_model, const char *name)
 {
-    if (g_model.import(name))
+    // Called by the model cache on a loader thread the first time a model
+    // file is loaded. Results that the main thread uses are handed over with
+    // an upload so the main thread's data never needs locking.
+
+    // Prefer the precompiled cache that sits next to the OBJ file. It's
+    // rebuilt whenever the OBJ file or one of its MTL files has changed.
+    // Failing to write the cache isn't an error. The model just gets
+    // imported again next time, and the failure is shown with the model's
+    // statistics.
+
+    std::string cacheFilename = std::string(name) + ".cache";
+    bool loaded = g_model.loadCache(cacheFilename.c_str(), name);
+    std::ostringstream statistics;
+
+    g_model.setImportMemoryLimit(MODEL_IMPORT_MEMORY_LIMIT);
+
+    statistics.setf(std::ios::fixed, std::ios::floatfield);
+    statistics << std::setprecision(2) << "  " << name << std::endl;
+
+    if (loaded)
     {
-        g_model.normalize();
+        statistics
+            << "    ACMR: " << g_model.calculateACMR() << " (cached)" << std::endl
+            << "    Bytes fetched per triangle: " << g_model.calculateFetchedBytesPerTriangle() << std::endl;
+    }
+    else if (g_model.import(name))
+    {
+        // Weld vertices that only differ by float noise. The position
+        // tolerance is relative to the size of the model.
 
-        for (int i = 0; i < g_model.getNumberOfMaterials(); ++i)
+        float size = g_model.getWidth();
+
+        if (g_model.getHeight() > size)
+            size = g_model.getHeight();
+
+        if (g_model.getLength() > size)
+            size = g_model.getLength();
+
+        int vertexCount = g_model.getNumberOfVertices();
+        int welded = g_model.weldVertices(MODEL_WELD_POSITION_TOLERANCE * size,
+            MODEL_WELD_TEXCOORD_TOLERANCE, MODEL_WELD_NORMAL_TOLERANCE);
+
+        // Reorder the triangles for the vertex cache and then the vertices
+        // for fetch locality before the cache file is written so that cached
+        // models are already optimized.
+
+        float acmr = g_model.calculateACMR();
+        float fetchedBytes = g_model.calculateFetchedBytesPerTriangle();
+
+        g_model.generateLods(MODEL_LOD_RATIOS, MODEL_LOD_COUNT);
+        g_model.optimizeVertexCache();
+
+        // Clusters for culling in RenderModel(). Building them reorders the
+        // triangles within each mesh so it has to come before the vertices
+        // are reordered.
+
+        g_model.buildClusters();
+
+        // Tangents for normal mapping are generated once here and are then
+        // loaded from the cache. Models without texture coordinates get none.
+        // Vertices split along mirror seams are added at the end of the
+        // vertex buffer, so the vertices are reordered afterwards.
+
+        g_model.generateTangents();
+        g_model.optimizeVertexFetch();
+
+        // Quantizing comes last since the steps above need float vertices.
+        // The quantized vertices are what the cache file stores.
+
+        if (MODEL_QUANTIZE_VERTICES)
         {
-            const ModelOBJ::Material &material = g_model.getMaterial(i);
+            g_model.quantizeVertices(MODEL_QUANTIZE_POSITION_ERROR * size,
+                MODEL_QUANTIZE_TEXCOORD_ERROR, MODEL_QUANTIZE_NORMAL_ERROR);
+        }
 
-            if (material.colorMapFilename.empty())
-                continue;
+        statistics
+            << "    Welded: " << welded << " of " << vertexCount << " vertices" << std::endl
+            << "    ACMR: " << acmr << " -> " << g_model.calculateACMR() << std::endl
+            << "    Bytes fetched per triangle: " << fetchedBytes
+            << " -> " << g_model.calculateFetchedBytesPerTriangle() << std::endl
+            << "    Import memory: " << g_model.getImportPeakBytes() / 1048576.0f << " MB peak, "
+            << g_model.getImportTotalBytes() / 1048576.0f << " MB total" << std::endl;
 
-            std::string filename = "Content/Textures/" + material.colorMapFilename;
-            GLuint textureId = LoadTexture(filename.c_str());
+        if (!g_model.saveCache(cacheFilename.c_str(), name))
+            statistics << "    Failed to save " << cacheFilename << std::endl;
 
-            if (!textureId)
-                throw std::runtime_error("Failed to load texture: \"" + filename + "\"");
-            else
-                g_modelTextures[material.colorMapFilename] = textureId;
+        loaded = true;
+    }
+
+    if (loaded)
+    {
+        statistics
+            << "    Index size: " << g_model.getIndexSize() * 8 << " bits" << std::endl
+            << "    Vertex size: " << g_model.getVertexSize() << " bytes"
+            << (g_model.hasQuantizedVertices() ? " (quantized)" : "") << std::endl
+            << "    Clusters: " << g_model.getNumberOfClusters() << std::endl;
+
+        for (int i = 0; i < g_model.getNumberOfLods(); ++i)
+        {
+            const ModelOBJ::Lod &lod = g_model.getLod(i);
+
+            statistics << "    LOD " << i + 1 << ": " << lod.triangleCount << " triangles, error "
+                       << std::setprecision(4) << lod.error << std::setprecision(2) << std::endl;
         }
     }
-    else
+
+    if (loaded)
     {
-        throw std::runtime_error("Failed to load model.");
+        g_model.normalize();
+
+        // BVH over the full detail model for picking in RenderModel(). It
+        // copies the triangles so it's built after the model is normalized,
+        // from a temporary copy of the indices widened to 32 bits and, if
+        // they're quantized, of the vertices decoded to floats.
+
+        std::shared_ptr<MeshBVH> pBVH(new MeshBVH);
+        std::vector<int> indices(g_model.getNumberOfIndices());
+        std::vector<ModelOBJ::Vertex> vertices;
+        const ModelOBJ::Vertex *pVertices = g_model.getVertexBuffer();
+
+        if (!indices.empty())
+            g_model.getIndices(0, static_cast<int>(indices.size()), &indices[0]);
+
+        if (!pVertices && g_model.getNumberOfVertices() > 0)
+        {
+            vertices.resize(g_model.getNumberOfVertices());
+            g_model.getVertices(0, static_cast<int>(vertices.size()), &vertices[0]);
+            pVertices = &vertices[0];
+        }
+
+        pBVH->build(pVertices ? pVertices->position : 0, static_cast<int>(sizeof(ModelOBJ::Vertex)),
+            indices.empty() ? 0 : &indices[0], static_cast<int>(indices.size()));
+
+        statistics << "    BVH nodes: " << pBVH->getNumberOfNodes() << std::endl;
+
+        // The materials are interned in the upload since g_materialTable is
+        // only used on the main thread. Materials and textures with the same
+        // parameters share a handle across every model so drawing can skip
+        // setting them again.
+
+        std::vector<ModelOBJ::Material> materials;
+
+        for (int i = 0; i < g_model.getNumberOfMaterials(); ++i)
+            materials.push_back(g_model.getMaterial(i));
+
+        const ModelOBJ *pModel = &g_model;
+        std::string filename(name);
+        std::string text = statistics.str();
+
+        g_loader.queueUpload([pModel, pBVH, filename, text, materials]()
+        {
+            g_modelBVHs[pModel] = pBVH;
+            g_modelStatistics[filename] = text;
+
+            // Textures shared with an earlier model are only loaded once.
+            // g_textures holds 0 until a texture has been loaded. It's a
+            // deque so the loader can write to it while it grows.
+
+            std::vector<MaterialState> &states = g_modelMaterialStates[pModel];
+
+            states.resize(materials.size());
+
+            for (size_t i = 0; i < materials.size(); ++i)
+            {
+                states[i].material = g_materialTable.intern(materials[i]);
+                states[i].texture = g_materialTable.internTexture(materials[i].colorMapFilename);
+
+                if (states[i].texture == static_cast<int>(g_textures.size()))
+                {
+                    g_textures.push_back(0);
+                    LoadTextureAsync("Content/Textures/" + materials[i].colorMapFilename,
+                        &g_textures.back());
+                }
+            }
+        }, 0);
     }
+
+    return loaded;
 }
 
-GLuint LoadTexture(const char *pszFilename)
+void InitModelInstance(ModelInstance &instance, const char *pszFilename, const float tint[4])
 {
-    return LoadTexture(pszFilename, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, GL_REPEAT, GL_REPEAT);
+    // Starts loading the instance's model. UpdateLoads() picks it up.
+
+    std::string filename(pszFilename);
+
+    instance.filename = filename;
+    instance.loading = g_loader.submit(std::function<ModelCache::Handle ()>([filename]()
+    {
+        return g_modelCache.load(filename.c_str());
+    }));
+
+    instance.orientation = Quaternion::IDENTITY;
+    instance.position = Vector3(0.0f, 0.0f, 0.0f);
+
+    for (int i = 0; i < 4; ++i)
+        instance.tint[i] = tint[i];
 }
 
-GLuint LoadTexture(const char *pszFilename, GLint magFilter, GLint minFilter,
-                   GLint wrapS, GLint wrapT)
+bool IsMeshOutsideFrustum(const ModelOBJ::Mesh &mesh, const float planes[6][4])
 {
-    GLuint id = 0;
-    Bitmap bitmap;
+    // The same sphere test as MeshClusterizer::isOutsideFrustum() using the
+    // mesh's bounding sphere.
 
-    if (bitmap.loadPicture(pszFilename))
+    for (int i = 0; i < 6; ++i)
     {
-        // The Bitmap class loads images and orients them top-down.
-        // OpenGL expects bitmap images to be oriented bottom-up.
-        bitmap.flipVertical();
+        const float *pPlane = planes[i];
+
+        if (pPlane[0] * mesh.center[0] + pPlane[1] * mesh.center[1] +
+            pPlane[2] * mesh.center[2] + pPlane[3] < -mesh.radius)
+        {
+            return true;
+        }
+    }
 
-        glGenTextures(1, &id);
-        glBindTexture(GL_TEXTURE_2D, id);
+    return false;
+}
 
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, magFilter);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapS);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapT);
+void LoadTextureAsync(const std::string &filename, GLuint *pTexture)
+{
+    // Decodes an image on a loader thread and then creates the texture from
+    // it on the main thread. *pTexture stays 0 until the texture exists. A
+    // missing or broken image is reported on the main thread as well.
+    //
+    // Loading into a texture that already exists reloads it. The old texture
+    // is replaced once the new image is ready, and is kept if the image's
+    // contents haven't changed or it can't be loaded, since it may still be
+    // being written.
 
-        if (g_maxAnisotrophy > 1)
-            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, g_maxAnisotrophy);
+    TextureFiles::iterator file = g_textureFiles.find(filename);
 
-        gluBuild2DMipmaps(GL_TEXTURE_2D, 4, bitmap.width, bitmap.height,
-            GL_BGRA_EXT, GL_UNSIGNED_BYTE, bitmap.getPixels());
+    if (file == g_textureFiles.end())
+    {
+        TextureFile textureFile = {pTexture, 0};
+        file = g_textureFiles.insert(std::make_pair(filename, textureFile)).first;
     }
 
-    return id;
+    bool reloading = *pTexture != 0;
+    unsigned long long previousHash = file->second.hash;
+
+    g_loader.submit(std::function<bool ()>([filename, pTexture, reloading, previousHash]() -> bool
+    {
+        unsigned long long hash = 0;
+        bool hashed = FileSystem::hashFile(filename.c_str(), hash);
+
+        if (reloading && (!hashed || hash == previousHash))
+            return false;
+
+        std::shared_ptr<Bitmap> pBitmap(new Bitmap);
+
+        // IPicture needs COM on the thread that decodes the image.
+
+        HRESULT hr = CoInitializeEx(0, COINIT_MULTITHREADED);
+        bool loaded = pBitmap->loadPicture(filename.c_str());
+
+        if (SUCCEEDED(hr))
+            CoUninitialize();
+
+        if (!loaded && reloading)
+            return false;
+
+        if (!loaded)
+        {
+            g_loader.queueUpload([filename]()
+            {
+                throw std::runtime_error("Failed to load texture: \"" + filename + "\"");
+            }, 0);
+
+            return false;
+        }
+
+        // The Bitmap class loads images and orients them top-down.
+        // OpenGL expects bitmap images to be oriented bottom-up.
+        pBitmap->flipVertical();
+
+        g_loader.queueUpload([pBitmap, pTexture, filename, hash]()
+        {
+            GLuint previousTexture = *pTexture;
+
+            *pTexture = CreateTexture(*pBitmap);
+            g_textureFiles[filename].hash = hash;
+
+            if (previousTexture)
+                glDeleteTextures(1, &previousTexture);
+        }, static_cast<size_t>(pBitmap->pitch) * pBitmap->height);
+
+        return true;
+    }));
 }
 
 void Log(const char *pszMessage)
@@ -917,6 +1559,32 @@ void PerformCameraCollisionDetection()
     }
 }
 
+void PickModel(const ModelOBJ &model, const Matrix4 &eyeToModel)
+{
+    // Casts a ray from the eye along the view direction through the model's
+    // BVH and keeps the hit if it's the nearest one so far this frame. The
+    // ray is cast in model space, and the models are only rotated and moved,
+    // so the distances of the different models can be compared.
+
+    ModelBVHs::const_iterator i = g_modelBVHs.find(&model);
+
+    if (i == g_modelBVHs.end() || i->second->isEmpty())
+        return;
+
+    float origin[3] = {eyeToModel[3][0], eyeToModel[3][1], eyeToModel[3][2]};
+    float direction[3] = {-eyeToModel[2][0], -eyeToModel[2][1], -eyeToModel[2][2]};
+    MeshBVH::Hit hit;
+
+    if (i->second->intersectRay(origin, direction, CAMERA_ZFAR, hit))
+    {
+        if (g_pickTriangle < 0 || hit.distance < g_pickDistance)
+        {
+            g_pickTriangle = hit.triangle;
+            g_pickDistance = hit.distance;
+        }
+    }
+}
+
 void ProcessUserInput()
 {
     Keyboard &keyboard = Keyboard::instance();
@@ -969,6 +1637,12 @@ void ProcessUserInput()
     if (keyboard.keyPressed(Keyboard::KEY_4))
         ChangeCameraBehavior(Camera::CAMERA_BEHAVIOR_ORBIT);
 
+    if (keyboard.keyPressed(Keyboard::KEY_B))
+        BenchmarkStaticBatch();
+
+    if (keyboard.keyPressed(Keyboard::KEY_C))
+        BenchmarkClusterCulling();
+
     if (keyboard.keyPressed(Keyboard::KEY_H))
         g_displayHelp = !g_displayHelp;
 
@@ -1011,6 +1685,34 @@ void ProcessUserInput()
         EnableVerticalSync(!g_enableVerticalSync);
 }
 
+void ReloadModel(ModelInstance &instance)
+{
+    // Loads the instance's model again on a loader thread. The model cache
+    // only prepares it again if its OBJ or MTL files really have changed.
+    // The new model replaces the old one in an upload that's queued after
+    // the one from InitModel(), so its BVH and material states are there
+    // before it's drawn. A model that fails to load, maybe because its files
+    // are still being written, leaves the old model in place.
+
+    std::string filename(instance.filename);
+    ModelInstance *pInstance = &instance;
+
+    g_loader.submit(std::function<bool ()>([filename, pInstance]() -> bool
+    {
+        ModelCache::Handle pModel = g_modelCache.reload(filename.c_str());
+
+        if (!pModel)
+            return false;
+
+        g_loader.queueUpload([pInstance, pModel]()
+        {
+            ReplaceModel(*pInstance, pModel);
+        }, 0);
+
+        return true;
+    }));
+}
+
 void RenderFloor()
 {
     glDisable(GL_LIGHTING);
@@ -1041,6 +1743,15 @@ void RenderFrame()
     glViewport(0, 0, g_windowWidth, g_windowHeight);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    g_clustersDrawn = 0;
+    g_clustersTested = 0;
+    g_meshesDrawn = 0;
+    g_meshesTested = 0;
+    g_stateChanges = 0;
+    g_stateChangesAvoided = 0;
+    g_pickTriangle = -1;
+    g_pickDistance = 0.0f;
+
     glMatrixMode(GL_PROJECTION);
     glLoadIdentity();
     glMultMatrixf(&g_camera.getProjectionMatrix()[0][0]);
@@ -1118,72 +1829,262 @@ void RenderFrame()
     RenderText();
 }
 
-void RenderModel(ModelOBJ &g_model)
+void RenderModel(const ModelInstance &instance)
 {
+    if (!instance.model)
+        return;
+
+    const ModelOBJ &model = *instance.model;
+    ModelMaterialStates::const_iterator states = g_modelMaterialStates.find(&model);
+
+    // The material states arrive from the loader just after the model.
+
+    if (states == g_modelMaterialStates.end())
+        return;
+
     glPushMatrix();
-    Matrix4 m = g_meshOrientation.toMatrix4();
+    Matrix4 m = instance.orientation.toMatrix4();
 
-    m[3][0] = g_meshPosition.x;
-    m[3][1] = g_meshPosition.y;
-    m[3][2] = g_meshPosition.z;
+    m[3][0] = instance.position.x;
+    m[3][1] = instance.position.y;
+    m[3][2] = instance.position.z;
 
     glMultMatrixf(&m[0][0]);
 
     GLuint textureId = 0;
+    GLuint currentTextureId = 0;
+    int currentMaterial = -1;
     const ModelOBJ::Mesh *pMesh = 0;
-    const ModelOBJ::Material *pMaterial = 0;
-    const ModelOBJ::Vertex *pVertices = 0;
+    const MaterialTable::Material *pMaterial = 0;
+    const ModelOBJ::Vertex *pVertices = model.getVertexBuffer();
+    const VertexQuantizer *pQuantizer = model.getVertexQuantizer();
+    int lod = SelectModelLod(model);
+    int meshCount = (lod < 0) ? model.getNumberOfMeshes() : model.getLod(lod).meshCount;
+
+    // Meshes whose bounding spheres are outside the view frustum are
+    // skipped. The full detail model is then drawn cluster by cluster,
+    // skipping clusters that are outside the view frustum or face away from
+    // the eye. All of the tests are done in model space.
+
+    bool textureSet = false;
+    bool cullClusters = (lod < 0) && model.hasClusters();
+    float planes[6][4];
+    float eyePosition[3];
+    Matrix4 modelView;
+    Matrix4 projection;
+
+    glGetFloatv(GL_MODELVIEW_MATRIX, &modelView[0][0]);
+    glGetFloatv(GL_PROJECTION_MATRIX, &projection[0][0]);
+
+    Matrix4 eyeToModel = modelView.inverse();
 
-    for (int i = 0; i < g_model.getNumberOfMeshes(); ++i)
+    PickModel(model, eyeToModel);
+    ExtractFrustumPlanes(modelView * projection, planes);
+
+    if (cullClusters)
     {
-        pMesh = &g_model.getMesh(i);
-        pMaterial = &g_model.getMaterial(pMesh->materialIndex);
-        pVertices = g_model.getVertexBuffer();
+        eyePosition[0] = eyeToModel[3][0];
+        eyePosition[1] = eyeToModel[3][1];
+        eyePosition[2] = eyeToModel[3][2];
+    }
+
+    // All meshes share the vertex buffer so the arrays are only set up once.
+    // The meshes are sorted by texture and then by material, and only the
+    // state that differs from the previous mesh is changed. Skipped changes
+    // are counted against setting everything for every mesh.
 
-        glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, pMaterial->ambient);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, pMaterial->diffuse);
-        glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, pMaterial->specular);
-        glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, pMaterial->shininess * 128.0f);
+    glActiveTextureARB(GL_TEXTURE0_ARB);
+    glEnableClientState(GL_VERTEX_ARRAY);
 
-        if ((textureId = g_modelTextures[pMaterial->colorMapFilename]) != 0)
+    if (pQuantizer)
+    {
+        // Quantized vertices are drawn as they are. GL_SHORT positions and
+        // texture coordinates aren't normalized, so the modelview and texture
+        // matrices map [-32767, 32767] onto their bounding boxes. The culling
+        // tests above used the model space matrices. The position scale is
+        // the same on every axis, so GL_NORMALIZE is all the GL_BYTE normals
+        // need.
+
+        const unsigned char *pQuantized = static_cast<const unsigned char *>(pQuantizer->getVertexBuffer());
+        const float *pCenter = pQuantizer->getPositionCenter();
+        const float *pExtent = pQuantizer->getPositionExtent();
+        int stride = pQuantizer->getVertexSize();
+
+        glTranslatef(pCenter[0], pCenter[1], pCenter[2]);
+        glScalef(pExtent[0] / 32767.0f, pExtent[1] / 32767.0f, pExtent[2] / 32767.0f);
+        glVertexPointer(3, GL_SHORT, stride, pQuantized);
+
+        if (model.hasTextureCoords())
         {
-            glEnable(GL_TEXTURE_2D);
-            glBindTexture(GL_TEXTURE_2D, textureId);
+            const float *pMin = pQuantizer->getTexCoordMin();
+            const float *pRange = pQuantizer->getTexCoordRange();
+
+            glMatrixMode(GL_TEXTURE);
+            glPushMatrix();
+            glLoadIdentity();
+            glTranslatef(pMin[0] + pRange[0] * 0.5f, pMin[1] + pRange[1] * 0.5f, 0.0f);
+            glScalef(pRange[0] / 65534.0f, pRange[1] / 65534.0f, 1.0f);
+            glMatrixMode(GL_MODELVIEW);
+
+            glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+            glTexCoordPointer(2, GL_SHORT, stride, pQuantized + pQuantizer->getTexCoordOffset());
         }
-        else
+
+        if (model.hasVertexNormals())
         {
-            glDisable(GL_TEXTURE_2D);
+            glEnable(GL_NORMALIZE);
+            glEnableClientState(GL_NORMAL_ARRAY);
+            glNormalPointer(GL_BYTE, stride, pQuantized + pQuantizer->getNormalOffset());
         }
+    }
+    else
+    {
+        glVertexPointer(3, GL_FLOAT, model.getVertexSize(), pVertices->position);
 
-        glEnableClientState(GL_VERTEX_ARRAY);
-        glVertexPointer(3, GL_FLOAT, g_model.getVertexSize(), pVertices->position);
-
-        if (g_model.hasTextureCoords())
+        if (model.hasTextureCoords())
         {
-            glActiveTextureARB(GL_TEXTURE0_ARB);
-            glEnable(GL_TEXTURE_2D);
             glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-            glTexCoordPointer(2, GL_FLOAT, g_model.getVertexSize(), pVertices->texCoord);
+            glTexCoordPointer(2, GL_FLOAT, model.getVertexSize(), pVertices->texCoord);
         }
 
-        if (g_model.hasVertexNormals())
+        if (model.hasVertexNormals())
         {
             glEnableClientState(GL_NORMAL_ARRAY);
-            glNormalPointer(GL_FLOAT, g_model.getVertexSize(), pVertices->normal);
+            glNormalPointer(GL_FLOAT, model.getVertexSize(), pVertices->normal);
+        }
+    }
+
+    if (meshCount > 0)
+    {
+        ++g_stateChanges;
+        g_stateChangesAvoided += meshCount - 1;
+    }
+
+    for (int i = 0; i < meshCount; ++i)
+    {
+        pMesh = (lod < 0) ? &model.getMesh(i) : &model.getLodMesh(model.getLod(lod).firstMesh + i);
+        ++g_meshesTested;
+
+        if (IsMeshOutsideFrustum(*pMesh, planes))
+            continue;
+
+        ++g_meshesDrawn;
+
+        const MaterialState &state = states->second[pMesh->materialIndex];
+
+        if (state.material != currentMaterial)
+        {
+            // The instance's tint is applied on top of the shared material.
+
+            float ambient[4];
+            float diffuse[4];
+
+            pMaterial = &g_materialTable.getMaterial(state.material);
+
+            for (int j = 0; j < 4; ++j)
+            {
+                ambient[j] = pMaterial->ambient[j] * instance.tint[j];
+                diffuse[j] = pMaterial->diffuse[j] * instance.tint[j];
+            }
+
+            glMaterialfv(GL_FRONT_AND_BACK, GL_AMBIENT, ambient);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_DIFFUSE, diffuse);
+            glMaterialfv(GL_FRONT_AND_BACK, GL_SPECULAR, pMaterial->specular);
+            glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, pMaterial->shininess * 128.0f);
+
+            currentMaterial = state.material;
+            ++g_stateChanges;
+        }
+        else
+        {
+            ++g_stateChangesAvoided;
         }
 
-        glDrawElements(GL_TRIANGLES, pMesh->triangleCount * 3,
-            GL_UNSIGNED_INT, g_model.getIndexBuffer() + pMesh->startIndex);
+        textureId = (state.texture >= 0) ? g_textures[state.texture] : 0;
 
-        if (g_model.hasVertexNormals())
-            glDisableClientState(GL_NORMAL_ARRAY);
+        if (!textureSet || textureId != currentTextureId)
+        {
+            if (textureId != 0)
+            {
+                glEnable(GL_TEXTURE_2D);
+                glBindTexture(GL_TEXTURE_2D, textureId);
+            }
+            else
+            {
+                glDisable(GL_TEXTURE_2D);
+            }
 
-        if (g_model.hasTextureCoords())
-            glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+            currentTextureId = textureId;
+            textureSet = true;
+            ++g_stateChanges;
+        }
+        else
+        {
+            ++g_stateChangesAvoided;
+        }
 
-        glDisableClientState(GL_VERTEX_ARRAY);
+        if (cullClusters)
+        {
+            // Visible clusters that follow one another in the index buffer
+            // are drawn together.
+
+            int firstCluster = 0;
+            int clusterCount = 0;
+            int startIndex = 0;
+            int triangleCount = 0;
+
+            model.getMeshClusters(i, firstCluster, clusterCount);
+            g_clustersTested += clusterCount;
+
+            for (int j = firstCluster; j < firstCluster + clusterCount; ++j)
+            {
+                const ModelOBJ::Cluster &cluster = model.getCluster(j);
+
+                if (MeshClusterizer::isOutsideFrustum(cluster, planes) ||
+                    MeshClusterizer::isBackFacing(cluster, eyePosition))
+                {
+                    continue;
+                }
+
+                ++g_clustersDrawn;
+
+                if (startIndex + triangleCount * 3 == cluster.startIndex)
+                {
+                    triangleCount += cluster.triangleCount;
+                }
+                else
+                {
+                    DrawModelTriangles(model, startIndex, triangleCount);
+                    startIndex = cluster.startIndex;
+                    triangleCount = cluster.triangleCount;
+                }
+            }
+
+            DrawModelTriangles(model, startIndex, triangleCount);
+        }
+        else
+        {
+            DrawModelTriangles(model, pMesh->startIndex, pMesh->triangleCount);
+        }
+    }
+
+    if (model.hasVertexNormals())
+        glDisableClientState(GL_NORMAL_ARRAY);
+
+    if (model.hasTextureCoords())
+        glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+
+    if (pQuantizer && model.hasVertexNormals())
+        glDisable(GL_NORMALIZE);
+
+    if (pQuantizer && model.hasTextureCoords())
+    {
+        glMatrixMode(GL_TEXTURE);
+        glPopMatrix();
+        glMatrixMode(GL_MODELVIEW);
     }
 
+    glDisableClientState(GL_VERTEX_ARRAY);
     glPopMatrix();
 }
 
@@ -1217,6 +2118,8 @@ void RenderText()
             << "  Move mouse to orbit the model" << std::endl
             << "  Mouse wheel to zoom in and out" << std::endl
             << std::endl
+            << "Press B to benchmark static batching of the loaded model" << std::endl
+            << "Press C to benchmark cluster culling around bigship2" << std::endl
             << "Press M to enable/disable mouse smoothing" << std::endl
             << "Press V to enable/disable vertical sync" << std::endl
             << "Press + and - to change camera rotation speed" << std::endl
@@ -1232,6 +2135,11 @@ void RenderText()
         const char *pszCurrentBehavior = 0;
         const char *pszOrbitStyle = 0;
         const Mouse &mouse = Mouse::instance();
+        std::ostringstream pick;
+        std::string modelStatistics;
+
+        for (ModelStatistics::const_iterator i = g_modelStatistics.begin(); i != g_modelStatistics.end(); ++i)
+            modelStatistics += i->second;
 
         switch (g_camera.getBehavior())
         {
@@ -1261,6 +2169,11 @@ void RenderText()
         else
             pszOrbitStyle = "Free";
 
+        if (g_pickTriangle < 0)
+            pick << "none";
+        else
+            pick << "triangle " << g_pickTriangle << " at " << std::fixed << std::setprecision(2) << g_pickDistance;
+
         output.setf(std::ios::fixed, std::ios::floatfield);
         output << std::setprecision(2);
 
@@ -1291,6 +2204,21 @@ void RenderText()
             << "  Rotation speed: " << g_camera.getRotationSpeed() << std::endl
             << "  Orbit style: " << pszOrbitStyle << std::endl
             << std::endl
+            << "Models" << std::endl
+            << "  Cache: " << g_modelCache.getNumberOfModels() << " models, "
+            << g_modelCache.getNumberOfLoads() << " loads, " << g_modelCache.getNumberOfHits() << " hits" << std::endl
+            << "  Loading: " << g_loader.getNumberOfPendingJobs() << " jobs, "
+            << g_loader.getNumberOfPendingUploads() << " uploads on " << g_loader.getNumberOfThreads() << " threads" << std::endl
+            << modelStatistics
+            << "  Materials: " << g_materialTable.getNumberOfMaterials() << " unique, "
+            << g_materialTable.getNumberOfTextures() << " textures" << std::endl
+            << "  Meshes drawn: " << g_meshesDrawn << " of " << g_meshesTested << std::endl
+            << "  Clusters drawn: " << g_clustersDrawn << " of " << g_clustersTested << std::endl
+            << "  State changes: " << g_stateChanges << " (" << g_stateChangesAvoided << " avoided)" << std::endl
+            << "  Picked: " << pick.str() << std::endl
+            << g_clusterBenchmark
+            << g_staticBatchBenchmark
+            << std::endl
             << "Mouse" << std::endl
             << "  Smoothing: " << (mouse.isMouseSmoothing() ? "enabled" : "disabled") << std::endl
             << "  Sensitivity: " << mouse.weightModifier() << std::endl
@@ -1304,6 +2232,67 @@ void RenderText()
     g_font.end();
 }
 
+void ReplaceModel(ModelInstance &instance, const ModelCache::Handle &pModel)
+{
+    // Swaps a reloaded model into an instance at the start of a frame. The
+    // old model's BVH and material states are released once no instance uses
+    // the old model anymore.
+
+    ModelCache::Handle pOldModel = instance.model;
+
+    if (pModel == pOldModel)
+        return;
+
+    instance.model = pModel;
+
+    if (&instance == &g_model)
+        g_cameraBoundsMin.y = pModel->getHeight() * 0.5f;
+
+    if (pOldModel && g_model.model != pOldModel && g_model0.model != pOldModel)
+    {
+        g_modelBVHs.erase(pOldModel.get());
+        g_modelMaterialStates.erase(pOldModel.get());
+    }
+}
+
+int SelectModelLod(const ModelOBJ &model)
+{
+    // Returns the coarsest level of detail whose error covers no more than
+    // MODEL_LOD_PIXEL_ERROR pixels at the model's current distance from the
+    // eye, or -1 for the full detail model. The model has been normalized so
+    // it fits in a unit sphere around the origin of the current modelview
+    // matrix.
+
+    if (model.getNumberOfLods() == 0)
+        return -1;
+
+    GLfloat modelView[16];
+    GLfloat projection[16];
+
+    glGetFloatv(GL_MODELVIEW_MATRIX, modelView);
+    glGetFloatv(GL_PROJECTION_MATRIX, projection);
+
+    float distance = sqrtf(modelView[12] * modelView[12] +
+                           modelView[13] * modelView[13] +
+                           modelView[14] * modelView[14]) - 1.0f;
+
+    if (distance < CAMERA_ZNEAR)
+        distance = CAMERA_ZNEAR;
+
+    float pixelsPerUnit = projection[5] * static_cast<float>(g_windowHeight) * 0.5f / distance;
+    int lod = -1;
+
+    for (int i = 0; i < model.getNumberOfLods(); ++i)
+    {
+        if (model.getLod(i).error * pixelsPerUnit > MODEL_LOD_PIXEL_ERROR)
+            break;
+
+        lod = i;
+    }
+
+    return lod;
+}
+
 void SetProcessorAffinity()
 {
     // Assign the current thread to one processor. This ensures that timing
@@ -1455,6 +2444,8 @@ void UpdateCamera(float elapsedTimeSec)
 void UpdateFrame(float elapsedTimeSec)
 {
     UpdateFrameRate(elapsedTimeSec);
+    UpdateLoads();
+    UpdateHotReload();
 
     Mouse::instance().update();
     Keyboard::instance().update();
@@ -1481,4 +2472,80 @@ void UpdateFrameRate(float elapsedTimeSec)
     {
         ++frames;
     }
+}
+
+void UpdateHotReload()
+{
+    // Reloads the models and textures whose files have been saved. The files
+    // are loaded on the loader threads and the results are swapped in by
+    // uploads at the start of a frame, so a frame never draws a mix of old
+    // and new data. Files whose contents haven't changed are skipped.
+    // Instances that haven't finished loading yet are left alone.
+
+    std::vector<std::string> changedFiles;
+
+    if (g_fileWatcher.poll(changedFiles, HOT_RELOAD_SETTLE_SECONDS) == 0)
+        return;
+
+    std::set<std::string> changed(changedFiles.begin(), changedFiles.end());
+    ModelInstance *instances[] = {&g_model, &g_model0};
+    const int instanceCount = sizeof(instances) / sizeof(instances[0]);
+
+    for (int i = 0; i < instanceCount; ++i)
+    {
+        ModelInstance &instance = *instances[i];
+
+        if (!instance.model || instance.loading.valid())
+            continue;
+
+        bool modelChanged = HasFileChanged(changed, instance.filename);
+
+        for (int j = 0; !modelChanged && j < instance.model->getNumberOfMaterialLibraries(); ++j)
+            modelChanged = HasFileChanged(changed, instance.model->getMaterialLibrary(j));
+
+        if (modelChanged)
+            ReloadModel(instance);
+    }
+
+    for (TextureFiles::iterator i = g_textureFiles.begin(); i != g_textureFiles.end(); ++i)
+    {
+        if (*i->second.pTexture && HasFileChanged(changed, i->first))
+            LoadTextureAsync(i->first, i->second.pTexture);
+    }
+}
+
+void UpdateLoads()
+{
+    // Runs this frame's share of the uploads queued by the loader threads and
+    // picks up models that have finished loading. A failed load ends the
+    // application just like a failure in Init() would.
+
+    try
+    {
+        g_loader.processUploads(LOAD_UPLOAD_BUDGET_BYTES);
+
+        if (AsyncLoader::isReady(g_model.loading))
+        {
+            if (!(g_model.model = g_model.loading.get()))
+                throw std::runtime_error("Failed to load model.");
+
+            g_cameraBoundsMin.y = g_model.model->getHeight() * 0.5f;
+        }
+
+        if (AsyncLoader::isReady(g_model0.loading))
+        {
+            if (!(g_model0.model = g_model0.loading.get()))
+                throw std::runtime_error("Failed to load model.");
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::ostringstream msg;
+
+        msg << "Loading failed!" << std::endl << std::endl;
+        msg << e.what();
+
+        Log(msg.str().c_str());
+        PostMessage(g_hWnd, WM_CLOSE, 0, 0);
+    }
 }
\ No newline at end of file
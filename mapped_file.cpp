@@ -0,0 +1,173 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#if defined(_WIN32)
+#if !defined(WIN32_LEAN_AND_MEAN)
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+MappedFile::MappedFile()
+{
+    m_isOpen = false;
+    m_copyOnWrite = false;
+    m_pData = 0;
+    m_size = 0;
+}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const char *pszFilename, bool copyOnWrite)
+{
+    close();
+
+    HANDLE hFile = CreateFileA(pszFilename, GENERIC_READ, FILE_SHARE_READ, 0,
+                       OPEN_EXISTING, copyOnWrite ? 0 : FILE_FLAG_SEQUENTIAL_SCAN, 0);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+
+    if (!GetFileSizeEx(hFile, &fileSize) ||
+        static_cast<unsigned long long>(fileSize.QuadPart) > static_cast<size_t>(-1))
+    {
+        CloseHandle(hFile);
+        return false;
+    }
+
+    if (fileSize.QuadPart == 0)
+    {
+        CloseHandle(hFile);
+        m_isOpen = true;
+        return true;
+    }
+
+    HANDLE hMapping = CreateFileMappingA(hFile, 0,
+                          copyOnWrite ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, 0);
+
+    // The view keeps the file mapping alive. Neither handle is needed once the
+    // view has been created.
+
+    void *pView = 0;
+
+    if (hMapping)
+    {
+        pView = MapViewOfFile(hMapping, copyOnWrite ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(hMapping);
+    }
+
+    CloseHandle(hFile);
+
+    if (!pView)
+        return false;
+
+    m_pData = static_cast<char *>(pView);
+    m_size = static_cast<size_t>(fileSize.QuadPart);
+    m_isOpen = true;
+    m_copyOnWrite = copyOnWrite;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_pData)
+        UnmapViewOfFile(m_pData);
+
+    m_isOpen = false;
+    m_copyOnWrite = false;
+    m_pData = 0;
+    m_size = 0;
+}
+
+#else
+
+bool MappedFile::open(const char *pszFilename, bool copyOnWrite)
+{
+    close();
+
+    int fd = ::open(pszFilename, O_RDONLY);
+
+    if (fd == -1)
+        return false;
+
+    struct stat fileInfo;
+
+    if (fstat(fd, &fileInfo) == -1 || !S_ISREG(fileInfo.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+
+    if (fileInfo.st_size == 0)
+    {
+        ::close(fd);
+        m_isOpen = true;
+        return true;
+    }
+
+    size_t size = static_cast<size_t>(fileInfo.st_size);
+    int protection = copyOnWrite ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void *pView = mmap(0, size, protection, MAP_PRIVATE, fd, 0);
+
+    // The mapping holds its own reference to the file.
+    ::close(fd);
+
+    if (pView == MAP_FAILED)
+        return false;
+
+    if (!copyOnWrite)
+        madvise(pView, size, MADV_SEQUENTIAL);
+
+    m_pData = static_cast<char *>(pView);
+    m_size = size;
+    m_isOpen = true;
+    m_copyOnWrite = copyOnWrite;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (m_pData)
+        munmap(m_pData, m_size);
+
+    m_isOpen = false;
+    m_copyOnWrite = false;
+    m_pData = 0;
+    m_size = 0;
+}
+
+#endif
@@ -0,0 +1,76 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#if !defined(MAPPED_FILE_H)
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+//-----------------------------------------------------------------------------
+// Read-only memory mapped file.
+//
+// The entire file is mapped into the process' address space when it's opened.
+// The mapped bytes stay valid until the file is closed or the MappedFile
+// object is destroyed. Zero length files open successfully but have a null
+// data pointer.
+//
+// A file opened with copyOnWrite set can also be written to through
+// getWritableData(). The first write to a page gives the process a private
+// copy of that page. Writes are never seen by the file or by other processes.
+//
+// On Windows the file is mapped using CreateFileMapping() and MapViewOfFile().
+// On all other platforms the POSIX mmap() function is used.
+//-----------------------------------------------------------------------------
+
+class MappedFile
+{
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const char *pszFilename, bool copyOnWrite = false);
+    void close();
+
+    const char *getData() const
+    { return m_pData; }
+
+    char *getWritableData() const
+    { return m_copyOnWrite ? m_pData : 0; }
+
+    size_t getSize() const
+    { return m_size; }
+
+    bool isOpen() const
+    { return m_isOpen; }
+
+private:
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+    bool m_isOpen;
+    bool m_copyOnWrite;
+    char *m_pData;
+    size_t m_size;
+};
+
+#endif
@@ -0,0 +1,133 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <cstring>
+#include "file_system.h"
+#include "material_table.h"
+
+namespace
+{
+    // Open addressing hash tables of handles with linear probing. A table is
+    // never more than half full.
+
+    const int INITIAL_SLOT_COUNT = 16;
+    const int EMPTY_SLOT = -1;
+
+    void PlaceSlot(std::vector<int> &slots, unsigned long long hash, int handle)
+    {
+        size_t mask = slots.size() - 1;
+        size_t slot = static_cast<size_t>(hash) & mask;
+
+        while (slots[slot] != EMPTY_SLOT)
+            slot = (slot + 1) & mask;
+
+        slots[slot] = handle;
+    }
+
+    void InsertSlot(std::vector<int> &slots, const std::vector<unsigned long long> &hashes, int handle)
+    {
+        // The table doubles in size once it would be more than half full and
+        // the earlier handles are placed again.
+
+        if (static_cast<size_t>(handle + 1) * 2 > slots.size())
+        {
+            slots.assign(slots.size() * 2, EMPTY_SLOT);
+
+            for (int i = 0; i < handle; ++i)
+                PlaceSlot(slots, hashes[i], i);
+        }
+
+        PlaceSlot(slots, hashes[handle], handle);
+    }
+}
+
+MaterialTable::MaterialTable()
+{
+    clear();
+}
+
+MaterialTable::~MaterialTable()
+{
+}
+
+void MaterialTable::clear()
+{
+    m_materials.clear();
+    m_materialHashes.clear();
+    m_materialSlots.assign(INITIAL_SLOT_COUNT, EMPTY_SLOT);
+    m_textures.clear();
+    m_textureHashes.clear();
+    m_textureSlots.assign(INITIAL_SLOT_COUNT, EMPTY_SLOT);
+}
+
+int MaterialTable::intern(const ModelOBJ::Material &material)
+{
+    Material entry;
+
+    memcpy(entry.ambient, material.ambient, sizeof(entry.ambient));
+    memcpy(entry.diffuse, material.diffuse, sizeof(entry.diffuse));
+    memcpy(entry.specular, material.specular, sizeof(entry.specular));
+    entry.shininess = material.shininess;
+    entry.alpha = material.alpha;
+
+    unsigned long long hash = FileSystem::hashBytes(&entry, sizeof(entry));
+    size_t mask = m_materialSlots.size() - 1;
+
+    for (size_t slot = static_cast<size_t>(hash) & mask; m_materialSlots[slot] != EMPTY_SLOT; slot = (slot + 1) & mask)
+    {
+        int handle = m_materialSlots[slot];
+
+        if (m_materialHashes[handle] == hash && memcmp(&m_materials[handle], &entry, sizeof(entry)) == 0)
+            return handle;
+    }
+
+    int handle = static_cast<int>(m_materials.size());
+
+    m_materials.push_back(entry);
+    m_materialHashes.push_back(hash);
+    InsertSlot(m_materialSlots, m_materialHashes, handle);
+    return handle;
+}
+
+int MaterialTable::internTexture(const std::string &filename)
+{
+    if (filename.empty())
+        return -1;
+
+    unsigned long long hash = FileSystem::hashBytes(filename.data(), filename.size());
+    size_t mask = m_textureSlots.size() - 1;
+
+    for (size_t slot = static_cast<size_t>(hash) & mask; m_textureSlots[slot] != EMPTY_SLOT; slot = (slot + 1) & mask)
+    {
+        int handle = m_textureSlots[slot];
+
+        if (m_textureHashes[handle] == hash && m_textures[handle] == filename)
+            return handle;
+    }
+
+    int handle = static_cast<int>(m_textures.size());
+
+    m_textures.push_back(filename);
+    m_textureHashes.push_back(hash);
+    InsertSlot(m_textureSlots, m_textureHashes, handle);
+    return handle;
+}
@@ -0,0 +1,100 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MATERIAL_TABLE_H)
+#define MATERIAL_TABLE_H
+
+#include <string>
+#include <vector>
+#include "model_obj.h"
+
+//-----------------------------------------------------------------------------
+// Table of the distinct materials and textures used by any number of models.
+//
+// intern() returns a dense integer handle for a material's lighting
+// parameters: its ambient, diffuse, and specular colors, shininess, and
+// alpha. internTexture() does the same for a color map file name. Equal
+// parameter sets and equal file names always get the same handle no matter
+// which model they came from, so materials are compared by comparing ints
+// and per-material or per-texture data can be kept in a vector indexed by
+// handle. The material's name isn't interned. The color map is interned on
+// its own so materials that only differ in lighting still share a texture.
+//
+// Parameters are compared bit for bit. Handles are numbered from 0 in the
+// order the values were first seen and stay valid until clear(). Both
+// lookups are hash table lookups using FileSystem::hashBytes(). An empty
+// file name means no texture and gets the handle -1.
+//
+// The table isn't thread safe.
+//-----------------------------------------------------------------------------
+
+class MaterialTable
+{
+public:
+    struct Material
+    {
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float shininess;
+        float alpha;
+    };
+
+    MaterialTable();
+    ~MaterialTable();
+
+    void clear();
+    int intern(const ModelOBJ::Material &material);
+    int internTexture(const std::string &filename);
+
+    // Getter methods.
+
+    const Material &getMaterial(int handle) const;
+    const std::string &getTexture(int handle) const;
+
+    int getNumberOfMaterials() const;
+    int getNumberOfTextures() const;
+
+private:
+    std::vector<Material> m_materials;
+    std::vector<unsigned long long> m_materialHashes;
+    std::vector<int> m_materialSlots;
+    std::vector<std::string> m_textures;
+    std::vector<unsigned long long> m_textureHashes;
+    std::vector<int> m_textureSlots;
+};
+
+//-----------------------------------------------------------------------------
+
+inline const MaterialTable::Material &MaterialTable::getMaterial(int handle) const
+{ return m_materials[handle]; }
+
+inline const std::string &MaterialTable::getTexture(int handle) const
+{ return m_textures[handle]; }
+
+inline int MaterialTable::getNumberOfMaterials() const
+{ return static_cast<int>(m_materials.size()); }
+
+inline int MaterialTable::getNumberOfTextures() const
+{ return static_cast<int>(m_textures.size()); }
+
+#endif
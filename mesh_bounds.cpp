@@ -0,0 +1,599 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define PERFORM_SIMD_BOUNDS             1
+#else
+#define PERFORM_SIMD_BOUNDS             0
+#endif
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "mesh_bounds.h"
+
+#if PERFORM_SIMD_BOUNDS
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Position sources for CalculateBounds(). load() reads a single vertex.
+    // load4() reads 4 vertices starting at vertex i and splits them into x,
+    // y, and z vectors. It reads 16 bytes from each strided vertex, so it's
+    // only used when canLoad4() says there's room for that.
+
+    struct StridedPositions
+    {
+        const char *pBytes;
+        int vertexStride;
+
+        const float *get(int i) const
+        { return reinterpret_cast<const float *>(pBytes + static_cast<size_t>(i) * vertexStride); }
+
+        void load(int i, float p[3]) const
+        {
+            const float *pPosition = get(i);
+
+            p[0] = pPosition[0];
+            p[1] = pPosition[1];
+            p[2] = pPosition[2];
+        }
+
+#if PERFORM_SIMD_BOUNDS
+        bool canLoad4() const
+        { return vertexStride >= 16; }
+
+        void load4(int i, __m128 &x, __m128 &y, __m128 &z) const
+        {
+            __m128 r0 = _mm_loadu_ps(get(i));
+            __m128 r1 = _mm_loadu_ps(get(i + 1));
+            __m128 r2 = _mm_loadu_ps(get(i + 2));
+            __m128 r3 = _mm_loadu_ps(get(i + 3));
+
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            x = r0;
+            y = r1;
+            z = r2;
+        }
+#endif
+    };
+
+    struct SplitPositions
+    {
+        const float *pX;
+        const float *pY;
+        const float *pZ;
+
+        void load(int i, float p[3]) const
+        {
+            p[0] = pX[i];
+            p[1] = pY[i];
+            p[2] = pZ[i];
+        }
+
+#if PERFORM_SIMD_BOUNDS
+        bool canLoad4() const
+        { return true; }
+
+        void load4(int i, __m128 &x, __m128 &y, __m128 &z) const
+        {
+            x = _mm_loadu_ps(pX + i);
+            y = _mm_loadu_ps(pY + i);
+            z = _mm_loadu_ps(pZ + i);
+        }
+#endif
+    };
+
+    struct IndexedPositions
+    {
+        const int *pIndices;
+        StridedPositions vertices;
+
+        void load(int i, float p[3]) const
+        { vertices.load(pIndices[i], p); }
+
+#if PERFORM_SIMD_BOUNDS
+        bool canLoad4() const
+        { return vertices.canLoad4(); }
+
+        void load4(int i, __m128 &x, __m128 &y, __m128 &z) const
+        {
+            __m128 r0 = _mm_loadu_ps(vertices.get(pIndices[i]));
+            __m128 r1 = _mm_loadu_ps(vertices.get(pIndices[i + 1]));
+            __m128 r2 = _mm_loadu_ps(vertices.get(pIndices[i + 2]));
+            __m128 r3 = _mm_loadu_ps(vertices.get(pIndices[i + 3]));
+
+            _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+            x = r0;
+            y = r1;
+            z = r2;
+        }
+#endif
+    };
+
+#if PERFORM_SIMD_BOUNDS
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline __m128i Select(__m128i mask, __m128i a, __m128i b)
+    {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+#endif
+
+    inline float DistanceSq(const float p[3], const float center[3])
+    {
+        float d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+        return d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+    }
+
+    inline void PadRadius(MeshBounds::Bounds &bounds)
+    {
+        // Allows for a few units in the last place of rounding in both the
+        // center and the radius.
+
+        bounds.radius = bounds.radius * (1.0f + 4.0f * FLT_EPSILON) +
+            (fabsf(bounds.center[0]) + fabsf(bounds.center[1]) + fabsf(bounds.center[2])) * 4.0f * FLT_EPSILON;
+    }
+
+    template <class Positions>
+    void GrowSphere(const Positions &positions, int i, float center[3], float &radius)
+    {
+        float p[3];
+
+        positions.load(i, p);
+
+        float d[3] = {p[0] - center[0], p[1] - center[1], p[2] - center[2]};
+        float distanceSq = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+
+        if (distanceSq > radius * radius)
+        {
+            float distance = sqrtf(distanceSq);
+            float shift = (distance - radius) * 0.5f / distance;
+
+            center[0] += d[0] * shift;
+            center[1] += d[1] * shift;
+            center[2] += d[2] * shift;
+            radius = (radius + distance) * 0.5f;
+        }
+    }
+
+    template <class Positions>
+    void CalculateBounds(const Positions &positions, int count, MeshBounds::Bounds &bounds)
+    {
+        memset(&bounds, 0, sizeof(bounds));
+
+        if (count <= 0)
+            return;
+
+        // First pass: the box, the vertices furthest along each axis (the
+        // first one of any that are equally far), and the sum of the
+        // positions. The sum is split four ways by vertex number, which is
+        // how the SSE lanes add it up, so both give the same centroid.
+
+        float p[3];
+        float minimum[3];
+        float maximum[3];
+        int minVertex[3] = {0, 0, 0};
+        int maxVertex[3] = {0, 0, 0};
+        float sums[4][3];
+        int i = 0;
+
+        positions.load(0, p);
+        memcpy(minimum, p, sizeof(minimum));
+        memcpy(maximum, p, sizeof(maximum));
+        memset(sums, 0, sizeof(sums));
+
+#if PERFORM_SIMD_BOUNDS
+        bool simd = positions.canLoad4();
+
+        if (simd && count >= 4)
+        {
+            __m128 low[3];
+            __m128 high[3];
+            __m128i lowVertex[3];
+            __m128i highVertex[3];
+            __m128 sum[3];
+            __m128i vertex = _mm_set_epi32(3, 2, 1, 0);
+            const __m128i step = _mm_set1_epi32(4);
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                low[axis] = high[axis] = _mm_set1_ps(p[axis]);
+                lowVertex[axis] = highVertex[axis] = _mm_setzero_si128();
+                sum[axis] = _mm_setzero_ps();
+            }
+
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 v[3];
+
+                positions.load4(i, v[0], v[1], v[2]);
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    __m128 less = _mm_cmplt_ps(v[axis], low[axis]);
+                    __m128 greater = _mm_cmpgt_ps(v[axis], high[axis]);
+
+                    low[axis] = Select(less, v[axis], low[axis]);
+                    high[axis] = Select(greater, v[axis], high[axis]);
+                    lowVertex[axis] = Select(_mm_castps_si128(less), vertex, lowVertex[axis]);
+                    highVertex[axis] = Select(_mm_castps_si128(greater), vertex, highVertex[axis]);
+                    sum[axis] = _mm_add_ps(sum[axis], v[axis]);
+                }
+
+                vertex = _mm_add_epi32(vertex, step);
+            }
+
+            // Each lane holds the first furthest vertex of every fourth
+            // vertex. The lowest numbered of the lanes that are furthest
+            // is then the first furthest of them all.
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                float lowLanes[4];
+                float highLanes[4];
+                float sumLanes[4];
+                int lowVertexLanes[4];
+                int highVertexLanes[4];
+
+                _mm_storeu_ps(lowLanes, low[axis]);
+                _mm_storeu_ps(highLanes, high[axis]);
+                _mm_storeu_ps(sumLanes, sum[axis]);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(lowVertexLanes), lowVertex[axis]);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(highVertexLanes), highVertex[axis]);
+
+                for (int lane = 0; lane < 4; ++lane)
+                {
+                    if (lowLanes[lane] < minimum[axis] ||
+                        (lowLanes[lane] == minimum[axis] && lowVertexLanes[lane] < minVertex[axis]))
+                    {
+                        minimum[axis] = lowLanes[lane];
+                        minVertex[axis] = lowVertexLanes[lane];
+                    }
+
+                    if (highLanes[lane] > maximum[axis] ||
+                        (highLanes[lane] == maximum[axis] && highVertexLanes[lane] < maxVertex[axis]))
+                    {
+                        maximum[axis] = highLanes[lane];
+                        maxVertex[axis] = highVertexLanes[lane];
+                    }
+
+                    sums[lane][axis] = sumLanes[lane];
+                }
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            positions.load(i, p);
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (p[axis] < minimum[axis])
+                {
+                    minimum[axis] = p[axis];
+                    minVertex[axis] = i;
+                }
+
+                if (p[axis] > maximum[axis])
+                {
+                    maximum[axis] = p[axis];
+                    maxVertex[axis] = i;
+                }
+
+                sums[i & 3][axis] += p[axis];
+            }
+        }
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float total = (sums[0][axis] + sums[2][axis]) + (sums[1][axis] + sums[3][axis]);
+
+            bounds.minimum[axis] = minimum[axis];
+            bounds.maximum[axis] = maximum[axis];
+            bounds.centroid[axis] = total / static_cast<float>(count);
+        }
+
+        // Start the sphere from the most separated pair of extreme vertices.
+
+        int widestAxis = 0;
+        float widestDistanceSq = -1.0f;
+        float a[3];
+        float b[3];
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            positions.load(minVertex[axis], a);
+            positions.load(maxVertex[axis], b);
+
+            float distanceSq = DistanceSq(b, a);
+
+            if (distanceSq > widestDistanceSq)
+            {
+                widestAxis = axis;
+                widestDistanceSq = distanceSq;
+            }
+        }
+
+        positions.load(minVertex[widestAxis], a);
+        positions.load(maxVertex[widestAxis], b);
+
+        float *center = bounds.center;
+        float radius = sqrtf(widestDistanceSq) * 0.5f;
+
+        center[0] = (a[0] + b[0]) * 0.5f;
+        center[1] = (a[1] + b[1]) * 0.5f;
+        center[2] = (a[2] + b[2]) * 0.5f;
+
+        // Second pass: grow the sphere to take in any vertex outside it.
+        // Groups of 4 vertices that are all inside are skipped. The first
+        // group with a vertex outside is redone one vertex at a time, exactly
+        // as the scalar loop would.
+
+        i = 0;
+
+#if PERFORM_SIMD_BOUNDS
+        if (simd)
+        {
+            __m128 centerX = _mm_set1_ps(center[0]);
+            __m128 centerY = _mm_set1_ps(center[1]);
+            __m128 centerZ = _mm_set1_ps(center[2]);
+            __m128 radiusSq = _mm_set1_ps(radius * radius);
+
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 x, y, z;
+
+                positions.load4(i, x, y, z);
+                x = _mm_sub_ps(x, centerX);
+                y = _mm_sub_ps(y, centerY);
+                z = _mm_sub_ps(z, centerZ);
+
+                __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+
+                if (_mm_movemask_ps(_mm_cmpgt_ps(distanceSq, radiusSq)) == 0)
+                    continue;
+
+                for (int j = i; j < i + 4; ++j)
+                    GrowSphere(positions, j, center, radius);
+
+                centerX = _mm_set1_ps(center[0]);
+                centerY = _mm_set1_ps(center[1]);
+                centerZ = _mm_set1_ps(center[2]);
+                radiusSq = _mm_set1_ps(radius * radius);
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+            GrowSphere(positions, i, center, radius);
+
+        // Third pass: Ritter's sphere can come out a good deal larger than
+        // one around the center of the box or the centroid, for example for
+        // scans that are long in one direction, so the radius around all
+        // three centers is measured at once and the smallest sphere kept.
+        // sqrtf() never reorders two values, so it's only taken at the end.
+
+        float centers[3][3];
+        float largestSq[3] = {0.0f, 0.0f, 0.0f};
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            centers[0][axis] = center[axis];
+            centers[1][axis] = (minimum[axis] + maximum[axis]) * 0.5f;
+            centers[2][axis] = bounds.centroid[axis];
+        }
+
+        i = 0;
+
+#if PERFORM_SIMD_BOUNDS
+        if (simd && count >= 4)
+        {
+            __m128 centerX[3];
+            __m128 centerY[3];
+            __m128 centerZ[3];
+            __m128 largest[3];
+
+            for (int k = 0; k < 3; ++k)
+            {
+                centerX[k] = _mm_set1_ps(centers[k][0]);
+                centerY[k] = _mm_set1_ps(centers[k][1]);
+                centerZ[k] = _mm_set1_ps(centers[k][2]);
+                largest[k] = _mm_setzero_ps();
+            }
+
+            for (; i + 4 <= count; i += 4)
+            {
+                __m128 x, y, z;
+
+                positions.load4(i, x, y, z);
+
+                for (int k = 0; k < 3; ++k)
+                {
+                    __m128 dx = _mm_sub_ps(x, centerX[k]);
+                    __m128 dy = _mm_sub_ps(y, centerY[k]);
+                    __m128 dz = _mm_sub_ps(z, centerZ[k]);
+                    __m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+                    largest[k] = _mm_max_ps(distanceSq, largest[k]);
+                }
+            }
+
+            for (int k = 0; k < 3; ++k)
+            {
+                __m128 v = _mm_max_ps(largest[k], _mm_movehl_ps(largest[k], largest[k]));
+
+                v = _mm_max_ss(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+                largestSq[k] = _mm_cvtss_f32(v);
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            positions.load(i, p);
+
+            for (int k = 0; k < 3; ++k)
+            {
+                float distanceSq = DistanceSq(p, centers[k]);
+
+                if (distanceSq > largestSq[k])
+                    largestSq[k] = distanceSq;
+            }
+        }
+
+        int best = 0;
+
+        for (int k = 1; k < 3; ++k)
+        {
+            if (largestSq[k] < largestSq[best])
+                best = k;
+        }
+
+        memcpy(center, centers[best], sizeof(centers[best]));
+        bounds.radius = sqrtf(largestSq[best]);
+
+        // The distances are rounded, so the furthest vertex can still be a
+        // unit in the last place outside.
+        PadRadius(bounds);
+    }
+}
+
+void MeshBounds::calculateBounds(const float *pPositions, int vertexCount, int vertexStride,
+                                 Bounds &bounds)
+{
+    StridedPositions positions;
+
+    positions.pBytes = reinterpret_cast<const char *>(pPositions);
+    positions.vertexStride = vertexStride;
+
+    CalculateBounds(positions, vertexCount, bounds);
+}
+
+void MeshBounds::calculateBounds(const float *pX, const float *pY, const float *pZ,
+                                 int vertexCount, Bounds &bounds)
+{
+    SplitPositions positions;
+
+    positions.pX = pX;
+    positions.pY = pY;
+    positions.pZ = pZ;
+
+    CalculateBounds(positions, vertexCount, bounds);
+}
+
+void MeshBounds::calculateBounds(const int *pIndices, int indexCount, const float *pPositions,
+                                 int vertexStride, Bounds &bounds)
+{
+    IndexedPositions positions;
+
+    positions.pIndices = pIndices;
+    positions.vertices.pBytes = reinterpret_cast<const char *>(pPositions);
+    positions.vertices.vertexStride = vertexStride;
+
+    CalculateBounds(positions, indexCount, bounds);
+}
+
+void MeshBounds::mergeBounds(Bounds &bounds, int vertexCount, const Bounds &other,
+                             int otherVertexCount)
+{
+    if (otherVertexCount <= 0)
+        return;
+
+    if (vertexCount <= 0)
+    {
+        bounds = other;
+        return;
+    }
+
+    double weight = static_cast<double>(otherVertexCount) / (static_cast<double>(vertexCount) + otherVertexCount);
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (other.minimum[axis] < bounds.minimum[axis])
+            bounds.minimum[axis] = other.minimum[axis];
+
+        if (other.maximum[axis] > bounds.maximum[axis])
+            bounds.maximum[axis] = other.maximum[axis];
+
+        bounds.centroid[axis] = static_cast<float>(bounds.centroid[axis] +
+            (static_cast<double>(other.centroid[axis]) - bounds.centroid[axis]) * weight);
+    }
+
+    // The smallest sphere around both spheres. If one already holds the
+    // other it's kept as it is.
+
+    float d[3] =
+    {
+        other.center[0] - bounds.center[0],
+        other.center[1] - bounds.center[1],
+        other.center[2] - bounds.center[2]
+    };
+
+    float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    if (distance + other.radius <= bounds.radius)
+        return;
+
+    if (distance + bounds.radius <= other.radius)
+    {
+        memcpy(bounds.center, other.center, sizeof(bounds.center));
+        bounds.radius = other.radius;
+        return;
+    }
+
+    float radius = (distance + bounds.radius + other.radius) * 0.5f;
+    float shift = (radius - bounds.radius) / distance;
+
+    bounds.center[0] += d[0] * shift;
+    bounds.center[1] += d[1] * shift;
+    bounds.center[2] += d[2] * shift;
+    bounds.radius = radius;
+
+    PadRadius(bounds);
+}
+
+void MeshBounds::transformBounds(Bounds &bounds, float scaleFactor, const float offset[3])
+{
+    // Adding a constant and multiplying by one never reorders two floats, so
+    // the transformed box is exactly the box of the transformed vertices. A
+    // negative scale swaps its sides.
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float minimum = (bounds.minimum[axis] + offset[axis]) * scaleFactor;
+        float maximum = (bounds.maximum[axis] + offset[axis]) * scaleFactor;
+
+        bounds.minimum[axis] = (scaleFactor < 0.0f) ? maximum : minimum;
+        bounds.maximum[axis] = (scaleFactor < 0.0f) ? minimum : maximum;
+        bounds.centroid[axis] = (bounds.centroid[axis] + offset[axis]) * scaleFactor;
+        bounds.center[axis] = (bounds.center[axis] + offset[axis]) * scaleFactor;
+    }
+
+    bounds.radius *= fabsf(scaleFactor);
+    PadRadius(bounds);
+}
@@ -0,0 +1,83 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_BOUNDS_H)
+#define MESH_BOUNDS_H
+
+//-----------------------------------------------------------------------------
+// Bounding volumes for a set of vertex positions.
+//
+// calculateBounds() finds the axis aligned bounding box, the centroid, and a
+// bounding sphere together. The positions can be strided (each vertex is
+// vertexStride bytes after the previous one and starts with its position),
+// split into separate x, y, and z arrays, or picked out of a strided vertex
+// buffer by a list of indices. Vertices listed more than once count that
+// many times towards the centroid.
+//
+// The sphere is Ritter's, checked against simpler ones. The first pass finds
+// the box, the sum of the positions, and the vertices that are furthest
+// along each axis, and starts the sphere from the pair of those that are
+// the furthest apart. The second pass grows the sphere to take in any vertex
+// outside it. Ritter's sphere is usually within 5 to 20 percent of the
+// smallest one but can do worse on long, thin models, so the third pass
+// measures the radius needed around its center, the center of the box, and
+// the centroid, and keeps the smallest of the three spheres. The radius is
+// padded by a few units in the last place so rounding can't leave a vertex
+// outside. With SSE each pass works on 4 vertices at a time, and the second
+// only drops back to one at a time for the rare group that has a vertex
+// outside the sphere. The results are exactly the same as the scalar code's.
+//
+// transformBounds() applies position = (position + offset) * scaleFactor to
+// bounds without visiting the vertices again. The box stays exact. The
+// sphere's radius is padded by a few units in the last place to allow for
+// the vertices and the center being rounded separately. mergeBounds()
+// combines the bounds of two sets of vertices into bounds that cover both.
+//-----------------------------------------------------------------------------
+
+class MeshBounds
+{
+public:
+    struct Bounds
+    {
+        float minimum[3];
+        float maximum[3];
+        float centroid[3];
+        float center[3];        // bounding sphere
+        float radius;
+    };
+
+    static void calculateBounds(const float *pPositions, int vertexCount, int vertexStride,
+                                Bounds &bounds);
+
+    static void calculateBounds(const float *pX, const float *pY, const float *pZ,
+                                int vertexCount, Bounds &bounds);
+
+    static void calculateBounds(const int *pIndices, int indexCount, const float *pPositions,
+                                int vertexStride, Bounds &bounds);
+
+    static void mergeBounds(Bounds &bounds, int vertexCount, const Bounds &other,
+                            int otherVertexCount);
+
+    static void transformBounds(Bounds &bounds, float scaleFactor, const float offset[3]);
+};
+
+#endif
@@ -0,0 +1,276 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_BUFFER_H)
+#define MESH_BUFFER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+//-----------------------------------------------------------------------------
+// Growable array of plain old data elements that can either own its memory
+// or refer to memory owned by someone else.
+//
+// MeshBuffer supports the subset of the std::vector interface used by the
+// model loaders. A buffer that has been attached to external memory (e.g., a
+// memory mapped model cache) reads and writes that memory in place. As soon
+// as an attached buffer needs to change size it copies its elements into
+// memory it owns and detaches from the external memory.
+//
+// Elements are copied with memcpy() and are never constructed or destroyed.
+// Only use MeshBuffer with types that don't need constructors or destructors.
+//-----------------------------------------------------------------------------
+
+template <typename T>
+class MeshBuffer
+{
+public:
+    MeshBuffer() : m_pData(0), m_size(0), m_capacity(0), m_ownsData(true)
+    {
+    }
+
+    MeshBuffer(const MeshBuffer &buffer) : m_pData(0), m_size(0), m_capacity(0), m_ownsData(true)
+    {
+        assign(buffer.begin(), buffer.end());
+    }
+
+    ~MeshBuffer()
+    {
+        release();
+    }
+
+    MeshBuffer &operator=(const MeshBuffer &buffer)
+    {
+        if (this != &buffer)
+            assign(buffer.begin(), buffer.end());
+
+        return *this;
+    }
+
+    T &operator[](size_t i)
+    { return m_pData[i]; }
+
+    const T &operator[](size_t i) const
+    { return m_pData[i]; }
+
+    T *begin()
+    { return m_pData; }
+
+    const T *begin() const
+    { return m_pData; }
+
+    T *end()
+    { return m_pData + m_size; }
+
+    const T *end() const
+    { return m_pData + m_size; }
+
+    T &back()
+    { return m_pData[m_size - 1]; }
+
+    const T &back() const
+    { return m_pData[m_size - 1]; }
+
+    size_t capacity() const
+    { return m_capacity; }
+
+    bool empty() const
+    { return m_size == 0; }
+
+    bool isAttached() const
+    { return !m_ownsData; }
+
+    size_t size() const
+    { return m_size; }
+
+    void assign(const T *pFirst, const T *pLast)
+    {
+        size_t count = pLast - pFirst;
+
+        if (!m_ownsData || count > m_capacity)
+        {
+            release();
+            allocate(count);
+        }
+
+        if (count)
+            memmove(m_pData, pFirst, count * sizeof(T));
+
+        m_size = count;
+    }
+
+    void attach(T *pData, size_t count)
+    {
+        // Refers to count elements at pData without copying them. The memory
+        // must stay valid until the buffer is cleared, detached, or destroyed.
+
+        release();
+
+        m_pData = pData;
+        m_size = count;
+        m_capacity = count;
+        m_ownsData = false;
+    }
+
+    void clear()
+    {
+        if (m_ownsData)
+            m_size = 0;
+        else
+            release();
+    }
+
+    void detach()
+    {
+        // Copies attached elements into owned memory.
+
+        if (!m_ownsData)
+            reallocate(m_size);
+    }
+
+    void push_back(const T &value)
+    {
+        if (m_size == m_capacity || !m_ownsData)
+        {
+            // value may refer to an element of this buffer.
+            T copy = value;
+
+            reallocate((m_capacity < 8) ? 16 : m_capacity * 2);
+            m_pData[m_size++] = copy;
+        }
+        else
+        {
+            m_pData[m_size++] = value;
+        }
+    }
+
+    void reserve(size_t count)
+    {
+        if (count > m_capacity || (!m_ownsData && count > m_size))
+            reallocate(count);
+    }
+
+    void resize(size_t count)
+    {
+        resize(count, T());
+    }
+
+    void resize(size_t count, const T &value)
+    {
+        if (count > m_capacity || (!m_ownsData && count != m_size))
+        {
+            T copy = value;
+
+            reallocate((count > m_capacity * 2) ? count : m_capacity * 2);
+
+            for (size_t i = m_size; i < count; ++i)
+                m_pData[i] = copy;
+        }
+        else
+        {
+            for (size_t i = m_size; i < count; ++i)
+                m_pData[i] = value;
+        }
+
+        m_size = count;
+    }
+
+    void swap(MeshBuffer &buffer)
+    {
+        T *pData = m_pData;
+        size_t size = m_size;
+        size_t capacity = m_capacity;
+        bool ownsData = m_ownsData;
+
+        m_pData = buffer.m_pData;
+        m_size = buffer.m_size;
+        m_capacity = buffer.m_capacity;
+        m_ownsData = buffer.m_ownsData;
+
+        buffer.m_pData = pData;
+        buffer.m_size = size;
+        buffer.m_capacity = capacity;
+        buffer.m_ownsData = ownsData;
+    }
+
+private:
+    void allocate(size_t count)
+    {
+        m_pData = 0;
+        m_size = 0;
+        m_capacity = 0;
+        m_ownsData = true;
+
+        if (count)
+        {
+            m_pData = static_cast<T *>(malloc(count * sizeof(T)));
+
+            if (!m_pData)
+                throw std::bad_alloc();
+
+            m_capacity = count;
+        }
+    }
+
+    void reallocate(size_t count)
+    {
+        // Moves the elements into a new owned block of count elements.
+
+        if (count < m_size)
+            count = m_size;
+
+        T *pData = static_cast<T *>(malloc((count ? count : 1) * sizeof(T)));
+
+        if (!pData)
+            throw std::bad_alloc();
+
+        if (m_size)
+            memcpy(pData, m_pData, m_size * sizeof(T));
+
+        if (m_ownsData)
+            free(m_pData);
+
+        m_pData = pData;
+        m_capacity = count;
+        m_ownsData = true;
+    }
+
+    void release()
+    {
+        if (m_ownsData)
+            free(m_pData);
+
+        m_pData = 0;
+        m_size = 0;
+        m_capacity = 0;
+        m_ownsData = true;
+    }
+
+    T *m_pData;
+    size_t m_size;
+    size_t m_capacity;
+    bool m_ownsData;
+};
+
+#endif
@@ -0,0 +1,955 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "mesh_bvh.h"
+#include "parallel.h"
+
+namespace
+{
+    // Centroids are binned into this many bins along each axis when looking
+    // for the cheapest split.
+
+    const int SAH_BIN_COUNT = 16;
+
+    // The cost of visiting a node relative to testing a triangle.
+
+    const float SAH_TRAVERSAL_COST = 1.0f;
+
+    // Below this depth nodes are split at their median instead of by the
+    // SAH. Median splits halve the node so the tree stays within
+    // MeshBVH::MAX_DEPTH for up to 2^23 triangles.
+
+    const int SAH_MAX_DEPTH = 40;
+
+    // Subtrees with at most this many triangles are built by one thread.
+
+    const int PARALLEL_SUBTREE_TRIANGLES = 8192;
+
+    const int TRIANGLE_BLOCK_SIZE = 4096;
+
+    struct Bounds
+    {
+        float min[3];
+        float max[3];
+
+        void reset()
+        {
+            min[0] = min[1] = min[2] = FLT_MAX;
+            max[0] = max[1] = max[2] = -FLT_MAX;
+        }
+
+        void grow(const float pMin[3], const float pMax[3])
+        {
+            for (int i = 0; i < 3; ++i)
+            {
+                if (pMin[i] < min[i])
+                    min[i] = pMin[i];
+
+                if (pMax[i] > max[i])
+                    max[i] = pMax[i];
+            }
+        }
+
+        float area() const
+        {
+            float dx = max[0] - min[0];
+            float dy = max[1] - min[1];
+            float dz = max[2] - min[2];
+
+            return (dx < 0.0f) ? 0.0f : 2.0f * (dx * dy + dy * dz + dz * dx);
+        }
+    };
+
+    // Per triangle data used while building. The records themselves are
+    // partitioned as the tree is built so every node's triangles stay
+    // together in memory.
+
+    struct BuildTriangle
+    {
+        float min[3];
+        float max[3];
+        float centroid[3];
+        int id;
+    };
+
+    // The part of the tree built on the calling thread. Each top node is
+    // either an ordinary node or a placeholder for a subtree that's built in
+    // parallel.
+
+    struct TopNode
+    {
+        MeshBVH::Node node;
+        int secondChild;
+        int subtree;
+    };
+
+    struct Subtree
+    {
+        int begin;
+        int end;
+        int depth;
+        std::vector<MeshBVH::Node> nodes;
+    };
+
+    inline int GetBin(float centroid, float centroidMin, float binScale)
+    {
+        int bin = static_cast<int>((centroid - centroidMin) * binScale);
+        return (bin < SAH_BIN_COUNT) ? bin : SAH_BIN_COUNT - 1;
+    }
+
+    struct CentroidLess
+    {
+        int axis;
+
+        bool operator()(const BuildTriangle &a, const BuildTriangle &b) const
+        {
+            return (a.centroid[axis] < b.centroid[axis]) ||
+                   (a.centroid[axis] == b.centroid[axis] && a.id < b.id);
+        }
+    };
+
+    struct BinLess
+    {
+        int axis;
+        int bin;
+        float centroidMin;
+        float binScale;
+
+        bool operator()(const BuildTriangle &triangle) const
+        {
+            return GetBin(triangle.centroid[axis], centroidMin, binScale) < bin;
+        }
+    };
+
+    int SplitNode(BuildTriangle *pTriangles, int begin, int end, int depth, MeshBVH::Node &node)
+    {
+        // Fills in the node's bounds and picks how to split its triangles.
+        // Returns the position that divides the partitioned triangles between
+        // the two children, or -1 if the node is a leaf.
+
+        Bounds bounds;
+        Bounds centroidBounds;
+
+        bounds.reset();
+        centroidBounds.reset();
+
+        for (int i = begin; i < end; ++i)
+        {
+            bounds.grow(pTriangles[i].min, pTriangles[i].max);
+            centroidBounds.grow(pTriangles[i].centroid, pTriangles[i].centroid);
+        }
+
+        memcpy(node.boundsMin, bounds.min, sizeof(node.boundsMin));
+        memcpy(node.boundsMax, bounds.max, sizeof(node.boundsMax));
+        node.offset = begin;
+        node.count = static_cast<unsigned short>(end - begin);
+        node.axis = 0;
+
+        int count = end - begin;
+
+        if (count <= 1 || depth >= MeshBVH::MAX_DEPTH - 1)
+            return -1;
+
+        int bestAxis = -1;
+        int bestBin = 0;
+        float bestCost = FLT_MAX;
+
+        // Bin the triangles along all three axes in one pass.
+
+        int binCounts[3][SAH_BIN_COUNT] = {{0}};
+        Bounds binBounds[3][SAH_BIN_COUNT];
+        float binScales[3];
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+
+            binScales[axis] = (extent > 0.0f) ? SAH_BIN_COUNT / extent : 0.0f;
+
+            for (int i = 0; i < SAH_BIN_COUNT; ++i)
+                binBounds[axis][i].reset();
+        }
+
+        if (depth < SAH_MAX_DEPTH)
+        {
+            for (int i = begin; i < end; ++i)
+            {
+                const BuildTriangle &triangle = pTriangles[i];
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    int bin = GetBin(triangle.centroid[axis], centroidBounds.min[axis], binScales[axis]);
+
+                    ++binCounts[axis][bin];
+                    binBounds[axis][bin].grow(triangle.min, triangle.max);
+                }
+            }
+        }
+
+        for (int axis = 0; axis < 3 && depth < SAH_MAX_DEPTH; ++axis)
+        {
+            if (binScales[axis] == 0.0f)
+                continue;
+
+            // Sweep from the right to get the cost of the triangles right of
+            // each split, then from the left to add the cost of the rest.
+
+            float rightCosts[SAH_BIN_COUNT];
+            Bounds sweep;
+            int sweepCount = 0;
+
+            sweep.reset();
+
+            for (int i = SAH_BIN_COUNT - 1; i > 0; --i)
+            {
+                sweep.grow(binBounds[axis][i].min, binBounds[axis][i].max);
+                sweepCount += binCounts[axis][i];
+                rightCosts[i] = sweepCount * sweep.area();
+            }
+
+            sweep.reset();
+            sweepCount = 0;
+
+            for (int i = 1; i < SAH_BIN_COUNT; ++i)
+            {
+                sweep.grow(binBounds[axis][i - 1].min, binBounds[axis][i - 1].max);
+                sweepCount += binCounts[axis][i - 1];
+
+                if (sweepCount == 0 || sweepCount == count)
+                    continue;
+
+                float cost = sweepCount * sweep.area() + rightCosts[i];
+
+                if (cost < bestCost)
+                {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestBin = i;
+                }
+            }
+        }
+
+        if (bestAxis >= 0)
+        {
+            float area = bounds.area();
+            float splitCost = SAH_TRAVERSAL_COST + ((area > 0.0f) ? bestCost / area : 0.0f);
+
+            if (count <= MeshBVH::MAX_LEAF_TRIANGLES && static_cast<float>(count) <= splitCost)
+                return -1;
+
+            BinLess less;
+            less.axis = bestAxis;
+            less.bin = bestBin;
+            less.centroidMin = centroidBounds.min[bestAxis];
+            less.binScale = binScales[bestAxis];
+
+            node.axis = static_cast<unsigned short>(bestAxis);
+            return static_cast<int>(std::partition(pTriangles + begin, pTriangles + end, less) - pTriangles);
+        }
+
+        if (count <= MeshBVH::MAX_LEAF_TRIANGLES)
+            return -1;
+
+        // Too deep for the SAH, or all of the centroids are in the same
+        // place. Split at the median along the widest axis to keep the
+        // leaves small.
+
+        int axis = 0;
+
+        for (int i = 1; i < 3; ++i)
+        {
+            if (centroidBounds.max[i] - centroidBounds.min[i] > centroidBounds.max[axis] - centroidBounds.min[axis])
+                axis = i;
+        }
+
+        CentroidLess less;
+        less.axis = axis;
+
+        int middle = begin + count / 2;
+
+        std::nth_element(pTriangles + begin, pTriangles + middle, pTriangles + end, less);
+        node.axis = static_cast<unsigned short>(axis);
+        return middle;
+    }
+
+    void BuildSubtree(BuildTriangle *pTriangles, int begin, int end, int depth, std::vector<MeshBVH::Node> &nodes)
+    {
+        int index = static_cast<int>(nodes.size());
+        MeshBVH::Node node;
+
+        nodes.resize(index + 1);
+
+        int middle = SplitNode(pTriangles, begin, end, depth, node);
+
+        if (middle >= 0)
+        {
+            node.count = 0;
+
+            BuildSubtree(pTriangles, begin, middle, depth + 1, nodes);
+            node.offset = static_cast<int>(nodes.size());
+            BuildSubtree(pTriangles, middle, end, depth + 1, nodes);
+        }
+
+        nodes[index] = node;
+    }
+
+    void BuildTop(BuildTriangle *pTriangles, int begin, int end, int depth,
+                  std::vector<TopNode> &topNodes, std::vector<Subtree> &subtrees)
+    {
+        int index = static_cast<int>(topNodes.size());
+        TopNode top;
+
+        memset(&top.node, 0, sizeof(top.node));
+        top.secondChild = -1;
+        top.subtree = -1;
+
+        if (end - begin <= PARALLEL_SUBTREE_TRIANGLES)
+        {
+            Subtree subtree;
+            subtree.begin = begin;
+            subtree.end = end;
+            subtree.depth = depth;
+
+            top.subtree = static_cast<int>(subtrees.size());
+            subtrees.push_back(subtree);
+            topNodes.push_back(top);
+            return;
+        }
+
+        topNodes.push_back(top);
+
+        int middle = SplitNode(pTriangles, begin, end, depth, top.node);
+
+        if (middle >= 0)
+        {
+            top.node.count = 0;
+
+            BuildTop(pTriangles, begin, middle, depth + 1, topNodes, subtrees);
+            top.secondChild = static_cast<int>(topNodes.size());
+            BuildTop(pTriangles, middle, end, depth + 1, topNodes, subtrees);
+        }
+
+        topNodes[index] = top;
+    }
+
+    void FlattenTop(const std::vector<TopNode> &topNodes, const std::vector<Subtree> &subtrees,
+                    int index, std::vector<MeshBVH::Node> &nodes)
+    {
+        const TopNode &top = topNodes[index];
+
+        if (top.subtree >= 0)
+        {
+            // The subtree's child links are relative to its own first node.
+
+            const std::vector<MeshBVH::Node> &subtreeNodes = subtrees[top.subtree].nodes;
+            int base = static_cast<int>(nodes.size());
+
+            nodes.insert(nodes.end(), subtreeNodes.begin(), subtreeNodes.end());
+
+            for (int i = base; i < static_cast<int>(nodes.size()); ++i)
+            {
+                if (nodes[i].count == 0)
+                    nodes[i].offset += base;
+            }
+
+            return;
+        }
+
+        int nodeIndex = static_cast<int>(nodes.size());
+
+        nodes.push_back(top.node);
+
+        if (top.node.count == 0)
+        {
+            FlattenTop(topNodes, subtrees, index + 1, nodes);
+            nodes[nodeIndex].offset = static_cast<int>(nodes.size());
+            FlattenTop(topNodes, subtrees, top.secondChild, nodes);
+        }
+    }
+
+    inline float Dot(const float a[3], const float b[3])
+    {
+        return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+    }
+
+    inline void Cross(const float a[3], const float b[3], float result[3])
+    {
+        result[0] = a[1] * b[2] - a[2] * b[1];
+        result[1] = a[2] * b[0] - a[0] * b[2];
+        result[2] = a[0] * b[1] - a[1] * b[0];
+    }
+
+    inline bool IntersectRayBox(const MeshBVH::Node &node, const float origin[3],
+                                const float inverseDirection[3], float maxDistance)
+    {
+        float tMin = 0.0f;
+        float tMax = maxDistance;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float t0 = (node.boundsMin[i] - origin[i]) * inverseDirection[i];
+            float t1 = (node.boundsMax[i] - origin[i]) * inverseDirection[i];
+
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            // Written so that a NaN (a ray lying in the plane of a face)
+            // leaves the interval as it is.
+
+            tMin = (t0 > tMin) ? t0 : tMin;
+            tMax = (t1 < tMax) ? t1 : tMax;
+        }
+
+        return tMin <= tMax;
+    }
+
+    inline bool IntersectRayTriangle(const float v0[3], const float edge1[3], const float edge2[3],
+                                     const float origin[3], const float direction[3],
+                                     float maxDistance, float &distance, float &u, float &v)
+    {
+        // Moller and Trumbore's ray triangle intersection. Hits both sides.
+
+        float p[3];
+        Cross(direction, edge2, p);
+
+        float determinant = Dot(edge1, p);
+
+        if (determinant == 0.0f)
+            return false;
+
+        float inverseDeterminant = 1.0f / determinant;
+        float s[3] = {origin[0] - v0[0], origin[1] - v0[1], origin[2] - v0[2]};
+
+        u = Dot(s, p) * inverseDeterminant;
+
+        if (u < 0.0f || u > 1.0f)
+            return false;
+
+        float q[3];
+        Cross(s, edge1, q);
+
+        v = Dot(direction, q) * inverseDeterminant;
+
+        if (v < 0.0f || u + v > 1.0f)
+            return false;
+
+        distance = Dot(edge2, q) * inverseDeterminant;
+        return distance >= 0.0f && distance <= maxDistance;
+    }
+
+    void ClosestPointOnTriangle(const float point[3], const float a[3], const float ab[3],
+                                const float ac[3], float closest[3])
+    {
+        // From Christer Ericson's Real-Time Collision Detection, section
+        // 5.1.5, with the triangle given as a corner and two edges.
+
+        float ap[3] = {point[0] - a[0], point[1] - a[1], point[2] - a[2]};
+        float d1 = Dot(ab, ap);
+        float d2 = Dot(ac, ap);
+
+        if (d1 <= 0.0f && d2 <= 0.0f)
+        {
+            memcpy(closest, a, sizeof(float) * 3);
+            return;
+        }
+
+        float bp[3] = {ap[0] - ab[0], ap[1] - ab[1], ap[2] - ab[2]};
+        float d3 = Dot(ab, bp);
+        float d4 = Dot(ac, bp);
+
+        if (d3 >= 0.0f && d4 <= d3)
+        {
+            for (int i = 0; i < 3; ++i)
+                closest[i] = a[i] + ab[i];
+
+            return;
+        }
+
+        float vc = d1 * d4 - d3 * d2;
+
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f)
+        {
+            float t = d1 / (d1 - d3);
+
+            for (int i = 0; i < 3; ++i)
+                closest[i] = a[i] + t * ab[i];
+
+            return;
+        }
+
+        float cp[3] = {ap[0] - ac[0], ap[1] - ac[1], ap[2] - ac[2]};
+        float d5 = Dot(ab, cp);
+        float d6 = Dot(ac, cp);
+
+        if (d6 >= 0.0f && d5 <= d6)
+        {
+            for (int i = 0; i < 3; ++i)
+                closest[i] = a[i] + ac[i];
+
+            return;
+        }
+
+        float vb = d5 * d2 - d1 * d6;
+
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f)
+        {
+            float t = d2 / (d2 - d6);
+
+            for (int i = 0; i < 3; ++i)
+                closest[i] = a[i] + t * ac[i];
+
+            return;
+        }
+
+        float va = d3 * d6 - d5 * d4;
+
+        if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f)
+        {
+            float t = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+
+            for (int i = 0; i < 3; ++i)
+                closest[i] = a[i] + ab[i] + t * (ac[i] - ab[i]);
+
+            return;
+        }
+
+        float denominator = 1.0f / (va + vb + vc);
+        float v = vb * denominator;
+        float w = vc * denominator;
+
+        for (int i = 0; i < 3; ++i)
+            closest[i] = a[i] + ab[i] * v + ac[i] * w;
+    }
+
+    bool AxisSeparates(const float axis[3], const float v0[3], const float v1[3],
+                       const float v2[3], const float halfSize[3])
+    {
+        float p0 = Dot(axis, v0);
+        float p1 = Dot(axis, v1);
+        float p2 = Dot(axis, v2);
+        float radius = halfSize[0] * fabsf(axis[0]) + halfSize[1] * fabsf(axis[1]) + halfSize[2] * fabsf(axis[2]);
+        float pMin = std::min(p0, std::min(p1, p2));
+        float pMax = std::max(p0, std::max(p1, p2));
+
+        return pMin > radius || pMax < -radius;
+    }
+
+    bool TriangleOverlapsBox(const float a[3], const float ab[3], const float ac[3],
+                             const float center[3], const float halfSize[3])
+    {
+        // Akenine-Moller's separating axis test: the box's three face
+        // normals, the triangle's normal, and the nine cross products of
+        // their edges. The triangle is moved so the box is centered on the
+        // origin.
+
+        float v0[3] = {a[0] - center[0], a[1] - center[1], a[2] - center[2]};
+        float v1[3] = {v0[0] + ab[0], v0[1] + ab[1], v0[2] + ab[2]};
+        float v2[3] = {v0[0] + ac[0], v0[1] + ac[1], v0[2] + ac[2]};
+        float edges[3][3] =
+        {
+            {ab[0], ab[1], ab[2]},
+            {ac[0] - ab[0], ac[1] - ab[1], ac[2] - ab[2]},
+            {-ac[0], -ac[1], -ac[2]}
+        };
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float boxAxis[3] = {0.0f, 0.0f, 0.0f};
+            boxAxis[i] = 1.0f;
+
+            if (AxisSeparates(boxAxis, v0, v1, v2, halfSize))
+                return false;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                float axis[3];
+                Cross(boxAxis, edges[j], axis);
+
+                if (AxisSeparates(axis, v0, v1, v2, halfSize))
+                    return false;
+            }
+        }
+
+        float normal[3];
+        Cross(ab, ac, normal);
+
+        return !AxisSeparates(normal, v0, v1, v2, halfSize);
+    }
+
+    inline bool SphereOverlapsNode(const MeshBVH::Node &node, const float center[3], float radiusSq)
+    {
+        float distanceSq = 0.0f;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float d = 0.0f;
+
+            if (center[i] < node.boundsMin[i])
+                d = node.boundsMin[i] - center[i];
+            else if (center[i] > node.boundsMax[i])
+                d = center[i] - node.boundsMax[i];
+
+            distanceSq += d * d;
+        }
+
+        return distanceSq <= radiusSq;
+    }
+
+    inline bool BoxOverlapsNode(const MeshBVH::Node &node, const float boxMin[3], const float boxMax[3])
+    {
+        return boxMin[0] <= node.boundsMax[0] && boxMax[0] >= node.boundsMin[0] &&
+               boxMin[1] <= node.boundsMax[1] && boxMax[1] >= node.boundsMin[1] &&
+               boxMin[2] <= node.boundsMax[2] && boxMax[2] >= node.boundsMin[2];
+    }
+}
+
+MeshBVH::MeshBVH()
+{
+}
+
+MeshBVH::~MeshBVH()
+{
+    destroy();
+}
+
+void MeshBVH::build(const float *pPositions, int vertexStride, const int *pIndices, int indexCount)
+{
+    // Replaces the BVH with one over the triangles in pIndices. pPositions
+    // points to the first vertex's position and vertexStride is the distance
+    // in bytes between vertices.
+
+    destroy();
+
+    int triangleCount = indexCount / 3;
+
+    if (triangleCount == 0)
+        return;
+
+    const char *pBytes = reinterpret_cast<const char *>(pPositions);
+    std::vector<BuildTriangle> buildTriangles(triangleCount);
+
+    m_triangles.resize(triangleCount);
+
+    BuildTriangle *pBuildTriangles = &buildTriangles[0];
+    Triangle *pTriangles = &m_triangles[0];
+    int blockCount = (triangleCount + TRIANGLE_BLOCK_SIZE - 1) / TRIANGLE_BLOCK_SIZE;
+
+    Parallel::forEach(blockCount, [pBytes, vertexStride, pIndices, triangleCount, pBuildTriangles, pTriangles](int block)
+    {
+        int first = block * TRIANGLE_BLOCK_SIZE;
+        int last = std::min(first + TRIANGLE_BLOCK_SIZE, triangleCount);
+
+        for (int i = first; i < last; ++i)
+        {
+            BuildTriangle &buildTriangle = pBuildTriangles[i];
+            const float *p[3];
+
+            for (int j = 0; j < 3; ++j)
+                p[j] = reinterpret_cast<const float *>(pBytes + static_cast<size_t>(pIndices[i * 3 + j]) * vertexStride);
+
+            for (int j = 0; j < 3; ++j)
+            {
+                buildTriangle.min[j] = std::min(p[0][j], std::min(p[1][j], p[2][j]));
+                buildTriangle.max[j] = std::max(p[0][j], std::max(p[1][j], p[2][j]));
+                buildTriangle.centroid[j] = (buildTriangle.min[j] + buildTriangle.max[j]) * 0.5f;
+
+                pTriangles[i].v0[j] = p[0][j];
+                pTriangles[i].edge1[j] = p[1][j] - p[0][j];
+                pTriangles[i].edge2[j] = p[2][j] - p[0][j];
+            }
+
+            buildTriangle.id = i;
+        }
+    });
+
+    // Split the top of the tree on this thread until the remaining subtrees
+    // are small, then build those in parallel. Each subtree works on its own
+    // range of triangles so they don't get in each other's way.
+
+    std::vector<TopNode> topNodes;
+    std::vector<Subtree> subtrees;
+
+    BuildTop(pBuildTriangles, 0, triangleCount, 0, topNodes, subtrees);
+
+    Subtree *pSubtrees = &subtrees[0];
+
+    Parallel::forEach(static_cast<int>(subtrees.size()), [pBuildTriangles, pSubtrees](int i)
+    {
+        Subtree &subtree = pSubtrees[i];
+        BuildSubtree(pBuildTriangles, subtree.begin, subtree.end, subtree.depth, subtree.nodes);
+    });
+
+    m_nodes.reserve(triangleCount * 2);
+    FlattenTop(topNodes, subtrees, 0, m_nodes);
+
+    // Store the triangles in leaf order so each leaf reads one run of
+    // memory.
+
+    std::vector<Triangle> triangles(triangleCount);
+
+    m_triangleIds.resize(triangleCount);
+
+    for (int i = 0; i < triangleCount; ++i)
+    {
+        m_triangleIds[i] = buildTriangles[i].id;
+        triangles[i] = m_triangles[buildTriangles[i].id];
+    }
+
+    m_triangles.swap(triangles);
+}
+
+void MeshBVH::destroy()
+{
+    m_nodes.clear();
+    m_triangles.clear();
+    m_triangleIds.clear();
+}
+
+bool MeshBVH::intersectRay(const float origin[3], const float direction[3], float maxDistance, Hit &hit) const
+{
+    // Returns true and the nearest hit if the ray hits a triangle within
+    // maxDistance. The direction doesn't have to be unit length.
+
+    if (m_nodes.empty())
+        return false;
+
+    float inverseDirection[3] = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    bool found = false;
+
+    hit.distance = maxDistance;
+
+    for (;;)
+    {
+        const Node &node = m_nodes[nodeIndex];
+
+        if (IntersectRayBox(node, origin, inverseDirection, hit.distance))
+        {
+            if (node.count == 0)
+            {
+                int nearChild = nodeIndex + 1;
+                int farChild = node.offset;
+
+                if (direction[node.axis] < 0.0f)
+                    std::swap(nearChild, farChild);
+
+                stack[stackSize++] = farChild;
+                nodeIndex = nearChild;
+                continue;
+            }
+
+            for (int i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const Triangle &triangle = m_triangles[i];
+                float distance = 0.0f;
+                float u = 0.0f;
+                float v = 0.0f;
+
+                if (IntersectRayTriangle(triangle.v0, triangle.edge1, triangle.edge2,
+                        origin, direction, hit.distance, distance, u, v))
+                {
+                    // Equally near hits go to the lowest triangle number so
+                    // the answer doesn't depend on the tree's layout.
+
+                    if (found && distance == hit.distance && m_triangleIds[i] > hit.triangle)
+                        continue;
+
+                    hit.triangle = m_triangleIds[i];
+                    hit.distance = distance;
+                    hit.u = u;
+                    hit.v = v;
+                    found = true;
+                }
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+
+        nodeIndex = stack[--stackSize];
+    }
+
+    return found;
+}
+
+bool MeshBVH::intersectRayAny(const float origin[3], const float direction[3], float maxDistance) const
+{
+    if (m_nodes.empty())
+        return false;
+
+    float inverseDirection[3] = {1.0f / direction[0], 1.0f / direction[1], 1.0f / direction[2]};
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+
+    for (;;)
+    {
+        const Node &node = m_nodes[nodeIndex];
+
+        if (IntersectRayBox(node, origin, inverseDirection, maxDistance))
+        {
+            if (node.count == 0)
+            {
+                stack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+                continue;
+            }
+
+            for (int i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const Triangle &triangle = m_triangles[i];
+                float distance = 0.0f;
+                float u = 0.0f;
+                float v = 0.0f;
+
+                if (IntersectRayTriangle(triangle.v0, triangle.edge1, triangle.edge2,
+                        origin, direction, maxDistance, distance, u, v))
+                {
+                    return true;
+                }
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+
+        nodeIndex = stack[--stackSize];
+    }
+
+    return false;
+}
+
+int MeshBVH::overlapBox(const float boxMin[3], const float boxMax[3], std::vector<int> &triangles) const
+{
+    // Appends the triangles that touch the box to triangles and returns how
+    // many there were.
+
+    if (m_nodes.empty())
+        return 0;
+
+    float center[3];
+    float halfSize[3];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        center[i] = (boxMin[i] + boxMax[i]) * 0.5f;
+        halfSize[i] = (boxMax[i] - boxMin[i]) * 0.5f;
+    }
+
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    int count = 0;
+
+    for (;;)
+    {
+        const Node &node = m_nodes[nodeIndex];
+
+        if (BoxOverlapsNode(node, boxMin, boxMax))
+        {
+            if (node.count == 0)
+            {
+                stack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+                continue;
+            }
+
+            for (int i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const Triangle &triangle = m_triangles[i];
+
+                if (TriangleOverlapsBox(triangle.v0, triangle.edge1, triangle.edge2, center, halfSize))
+                {
+                    triangles.push_back(m_triangleIds[i]);
+                    ++count;
+                }
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+
+        nodeIndex = stack[--stackSize];
+    }
+
+    return count;
+}
+
+int MeshBVH::overlapSphere(const float center[3], float radius, std::vector<int> &triangles) const
+{
+    // Appends the triangles that touch the sphere to triangles and returns
+    // how many there were.
+
+    if (m_nodes.empty())
+        return 0;
+
+    float radiusSq = radius * radius;
+    int stack[MAX_DEPTH];
+    int stackSize = 0;
+    int nodeIndex = 0;
+    int count = 0;
+
+    for (;;)
+    {
+        const Node &node = m_nodes[nodeIndex];
+
+        if (SphereOverlapsNode(node, center, radiusSq))
+        {
+            if (node.count == 0)
+            {
+                stack[stackSize++] = node.offset;
+                nodeIndex = nodeIndex + 1;
+                continue;
+            }
+
+            for (int i = node.offset; i < node.offset + node.count; ++i)
+            {
+                const Triangle &triangle = m_triangles[i];
+                float closest[3];
+
+                ClosestPointOnTriangle(center, triangle.v0, triangle.edge1, triangle.edge2, closest);
+
+                float d[3] = {closest[0] - center[0], closest[1] - center[1], closest[2] - center[2]};
+
+                if (Dot(d, d) <= radiusSq)
+                {
+                    triangles.push_back(m_triangleIds[i]);
+                    ++count;
+                }
+            }
+        }
+
+        if (stackSize == 0)
+            break;
+
+        nodeIndex = stack[--stackSize];
+    }
+
+    return count;
+}
@@ -0,0 +1,128 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_BVH_H)
+#define MESH_BVH_H
+
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Bounding volume hierarchy over the triangles of an indexed triangle list.
+//
+// build() copies the triangles out of the vertex and index buffers, so the
+// model can be changed or destroyed afterwards without affecting the BVH.
+// The tree is built top down with the surface area heuristic (SAH): each
+// node's triangles are binned along every axis by their centroids and split
+// where the summed surface area of the two children, weighted by the number
+// of triangles in each, is smallest. A node becomes a leaf once splitting it
+// would cost more than testing its triangles or it has at most
+// MAX_LEAF_TRIANGLES triangles. The first few levels are split on the
+// calling thread and the subtrees below them are then built in parallel.
+// The result is the same no matter how many threads did the work.
+//
+// The nodes are stored depth first in a single array of 32 byte nodes: a
+// node's first child directly follows it and only the second child's index
+// is stored. A leaf's triangles are contiguous.
+//
+// Queries only read the BVH and don't allocate any memory other than the
+// results, so any number of threads can query one BVH at the same time as
+// long as nobody is rebuilding it. Triangles are reported by their number in
+// the index buffer that was passed to build() (index / 3).
+//
+//  - intersectRay() finds the nearest triangle hit by a ray within
+//    maxDistance, visiting the nearer child first. Both sides of a triangle
+//    are hit.
+//  - intersectRayAny() returns as soon as any triangle is hit, which is all
+//    shadow and visibility tests need.
+//  - overlapSphere() and overlapBox() return every triangle that touches a
+//    sphere or an axis aligned box using exact triangle tests.
+//-----------------------------------------------------------------------------
+
+class MeshBVH
+{
+public:
+    static const int MAX_LEAF_TRIANGLES = 4;
+    static const int MAX_DEPTH = 64;
+
+    struct Node
+    {
+        float boundsMin[3];
+        float boundsMax[3];
+        int offset;                 // leaf: first triangle, otherwise: second child
+        unsigned short count;       // leaf: number of triangles, otherwise: 0
+        unsigned short axis;        // split axis [0 = x, 1 = y, 2 = z]
+    };
+
+    struct Hit
+    {
+        int triangle;
+        float distance;             // along the ray in units of its direction
+        float u;                    // barycentric coordinates of the hit point
+        float v;
+    };
+
+    MeshBVH();
+    ~MeshBVH();
+
+    void build(const float *pPositions, int vertexStride, const int *pIndices, int indexCount);
+    void destroy();
+
+    bool intersectRay(const float origin[3], const float direction[3], float maxDistance, Hit &hit) const;
+    bool intersectRayAny(const float origin[3], const float direction[3], float maxDistance) const;
+    int overlapBox(const float boxMin[3], const float boxMax[3], std::vector<int> &triangles) const;
+    int overlapSphere(const float center[3], float radius, std::vector<int> &triangles) const;
+
+    // Getter methods.
+
+    const Node &getNode(int i) const;
+    int getNumberOfNodes() const;
+    int getNumberOfTriangles() const;
+    bool isEmpty() const;
+
+private:
+    struct Triangle
+    {
+        float v0[3];
+        float edge1[3];             // v1 - v0
+        float edge2[3];             // v2 - v0
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<Triangle> m_triangles;
+    std::vector<int> m_triangleIds;
+};
+
+//-----------------------------------------------------------------------------
+
+inline const MeshBVH::Node &MeshBVH::getNode(int i) const
+{ return m_nodes[i]; }
+
+inline int MeshBVH::getNumberOfNodes() const
+{ return static_cast<int>(m_nodes.size()); }
+
+inline int MeshBVH::getNumberOfTriangles() const
+{ return static_cast<int>(m_triangles.size()); }
+
+inline bool MeshBVH::isEmpty() const
+{ return m_nodes.empty(); }
+
+#endif
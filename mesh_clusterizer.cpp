@@ -0,0 +1,348 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "mesh_bounds.h"
+#include "mesh_clusterizer.h"
+#include "mesh_optimizer.h"
+
+namespace
+{
+    // A cluster whose triangle normals spread this close to a right angle
+    // from the cone axis can't be back facing from any useful distance, so
+    // it isn't given a cone at all.
+
+    const float MIN_CONE_SPREAD = 0.1f;
+
+    // How many new vertices a triangle facing at right angles to a cluster
+    // is worth when picking the next triangle. Higher values make tighter
+    // cones at the cost of clusters that use their vertices less well.
+
+    const float CONE_WEIGHT = 2.0f;
+
+    inline const float *GetPosition(const char *pBytes, int vertexStride, int vertex)
+    {
+        return reinterpret_cast<const float *>(pBytes + static_cast<size_t>(vertex) * vertexStride);
+    }
+
+    void CalculateTriangleNormal(const int *pTriangle, const char *pBytes, int vertexStride, float n[3])
+    {
+        // Unit normal of a counter-clockwise triangle, or zero if it's
+        // degenerate.
+
+        const float *p0 = GetPosition(pBytes, vertexStride, pTriangle[0]);
+        const float *p1 = GetPosition(pBytes, vertexStride, pTriangle[1]);
+        const float *p2 = GetPosition(pBytes, vertexStride, pTriangle[2]);
+
+        float e1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+        float e2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+        n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        if (length == 0.0f)
+            return;
+
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+
+    void CalculateNormalCone(const int *pIndices, int triangleCount, const char *pBytes,
+                             int vertexStride, float axis[3], float &cutoff)
+    {
+        axis[0] = 0.0f;
+        axis[1] = 0.0f;
+        axis[2] = 0.0f;
+        cutoff = 1.0f;
+
+        std::vector<float> normals(triangleCount * 3, 0.0f);
+        bool anyNormals = false;
+
+        for (int i = 0; i < triangleCount; ++i)
+        {
+            float *n = &normals[i * 3];
+
+            CalculateTriangleNormal(pIndices + i * 3, pBytes, vertexStride, n);
+
+            if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+                continue;
+
+            axis[0] += n[0];
+            axis[1] += n[1];
+            axis[2] += n[2];
+            anyNormals = true;
+        }
+
+        float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+        if (!anyNormals || axisLength == 0.0f)
+        {
+            axis[0] = 0.0f;
+            axis[1] = 0.0f;
+            axis[2] = 0.0f;
+            return;
+        }
+
+        axis[0] /= axisLength;
+        axis[1] /= axisLength;
+        axis[2] /= axisLength;
+
+        // The cone has to contain every normal. Degenerate triangles have a
+        // zero normal and face nowhere so they're left out.
+
+        float minDot = 1.0f;
+
+        for (int i = 0; i < triangleCount; ++i)
+        {
+            const float *n = &normals[i * 3];
+
+            if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f)
+                continue;
+
+            float d = n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2];
+
+            if (d < minDot)
+                minDot = d;
+        }
+
+        if (minDot > MIN_CONE_SPREAD)
+            cutoff = sqrtf(1.0f - minDot * minDot);
+    }
+
+    void FinishCluster(MeshClusterizer::Cluster &cluster, const int *pIndices,
+                       const char *pBytes, int vertexStride)
+    {
+        int vertices[MeshClusterizer::MAX_VERTICES];
+        int vertexCount = 0;
+
+        for (int i = cluster.startIndex; i < cluster.startIndex + cluster.triangleCount * 3; ++i)
+        {
+            int j = 0;
+
+            while (j < vertexCount && vertices[j] != pIndices[i])
+                ++j;
+
+            if (j == vertexCount)
+                vertices[vertexCount++] = pIndices[i];
+        }
+
+        cluster.vertexCount = vertexCount;
+
+        MeshBounds::Bounds bounds;
+
+        MeshBounds::calculateBounds(vertices, vertexCount, reinterpret_cast<const float *>(pBytes),
+            vertexStride, bounds);
+        memcpy(cluster.center, bounds.center, sizeof(cluster.center));
+        cluster.radius = bounds.radius;
+
+        CalculateNormalCone(pIndices + cluster.startIndex, cluster.triangleCount, pBytes,
+            vertexStride, cluster.coneAxis, cluster.coneCutoff);
+    }
+}
+
+void MeshClusterizer::buildClusters(int *pIndices, int indexCount, const float *pPositions,
+                                    int vertexStride, std::vector<Cluster> &clusters)
+{
+    // Reorders the triangles in pIndices so that each cluster is a
+    // contiguous run and appends the clusters to clusters. Their start
+    // indices are relative to pIndices.
+
+    const char *pBytes = reinterpret_cast<const char *>(pPositions);
+    int triangleCount = indexCount / 3;
+
+    if (triangleCount == 0)
+        return;
+
+    // Number the vertices used by the triangles from 0 so the working arrays
+    // only need to be as large as this range rather than the vertex buffer.
+
+    std::vector<int> vertices(pIndices, pIndices + triangleCount * 3);
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    int vertexCount = static_cast<int>(vertices.size());
+    std::vector<int> corners(triangleCount * 3);
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        corners[i] = static_cast<int>(std::lower_bound(vertices.begin(), vertices.end(), pIndices[i]) - vertices.begin());
+
+    // The triangles around each vertex.
+
+    std::vector<int> vertexTriangleOffsets(vertexCount + 1, 0);
+    std::vector<int> vertexTriangles(triangleCount * 3);
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        ++vertexTriangleOffsets[corners[i] + 1];
+
+    for (int i = 0; i < vertexCount; ++i)
+        vertexTriangleOffsets[i + 1] += vertexTriangleOffsets[i];
+
+    std::vector<int> fill(vertexTriangleOffsets.begin(), vertexTriangleOffsets.end() - 1);
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        vertexTriangles[fill[corners[i]]++] = i / 3;
+
+    std::vector<float> normals(triangleCount * 3);
+
+    for (int i = 0; i < triangleCount; ++i)
+        CalculateTriangleNormal(pIndices + i * 3, pBytes, vertexStride, &normals[i * 3]);
+
+    // Grow one cluster at a time. A cluster starts from the first triangle
+    // that hasn't been taken yet and then takes the neighboring triangle
+    // that adds the fewest vertices and faces the most like the triangles
+    // already in the cluster. It ends when it's full or nothing fits.
+
+    std::vector<int> ordered;
+    std::vector<int> clusterVertexStamps(vertexCount, -1);
+    std::vector<int> candidateStamps(triangleCount, -1);
+    std::vector<unsigned char> taken(triangleCount, 0);
+    std::vector<int> candidates;
+    int firstCluster = static_cast<int>(clusters.size());
+    int nextSeed = 0;
+
+    ordered.reserve(triangleCount * 3);
+    candidates.reserve(MAX_VERTICES * 8);
+
+    while (static_cast<int>(ordered.size()) < triangleCount * 3)
+    {
+        int clusterId = static_cast<int>(clusters.size());
+        Cluster cluster;
+        float axis[3] = {0.0f, 0.0f, 0.0f};
+
+        memset(&cluster, 0, sizeof(cluster));
+        cluster.startIndex = static_cast<int>(ordered.size());
+        candidates.clear();
+
+        while (nextSeed < triangleCount && taken[nextSeed])
+            ++nextSeed;
+
+        int triangle = nextSeed;
+
+        while (triangle != -1)
+        {
+            const int *pCorners = &corners[triangle * 3];
+            const float *pNormal = &normals[triangle * 3];
+
+            taken[triangle] = 1;
+            ++cluster.triangleCount;
+
+            axis[0] += pNormal[0];
+            axis[1] += pNormal[1];
+            axis[2] += pNormal[2];
+
+            for (int i = 0; i < 3; ++i)
+            {
+                int vertex = pCorners[i];
+
+                ordered.push_back(vertex);
+
+                if (clusterVertexStamps[vertex] == clusterId)
+                    continue;
+
+                clusterVertexStamps[vertex] = clusterId;
+                ++cluster.vertexCount;
+
+                for (int j = vertexTriangleOffsets[vertex]; j < vertexTriangleOffsets[vertex + 1]; ++j)
+                {
+                    int neighbor = vertexTriangles[j];
+
+                    if (!taken[neighbor] && candidateStamps[neighbor] != clusterId)
+                    {
+                        candidateStamps[neighbor] = clusterId;
+                        candidates.push_back(neighbor);
+                    }
+                }
+            }
+
+            if (cluster.triangleCount == MAX_TRIANGLES)
+                break;
+
+            // Pick the next triangle. Ties go to the candidate found first,
+            // which keeps the result independent of anything but the input.
+
+            float axisLength = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+            float bestScore = FLT_MAX;
+            int candidateCount = 0;
+
+            triangle = -1;
+
+            for (int i = 0; i < static_cast<int>(candidates.size()); ++i)
+            {
+                int candidate = candidates[i];
+
+                if (taken[candidate])
+                    continue;
+
+                candidates[candidateCount++] = candidate;
+
+                int newVertices = 0;
+
+                for (int j = 0; j < 3; ++j)
+                {
+                    if (clusterVertexStamps[corners[candidate * 3 + j]] != clusterId)
+                        ++newVertices;
+                }
+
+                if (cluster.vertexCount + newVertices > MAX_VERTICES)
+                    continue;
+
+                const float *n = &normals[candidate * 3];
+                float alignment = (axisLength > 0.0f) ? (n[0] * axis[0] + n[1] * axis[1] + n[2] * axis[2]) / axisLength : 1.0f;
+                float score = static_cast<float>(newVertices) + (1.0f - alignment) * CONE_WEIGHT;
+
+                if (score < bestScore)
+                {
+                    bestScore = score;
+                    triangle = candidate;
+                }
+            }
+
+            candidates.resize(candidateCount);
+        }
+
+        clusters.push_back(cluster);
+    }
+
+    // Picking triangles for their normals doesn't leave them in a good order
+    // for the vertex cache, so each cluster's triangles are reordered again.
+    // The clusters are small enough that this doesn't take long.
+
+    for (int i = firstCluster; i < static_cast<int>(clusters.size()); ++i)
+    {
+        MeshOptimizer::optimizeVertexCache(&ordered[clusters[i].startIndex],
+            clusters[i].triangleCount * 3, vertexCount);
+    }
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        pIndices[i] = vertices[ordered[i]];
+
+    for (int i = firstCluster; i < static_cast<int>(clusters.size()); ++i)
+        FinishCluster(clusters[i], pIndices, pBytes, vertexStride);
+}
@@ -0,0 +1,111 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_CLUSTERIZER_H)
+#define MESH_CLUSTERIZER_H
+
+#include <cmath>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Splits triangle lists into small clusters that can be culled on the CPU.
+//
+// buildClusters() grows clusters over a single range of a triangle list
+// index buffer. Each cluster starts from the first triangle that hasn't been
+// used yet and keeps taking the neighboring triangle that adds the fewest new
+// vertices and faces the most like the triangles it already has, until it
+// reaches MAX_VERTICES unique vertices or MAX_TRIANGLES triangles or no
+// neighbor fits. The triangles are then reordered so each cluster is a
+// contiguous run of the index buffer that can be drawn with a single call,
+// and each cluster's triangles are optimized for the vertex cache again. The
+// result only depends on the input so it's the same every time.
+//
+// Each cluster carries a bounding sphere and a normal cone. The cone's axis
+// is the average direction of the cluster's triangle normals and its cutoff
+// is the sine of the widest angle between the axis and a triangle normal.
+// isBackFacing() returns true if every triangle in the cluster faces away
+// from the camera, using the bounding sphere to stand in for the cone's apex.
+// Clusters with triangles facing in opposite directions get a cutoff of 1
+// and are never back facing. isOutsideFrustum() tests the bounding sphere
+// against six normalized planes that point into the frustum.
+//
+// Front faces are taken to be counter-clockwise as in OpenGL.
+//-----------------------------------------------------------------------------
+
+class MeshClusterizer
+{
+public:
+    static const int MAX_VERTICES = 64;
+    static const int MAX_TRIANGLES = 124;
+
+    struct Cluster
+    {
+        int startIndex;
+        int triangleCount;
+        int vertexCount;
+        float center[3];
+        float radius;
+        float coneAxis[3];
+        float coneCutoff;
+    };
+
+    static void buildClusters(int *pIndices, int indexCount, const float *pPositions,
+                              int vertexStride, std::vector<Cluster> &clusters);
+
+    static bool isBackFacing(const Cluster &cluster, const float cameraPosition[3]);
+    static bool isOutsideFrustum(const Cluster &cluster, const float planes[6][4]);
+};
+
+//-----------------------------------------------------------------------------
+
+inline bool MeshClusterizer::isBackFacing(const Cluster &cluster, const float cameraPosition[3])
+{
+    float d[3] =
+    {
+        cluster.center[0] - cameraPosition[0],
+        cluster.center[1] - cameraPosition[1],
+        cluster.center[2] - cameraPosition[2]
+    };
+
+    float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+    return d[0] * cluster.coneAxis[0] + d[1] * cluster.coneAxis[1] + d[2] * cluster.coneAxis[2] >
+           cluster.coneCutoff * distance + cluster.radius;
+}
+
+inline bool MeshClusterizer::isOutsideFrustum(const Cluster &cluster, const float planes[6][4])
+{
+    for (int i = 0; i < 6; ++i)
+    {
+        const float *pPlane = planes[i];
+
+        if (pPlane[0] * cluster.center[0] + pPlane[1] * cluster.center[1] +
+            pPlane[2] * cluster.center[2] + pPlane[3] < -cluster.radius)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#endif
@@ -0,0 +1,656 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define PERFORM_SIMD_CODEC              1
+#else
+#define PERFORM_SIMD_CODEC              0
+#endif
+
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include "mesh_codec.h"
+
+#if PERFORM_SIMD_CODEC
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+    // Index codec. Each triangle's code byte holds the rotation that lines
+    // its first edge up with a recent edge in the top two bits, followed by
+    // the edge's place in the edge FIFO and how the third vertex is coded.
+    // Triangles that don't share a recent edge use the rotation CODE_NO_EDGE
+    // and code each of their vertices in two bits instead.
+
+    const int EDGE_FIFO_SIZE = 8;
+    const int VERTEX_FIFO_SIZE = 6;
+
+    const unsigned int CODE_NO_EDGE = 3;
+
+    const unsigned int THIRD_NEXT = 0;          // 1 to 6 are recent vertices
+    const unsigned int THIRD_EXPLICIT = 7;
+
+    const unsigned int VERTEX_NEXT = 0;
+    const unsigned int VERTEX_RECENT = 1;       // 1 and 2 are recent vertices
+    const unsigned int VERTEX_EXPLICIT = 3;
+
+    // Vertex codec.
+
+    const int VERTEX_BLOCK_SIZE = 256;
+    const int GROUP_SIZE = 16;
+    const int GROUP_BITS[5] = {0, 1, 2, 4, 8};
+
+    struct IndexCoder
+    {
+        // State shared by the encoder and the decoder. Both update it in
+        // exactly the same way after every triangle.
+
+        IndexCoder() : edgeHead(0), vertexHead(0), next(0), last(0)
+        {
+            memset(edges, 0, sizeof(edges));
+            memset(vertices, 0, sizeof(vertices));
+        }
+
+        int findEdge(unsigned int a, unsigned int b) const
+        {
+            for (int i = 0; i < EDGE_FIFO_SIZE; ++i)
+            {
+                const unsigned int *pEdge = getEdge(i);
+
+                if (pEdge[0] == a && pEdge[1] == b)
+                    return i;
+            }
+
+            return -1;
+        }
+
+        int findVertex(unsigned int v, int count) const
+        {
+            for (int i = 0; i < count; ++i)
+            {
+                if (getVertex(i) == v)
+                    return i;
+            }
+
+            return -1;
+        }
+
+        const unsigned int *getEdge(int i) const
+        {
+            // 0 is the most recent edge.
+            return edges[(edgeHead + EDGE_FIFO_SIZE - 1 - i) % EDGE_FIFO_SIZE];
+        }
+
+        unsigned int getVertex(int i) const
+        {
+            // 0 is the most recent vertex.
+            return vertices[(vertexHead + VERTEX_FIFO_SIZE - 1 - i) % VERTEX_FIFO_SIZE];
+        }
+
+        void pushEdge(unsigned int a, unsigned int b)
+        {
+            edges[edgeHead][0] = a;
+            edges[edgeHead][1] = b;
+            edgeHead = (edgeHead + 1) % EDGE_FIFO_SIZE;
+        }
+
+        void pushVertex(unsigned int v)
+        {
+            vertices[vertexHead] = v;
+            vertexHead = (vertexHead + 1) % VERTEX_FIFO_SIZE;
+        }
+
+        unsigned int edges[EDGE_FIFO_SIZE][2];
+        unsigned int vertices[VERTEX_FIFO_SIZE];
+        int edgeHead;
+        int vertexHead;
+        unsigned int next;      // lowest vertex not seen yet
+        unsigned int last;      // last explicitly coded vertex
+    };
+
+    void WriteVarint(std::vector<unsigned char> &data, unsigned int value)
+    {
+        while (value >= 0x80)
+        {
+            data.push_back(static_cast<unsigned char>(value | 0x80));
+            value >>= 7;
+        }
+
+        data.push_back(static_cast<unsigned char>(value));
+    }
+
+    inline bool ReadVarint(const unsigned char *&p, const unsigned char *pEnd, unsigned int &value)
+    {
+        value = 0;
+
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            if (p == pEnd)
+                return false;
+
+            unsigned int byte = *p++;
+            value |= (byte & 0x7F) << shift;
+
+            if (byte < 0x80)
+                return true;
+        }
+
+        return false;
+    }
+
+    void WriteExplicit(std::vector<unsigned char> &data, IndexCoder &coder, unsigned int v)
+    {
+        // Explicit vertices are zigzag coded differences from the previous
+        // explicit vertex.
+
+        int delta = static_cast<int>(v - coder.last);
+
+        WriteVarint(data, (static_cast<unsigned int>(delta) << 1) ^ static_cast<unsigned int>(delta >> 31));
+        coder.last = v;
+    }
+
+    inline bool ReadExplicit(const unsigned char *&p, const unsigned char *pEnd, IndexCoder &coder, unsigned int &v)
+    {
+        unsigned int zigzag = 0;
+
+        if (!ReadVarint(p, pEnd, zigzag))
+            return false;
+
+        v = coder.last + ((zigzag >> 1) ^ (0u - (zigzag & 1)));
+        coder.last = v;
+        return true;
+    }
+
+    unsigned int EncodeVertex(std::vector<unsigned char> &extra, IndexCoder &coder, unsigned int v,
+                              unsigned int recentCount, unsigned int recentBase,
+                              unsigned int explicitCode)
+    {
+        // Returns the code of a vertex that isn't part of a shared edge. A
+        // new or explicit vertex becomes a recent vertex. A recent one stays
+        // where it is.
+
+        if (v == coder.next)
+        {
+            ++coder.next;
+            coder.pushVertex(v);
+            return 0;
+        }
+
+        int recent = coder.findVertex(v, static_cast<int>(recentCount));
+
+        if (recent != -1)
+            return recentBase + recent;
+
+        WriteExplicit(extra, coder, v);
+        coder.pushVertex(v);
+        return explicitCode;
+    }
+
+    inline bool DecodeVertex(const unsigned char *&p, const unsigned char *pEnd, IndexCoder &coder,
+                             unsigned int code, unsigned int recentBase,
+                             unsigned int explicitCode, unsigned int &v)
+    {
+        if (code == 0)
+        {
+            v = coder.next++;
+            coder.pushVertex(v);
+        }
+        else if (code == explicitCode)
+        {
+            if (!ReadExplicit(p, pEnd, coder, v))
+                return false;
+
+            coder.pushVertex(v);
+        }
+        else
+        {
+            v = coder.getVertex(static_cast<int>(code - recentBase));
+        }
+
+        return true;
+    }
+
+    inline unsigned char ZigZag(unsigned char delta)
+    {
+        return static_cast<unsigned char>((delta << 1) ^ ((delta & 0x80) ? 0xFF : 0x00));
+    }
+
+    inline unsigned char UnZigZag(unsigned char value)
+    {
+        return static_cast<unsigned char>((value >> 1) ^ (0 - (value & 1)));
+    }
+
+    void EncodeGroup(std::vector<unsigned char> &data, const unsigned char *pGroup, int bits)
+    {
+        if (bits == 0)
+            return;
+
+        if (bits == 8)
+        {
+            data.insert(data.end(), pGroup, pGroup + GROUP_SIZE);
+            return;
+        }
+
+        int perByte = 8 / bits;
+
+        for (int i = 0; i < GROUP_SIZE; i += perByte)
+        {
+            unsigned int byte = 0;
+
+            for (int j = 0; j < perByte; ++j)
+                byte |= static_cast<unsigned int>(pGroup[i + j]) << (j * bits);
+
+            data.push_back(static_cast<unsigned char>(byte));
+        }
+    }
+
+    inline void DecodeGroup(const unsigned char *pData, unsigned char *pGroup, int bits)
+    {
+#if PERFORM_SIMD_CODEC
+        const __m128i ONES = _mm_set1_epi8(1);
+        __m128i v;
+        __m128i group;
+
+        switch (bits)
+        {
+        case 0:
+            group = _mm_setzero_si128();
+            break;
+
+        case 1:
+            v = _mm_unpacklo_epi64(_mm_set1_epi8(static_cast<char>(pData[0])), _mm_set1_epi8(static_cast<char>(pData[1])));
+            v = _mm_and_si128(v, _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128));
+            group = _mm_min_epu8(v, ONES);
+            break;
+
+        case 2:
+        {
+            const __m128i MASK = _mm_set1_epi8(3);
+            v = _mm_cvtsi32_si128(static_cast<int>(pData[0] | (pData[1] << 8) | (pData[2] << 16) | (static_cast<unsigned int>(pData[3]) << 24)));
+            __m128i a = _mm_unpacklo_epi8(_mm_and_si128(v, MASK), _mm_and_si128(_mm_srli_epi16(v, 2), MASK));
+            __m128i b = _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), MASK), _mm_and_si128(_mm_srli_epi16(v, 6), MASK));
+            group = _mm_unpacklo_epi16(a, b);
+            break;
+        }
+
+        case 4:
+        {
+            const __m128i MASK = _mm_set1_epi8(15);
+            v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(pData));
+            group = _mm_unpacklo_epi8(_mm_and_si128(v, MASK), _mm_and_si128(_mm_srli_epi16(v, 4), MASK));
+            break;
+        }
+
+        default:
+            group = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pData));
+            break;
+        }
+
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(pGroup), group);
+#else
+        switch (bits)
+        {
+        case 0:
+            memset(pGroup, 0, GROUP_SIZE);
+            break;
+
+        case 1:
+            for (int i = 0; i < GROUP_SIZE; ++i)
+                pGroup[i] = (pData[i >> 3] >> (i & 7)) & 1;
+            break;
+
+        case 2:
+            for (int i = 0; i < GROUP_SIZE; ++i)
+                pGroup[i] = (pData[i >> 2] >> ((i & 3) * 2)) & 3;
+            break;
+
+        case 4:
+            for (int i = 0; i < GROUP_SIZE; ++i)
+                pGroup[i] = (pData[i >> 1] >> ((i & 1) * 4)) & 15;
+            break;
+
+        default:
+            memcpy(pGroup, pData, GROUP_SIZE);
+            break;
+        }
+#endif
+    }
+
+    void AccumulateColumns(const unsigned char *pColumns, unsigned char *pLast,
+                           unsigned char *pVertices, int length, int vertexSize)
+    {
+        // Column k holds the zigzag coded differences of byte k of the next
+        // (up to) 16 vertices. Each difference is added to the same byte of
+        // the previous vertex. With SIMD, 16 columns are transposed into rows
+        // so that 16 bytes of a vertex are finished at once.
+
+        int k = 0;
+
+#if PERFORM_SIMD_CODEC
+        const __m128i ONES = _mm_set1_epi8(1);
+        const __m128i LOW_BITS = _mm_set1_epi8(0x7F);
+        const __m128i ZERO = _mm_setzero_si128();
+
+        for (; k + GROUP_SIZE <= vertexSize; k += GROUP_SIZE)
+        {
+            __m128i rows[GROUP_SIZE];
+            __m128i shuffled[GROUP_SIZE];
+
+            for (int i = 0; i < GROUP_SIZE; ++i)
+                rows[i] = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pColumns + (k + i) * GROUP_SIZE));
+
+            // Four rounds of interleaving the first half of the rows with
+            // the second half transpose the 16x16 bytes.
+
+            for (int round = 0; round < 4; ++round)
+            {
+                for (int i = 0; i < GROUP_SIZE / 2; ++i)
+                {
+                    shuffled[i * 2] = _mm_unpacklo_epi8(rows[i], rows[i + GROUP_SIZE / 2]);
+                    shuffled[i * 2 + 1] = _mm_unpackhi_epi8(rows[i], rows[i + GROUP_SIZE / 2]);
+                }
+
+                memcpy(rows, shuffled, sizeof(rows));
+            }
+
+            __m128i running = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pLast + k));
+            unsigned char *pVertex = pVertices + k;
+
+            for (int i = 0; i < length; ++i, pVertex += vertexSize)
+            {
+                __m128i zigzag = rows[i];
+                __m128i delta = _mm_xor_si128(_mm_and_si128(_mm_srli_epi16(zigzag, 1), LOW_BITS),
+                                              _mm_sub_epi8(ZERO, _mm_and_si128(zigzag, ONES)));
+
+                running = _mm_add_epi8(running, delta);
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(pVertex), running);
+            }
+
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(pLast + k), running);
+        }
+#endif
+
+        for (; k < vertexSize; ++k)
+        {
+            const unsigned char *pColumn = pColumns + k * GROUP_SIZE;
+            unsigned char *pByte = pVertices + k;
+            unsigned char previous = pLast[k];
+
+            for (int i = 0; i < length; ++i, pByte += vertexSize)
+            {
+                previous = static_cast<unsigned char>(previous + UnZigZag(pColumn[i]));
+                *pByte = previous;
+            }
+
+            pLast[k] = previous;
+        }
+    }
+}
+
+void MeshCodec::encodeIndexBuffer(std::vector<unsigned char> &data, const int *pIndices, int indexCount)
+{
+    // The code bytes come first, one per triangle, followed by the explicit
+    // vertices in the order the triangles need them.
+
+    assert(indexCount % 3 == 0);
+
+    int triangleCount = indexCount / 3;
+    IndexCoder coder;
+    std::vector<unsigned char> extra;
+
+    data.clear();
+    data.reserve(triangleCount);
+
+    for (int i = 0; i < triangleCount; ++i)
+    {
+        const unsigned int *pTriangle = reinterpret_cast<const unsigned int *>(pIndices + i * 3);
+        unsigned int a = pTriangle[0];
+        unsigned int b = pTriangle[1];
+        unsigned int c = pTriangle[2];
+
+        // Look for the rotation (x, y, z) of the triangle whose first edge
+        // is the most recent one in the FIFO.
+
+        unsigned int rotated[3][3] = {{a, b, c}, {b, c, a}, {c, a, b}};
+        unsigned int rotation = CODE_NO_EDGE;
+        int edge = EDGE_FIFO_SIZE;
+
+        for (unsigned int r = 0; r < 3; ++r)
+        {
+            int found = coder.findEdge(rotated[r][0], rotated[r][1]);
+
+            if (found != -1 && found < edge)
+            {
+                edge = found;
+                rotation = r;
+            }
+        }
+
+        if (rotation != CODE_NO_EDGE)
+        {
+            unsigned int x = rotated[rotation][0];
+            unsigned int y = rotated[rotation][1];
+            unsigned int z = rotated[rotation][2];
+            unsigned int third = EncodeVertex(extra, coder, z, VERTEX_FIFO_SIZE, 1, THIRD_EXPLICIT);
+
+            data.push_back(static_cast<unsigned char>((rotation << 6) | (edge << 3) | third));
+            coder.pushEdge(z, y);
+            coder.pushEdge(x, z);
+        }
+        else
+        {
+            unsigned int codeA = EncodeVertex(extra, coder, a, 2, VERTEX_RECENT, VERTEX_EXPLICIT);
+            unsigned int codeB = EncodeVertex(extra, coder, b, 2, VERTEX_RECENT, VERTEX_EXPLICIT);
+            unsigned int codeC = EncodeVertex(extra, coder, c, 2, VERTEX_RECENT, VERTEX_EXPLICIT);
+
+            data.push_back(static_cast<unsigned char>((CODE_NO_EDGE << 6) | (codeA << 4) | (codeB << 2) | codeC));
+            coder.pushEdge(b, a);
+            coder.pushEdge(c, b);
+            coder.pushEdge(a, c);
+        }
+    }
+
+    data.insert(data.end(), extra.begin(), extra.end());
+}
+
+bool MeshCodec::decodeIndexBuffer(int *pIndices, int indexCount, const unsigned char *pData, size_t size)
+{
+    if (indexCount < 0 || indexCount % 3 != 0 || size < static_cast<size_t>(indexCount / 3))
+        return false;
+
+    int triangleCount = indexCount / 3;
+    IndexCoder coder;
+    const unsigned char *pCode = pData;
+    const unsigned char *p = pData + triangleCount;
+    const unsigned char *pEnd = pData + size;
+    unsigned int *pTriangle = reinterpret_cast<unsigned int *>(pIndices);
+
+    for (int i = 0; i < triangleCount; ++i, pTriangle += 3)
+    {
+        unsigned int code = pCode[i];
+        unsigned int rotation = code >> 6;
+
+        if (rotation != CODE_NO_EDGE)
+        {
+            const unsigned int *pEdge = coder.getEdge((code >> 3) & 7);
+            unsigned int x = pEdge[0];
+            unsigned int y = pEdge[1];
+            unsigned int z = 0;
+
+            if (!DecodeVertex(p, pEnd, coder, code & 7, 1, THIRD_EXPLICIT, z))
+                return false;
+
+            // Undo the rotation.
+
+            pTriangle[rotation] = x;
+            pTriangle[(rotation + 1) % 3] = y;
+            pTriangle[(rotation + 2) % 3] = z;
+
+            coder.pushEdge(z, y);
+            coder.pushEdge(x, z);
+        }
+        else
+        {
+            unsigned int a = 0;
+            unsigned int b = 0;
+            unsigned int c = 0;
+
+            if (!DecodeVertex(p, pEnd, coder, (code >> 4) & 3, VERTEX_RECENT, VERTEX_EXPLICIT, a) ||
+                !DecodeVertex(p, pEnd, coder, (code >> 2) & 3, VERTEX_RECENT, VERTEX_EXPLICIT, b) ||
+                !DecodeVertex(p, pEnd, coder, code & 3, VERTEX_RECENT, VERTEX_EXPLICIT, c))
+            {
+                return false;
+            }
+
+            pTriangle[0] = a;
+            pTriangle[1] = b;
+            pTriangle[2] = c;
+
+            coder.pushEdge(b, a);
+            coder.pushEdge(c, b);
+            coder.pushEdge(a, c);
+        }
+    }
+
+    return p == pEnd;
+}
+
+void MeshCodec::encodeVertexBuffer(std::vector<unsigned char> &data, const void *pVertices,
+                                   int vertexCount, int vertexSize)
+{
+    // A block starts with one nibble per group and plane giving the group's
+    // entry in GROUP_BITS, two to a byte, followed by the packed groups. Both
+    // are ordered by group and then by plane so that the decoder can finish
+    // 16 whole vertices at a time.
+
+    const unsigned char *pBytes = static_cast<const unsigned char *>(pVertices);
+    std::vector<unsigned char> last(vertexSize, 0);
+    std::vector<unsigned char> planes(static_cast<size_t>(vertexSize) * VERTEX_BLOCK_SIZE);
+
+    data.clear();
+
+    for (int start = 0; start < vertexCount; start += VERTEX_BLOCK_SIZE)
+    {
+        int count = (vertexCount - start < VERTEX_BLOCK_SIZE) ? vertexCount - start : VERTEX_BLOCK_SIZE;
+        int groupCount = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+
+        for (int k = 0; k < vertexSize; ++k)
+        {
+            const unsigned char *pByte = pBytes + static_cast<size_t>(start) * vertexSize + k;
+            unsigned char *pPlane = &planes[static_cast<size_t>(k) * VERTEX_BLOCK_SIZE];
+            unsigned char previous = last[k];
+
+            for (int i = 0; i < count; ++i, pByte += vertexSize)
+            {
+                pPlane[i] = ZigZag(static_cast<unsigned char>(*pByte - previous));
+                previous = *pByte;
+            }
+
+            last[k] = previous;
+            memset(pPlane + count, 0, groupCount * GROUP_SIZE - count);
+        }
+
+        size_t header = data.size();
+        int nibble = 0;
+
+        data.resize(header + (groupCount * vertexSize + 1) / 2, 0);
+
+        for (int g = 0; g < groupCount; ++g)
+        {
+            for (int k = 0; k < vertexSize; ++k, ++nibble)
+            {
+                const unsigned char *pGroup = &planes[static_cast<size_t>(k) * VERTEX_BLOCK_SIZE + g * GROUP_SIZE];
+                unsigned char largest = 0;
+                int mode = 0;
+
+                for (int i = 0; i < GROUP_SIZE; ++i)
+                    largest |= pGroup[i];
+
+                while (largest >> GROUP_BITS[mode])
+                    ++mode;
+
+                data[header + nibble / 2] |= static_cast<unsigned char>(mode << ((nibble & 1) * 4));
+                EncodeGroup(data, pGroup, GROUP_BITS[mode]);
+            }
+        }
+    }
+}
+
+bool MeshCodec::decodeVertexBuffer(void *pVertices, int vertexCount, int vertexSize,
+                                   const unsigned char *pData, size_t size)
+{
+    // The groups of 16 vertices are unpacked into one 16 byte column per
+    // byte of the vertex. The columns are then added up into the vertices,
+    // 16 bytes of each vertex at a time when SIMD is available.
+
+    if (vertexCount < 0 || vertexSize <= 0)
+        return false;
+
+    unsigned char *pBytes = static_cast<unsigned char *>(pVertices);
+    const unsigned char *p = pData;
+    const unsigned char *pEnd = pData + size;
+    std::vector<unsigned char> last(vertexSize, 0);
+    std::vector<unsigned char> columns(static_cast<size_t>(vertexSize) * GROUP_SIZE);
+
+    for (int start = 0; start < vertexCount; start += VERTEX_BLOCK_SIZE)
+    {
+        int count = (vertexCount - start < VERTEX_BLOCK_SIZE) ? vertexCount - start : VERTEX_BLOCK_SIZE;
+        int groupCount = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+        int headerSize = (groupCount * vertexSize + 1) / 2;
+        int nibble = 0;
+
+        if (pEnd - p < headerSize)
+            return false;
+
+        const unsigned char *pHeader = p;
+        p += headerSize;
+
+        for (int g = 0; g < groupCount; ++g)
+        {
+            for (int k = 0; k < vertexSize; ++k, ++nibble)
+            {
+                int mode = (pHeader[nibble / 2] >> ((nibble & 1) * 4)) & 15;
+
+                if (mode > 4)
+                    return false;
+
+                int groupBytes = GROUP_BITS[mode] * GROUP_SIZE / 8;
+
+                if (pEnd - p < groupBytes)
+                    return false;
+
+                DecodeGroup(p, &columns[static_cast<size_t>(k) * GROUP_SIZE], GROUP_BITS[mode]);
+                p += groupBytes;
+            }
+
+            int first = start + g * GROUP_SIZE;
+            int length = (count - g * GROUP_SIZE < GROUP_SIZE) ? count - g * GROUP_SIZE : GROUP_SIZE;
+
+            AccumulateColumns(&columns[0], &last[0], pBytes + static_cast<size_t>(first) * vertexSize,
+                              length, vertexSize);
+        }
+    }
+
+    return p == pEnd;
+}
@@ -0,0 +1,72 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_CODEC_H)
+#define MESH_CODEC_H
+
+#include <cstddef>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Lossless compression of vertex buffers and triangle list index buffers.
+//
+// encodeIndexBuffer() writes one code byte per triangle followed by the
+// indices that can't be predicted. The encoder keeps a FIFO of the 8 most
+// recent edges (reversed, the way a neighboring triangle uses them) and of
+// the 6 most recent vertices, and counts off the vertices in the order they
+// first appear. Most triangles of a vertex cache optimized mesh share an edge
+// with a recent triangle and their third vertex is either the next new vertex
+// or a recent one, so they take a single byte. Triangles keep their order and
+// the order of their vertices, so the decoded index buffer is identical.
+// Running MeshOptimizer::optimizeVertexCache() and optimizeVertexFetch()
+// first gives the best results.
+//
+// encodeVertexBuffer() works on blocks of 256 vertices of any size. Each byte
+// of a vertex is replaced by its difference from the same byte of the
+// previous vertex, and the differences are split into one plane per byte of
+// the vertex. Differences between neighboring vertices are mostly small, so
+// each plane is coded in groups of 16 bytes with 0, 1, 2, 4, or 8 bits per
+// byte, whichever is the smallest that holds every byte in the group.
+//
+// The decoders write straight into the caller's final arrays. They return
+// false if the data is damaged or doesn't hold exactly the number of
+// elements asked for. Decoded indices aren't checked against the number of
+// vertices; that's up to the caller.
+//-----------------------------------------------------------------------------
+
+class MeshCodec
+{
+public:
+    static void encodeIndexBuffer(std::vector<unsigned char> &data, const int *pIndices,
+                                  int indexCount);
+
+    static bool decodeIndexBuffer(int *pIndices, int indexCount,
+                                  const unsigned char *pData, size_t size);
+
+    static void encodeVertexBuffer(std::vector<unsigned char> &data, const void *pVertices,
+                                   int vertexCount, int vertexSize);
+
+    static bool decodeVertexBuffer(void *pVertices, int vertexCount, int vertexSize,
+                                   const unsigned char *pData, size_t size);
+};
+
+#endif
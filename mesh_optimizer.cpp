@@ -0,0 +1,436 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "mesh_optimizer.h"
+
+namespace
+{
+    // Vertex scoring constants from Tom Forsyth's "Linear-Speed Vertex Cache
+    // Optimisation". Forsyth models a 32 entry cache. A 16 entry cache gives
+    // almost the same results on our models and is about twice as fast since
+    // fewer triangles are rescored after every step.
+
+    const int CACHE_SIZE = 16;
+    const int MAX_VALENCE = 32;
+
+    // Vertex fetch cache modeled by calculateFetchedBytesPerTriangle(). This
+    // is roughly the size of a GPU's first level cache.
+
+    const int FETCH_CACHE_LINE_SIZE = 64;
+    const int FETCH_CACHE_LINES = 256;
+
+    const float CACHE_DECAY_POWER = 1.5f;
+    const float LAST_TRIANGLE_SCORE = 0.75f;
+    const float VALENCE_BOOST_SCALE = 2.0f;
+    const float VALENCE_BOOST_POWER = 0.5f;
+
+    struct ScoreTable
+    {
+        float cache[CACHE_SIZE];
+        float valence[MAX_VALENCE + 1];
+    };
+
+    void InitScoreTable(ScoreTable &table)
+    {
+        // Vertices used by the last triangle all get the same score so that
+        // the order the triangle was drawn in doesn't matter. After that the
+        // score decays the further back in the cache the vertex is.
+
+        for (int i = 0; i < CACHE_SIZE; ++i)
+        {
+            if (i < 3)
+            {
+                table.cache[i] = LAST_TRIANGLE_SCORE;
+            }
+            else
+            {
+                float scale = 1.0f / static_cast<float>(CACHE_SIZE - 3);
+                table.cache[i] = powf(1.0f - static_cast<float>(i - 3) * scale, CACHE_DECAY_POWER);
+            }
+        }
+
+        // Vertices with only a few triangles left get a boost so that they're
+        // finished off rather than leaving lone triangles behind.
+
+        table.valence[0] = 0.0f;
+
+        for (int i = 1; i <= MAX_VALENCE; ++i)
+            table.valence[i] = VALENCE_BOOST_SCALE * powf(static_cast<float>(i), -VALENCE_BOOST_POWER);
+    }
+
+    inline float VertexScore(const ScoreTable &table, int cachePosition, int liveTriangles)
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        float score = (cachePosition < 0) ? 0.0f : table.cache[cachePosition];
+        return score + table.valence[(liveTriangles < MAX_VALENCE) ? liveTriangles : MAX_VALENCE];
+    }
+}
+
+float MeshOptimizer::calculateACMR(const int *pIndices, int indexCount, int vertexCount, int cacheSize)
+{
+    int triangleCount = indexCount / 3;
+
+    if (triangleCount == 0)
+        return 0.0f;
+
+    // A vertex is in the FIFO cache if fewer than cacheSize misses have
+    // happened since it was last loaded.
+
+    std::vector<int> loadTime(vertexCount, 0);
+    int time = cacheSize + 1;
+    int misses = 0;
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+    {
+        int vertex = pIndices[i];
+
+        if (time - loadTime[vertex] > cacheSize)
+        {
+            loadTime[vertex] = time++;
+            ++misses;
+        }
+    }
+
+    return static_cast<float>(misses) / static_cast<float>(triangleCount);
+}
+
+float MeshOptimizer::calculateFetchedBytesPerTriangle(const int *pIndices, int indexCount,
+                                                      int vertexCount, int vertexSize)
+{
+    int triangleCount = indexCount / 3;
+
+    if (triangleCount == 0)
+        return 0.0f;
+
+    // Same FIFO model as calculateACMR() but for cache lines rather than
+    // vertices. A vertex can straddle two cache lines.
+
+    long long lineCount = (static_cast<long long>(vertexCount) * vertexSize + FETCH_CACHE_LINE_SIZE - 1) / FETCH_CACHE_LINE_SIZE;
+    std::vector<int> loadTime(static_cast<size_t>(lineCount), 0);
+    int time = FETCH_CACHE_LINES + 1;
+    long long misses = 0;
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+    {
+        long long offset = static_cast<long long>(pIndices[i]) * vertexSize;
+        int firstLine = static_cast<int>(offset / FETCH_CACHE_LINE_SIZE);
+        int lastLine = static_cast<int>((offset + vertexSize - 1) / FETCH_CACHE_LINE_SIZE);
+
+        for (int line = firstLine; line <= lastLine; ++line)
+        {
+            if (time - loadTime[line] > FETCH_CACHE_LINES)
+            {
+                loadTime[line] = time++;
+                ++misses;
+            }
+        }
+    }
+
+    return static_cast<float>(misses * FETCH_CACHE_LINE_SIZE) / static_cast<float>(triangleCount);
+}
+
+void MeshOptimizer::optimizeVertexCache(int *pIndices, int indexCount, int vertexCount)
+{
+    int triangleCount = indexCount / 3;
+
+    if (triangleCount < 2)
+        return;
+
+    ScoreTable table;
+    InitScoreTable(table);
+
+    // The triangles are read from a copy and written back in their new
+    // order.
+
+    std::vector<int> indices(pIndices, pIndices + triangleCount * 3);
+
+    // A mesh that only uses a small part of a shared vertex buffer is first
+    // renumbered to use local vertex indices. Otherwise the per vertex arrays
+    // below would cost as much as the whole vertex buffer for every mesh.
+
+    std::vector<int> vertices;
+
+    if (vertexCount > triangleCount * 3)
+    {
+        vertices = indices;
+        std::sort(vertices.begin(), vertices.end());
+        vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+        for (int i = 0; i < triangleCount * 3; ++i)
+            indices[i] = static_cast<int>(std::lower_bound(vertices.begin(), vertices.end(), indices[i]) - vertices.begin());
+
+        vertexCount = static_cast<int>(vertices.size());
+    }
+
+    // Build the list of triangles that use each vertex. The first
+    // liveTriangles[v] entries of a vertex's list are the triangles that
+    // haven't been emitted yet.
+
+    std::vector<int> liveTriangles(vertexCount, 0);
+    std::vector<int> adjacencyOffsets(vertexCount + 1, 0);
+    std::vector<int> adjacency(triangleCount * 3);
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        ++liveTriangles[indices[i]];
+
+    for (int i = 0; i < vertexCount; ++i)
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveTriangles[i];
+
+    std::vector<int> adjacencyCursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+
+    for (int i = 0; i < triangleCount * 3; ++i)
+        adjacency[adjacencyCursor[indices[i]]++] = i / 3;
+
+    // Score every vertex and triangle and start with the best triangle.
+
+    std::vector<float> vertexScores(vertexCount);
+    std::vector<float> triangleScores(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+
+    for (int i = 0; i < vertexCount; ++i)
+        vertexScores[i] = VertexScore(table, -1, liveTriangles[i]);
+
+    int currentTriangle = 0;
+
+    for (int i = 0; i < triangleCount; ++i)
+    {
+        const int *pTriangle = &indices[i * 3];
+
+        triangleScores[i] = vertexScores[pTriangle[0]] + vertexScores[pTriangle[1]] + vertexScores[pTriangle[2]];
+
+        if (triangleScores[i] > triangleScores[currentTriangle])
+            currentTriangle = i;
+    }
+
+    int cache[CACHE_SIZE + 3];
+    int newCache[CACHE_SIZE + 3];
+    int cacheCount = 0;
+    int nextInputTriangle = 0;
+
+    for (int outputTriangle = 0; ; )
+    {
+        const int *pTriangle = &indices[currentTriangle * 3];
+
+        pIndices[outputTriangle * 3 + 0] = pTriangle[0];
+        pIndices[outputTriangle * 3 + 1] = pTriangle[1];
+        pIndices[outputTriangle * 3 + 2] = pTriangle[2];
+        emitted[currentTriangle] = 1;
+
+        if (++outputTriangle == triangleCount)
+            break;
+
+        // Move the triangle's vertices to the front of the cache. Entries
+        // pushed past CACHE_SIZE are kept until their scores are updated.
+
+        int newCacheCount = 0;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            int vertex = pTriangle[i];
+
+            if (i > 0 && vertex == pTriangle[0])
+                continue;
+
+            if (i > 1 && vertex == pTriangle[1])
+                continue;
+
+            newCache[newCacheCount++] = vertex;
+        }
+
+        for (int i = 0; i < cacheCount; ++i)
+        {
+            int vertex = cache[i];
+
+            if (vertex != pTriangle[0] && vertex != pTriangle[1] && vertex != pTriangle[2])
+                newCache[newCacheCount++] = vertex;
+        }
+
+        // Remove the triangle from the live triangle lists of its vertices.
+
+        for (int i = 0; i < 3; ++i)
+        {
+            int vertex = pTriangle[i];
+            int *pList = &adjacency[adjacencyOffsets[vertex]];
+            int last = --liveTriangles[vertex];
+
+            for (int j = 0; j <= last; ++j)
+            {
+                if (pList[j] == currentTriangle)
+                {
+                    pList[j] = pList[last];
+                    pList[last] = currentTriangle;
+                    break;
+                }
+            }
+        }
+
+        // Rescore the vertices whose cache position changed and pass the
+        // change on to the triangles that still use them. The next triangle
+        // is the best scoring one of those since no other triangle's score
+        // has changed. A triangle using several cached vertices is compared
+        // before all of its updates are in, which is a good enough estimate
+        // and saves a second pass over the cache.
+
+        int bestTriangle = -1;
+        float bestScore = 0.0f;
+
+        for (int i = 0; i < newCacheCount; ++i)
+        {
+            int vertex = newCache[i];
+            float score = VertexScore(table, (i < CACHE_SIZE) ? i : -1, liveTriangles[vertex]);
+            float delta = score - vertexScores[vertex];
+            const int *pList = &adjacency[adjacencyOffsets[vertex]];
+
+            vertexScores[vertex] = score;
+
+            for (int j = 0; j < liveTriangles[vertex]; ++j)
+            {
+                int triangle = pList[j];
+                float triangleScore = triangleScores[triangle] + delta;
+
+                triangleScores[triangle] = triangleScore;
+
+                if (bestTriangle < 0 || triangleScore > bestScore)
+                {
+                    bestTriangle = triangle;
+                    bestScore = triangleScore;
+                }
+            }
+        }
+
+        cacheCount = (newCacheCount < CACHE_SIZE) ? newCacheCount : CACHE_SIZE;
+
+        for (int i = 0; i < cacheCount; ++i)
+            cache[i] = newCache[i];
+
+        // Dead end. None of the cached vertices have any triangles left so
+        // continue with the first remaining triangle in the original order.
+
+        if (bestTriangle < 0)
+        {
+            while (emitted[nextInputTriangle])
+                ++nextInputTriangle;
+
+            bestTriangle = nextInputTriangle;
+        }
+
+        currentTriangle = bestTriangle;
+    }
+
+    if (!vertices.empty())
+    {
+        for (int i = 0; i < triangleCount * 3; ++i)
+            pIndices[i] = vertices[pIndices[i]];
+    }
+}
+
+void MeshOptimizer::generateVertexFetchRemap(const int *pIndices, int indexCount,
+                                             int vertexCount, int *pRemap)
+{
+    // Number the vertices in the order they're first used. Unused vertices
+    // keep their relative order after all the used ones.
+
+    int nextVertex = 0;
+
+    for (int i = 0; i < vertexCount; ++i)
+        pRemap[i] = -1;
+
+    for (int i = 0; i < indexCount; ++i)
+    {
+        int &newIndex = pRemap[pIndices[i]];
+
+        if (newIndex < 0)
+            newIndex = nextVertex++;
+    }
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        if (pRemap[i] < 0)
+            pRemap[i] = nextVertex++;
+    }
+}
+
+void MeshOptimizer::optimizeVertexFetch(int *pIndices, int indexCount, void *pVertices,
+                                        int vertexCount, int vertexSize)
+{
+    if (vertexCount == 0)
+        return;
+
+    std::vector<int> remap(vertexCount);
+
+    generateVertexFetchRemap(pIndices, indexCount, vertexCount, &remap[0]);
+    remapIndexBuffer(pIndices, indexCount, &remap[0]);
+    remapVertexBuffer(pVertices, vertexCount, vertexSize, &remap[0]);
+}
+
+void MeshOptimizer::remapIndexBuffer(int *pIndices, int indexCount, const int *pRemap)
+{
+    for (int i = 0; i < indexCount; ++i)
+        pIndices[i] = pRemap[pIndices[i]];
+}
+
+void MeshOptimizer::remapVertexBuffer(void *pVertices, int vertexCount, int vertexSize,
+                                      const int *pRemap)
+{
+    // Move every vertex to its new position by following the cycles of the
+    // permutation. Each vertex is copied once and only two vertices worth of
+    // temporary storage is needed, plus one bit per vertex to mark the ones
+    // that have already been moved.
+
+    char *pBytes = static_cast<char *>(pVertices);
+    std::vector<bool> moved(vertexCount, false);
+    std::vector<char> carried(vertexSize);
+    std::vector<char> displaced(vertexSize);
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        if (moved[i])
+            continue;
+
+        if (pRemap[i] == i)
+        {
+            moved[i] = true;
+            continue;
+        }
+
+        memcpy(&carried[0], pBytes + static_cast<size_t>(i) * vertexSize, vertexSize);
+
+        for (int j = i; !moved[j]; )
+        {
+            int next = pRemap[j];
+            char *pTarget = pBytes + static_cast<size_t>(next) * vertexSize;
+
+            memcpy(&displaced[0], pTarget, vertexSize);
+            memcpy(pTarget, &carried[0], vertexSize);
+            carried.swap(displaced);
+
+            moved[j] = true;
+            j = next;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_OPTIMIZER_H)
+#define MESH_OPTIMIZER_H
+
+//-----------------------------------------------------------------------------
+// Triangle list optimizations for indexed meshes.
+//
+// All methods work on a single range of a triangle list index buffer. Callers
+// that keep several meshes in one index buffer (e.g., one mesh per material)
+// should optimize each mesh's range on its own so the meshes stay intact.
+//
+// calculateACMR() returns the average cache miss ratio of a triangle list:
+// the number of vertices transformed per triangle when the GPU's post
+// transform vertex cache is modeled as a FIFO of cacheSize entries. The best
+// possible value is around 0.5 and the worst is 3.0.
+//
+// optimizeVertexCache() reorders the triangles in place so that triangles
+// sharing vertices are drawn close to each other. It uses Tom Forsyth's
+// linear-speed vertex cache optimization algorithm and runs in time roughly
+// linear in the number of triangles. The vertices themselves are unchanged.
+//
+// calculateFetchedBytesPerTriangle() returns the number of bytes of vertex
+// data read from memory per triangle when vertices are fetched through a small
+// cache of 64 byte lines. The minimum is the vertex size times the number of
+// vertices per triangle, which is about half a vertex for a regular mesh.
+//
+// optimizeVertexFetch() renumbers the vertices in the order the index buffer
+// first uses them so that vertex fetches walk through memory mostly in order.
+// The vertices are moved in place and the index buffer is rewritten in place.
+// Only one int and one bit per vertex are allocated. Vertices that aren't used
+// by any triangle are moved to the end. Run it after optimizeVertexCache()
+// and on the whole index buffer so that every mesh sees the same vertices.
+//
+// optimizeVertexFetch() is made up of generateVertexFetchRemap(), which
+// builds the table of new vertex numbers, remapIndexBuffer(), and
+// remapVertexBuffer(). Call those directly when more than one vertex stream
+// has to be moved the same way.
+//-----------------------------------------------------------------------------
+
+class MeshOptimizer
+{
+public:
+    static const int DEFAULT_CACHE_SIZE = 16;
+
+    static float calculateACMR(const int *pIndices, int indexCount, int vertexCount,
+                               int cacheSize = DEFAULT_CACHE_SIZE);
+
+    static float calculateFetchedBytesPerTriangle(const int *pIndices, int indexCount,
+                                                  int vertexCount, int vertexSize);
+
+    static void generateVertexFetchRemap(const int *pIndices, int indexCount,
+                                         int vertexCount, int *pRemap);
+
+    static void optimizeVertexCache(int *pIndices, int indexCount, int vertexCount);
+
+    static void optimizeVertexFetch(int *pIndices, int indexCount, void *pVertices,
+                                    int vertexCount, int vertexSize);
+
+    static void remapIndexBuffer(int *pIndices, int indexCount, const int *pRemap);
+
+    static void remapVertexBuffer(void *pVertices, int vertexCount, int vertexSize,
+                                  const int *pRemap);
+};
+
+#endif
@@ -0,0 +1,788 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "mesh_simplifier.h"
+
+namespace
+{
+    // Open edges (borders and seams) get an extra quadric for a plane that
+    // runs through the edge at right angles to its triangle. This keeps the
+    // outline of open edges in place. The constant is its weight relative to
+    // the quadrics of the triangles.
+
+    const double EDGE_WEIGHT = 10.0;
+
+    // A pass only makes collapses that are no worse than the collapse this
+    // far down the sorted list, relative to the number of collapses the pass
+    // needs. Collapses blocked by earlier ones in the same pass would
+    // otherwise let expensive collapses through that a later pass would have
+    // made cheaper.
+
+    const float PASS_ERROR_BOUND = 1.5f;
+
+    enum VertexKind
+    {
+        KIND_MANIFOLD,
+        KIND_BORDER,
+        KIND_SEAM,
+        KIND_LOCKED,
+        KIND_COUNT
+    };
+
+    // Whether a vertex of the first kind may collapse into a neighbor of the
+    // second kind.
+    const bool CAN_COLLAPSE[KIND_COUNT][KIND_COUNT] =
+    {
+        {true,  true,  true,  true },   // manifold
+        {false, true,  false, true },   // border
+        {false, false, true,  false},   // seam
+        {false, false, false, false}    // locked
+    };
+
+    // Whether an edge between vertices of the two kinds has an opposite edge
+    // between the same two positions. Such edges are seen twice.
+    const bool HAS_OPPOSITE[KIND_COUNT][KIND_COUNT] =
+    {
+        {true,  true,  true,  true },
+        {true,  false, true,  false},
+        {true,  true,  true,  true },
+        {true,  false, true,  false}
+    };
+
+    struct Position
+    {
+        float x, y, z;
+    };
+
+    struct Quadric
+    {
+        double a00, a11, a22;
+        double a10, a20, a21;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    struct Collapse
+    {
+        int v0;
+        int v1;
+        bool bidirectional;
+        float error;
+    };
+
+    unsigned int HashPosition(const float *pPosition)
+    {
+        unsigned int bits[3];
+        memcpy(bits, pPosition, sizeof(bits));
+
+        unsigned int h = bits[0] * 0x9e3779b1u;
+
+        h = (h ^ (h >> 15)) + bits[1] * 0x85ebca77u;
+        h = (h ^ (h >> 13)) + bits[2] * 0xc2b2ae3du;
+
+        return h ^ (h >> 16);
+    }
+
+    void AddQuadric(Quadric &q, const Quadric &r)
+    {
+        q.a00 += r.a00; q.a11 += r.a11; q.a22 += r.a22;
+        q.a10 += r.a10; q.a20 += r.a20; q.a21 += r.a21;
+        q.b0 += r.b0; q.b1 += r.b1; q.b2 += r.b2;
+        q.c += r.c;
+        q.weight += r.weight;
+    }
+
+    void AddPlaneQuadric(Quadric &q, double a, double b, double c, double d, double weight)
+    {
+        // Adds weight * (distance to the plane ax + by + cz + d = 0)^2. The
+        // plane normal must be unit length.
+
+        q.a00 += a * a * weight; q.a11 += b * b * weight; q.a22 += c * c * weight;
+        q.a10 += b * a * weight; q.a20 += c * a * weight; q.a21 += c * b * weight;
+        q.b0 += a * d * weight; q.b1 += b * d * weight; q.b2 += c * d * weight;
+        q.c += d * d * weight;
+        q.weight += weight;
+    }
+
+    float QuadricError(const Quadric &q, const Position &p)
+    {
+        // Returns the weighted mean of the squared distances to the planes.
+
+        double x = p.x;
+        double y = p.y;
+        double z = p.z;
+
+        double r = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+                   2.0 * (q.a10 * x * y + q.a20 * x * z + q.a21 * y * z) +
+                   2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+        return (q.weight > 0.0) ? static_cast<float>(fabs(r) / q.weight) : 0.0f;
+    }
+
+    void Cross(const Position &a, const Position &b, const Position &c, double normal[3])
+    {
+        // Unnormalized normal of triangle abc.
+
+        double e1[3] = {b.x - a.x, b.y - a.y, b.z - a.z};
+        double e2[3] = {c.x - a.x, c.y - a.y, c.z - a.z};
+
+        normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+        normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+        normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    }
+
+    void BuildAdjacency(const int *pIndices, int indexCount, const int *pKeys, int keyCount,
+                        std::vector<int> &offsets, std::vector<int> &items, bool edges)
+    {
+        // Compressed sparse row table listing, for every key, either the
+        // outgoing half-edges (the vertex each edge leads to) or the
+        // triangles of the vertices mapped to that key.
+
+        offsets.assign(keyCount + 1, 0);
+        items.resize(indexCount);
+
+        for (int i = 0; i < indexCount; ++i)
+            ++offsets[pKeys[pIndices[i]] + 1];
+
+        for (int i = 0; i < keyCount; ++i)
+            offsets[i + 1] += offsets[i];
+
+        std::vector<int> cursor(offsets.begin(), offsets.end() - 1);
+
+        for (int i = 0; i < indexCount; ++i)
+        {
+            int next = (i % 3 == 2) ? i - 2 : i + 1;
+            items[cursor[pKeys[pIndices[i]]]++] = edges ? pIndices[next] : i / 3;
+        }
+    }
+
+    bool HasEdge(const std::vector<int> &offsets, const std::vector<int> &targets, int a, int b)
+    {
+        for (int i = offsets[a]; i < offsets[a + 1]; ++i)
+        {
+            if (targets[i] == b)
+                return true;
+        }
+
+        return false;
+    }
+
+    class Simplifier
+    {
+    public:
+        Simplifier(const int *pIndices, int indexCount, const Position *pPositions,
+                   int vertexCount, const unsigned char *pLocked);
+
+        float simplify(std::vector<int> &indices, int targetIndexCount, float targetError);
+
+    private:
+        bool canCollapse(int v0, int v1) const;
+        void classifyVertices(const std::vector<int> &indices, const unsigned char *pLocked);
+        void computeQuadrics(const std::vector<int> &indices);
+        bool hasTriangleFlips(const std::vector<int> &indices, int v0, int v1) const;
+        void pickCollapses(const std::vector<int> &indices);
+        void remapLoops(std::vector<int> &loop);
+
+        int m_vertexCount;
+        const Position *m_pPositions;
+
+        std::vector<int> m_remap;       // first vertex with the same position
+        std::vector<int> m_wedge;       // next vertex with the same position
+        std::vector<unsigned char> m_kind;
+        std::vector<int> m_loop;        // vertex the open edge leaving a vertex leads to
+        std::vector<int> m_loopBack;    // vertex the open edge arriving at a vertex comes from
+        std::vector<Quadric> m_quadrics;
+
+        std::vector<Collapse> m_collapses;
+        std::vector<int> m_collapseRemap;
+        std::vector<unsigned char> m_collapseLocked;
+        std::vector<int> m_triangleOffsets;
+        std::vector<int> m_triangles;
+    };
+
+    Simplifier::Simplifier(const int *pIndices, int indexCount, const Position *pPositions,
+                           int vertexCount, const unsigned char *pLocked)
+        : m_vertexCount(vertexCount), m_pPositions(pPositions), m_remap(vertexCount), m_wedge(vertexCount)
+    {
+        MeshSimplifier::generatePositionRemap(&pPositions[0].x, vertexCount,
+            static_cast<int>(sizeof(Position)), &m_remap[0]);
+
+        // Link the vertices that share a position into circular lists.
+
+        for (int i = 0; i < vertexCount; ++i)
+            m_wedge[i] = i;
+
+        for (int i = 0; i < vertexCount; ++i)
+        {
+            int r = m_remap[i];
+
+            if (r != i)
+            {
+                m_wedge[i] = m_wedge[r];
+                m_wedge[r] = i;
+            }
+        }
+
+        std::vector<int> indices(pIndices, pIndices + indexCount);
+
+        classifyVertices(indices, pLocked);
+        computeQuadrics(indices);
+    }
+
+    bool Simplifier::canCollapse(int v0, int v1) const
+    {
+        int k0 = m_kind[v0];
+
+        if (!CAN_COLLAPSE[k0][m_kind[v1]])
+            return false;
+
+        // Border and seam vertices may only move along their open edge.
+
+        if (k0 == KIND_BORDER || k0 == KIND_SEAM)
+        {
+            if (m_loop[v0] != v1 && m_loopBack[v0] != v1)
+                return false;
+        }
+
+        // The twin of a seam vertex has to be able to follow it along the
+        // other side of the seam.
+
+        if (k0 == KIND_SEAM)
+        {
+            int s0 = m_wedge[v0];
+            int s1 = m_wedge[v1];
+
+            if (m_loop[s0] != s1 && m_loopBack[s0] != s1)
+                return false;
+        }
+
+        return true;
+    }
+
+    void Simplifier::classifyVertices(const std::vector<int> &indices, const unsigned char *pLocked)
+    {
+        int indexCount = static_cast<int>(indices.size());
+        std::vector<int> offsets;
+        std::vector<int> targets;
+        std::vector<int> identity(m_vertexCount);
+
+        for (int i = 0; i < m_vertexCount; ++i)
+            identity[i] = i;
+
+        BuildAdjacency(&indices[0], indexCount, &identity[0], m_vertexCount, offsets, targets, true);
+
+        // An edge is open if no triangle uses it in the opposite direction.
+        // Each vertex records the single open edge leaving and arriving at it.
+        // A vertex with more than one refers to itself.
+
+        std::vector<int> openOut(m_vertexCount, -1);
+        std::vector<int> openIn(m_vertexCount, -1);
+
+        for (int v = 0; v < m_vertexCount; ++v)
+        {
+            for (int i = offsets[v]; i < offsets[v + 1]; ++i)
+            {
+                int t = targets[i];
+
+                if (!HasEdge(offsets, targets, t, v))
+                {
+                    openIn[t] = (openIn[t] == -1) ? v : t;
+                    openOut[v] = (openOut[v] == -1) ? t : v;
+                }
+            }
+        }
+
+        m_kind.assign(m_vertexCount, KIND_LOCKED);
+
+        for (int i = 0; i < m_vertexCount; ++i)
+        {
+            if (m_remap[i] != i)
+                continue;
+
+            int w = m_wedge[i];
+
+            if (w == i)
+            {
+                if (openIn[i] == -1 && openOut[i] == -1)
+                    m_kind[i] = KIND_MANIFOLD;
+                else if (openIn[i] != -1 && openIn[i] != i && openOut[i] != -1 && openOut[i] != i)
+                    m_kind[i] = KIND_BORDER;
+            }
+            else if (m_wedge[w] == i)
+            {
+                // Exactly two vertices at this position. It's a seam if each
+                // has one open edge in and out and the two sides of the seam
+                // run between the same positions in opposite directions.
+
+                int inI = openIn[i];
+                int outI = openOut[i];
+                int inW = openIn[w];
+                int outW = openOut[w];
+
+                if (inI != -1 && inI != i && outI != -1 && outI != i &&
+                    inW != -1 && inW != w && outW != -1 && outW != w &&
+                    m_remap[inI] == m_remap[outW] && m_remap[outI] == m_remap[inW])
+                {
+                    m_kind[i] = KIND_SEAM;
+                }
+            }
+        }
+
+        // Every vertex takes the kind of its position. A position is locked
+        // if any of its vertices is.
+
+        if (pLocked)
+        {
+            for (int i = 0; i < m_vertexCount; ++i)
+            {
+                if (pLocked[i])
+                    m_kind[m_remap[i]] = KIND_LOCKED;
+            }
+        }
+
+        for (int i = 0; i < m_vertexCount; ++i)
+            m_kind[i] = m_kind[m_remap[i]];
+
+        m_loop.assign(m_vertexCount, -1);
+        m_loopBack.assign(m_vertexCount, -1);
+
+        for (int i = 0; i < m_vertexCount; ++i)
+        {
+            if (openOut[i] != -1 && openOut[i] != i)
+                m_loop[i] = openOut[i];
+
+            if (openIn[i] != -1 && openIn[i] != i)
+                m_loopBack[i] = openIn[i];
+        }
+    }
+
+    void Simplifier::computeQuadrics(const std::vector<int> &indices)
+    {
+        Quadric zero;
+        memset(&zero, 0, sizeof(zero));
+        m_quadrics.assign(m_vertexCount, zero);
+
+        for (int i = 0; i < static_cast<int>(indices.size()); i += 3)
+        {
+            const Position &p0 = m_pPositions[indices[i + 0]];
+            const Position &p1 = m_pPositions[indices[i + 1]];
+            const Position &p2 = m_pPositions[indices[i + 2]];
+
+            double normal[3];
+            Cross(p0, p1, p2, normal);
+
+            double length = sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+
+            if (length == 0.0)
+                continue;
+
+            double a = normal[0] / length;
+            double b = normal[1] / length;
+            double c = normal[2] / length;
+            double d = -(a * p0.x + b * p0.y + c * p0.z);
+
+            Quadric q;
+            memset(&q, 0, sizeof(q));
+            AddPlaneQuadric(q, a, b, c, d, length * 0.5);
+
+            for (int j = 0; j < 3; ++j)
+                AddQuadric(m_quadrics[m_remap[indices[i + j]]], q);
+
+            // Constrain the open edges of this triangle.
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int v0 = indices[i + j];
+                int v1 = indices[i + (j + 1) % 3];
+
+                if (m_loop[v0] != v1)
+                    continue;
+
+                const Position &e0 = m_pPositions[v0];
+                const Position &e1 = m_pPositions[v1];
+                double edge[3] = {e1.x - e0.x, e1.y - e0.y, e1.z - e0.z};
+                double plane[3] =
+                {
+                    edge[1] * c - edge[2] * b,
+                    edge[2] * a - edge[0] * c,
+                    edge[0] * b - edge[1] * a
+                };
+
+                double edgeLengthSq = edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2];
+                double planeLength = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+
+                if (planeLength == 0.0)
+                    continue;
+
+                plane[0] /= planeLength;
+                plane[1] /= planeLength;
+                plane[2] /= planeLength;
+
+                Quadric edgeQuadric;
+                memset(&edgeQuadric, 0, sizeof(edgeQuadric));
+                AddPlaneQuadric(edgeQuadric, plane[0], plane[1], plane[2],
+                    -(plane[0] * e0.x + plane[1] * e0.y + plane[2] * e0.z),
+                    edgeLengthSq * EDGE_WEIGHT);
+
+                AddQuadric(m_quadrics[m_remap[v0]], edgeQuadric);
+                AddQuadric(m_quadrics[m_remap[v1]], edgeQuadric);
+            }
+        }
+    }
+
+    bool Simplifier::hasTriangleFlips(const std::vector<int> &indices, int v0, int v1) const
+    {
+        // Checks whether moving v0's position to v1's turns any triangle
+        // around v0 over. Triangles that contain both positions disappear.
+
+        int r0 = m_remap[v0];
+        int r1 = m_remap[v1];
+        const Position &target = m_pPositions[v1];
+
+        for (int i = m_triangleOffsets[r0]; i < m_triangleOffsets[r0 + 1]; ++i)
+        {
+            const int *pTriangle = &indices[m_triangles[i] * 3];
+            int corner = -1;
+            bool collapses = false;
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int r = m_remap[pTriangle[j]];
+
+                if (r == r0)
+                    corner = j;
+                else if (r == r1)
+                    collapses = true;
+            }
+
+            if (collapses || corner < 0)
+                continue;
+
+            const Position &a = m_pPositions[pTriangle[corner]];
+            const Position &b = m_pPositions[pTriangle[(corner + 1) % 3]];
+            const Position &c = m_pPositions[pTriangle[(corner + 2) % 3]];
+
+            double before[3];
+            double after[3];
+
+            Cross(a, b, c, before);
+            Cross(target, b, c, after);
+
+            double dot = before[0] * after[0] + before[1] * after[1] + before[2] * after[2];
+            double lengthSq = (before[0] * before[0] + before[1] * before[1] + before[2] * before[2]) *
+                              (after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+
+            if (dot <= 0.25 * sqrt(lengthSq))
+                return true;
+        }
+
+        return false;
+    }
+
+    void Simplifier::pickCollapses(const std::vector<int> &indices)
+    {
+        m_collapses.clear();
+
+        for (int i = 0; i < static_cast<int>(indices.size()); ++i)
+        {
+            int v0 = indices[i];
+            int v1 = indices[(i % 3 == 2) ? i - 2 : i + 1];
+            int k0 = m_kind[v0];
+            int k1 = m_kind[v1];
+
+            // Skip the second copy of edges that are seen twice.
+            if (HAS_OPPOSITE[k0][k1] && m_remap[v1] > m_remap[v0])
+                continue;
+
+            bool forward = canCollapse(v0, v1);
+            bool backward = canCollapse(v1, v0);
+
+            if (!forward && !backward)
+                continue;
+
+            Collapse collapse;
+
+            collapse.v0 = forward ? v0 : v1;
+            collapse.v1 = forward ? v1 : v0;
+            collapse.bidirectional = forward && backward;
+            collapse.error = 0.0f;
+
+            m_collapses.push_back(collapse);
+        }
+
+        // Collapses that can go either way go the cheaper way.
+
+        for (int i = 0; i < static_cast<int>(m_collapses.size()); ++i)
+        {
+            Collapse &collapse = m_collapses[i];
+
+            collapse.error = QuadricError(m_quadrics[m_remap[collapse.v0]], m_pPositions[collapse.v1]);
+
+            if (collapse.bidirectional)
+            {
+                float reverseError = QuadricError(m_quadrics[m_remap[collapse.v1]], m_pPositions[collapse.v0]);
+
+                if (reverseError < collapse.error)
+                {
+                    std::swap(collapse.v0, collapse.v1);
+                    collapse.error = reverseError;
+                }
+            }
+        }
+    }
+
+    void Simplifier::remapLoops(std::vector<int> &loop)
+    {
+        for (int i = 0; i < m_vertexCount; ++i)
+        {
+            if (loop[i] == -1)
+                continue;
+
+            int target = m_collapseRemap[loop[i]];
+
+            // If the vertex the edge led to collapsed into this vertex the
+            // loop continues where that vertex's did.
+            loop[i] = (target == i) ? loop[loop[i]] : target;
+        }
+    }
+
+    struct CompareCollapseErrors
+    {
+        explicit CompareCollapseErrors(const std::vector<Collapse> &collapses) : collapses(collapses)
+        {
+        }
+
+        bool operator()(int a, int b) const
+        {
+            return collapses[a].error < collapses[b].error;
+        }
+
+        const std::vector<Collapse> &collapses;
+    };
+
+    float Simplifier::simplify(std::vector<int> &indices, int targetIndexCount, float targetError)
+    {
+        float errorLimit = targetError * targetError;
+        float resultError = 0.0f;
+        std::vector<int> order;
+
+        while (static_cast<int>(indices.size()) > targetIndexCount)
+        {
+            pickCollapses(indices);
+
+            if (m_collapses.empty())
+                break;
+
+            int collapseCount = static_cast<int>(m_collapses.size());
+
+            order.resize(collapseCount);
+
+            for (int i = 0; i < collapseCount; ++i)
+                order[i] = i;
+
+            std::stable_sort(order.begin(), order.end(), CompareCollapseErrors(m_collapses));
+
+            int triangleGoal = (static_cast<int>(indices.size()) - targetIndexCount) / 3;
+            int boundIndex = static_cast<int>((triangleGoal / 2) * PASS_ERROR_BOUND);
+            float passErrorLimit = m_collapses[order[std::min(boundIndex, collapseCount - 1)]].error;
+
+            if (passErrorLimit > errorLimit)
+                passErrorLimit = errorLimit;
+
+            BuildAdjacency(&indices[0], static_cast<int>(indices.size()), &m_remap[0],
+                m_vertexCount, m_triangleOffsets, m_triangles, false);
+
+            m_collapseRemap.resize(m_vertexCount);
+            m_collapseLocked.assign(m_vertexCount, 0);
+
+            for (int i = 0; i < m_vertexCount; ++i)
+                m_collapseRemap[i] = i;
+
+            int triangleCollapses = 0;
+            int edgeCollapses = 0;
+
+            for (int i = 0; i < collapseCount && triangleCollapses < triangleGoal; ++i)
+            {
+                const Collapse &collapse = m_collapses[order[i]];
+
+                if (collapse.error > passErrorLimit)
+                    break;
+
+                int v0 = collapse.v0;
+                int v1 = collapse.v1;
+                int r0 = m_remap[v0];
+                int r1 = m_remap[v1];
+
+                // Each position takes part in at most one collapse per pass.
+                if (m_collapseLocked[r0] || m_collapseLocked[r1])
+                    continue;
+
+                if (hasTriangleFlips(indices, v0, v1))
+                    continue;
+
+                AddQuadric(m_quadrics[r1], m_quadrics[r0]);
+
+                if (m_kind[v0] == KIND_SEAM)
+                {
+                    m_collapseRemap[v0] = v1;
+                    m_collapseRemap[m_wedge[v0]] = m_wedge[v1];
+                }
+                else
+                {
+                    m_collapseRemap[v0] = v1;
+                }
+
+                m_collapseLocked[r0] = 1;
+                m_collapseLocked[r1] = 1;
+
+                triangleCollapses += (m_kind[v0] == KIND_BORDER) ? 1 : 2;
+                ++edgeCollapses;
+
+                if (collapse.error > resultError)
+                    resultError = collapse.error;
+            }
+
+            if (edgeCollapses == 0)
+                break;
+
+            remapLoops(m_loop);
+            remapLoops(m_loopBack);
+
+            // Drop the triangles that have collapsed to lines or points.
+
+            int writeIndex = 0;
+
+            for (int i = 0; i < static_cast<int>(indices.size()); i += 3)
+            {
+                int a = m_collapseRemap[indices[i + 0]];
+                int b = m_collapseRemap[indices[i + 1]];
+                int c = m_collapseRemap[indices[i + 2]];
+
+                if (m_remap[a] == m_remap[b] || m_remap[b] == m_remap[c] || m_remap[a] == m_remap[c])
+                    continue;
+
+                indices[writeIndex++] = a;
+                indices[writeIndex++] = b;
+                indices[writeIndex++] = c;
+            }
+
+            indices.resize(writeIndex);
+        }
+
+        return sqrtf(resultError);
+    }
+}
+
+void MeshSimplifier::generatePositionRemap(const float *pPositions, int vertexCount,
+                                           int vertexStride, int *pRemap)
+{
+    // Open addressing hash table of vertex indices, at most half full.
+
+    int tableSize = 1;
+
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+
+    std::vector<int> table(tableSize, -1);
+    const char *pBytes = reinterpret_cast<const char *>(pPositions);
+    unsigned int mask = static_cast<unsigned int>(tableSize - 1);
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const float *pPosition = reinterpret_cast<const float *>(pBytes + static_cast<size_t>(i) * vertexStride);
+
+        for (unsigned int slot = HashPosition(pPosition) & mask; ; slot = (slot + 1) & mask)
+        {
+            int j = table[slot];
+
+            if (j < 0)
+            {
+                table[slot] = i;
+                pRemap[i] = i;
+                break;
+            }
+
+            if (memcmp(pBytes + static_cast<size_t>(j) * vertexStride, pPosition, sizeof(float) * 3) == 0)
+            {
+                pRemap[i] = j;
+                break;
+            }
+        }
+    }
+}
+
+int MeshSimplifier::simplify(int *pDestination, const int *pIndices, int indexCount,
+                             const float *pPositions, int vertexStride, int targetIndexCount, float targetError,
+                             const unsigned char *pLockedVertices, float *pResultError)
+{
+    if (pResultError)
+        *pResultError = 0.0f;
+
+    if (targetIndexCount >= indexCount)
+    {
+        if (indexCount > 0)
+            memmove(pDestination, pIndices, indexCount * sizeof(int));
+
+        return indexCount;
+    }
+
+    // Work on a local copy of just the vertices this range uses so that a
+    // small mesh in a large vertex buffer only pays for its own vertices.
+
+    std::vector<int> vertices(pIndices, pIndices + indexCount);
+
+    std::sort(vertices.begin(), vertices.end());
+    vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+
+    int localCount = static_cast<int>(vertices.size());
+    const char *pBytes = reinterpret_cast<const char *>(pPositions);
+    std::vector<Position> positions(localCount);
+    std::vector<unsigned char> locked(localCount, 0);
+    std::vector<int> indices(indexCount);
+
+    for (int i = 0; i < localCount; ++i)
+    {
+        memcpy(&positions[i], pBytes + static_cast<size_t>(vertices[i]) * vertexStride, sizeof(Position));
+
+        if (pLockedVertices)
+            locked[i] = pLockedVertices[vertices[i]];
+    }
+
+    for (int i = 0; i < indexCount; ++i)
+        indices[i] = static_cast<int>(std::lower_bound(vertices.begin(), vertices.end(), pIndices[i]) - vertices.begin());
+
+    Simplifier simplifier(&indices[0], indexCount, &positions[0], localCount, &locked[0]);
+    float error = simplifier.simplify(indices, targetIndexCount, targetError);
+
+    for (int i = 0; i < static_cast<int>(indices.size()); ++i)
+        pDestination[i] = vertices[indices[i]];
+
+    if (pResultError)
+        *pResultError = error;
+
+    return static_cast<int>(indices.size());
+}
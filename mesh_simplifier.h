@@ -0,0 +1,75 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_SIMPLIFIER_H)
+#define MESH_SIMPLIFIER_H
+
+//-----------------------------------------------------------------------------
+// Triangle list simplification using edge collapses ordered by quadric error.
+//
+// simplify() reduces a single range of a triangle list index buffer to about
+// targetIndexCount indices and writes the result to pDestination, which must
+// have room for indexCount indices. It returns the number of indices written.
+// pPositions points to the first vertex's position and vertexStride is the
+// distance in bytes between vertices. The vertices themselves are never
+// changed or moved: an edge collapse always merges one vertex into one of its
+// neighbors, so the simplified triangles refer to a subset of the original
+// vertices and keep their texture coordinates and normals.
+//
+// Each vertex's error is measured with Garland and Heckbert's quadric error
+// metric: the sum of the squared distances to the planes of the triangles
+// around it, weighted by triangle area. Vertices are classified by their
+// neighborhood before any collapses are made:
+//
+//  - Manifold vertices can collapse into any neighbor.
+//  - Border vertices lie on an open edge and may only slide along it.
+//  - Seam vertices have a twin with the same position but different
+//    attributes (e.g., a texture coordinate seam). They may only slide along
+//    the seam, and their twin collapses along the other side of the seam with
+//    them so the seam stays closed.
+//  - Locked vertices never move. Anything that doesn't fit the other kinds is
+//    locked, as is every vertex flagged in pLockedVertices.
+//
+// Vertices are identified by position for the classification and the error
+// quadrics. generatePositionRemap() maps every vertex to the first vertex
+// with a bit identical position and is what simplify() uses to find them.
+//
+// Collapses that would flip a triangle over are rejected. Simplification
+// stops once the target index count is reached, when the next collapse would
+// exceed targetError, or when nothing more can be collapsed. pResultError, if
+// not null, receives the largest error of all collapses made. Errors are
+// distances in the same units as the vertex positions.
+//-----------------------------------------------------------------------------
+
+class MeshSimplifier
+{
+public:
+    static void generatePositionRemap(const float *pPositions, int vertexCount,
+                                      int vertexStride, int *pRemap);
+
+    static int simplify(int *pDestination, const int *pIndices, int indexCount,
+                        const float *pPositions, int vertexStride, int targetIndexCount,
+                        float targetError,
+                        const unsigned char *pLockedVertices, float *pResultError);
+};
+
+#endif
@@ -0,0 +1,262 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "mesh_welder.h"
+#include "parallel.h"
+
+namespace
+{
+    const int SEARCH_BLOCK_SIZE = 4096;
+
+    // The grid never has more than this many cells along an axis, which
+    // keeps the cell coordinates well within the range of an int.
+    const float GRID_RESOLUTION = 1048576.0f;
+
+    inline const float *GetVertex(const char *pBytes, int vertexStride, int vertex)
+    {
+        return reinterpret_cast<const float *>(pBytes + static_cast<size_t>(vertex) * vertexStride);
+    }
+
+    inline void GetCell(const float *pPosition, const float *pMinimum, float scale, int cell[3], int side[3])
+    {
+        // Finds the cell containing a position, and for each axis whether the
+        // position is in the lower (-1) or upper (+1) half of the cell.
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            float c = (pPosition[axis] - pMinimum[axis]) * scale;
+
+            if (!(c >= 0.0f))
+                c = 0.0f;
+            else if (c > GRID_RESOLUTION)
+                c = GRID_RESOLUTION;
+
+            cell[axis] = static_cast<int>(c);
+            side[axis] = (c - static_cast<float>(cell[axis]) < 0.5f) ? -1 : 1;
+        }
+    }
+
+    inline unsigned int HashCell(int x, int y, int z)
+    {
+        return (static_cast<unsigned int>(x) * 73856093u) ^
+               (static_cast<unsigned int>(y) * 19349663u) ^
+               (static_cast<unsigned int>(z) * 83492791u);
+    }
+
+    inline bool Matches(const float *pA, const float *pB, const float *pTolerances, int attributeCount)
+    {
+        // Written so that NaNs never match.
+
+        for (int i = 0; i < attributeCount; ++i)
+        {
+            if (!(fabsf(pA[i] - pB[i]) <= pTolerances[i]))
+                return false;
+        }
+
+        return true;
+    }
+}
+
+int MeshWelder::generateWeldRemap(const float *pVertices, int vertexCount, int vertexStride,
+                                  const float *pTolerances, int attributeCount, int *pRemap)
+{
+    if (vertexCount <= 0)
+        return 0;
+
+    const char *pBytes = reinterpret_cast<const char *>(pVertices);
+
+    // Size the grid cells. They must be at least twice as large as the
+    // position tolerance so that a matching vertex is either in the same cell
+    // or in the neighboring cell on the side of the nearer cell boundary.
+
+    float minimum[3] = {0.0f, 0.0f, 0.0f};
+    float maximum[3] = {0.0f, 0.0f, 0.0f};
+    float cellSize = 0.0f;
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const float *pPosition = GetVertex(pBytes, vertexStride, i);
+
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (i == 0 || pPosition[axis] < minimum[axis])
+                minimum[axis] = pPosition[axis];
+
+            if (i == 0 || pPosition[axis] > maximum[axis])
+                maximum[axis] = pPosition[axis];
+        }
+    }
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (pTolerances[axis] * 2.0f > cellSize)
+            cellSize = pTolerances[axis] * 2.0f;
+
+        if ((maximum[axis] - minimum[axis]) / GRID_RESOLUTION > cellSize)
+            cellSize = (maximum[axis] - minimum[axis]) / GRID_RESOLUTION;
+    }
+
+    if (!(cellSize > 0.0f))
+        cellSize = 1.0f;
+
+    // Bucket the vertices by the hash of their cell. A counting sort keeps
+    // the vertices in each bucket in ascending order.
+
+    int tableSize = 1;
+
+    while (tableSize < vertexCount * 2)
+        tableSize *= 2;
+
+    unsigned int mask = static_cast<unsigned int>(tableSize) - 1;
+    float scale = 1.0f / cellSize;
+    std::vector<unsigned int> buckets(vertexCount);
+    std::vector<int> bucketStarts(tableSize + 1, 0);
+    std::vector<int> bucketVertices(vertexCount);
+    int cell[3];
+    int side[3];
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        GetCell(GetVertex(pBytes, vertexStride, i), minimum, scale, cell, side);
+        buckets[i] = HashCell(cell[0], cell[1], cell[2]) & mask;
+        ++bucketStarts[buckets[i] + 1];
+    }
+
+    for (int i = 0; i < tableSize; ++i)
+        bucketStarts[i + 1] += bucketStarts[i];
+
+    std::vector<int> cursors(bucketStarts.begin(), bucketStarts.end() - 1);
+
+    for (int i = 0; i < vertexCount; ++i)
+        bucketVertices[cursors[buckets[i]]++] = i;
+
+    std::vector<int>().swap(cursors);
+    std::vector<unsigned int>().swap(buckets);
+
+    // Find the first earlier vertex that each vertex matches. Every vertex is
+    // searched for on its own, so this runs in parallel.
+
+    std::vector<int> matches(vertexCount, -1);
+    int blockCount = (vertexCount + SEARCH_BLOCK_SIZE - 1) / SEARCH_BLOCK_SIZE;
+    const float *pMinimum = minimum;
+    const int *pBucketStarts = &bucketStarts[0];
+    const int *pBucketVertices = &bucketVertices[0];
+    int *pMatches = &matches[0];
+
+    Parallel::forEach(blockCount, [pBytes, vertexCount, vertexStride, pTolerances, attributeCount,
+                                   pMinimum, scale, mask, pBucketStarts, pBucketVertices, pMatches](int block)
+    {
+        int first = block * SEARCH_BLOCK_SIZE;
+        int last = (first + SEARCH_BLOCK_SIZE < vertexCount) ? first + SEARCH_BLOCK_SIZE : vertexCount;
+
+        for (int i = first; i < last; ++i)
+        {
+            const float *pVertex = GetVertex(pBytes, vertexStride, i);
+            int cell[3];
+            int side[3];
+            int best = i;
+
+            GetCell(pVertex, pMinimum, scale, cell, side);
+
+            for (int neighbor = 0; neighbor < 8; ++neighbor)
+            {
+                int x = cell[0] + ((neighbor & 1) ? side[0] : 0);
+                int y = cell[1] + ((neighbor & 2) ? side[1] : 0);
+                int z = cell[2] + ((neighbor & 4) ? side[2] : 0);
+                unsigned int bucket = HashCell(x, y, z) & mask;
+
+                for (int k = pBucketStarts[bucket]; k < pBucketStarts[bucket + 1]; ++k)
+                {
+                    int j = pBucketVertices[k];
+
+                    if (j >= best)
+                        break;
+
+                    if (Matches(pVertex, GetVertex(pBytes, vertexStride, j), pTolerances, attributeCount))
+                    {
+                        best = j;
+                        break;
+                    }
+                }
+            }
+
+            pMatches[i] = (best < i) ? best : -1;
+        }
+    });
+
+    // Group the vertices in order. A vertex only joins its match's group if
+    // it also matches the vertex that started the group, so chains of
+    // matches can't drift further than the tolerances.
+
+    std::vector<int> groupStarts;
+    int groupCount = 0;
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        int match = matches[i];
+
+        if (match >= 0)
+        {
+            int group = pRemap[match];
+            const float *pStart = GetVertex(pBytes, vertexStride, groupStarts[group]);
+
+            if (Matches(GetVertex(pBytes, vertexStride, i), pStart, pTolerances, attributeCount))
+            {
+                pRemap[i] = group;
+                continue;
+            }
+        }
+
+        pRemap[i] = groupCount++;
+        groupStarts.push_back(i);
+    }
+
+    return groupCount;
+}
+
+void MeshWelder::compactVertexBuffer(void *pVertices, int vertexCount, int vertexSize,
+                                     const int *pRemap)
+{
+    // New vertex numbers are handed out in increasing order, so the first
+    // vertex with a new number is the one that started its group and its new
+    // position is never after its old one.
+
+    char *pBytes = static_cast<char *>(pVertices);
+    int next = 0;
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        if (pRemap[i] != next)
+            continue;
+
+        if (next != i)
+        {
+            memcpy(pBytes + static_cast<size_t>(next) * vertexSize,
+                   pBytes + static_cast<size_t>(i) * vertexSize, vertexSize);
+        }
+
+        ++next;
+    }
+}
@@ -0,0 +1,66 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MESH_WELDER_H)
+#define MESH_WELDER_H
+
+//-----------------------------------------------------------------------------
+// Merges vertices that are equal within a tolerance.
+//
+// Each vertex is a run of attributeCount floats, the first three of which are
+// its position, with vertexStride bytes from one vertex to the next. Two
+// vertices match if every attribute differs by no more than that attribute's
+// tolerance. A tolerance of zero only matches equal values.
+//
+// generateWeldRemap() fills in a table with one new vertex number for every
+// vertex and returns the number of vertices left. Vertices are visited in
+// order. A vertex joins the group of the first earlier vertex it matches, as
+// long as it also matches the vertex that started that group, and starts a
+// group of its own otherwise. So no vertex moves further than the tolerances
+// allow and the result only depends on the input. Groups are numbered in the
+// order they start, so the vertices keep their relative order.
+//
+// Candidates are found with a uniform grid over the positions whose cells are
+// at least twice as large as the position tolerance, hashed into a table with
+// twice as many slots as there are vertices. A matching vertex can then only
+// be in the same cell or across the nearer cell boundary on each axis, so a
+// vertex only has to look at 8 cells: its own and the 7 on the sides it's
+// closest to. The search takes linear time unless very many vertices lie
+// within the tolerance of each other. The search runs on all available cores.
+// Only the final grouping pass is serial.
+//
+// MeshOptimizer::remapIndexBuffer() and compactVertexBuffer() then apply the
+// table. compactVertexBuffer() keeps the vertex that started each group and
+// moves the vertices in place.
+//-----------------------------------------------------------------------------
+
+class MeshWelder
+{
+public:
+    static int generateWeldRemap(const float *pVertices, int vertexCount, int vertexStride,
+                                 const float *pTolerances, int attributeCount, int *pRemap);
+
+    static void compactVertexBuffer(void *pVertices, int vertexCount, int vertexSize,
+                                    const int *pRemap);
+};
+
+#endif
@@ -0,0 +1,303 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "model_cache.h"
+#include "model_obj.h"
+
+namespace
+{
+    bool ImportModel(ModelOBJ &model, const char *pszFilename)
+    {
+        return model.import(pszFilename);
+    }
+}
+
+ModelCache::ModelCache() : m_pfnPrepare(ImportModel), m_hits(0), m_loads(0)
+{
+}
+
+ModelCache::~ModelCache()
+{
+}
+
+void ModelCache::cancelLoad(const std::string &path, bool isNew)
+{
+    // Ends a load that didn't produce a model. An entry that was only created
+    // for the load is removed again. The caller holds m_mutex.
+
+    Entries::iterator i = m_entries.find(path);
+
+    if (isNew)
+        m_entries.erase(i);
+    else
+        i->second.loading = false;
+}
+
+bool ModelCache::checkDependencies(Dependencies &dependencies, bool rehash)
+{
+    // Returns false if any of the files has been created, deleted, or
+    // changed. Files that have only been touched get their new modification
+    // time so they aren't hashed again next time. With rehash set every file
+    // is hashed.
+
+    for (size_t i = 0; i < dependencies.size(); ++i)
+    {
+        Dependency &dependency = dependencies[i];
+        FileSystem::FileInfo info;
+        bool exists = FileSystem::getFileInfo(dependency.path.c_str(), info);
+
+        if (exists != dependency.exists)
+            return false;
+
+        if (!exists || (!rehash && info.size == dependency.info.size &&
+            info.modificationTime == dependency.info.modificationTime))
+        {
+            continue;
+        }
+
+        unsigned long long hash = 0;
+
+        if (info.size != dependency.info.size || !FileSystem::hashFile(dependency.path.c_str(), hash) ||
+            hash != dependency.hash)
+        {
+            return false;
+        }
+
+        dependency.info = info;
+    }
+
+    return true;
+}
+
+void ModelCache::clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (Entries::iterator i = m_entries.begin(); i != m_entries.end();)
+    {
+        if (i->second.loading)
+            ++i;
+        else
+            m_entries.erase(i++);
+    }
+}
+
+void ModelCache::findDependencies(const ModelOBJ &model, Dependencies &dependencies)
+{
+    dependencies.resize(model.getNumberOfMaterialLibraries());
+
+    for (size_t i = 0; i < dependencies.size(); ++i)
+    {
+        Dependency &dependency = dependencies[i];
+
+        dependency.path = model.getMaterialLibrary(static_cast<int>(i));
+        dependency.hash = 0;
+        dependency.exists = FileSystem::getFileInfo(dependency.path.c_str(), dependency.info) &&
+                            FileSystem::hashFile(dependency.path.c_str(), dependency.hash);
+    }
+}
+
+int ModelCache::getNumberOfHits() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+
+int ModelCache::getNumberOfLoads() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_loads;
+}
+
+int ModelCache::getNumberOfModels() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_entries.size());
+}
+
+ModelCache::Handle ModelCache::load(const char *pszFilename)
+{
+    return loadModel(pszFilename, false);
+}
+
+ModelCache::Handle ModelCache::loadModel(const char *pszFilename, bool rehash)
+{
+    std::string path;
+    FileSystem::FileInfo info;
+
+    if (!FileSystem::getCanonicalPath(pszFilename, path) || !FileSystem::getFileInfo(path.c_str(), info))
+        return Handle();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    unsigned long long hash = 0;
+    bool hashed = false;
+
+    while (true)
+    {
+        Entries::iterator i = m_entries.find(path);
+
+        if (i != m_entries.end() && i->second.loading)
+        {
+            m_loaded.wait(lock);
+            continue;
+        }
+
+        // Only hash the file when it may have changed since it was last
+        // seen. Other threads can use the cache while the file is hashed.
+
+        if (!hashed)
+        {
+            if (!rehash && i != m_entries.end() && i->second.info.size == info.size &&
+                i->second.info.modificationTime == info.modificationTime)
+            {
+                hash = i->second.hash;
+            }
+            else
+            {
+                lock.unlock();
+
+                bool result = FileSystem::hashFile(path.c_str(), hash);
+
+                lock.lock();
+
+                if (!result)
+                    return Handle();
+
+                hashed = true;
+                continue;
+            }
+        }
+
+        if (i != m_entries.end() && i->second.hash == hash)
+        {
+            // The OBJ file hasn't changed, but the model is only reused if
+            // its MTL files haven't either. They're checked without holding
+            // the lock, so start over if the entry changes meanwhile.
+
+            Handle model = i->second.model;
+            Dependencies dependencies(i->second.dependencies);
+
+            lock.unlock();
+
+            bool unchanged = checkDependencies(dependencies, rehash);
+
+            lock.lock();
+            i = m_entries.find(path);
+
+            if (i == m_entries.end() || i->second.loading || i->second.model != model)
+                continue;
+
+            if (unchanged)
+            {
+                i->second.info = info;
+                i->second.dependencies.swap(dependencies);
+                ++m_hits;
+                return model;
+            }
+        }
+
+        break;
+    }
+
+    // Mark the file as being loaded so other threads wait for it rather than
+    // loading it a second time. Earlier handles to the file's old model stay
+    // in the entry until the new model replaces them.
+
+    Entry &entry = m_entries[path];
+    bool isNew = !entry.model;
+    PrepareFunction pfnPrepare = m_pfnPrepare;
+
+    entry.loading = true;
+    lock.unlock();
+
+    std::shared_ptr<ModelOBJ> pModel(new ModelOBJ);
+    Dependencies dependencies;
+    bool prepared = false;
+
+    try
+    {
+        prepared = pfnPrepare(*pModel, pszFilename);
+
+        if (prepared)
+            findDependencies(*pModel, dependencies);
+    }
+    catch (...)
+    {
+        lock.lock();
+        cancelLoad(path, isNew);
+        m_loaded.notify_all();
+        throw;
+    }
+
+    lock.lock();
+
+    if (!prepared)
+    {
+        cancelLoad(path, isNew);
+        m_loaded.notify_all();
+        return Handle();
+    }
+
+    Entries::iterator i = m_entries.find(path);
+
+    i->second.info = info;
+    i->second.hash = hash;
+    i->second.dependencies.swap(dependencies);
+    i->second.model = pModel;
+    i->second.loading = false;
+    ++m_loads;
+
+    m_loaded.notify_all();
+    return pModel;
+}
+
+int ModelCache::purge()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    int count = 0;
+
+    for (Entries::iterator i = m_entries.begin(); i != m_entries.end();)
+    {
+        if (!i->second.loading && i->second.model.use_count() == 1)
+        {
+            m_entries.erase(i++);
+            ++count;
+        }
+        else
+        {
+            ++i;
+        }
+    }
+
+    return count;
+}
+
+ModelCache::Handle ModelCache::reload(const char *pszFilename)
+{
+    return loadModel(pszFilename, true);
+}
+
+void ModelCache::setPrepareFunction(PrepareFunction pfnPrepare)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pfnPrepare = pfnPrepare;
+}
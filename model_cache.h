@@ -0,0 +1,139 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(MODEL_CACHE_H)
+#define MODEL_CACHE_H
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "file_system.h"
+
+class ModelOBJ;
+
+//-----------------------------------------------------------------------------
+// Cache of loaded models so that a file used by several instances is only
+// loaded and held in memory once.
+//
+// Models are keyed by the canonical path of their OBJ file together with a
+// hash of its contents. load() returns a shared handle to a const ModelOBJ,
+// so the geometry can't be changed once it has been handed out. Anything
+// that differs between the instances of a model (transform, tint) belongs
+// with the instance and not with the model.
+//
+// The file is only hashed again when its size or modification time has
+// changed since it was last seen. When the contents really have changed the
+// file is loaded again and later calls to load() get the new model. Handles
+// to the old model stay valid until they're released. The MTL files a model
+// refers to (see ModelOBJ::getMaterialLibrary()) are checked the same way,
+// so editing a material also loads the model again.
+//
+// Modification times are only accurate to the second, so a file that's
+// saved twice within a second without changing size looks unchanged to
+// load(). reload() is load() for a file that's known to have been written,
+// for example by a FileWatcher. It always hashes the OBJ and MTL files and
+// only loads the model again if their contents have really changed.
+// Otherwise it returns the model that's already loaded.
+//
+// The cache holds its own reference to every model. purge() releases the
+// models nobody else is using anymore and clear() releases all of them.
+//
+// By default a model is loaded with ModelOBJ::import(). A different
+// PrepareFunction can be set with setPrepareFunction() to also optimize the
+// model, load it from a cache file, create its textures, and so on. The
+// function is called once for every model that's loaded and returns false if
+// the model couldn't be loaded.
+//
+// All methods may be called from any number of threads at once. Different
+// files are loaded at the same time, so the PrepareFunction must be thread
+// safe. A thread that asks for a file that another thread is already loading
+// waits for that load to finish and then shares its model. Exceptions thrown
+// by the PrepareFunction are passed on to the caller of load().
+//-----------------------------------------------------------------------------
+
+class ModelCache
+{
+public:
+    typedef std::shared_ptr<const ModelOBJ> Handle;
+    typedef bool (*PrepareFunction)(ModelOBJ &model, const char *pszFilename);
+
+    ModelCache();
+    ~ModelCache();
+
+    void clear();
+    Handle load(const char *pszFilename);
+    int purge();
+    Handle reload(const char *pszFilename);
+
+    // Getter methods.
+
+    int getNumberOfHits() const;
+    int getNumberOfLoads() const;
+    int getNumberOfModels() const;
+
+    // Setter methods.
+
+    void setPrepareFunction(PrepareFunction pfnPrepare);
+
+private:
+    struct Dependency
+    {
+        std::string path;
+        FileSystem::FileInfo info;
+        unsigned long long hash;
+        bool exists;
+    };
+
+    typedef std::vector<Dependency> Dependencies;
+
+    struct Entry
+    {
+        FileSystem::FileInfo info;
+        unsigned long long hash;
+        Dependencies dependencies;
+        Handle model;
+        bool loading;
+    };
+
+    typedef std::map<std::string, Entry> Entries;
+
+    ModelCache(const ModelCache &);
+    ModelCache &operator=(const ModelCache &);
+
+    void cancelLoad(const std::string &path, bool isNew);
+    Handle loadModel(const char *pszFilename, bool rehash);
+
+    static bool checkDependencies(Dependencies &dependencies, bool rehash);
+    static void findDependencies(const ModelOBJ &model, Dependencies &dependencies);
+
+    Entries m_entries;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_loaded;
+    PrepareFunction m_pfnPrepare;
+    int m_hits;
+    int m_loads;
+};
+
+#endif
@@ -20,7 +20,7 @@
 // IN THE SOFTWARE.
 //-----------------------------------------------------------------------------
 //
-// The methods bounds(), normalize(), and scale() are based on source code
+// The methods normalize() and scale() are based on source code
 // from http://www.mvps.org/directx/articles/scalemesh9.htm
 //
 // The methods importGeometrySecondPass(), importMaterials(), and addVertex()
@@ -35,435 +35,3889 @@
 // and the model data is loaded into vector containers that are dynamically
 // grown in size.
 //
+// When PERFORM_MEMORY_MAPPED_LOADING is enabled the import() method maps the
+// OBJ file into memory and scans the mapped bytes directly. Numbers are parsed
+// in place by a hand written scanner instead of being extracted one token at a
+// time through a std::istringstream. The scanner produces exactly the same
+// vertex buffer, index buffer, and meshes as the stream based loader. It also
+// accepts negative (relative) OBJ indices. With PERFORM_MEMORY_MAPPED_LOADING
+// disabled the OBJ file is read line by line using a std::ifstream. MTL files
+// are always memory mapped and parsed by the same scanner.
+//
+// When PERFORM_PARALLEL_LOADING is enabled (it requires memory mapped loading)
+// large OBJ files are split into chunks at line boundaries and the chunks are
+// parsed concurrently on all available cores. The chunks are then merged in
+// file order so the imported model is bit-identical to the one produced by the
+// single threaded loader. Parallel loading always counts the file's contents
+// before parsing it regardless of PERFORM_TWO_PASS_LOADING.
+//
 // The OBJ loader will generate vertex normals only if the OBJ file doesn't
 // already contain any vertex normals. You can force the OBJ loader to rebuild
 // all the vertex normals every time the OBJ file is imported by enabling
 // REBUILD_NORMALS_DURING_IMPORT.
 //
+// Vertex normals are generated on all available cores. PERFORM_SIMD_NORMALS
+// computes face normals four triangles at a time using SSE. It's enabled
+// automatically on x86 and x64 and produces exactly the same normals as the
+// scalar code.
+//
+// Tangents are only generated when generateTangents() is called. They follow
+// the MikkTSpace construction: per corner tangents are projected onto the
+// plane of the vertex normal and weighted by the corner's angle. Like
+// MikkTSpace a vertex shared by faces with mirrored texture coordinates is
+// split in two so each side of the mirror seam gets its own bitangent sign.
+//
 //-----------------------------------------------------------------------------
 
 #define PERFORM_TWO_PASS_LOADING        1
+#define PERFORM_MEMORY_MAPPED_LOADING   1
+#define PERFORM_PARALLEL_LOADING        1
 //#define REBUILD_NORMALS_DURING_IMPORT   1
 
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define PERFORM_SIMD_NORMALS            1
+#else
+#define PERFORM_SIMD_NORMALS            0
+#endif
+
+#include <algorithm>
 #include <cassert>
+#include <cfloat>
+#include <climits>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
-#include <limits>
+#include <memory>
 #include <sstream>
 #include <string>
+#include "file_system.h"
+#include "mapped_file.h"
+#include "mesh_codec.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "mesh_welder.h"
 #include "model_obj.h"
+#include "parallel.h"
+#include "vertex_quantizer.h"
+#include "vertex_streams.h"
 
-int ModelOBJ::m_faceIndexCache[FACE_INDEX_CACHE_SIZE];
+#if PERFORM_SIMD_NORMALS
+#include <xmmintrin.h>
+#endif
 
-ModelOBJ::ModelOBJ()
+namespace
 {
-    m_hasTextureCoords = false;
-    m_hasVertexNormals = false;
+    typedef std::vector<float, LinearAllocatorAdapter<float> > ImportFloatArray;
+    typedef std::vector<int, LinearAllocatorAdapter<int> > ImportIntArray;
 
-    m_numberOfVertexCoords = 0;
-    m_numberOfTextureCoords = 0;
-    m_numberOfNormals = 0;
-    m_numberOfFaces = 0;
-}
+    const double POWERS_OF_TEN[] =
+    {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
 
-ModelOBJ::~ModelOBJ()
-{
-}
+    inline bool IsBlank(char ch)
+    {
+        // Whitespace within a single line.
+        return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\f';
+    }
 
-void ModelOBJ::bounds(float center[3], float &radius) const
-{
-    center[0] = 0.0f;
-    center[1] = 0.0f;
-    center[2] = 0.0f;
+    inline bool IsDigit(char ch)
+    {
+        return static_cast<unsigned>(ch - '0') < 10;
+    }
+
+    inline const char *SkipBlanks(const char *p, const char *pEnd)
+    {
+        while (p < pEnd && IsBlank(*p))
+            ++p;
+
+        return p;
+    }
+
+    inline const char *SkipToken(const char *p, const char *pEnd)
+    {
+        while (p < pEnd && *p != '\n' && !IsBlank(*p))
+            ++p;
 
-    int numVerts = static_cast<int>(m_vertexBuffer.size());
+        return p;
+    }
 
-    // Calculate the center of the bounding sphere.
-    // Done by averaging the vertex coordinates.
+    inline const char *SkipLine(const char *p, const char *pEnd)
+    {
+        const char *pNewLine = static_cast<const char *>(memchr(p, '\n', pEnd - p));
+        return pNewLine ? pNewLine + 1 : pEnd;
+    }
 
-    for (int i = 0; i < numVerts; ++i)
+    inline bool TokenEquals(const char *pToken, const char *pTokenEnd, const char *pszText)
     {
-        center[0] += m_vertexBuffer[i].position[0];
-        center[1] += m_vertexBuffer[i].position[1];
-        center[2] += m_vertexBuffer[i].position[2];
+        size_t length = strlen(pszText);
+        return static_cast<size_t>(pTokenEnd - pToken) == length && memcmp(pToken, pszText, length) == 0;
     }
 
-    center[0] /= static_cast<float>(numVerts);
-    center[1] /= static_cast<float>(numVerts);
-    center[2] /= static_cast<float>(numVerts);
+    void TwoProduct(double a, double b, double &product, double &error)
+    {
+        // Dekker's algorithm. The exact product a * b is product + error.
 
-    // Calculate the radius. This is the max distance from the center.
+        const double SPLITTER = 134217729.0; // 2^27 + 1
 
-    radius = 0.0f;
+        product = a * b;
 
-    const float *pPos = 0;
-    float distanceSq = 0.0f;
+        double t = SPLITTER * a;
+        double aHi = t - (t - a);
+        double aLo = a - aHi;
 
-    for (int i = 0; i < numVerts; ++i)
-    {
-        pPos = m_vertexBuffer[i].position;
-        distanceSq = (pPos[0] * pPos[0]) + (pPos[1] * pPos[1]) + (pPos[2] * pPos[2]);
+        t = SPLITTER * b;
+        double bHi = t - (t - b);
+        double bLo = b - bHi;
 
-        if (distanceSq > radius)
-            radius = distanceSq;
+        error = ((aHi * bHi - product) + aHi * bLo + aLo * bHi) + aLo * bLo;
     }
 
-    radius = sqrtf(radius);
-}
+    float ParseFloatSlow(const char *pBegin, const char *pEnd)
+    {
+        // Fallback for numbers the fast path can't convert exactly. This
+        // includes very long mantissas, huge exponents, infinities, and NaNs.
 
-void ModelOBJ::bounds(float center[3], float &width, float &height, float &length) const
-{
-    float xMax = std::numeric_limits<float>::min();
-    float yMax = std::numeric_limits<float>::min();
-    float zMax = std::numeric_limits<float>::min();
+        char szBuffer[128];
+        size_t length = pEnd - pBegin;
 
-    float xMin = std::numeric_limits<float>::max();
-    float yMin = std::numeric_limits<float>::max();
-    float zMin = std::numeric_limits<float>::max();
+        if (length >= sizeof(szBuffer))
+            length = sizeof(szBuffer) - 1;
 
-    float x = 0.0f;
-    float y = 0.0f;
-    float z = 0.0f;
+        memcpy(szBuffer, pBegin, length);
+        szBuffer[length] = '\0';
 
-    int numVerts = static_cast<int>(m_vertexBuffer.size());
+#if defined(_MSC_VER) && _MSC_VER < 1800
+        return static_cast<float>(strtod(szBuffer, 0));
+#else
+        return strtof(szBuffer, 0);
+#endif
+    }
 
-    for (int i = 0; i < numVerts; ++i)
+    const char *ParseFloat(const char *p, const char *pEnd, float &value)
     {
-        x = m_vertexBuffer[i].position[0];
-        y = m_vertexBuffer[i].position[1];
-        z = m_vertexBuffer[i].position[2];
+        // Parses a decimal floating point number starting at p. Returns a
+        // pointer to the first character following the number, or 0 if there
+        // is no number at p.
+        //
+        // Numbers with at most 19 significant digits and a small decimal
+        // exponent are converted using a double precision multiply or divide
+        // by an exact power of ten. The result is correctly rounded to double
+        // precision. Rounding that double to float is correct unless the
+        // double landed exactly halfway between two floats. In that rare case
+        // the exact residual tells which way the true value lies.
+
+        const char *pStart = p = SkipBlanks(p, pEnd);
+        bool negative = false;
+
+        if (p < pEnd && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
+
+        unsigned long long mantissa = 0;
+        int significantDigits = 0;
+        int exponent = 0;
+        bool hasDigits = false;
+        bool truncated = false;
+
+        for (; p < pEnd && IsDigit(*p); ++p)
+        {
+            hasDigits = true;
 
-        if (x < xMin)
-            xMin = x;
+            if (significantDigits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
 
-        if (x > xMax)
-            xMax = x;
+                if (mantissa)
+                    ++significantDigits;
+            }
+            else
+            {
+                ++exponent;
+                truncated = truncated || *p != '0';
+            }
+        }
 
-        if (y < yMin)
-            yMin = y;
+        if (p < pEnd && *p == '.')
+        {
+            for (++p; p < pEnd && IsDigit(*p); ++p)
+            {
+                hasDigits = true;
 
-        if (y > yMax)
-            yMax = y;
+                if (significantDigits < 19)
+                {
+                    mantissa = mantissa * 10 + (*p - '0');
+                    --exponent;
 
-        if (z < zMin)
-            zMin = z;
+                    if (mantissa)
+                        ++significantDigits;
+                }
+                else
+                {
+                    truncated = truncated || *p != '0';
+                }
+            }
+        }
 
-        if (z > zMax)
-            zMax = z;
-    }
+        if (!hasDigits)
+        {
+            // Possibly "inf" or "nan". Let the C runtime decide.
 
-    center[0] = (xMin + xMax) / 2.0f;
-    center[1] = (yMin + yMax) / 2.0f;
-    center[2] = (zMin + zMax) / 2.0f;
+            const char *pTokenEnd = SkipToken(pStart, pEnd);
 
-    width = xMax - xMin;
-    height = yMax - yMin;
-    length = zMax - zMin;
-}
+            if (pTokenEnd == pStart)
+                return 0;
 
-bool ModelOBJ::import(const char *pszFilename)
-{
-    std::ifstream stream(pszFilename);
+            char *pParseEnd = 0;
+            char szBuffer[32];
+            size_t length = pTokenEnd - pStart;
 
-    if (!stream.is_open())
-        return false;
+            if (length >= sizeof(szBuffer))
+                length = sizeof(szBuffer) - 1;
 
-    // Extract the directory the OBJ file is in from the file name.
-    // This directory path will be used to load the OBJ's associated MTL file.
+            memcpy(szBuffer, pStart, length);
+            szBuffer[length] = '\0';
+            value = static_cast<float>(strtod(szBuffer, &pParseEnd));
 
-    m_directoryPath.clear();
+            if (pParseEnd == szBuffer)
+                return 0;
 
-    std::string filename = pszFilename;
-    std::string::size_type offset = filename.find_last_of('\\');
+            return pStart + (pParseEnd - szBuffer);
+        }
 
-    if (offset != std::string::npos)
-    {
-        m_directoryPath = filename.substr(0, ++offset);
-    }
-    else
-    {
-        offset = filename.find_last_of('/');
+        if (p < pEnd && (*p == 'e' || *p == 'E'))
+        {
+            const char *pExponent = p + 1;
+            bool negativeExponent = false;
+            int explicitExponent = 0;
 
-        if (offset != std::string::npos)
-            m_directoryPath = filename.substr(0, ++offset);
-    }
+            if (pExponent < pEnd && (*pExponent == '-' || *pExponent == '+'))
+                negativeExponent = (*pExponent++ == '-');
 
-    // Import the geometry and materials.
-    // This is done with either two passes or a single pass. Two pass loading
-    // goes through the file once to determine the amount of memory required.
-    // Single pass loading relies on the STL vector and map classes dynamically
-    // growing itself as more elements are added.
+            if (pExponent < pEnd && IsDigit(*pExponent))
+            {
+                for (p = pExponent; p < pEnd && IsDigit(*p); ++p)
+                {
+                    if (explicitExponent < 100000)
+                        explicitExponent = explicitExponent * 10 + (*p - '0');
+                }
 
-#if PERFORM_TWO_PASS_LOADING
-    importGeometryFirstPass(stream);
-    importGeometrySecondPass(stream);
-#else
-    importGeometrySecondPass(stream);
-#endif
+                exponent += negativeExponent ? -explicitExponent : explicitExponent;
+            }
+        }
 
-    buildMeshes();
-    bounds(m_center, m_width, m_height, m_length);
+        if (mantissa == 0)
+        {
+            value = negative ? -0.0f : 0.0f;
+            return p;
+        }
 
-#if REBUILD_NORMALS_DURING_IMPORT
-    generateNormals();
-#else
-    if (!hasVertexNormals())
-        generateNormals();
-#endif
+        if (truncated || mantissa > (1ULL << 53) || exponent < -22 || exponent > 22)
+        {
+            value = ParseFloatSlow(pStart, p);
+            return p;
+        }
 
-    return true;
-}
+        double m = static_cast<double>(mantissa);
+        double scale = POWERS_OF_TEN[exponent < 0 ? -exponent : exponent];
+        double d = (exponent < 0) ? m / scale : m * scale;
 
-void ModelOBJ::normalize(float scaleTo, bool center)
-{
-    float radius;
-    float centerPos[3];
+        if (d < FLT_MIN || d > FLT_MAX)
+        {
+            value = ParseFloatSlow(pStart, p);
+            return p;
+        }
 
-    bounds(centerPos, radius);
+        float f = static_cast<float>(d);
 
-    float scalingFactor = scaleTo / radius;
-    float offset[3];
+        // A float has 29 fewer mantissa bits than a double. The double is a
+        // halfway point between two floats when the 29 dropped bits are
+        // exactly 1 followed by 28 zeros.
 
-    if (center)
-    {
-        offset[0] = -centerPos[0];
-        offset[1] = -centerPos[1];
-        offset[2] = -centerPos[2];
-    }
-    else
-    {
-        offset[0] = 0.0f;
-        offset[1] = 0.0f;
-        offset[2] = 0.0f;
-    }
+        unsigned long long bits;
+        memcpy(&bits, &d, sizeof(bits));
 
-    scale(scalingFactor, offset);
-    bounds(m_center, m_width, m_height, m_length);
-}
+        if ((bits & 0x1FFFFFFFULL) == 0x10000000ULL)
+        {
+            double product = 0.0;
+            double error = 0.0;
+            double residual = 0.0;
 
-void ModelOBJ::reverseWinding()
-{
-    int swap = 0;
+            if (exponent < 0)
+            {
+                // d * scale versus mantissa.
+                TwoProduct(d, scale, product, error);
+                residual = -((product - m) + error);
+            }
+            else
+            {
+                // mantissa * scale versus d.
+                TwoProduct(m, scale, product, error);
+                residual = (product - d) + error;
+            }
 
-    // Reverse face winding.
-    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); i += 3)
-    {
-        swap = m_indexBuffer[i + 1];
-        m_indexBuffer[i + 1] = m_indexBuffer[i + 2];
-        m_indexBuffer[i + 2] = swap;
-    }
+            if (residual != 0.0)
+            {
+                unsigned int floatBits;
+                memcpy(&floatBits, &f, sizeof(floatBits));
 
-    float *pNormal = 0;
+                if (residual > 0.0 && static_cast<double>(f) < d)
+                    ++floatBits;
+                else if (residual < 0.0 && static_cast<double>(f) > d)
+                    --floatBits;
 
-    // Invert normals.
-    for (int i = 0; i < static_cast<int>(m_vertexBuffer.size()); ++i)
-    {
-        pNormal = m_vertexBuffer[i].normal;
-        pNormal[0] = -pNormal[0];
-        pNormal[1] = -pNormal[1];
-        pNormal[2] = -pNormal[2];
-    }
-}
+                memcpy(&f, &floatBits, sizeof(f));
+            }
+        }
 
-void ModelOBJ::scale(float scaleFactor, float offset[3])
-{
-    float *pPosition = 0;
+        value = negative ? -f : f;
+        return p;
+    }
 
-    for (int i = 0; i < static_cast<int>(m_vertexBuffer.size()); ++i)
+    const char *ParseInt(const char *p, const char *pEnd, int &value)
     {
-        pPosition = m_vertexBuffer[i].position;
+        // Parses a decimal integer starting at p. Returns a pointer to the
+        // first character following the integer, or 0 if there is no integer
+        // at p.
 
-        pPosition[0] += offset[0];
-        pPosition[1] += offset[1];
-        pPosition[2] += offset[2];
+        p = SkipBlanks(p, pEnd);
 
-        pPosition[0] *= scaleFactor;
-        pPosition[1] *= scaleFactor;
-        pPosition[2] *= scaleFactor;
-    }
-}
+        bool negative = false;
 
-void ModelOBJ::addVertex(int hash, const Vertex *pVertex)
-{
-    std::map<int, std::vector<int> >::const_iterator iter = m_vertexCache.find(hash);
+        if (p < pEnd && (*p == '-' || *p == '+'))
+            negative = (*p++ == '-');
 
-    if (iter == m_vertexCache.end())
-    {
-        // Vertex hash doesn't exist in the cache.
+        if (p == pEnd || !IsDigit(*p))
+            return 0;
 
-        int index = static_cast<int>(m_vertexBuffer.size());
+        int result = 0;
 
-        m_vertexBuffer.push_back(*pVertex);
-        m_vertexCache.insert(std::make_pair(hash, std::vector<int>(1, index)));
+        for (; p < pEnd && IsDigit(*p); ++p)
+            result = result * 10 + (*p - '0');
 
-        m_indexBuffer.push_back(index);
+        value = negative ? -result : result;
+        return p;
     }
-    else
+
+    const char *ParseColor(const char *p, const char *pEnd, float color[4])
     {
-        // One or more vertices have been hashed to this entry in the cache.
+        // Parses an MTL color. The green and blue components are optional and
+        // default to red. Returns 0 and leaves the color alone if there is no
+        // number at p, as with "Kd spectral file.rfl".
 
-        const std::vector<int> &vertices = iter->second;
-        const Vertex *pCachedVertex = 0;
-        int index = 0;
-        bool found = false;
+        float rgb[3];
+        int count = 0;
+        const char *pNext = 0;
 
-        for (std::vector<int>::const_iterator i = vertices.begin(); i != vertices.end(); ++i)
-        {
-            index = *i;
-            pCachedVertex = &m_vertexBuffer[index];
+        for (; count < 3 && (pNext = ParseFloat(p, pEnd, rgb[count])) != 0; ++count)
+            p = pNext;
 
-            if (memcmp(pCachedVertex, pVertex, sizeof(Vertex)) == 0)
-            {
-                found = true;
-                break;
-            }
-        }
+        if (count == 0)
+            return 0;
 
-        if (!found)
-        {
-            index = static_cast<int>(m_vertexBuffer.size());
-            m_vertexBuffer.push_back(*pVertex);
-            m_vertexCache[hash].push_back(index);
-        }
+        for (int i = 0; i < 3; ++i)
+            color[i] = rgb[i < count ? i : 0];
 
-        m_indexBuffer.push_back(index);
+        color[3] = 1.0f;
+        return p;
     }
-}
-
-void ModelOBJ::buildMeshes()
-{
-    // Group the OBJ file triangles based on material type.
 
-    Mesh *pMesh = 0;
-    int materialId = -1;
+    const int MISSING_INDEX = INT_MIN;
 
-    for (int i = 0; i < static_cast<int>(m_attributeBuffer.size()); ++i)
+    const char *ParseFaceVertex(const char *p, const char *pEnd,
+                                int &posIndex, int &texCoordIndex, int &normalIndex)
     {
-        if (m_attributeBuffer[i] != materialId)
-        {
-            materialId = m_attributeBuffer[i];
+        // Parses one "v", "v/vt", "v//vn", or "v/vt/vn" face vertex. The
+        // indices are returned as they appear in the file. Indices that are
+        // not present are set to MISSING_INDEX. Returns a pointer to the first
+        // character following the face vertex, or 0 if there is none at p.
 
-            m_meshes.push_back(Mesh());
-            pMesh = &m_meshes[m_meshes.size() - 1];
-            pMesh->materialIndex = materialId;
-            pMesh->startIndex = i * 3;
-            ++pMesh->triangleCount;
-        }
-        else
+        if ((p = ParseInt(p, pEnd, posIndex)) == 0)
+            return 0;
+
+        const char *pNext = 0;
+
+        texCoordIndex = MISSING_INDEX;
+        normalIndex = MISSING_INDEX;
+
+        if (p < pEnd && *p == '/')
         {
-            ++pMesh->triangleCount;
-        }
-    }
-}
+            ++p;
 
-void ModelOBJ::generateNormals()
-{
-    const int *pTriangle = 0;
-    Vertex *pVertex0 = 0;
-    Vertex *pVertex1 = 0;
-    Vertex *pVertex2 = 0;
-    float edge1[3] = {0.0f};
-    float edge2[3] = {0.0f};
-    float normal[3] = {0.0f};
-    float length = 0.0f;
-    int totalVertices = getNumberOfVertices();
-    int totalTriangles = getNumberOfTriangles();
+            if (p < pEnd && *p != '/' && (pNext = ParseInt(p, pEnd, texCoordIndex)) != 0)
+                p = pNext;
 
-    // Initialize all the vertex normals.
-    for (int i = 0; i < totalVertices; ++i)
-    {
-        pVertex0 = &m_vertexBuffer[i];
-        pVertex0->normal[0] = 0.0f;
-        pVertex0->normal[1] = 0.0f;
-        pVertex0->normal[2] = 0.0f;
+            if (p < pEnd && *p == '/')
+            {
+                ++p;
+
+                if ((pNext = ParseInt(p, pEnd, normalIndex)) != 0)
+                    p = pNext;
+            }
+        }
+
+        return p;
     }
 
-    // Calculate the vertex normals.
-    for (int i = 0; i < totalTriangles; ++i)
+    inline bool ResolveIndex(int &index, int count)
     {
-        pTriangle = &m_indexBuffer[i * 3];
+        // Converts a negative (relative) OBJ index into an absolute one based
+        // on the number of elements read so far. Returns false if the index
+        // refers to an element that doesn't exist yet.
 
-        pVertex0 = &m_vertexBuffer[pTriangle[0]];
-        pVertex1 = &m_vertexBuffer[pTriangle[1]];
-        pVertex2 = &m_vertexBuffer[pTriangle[2]];
+        if (index < 0)
+            index += count + 1;
 
-        // Calculate triangle face normal.
+        return index >= 1 && index <= count;
+    }
 
-        edge1[0] = pVertex1->position[0] - pVertex0->position[0];
-        edge1[1] = pVertex1->position[1] - pVertex0->position[1];
-        edge1[2] = pVertex1->position[2] - pVertex0->position[2];
+    struct ImportCommand
+    {
+        int faceIndex;
+        bool isMaterialLibrary;
+        std::string name;
+    };
 
-        edge2[0] = pVertex2->position[0] - pVertex0->position[0];
-        edge2[1] = pVertex2->position[1] - pVertex0->position[1];
-        edge2[2] = pVertex2->position[2] - pVertex0->position[2];
+    struct ImportChunk
+    {
+        // A newline aligned slice of a memory mapped OBJ file.
+
+        explicit ImportChunk(const LinearAllocatorAdapter<int> &allocator)
+            : pBegin(0), pEnd(0), numVertexCoords(0), numTextureCoords(0),
+              numNormals(0), numFaceVertices(0), numTriangles(0),
+              vertexCoordBase(0), textureCoordBase(0), normalBase(0),
+              faceVertices(allocator), verticesPerFace(allocator), failed(false) {}
+
+        const char *pBegin;
+        const char *pEnd;
+
+        int numVertexCoords;
+        int numTextureCoords;
+        int numNormals;
+        int numFaceVertices;
+        int numTriangles;
+
+        int vertexCoordBase;
+        int textureCoordBase;
+        int normalBase;
+
+        // Three zero based (position, texture coordinate, normal) indices per
+        // face vertex. Texture coordinate and normal indices are -1 when the
+        // face vertex doesn't have them.
+        ImportIntArray faceVertices;
+        ImportIntArray verticesPerFace;
+
+        // mtllib and usemtl commands in the order they appear in the chunk.
+        // Each command applies to the faces starting at faceIndex.
+        std::vector<ImportCommand> commands;
+
+        bool failed;
+    };
 
-        normal[0] = (edge1[1] * edge2[2]) - (edge1[2] * edge2[1]);
-        normal[1] = (edge1[2] * edge2[0]) - (edge1[0] * edge2[2]);
-        normal[2] = (edge1[0] * edge2[1]) - (edge1[1] * edge2[0]);
+    void CountChunk(ImportChunk &chunk)
+    {
+        // Counts the coordinates, face vertices, and triangles in a chunk. The
+        // coordinate counts give each chunk its base offsets into the model
+        // wide coordinate arrays, so the lines must be classified exactly the
+        // same way ParseChunk() classifies them.
+
+        const char *p = chunk.pBegin;
+        const char *pEnd = chunk.pEnd;
+        const char *pCommand = 0;
+        const char *pCommandEnd = 0;
+        int verticesPerFace = 0;
+
+        chunk.numVertexCoords = 0;
+        chunk.numTextureCoords = 0;
+        chunk.numNormals = 0;
+        chunk.numFaceVertices = 0;
+        chunk.numTriangles = 0;
+
+        for (; p < pEnd; p = SkipLine(p, pEnd))
+        {
+            pCommand = SkipBlanks(p, pEnd);
+            pCommandEnd = SkipToken(pCommand, pEnd);
+            p = pCommandEnd;
 
-        // Accumulate the normals.
+            if (pCommandEnd - pCommand == 1)
+            {
+                if (*pCommand == 'v')
+                {
+                    ++chunk.numVertexCoords;
+                }
+                else if (*pCommand == 'f')
+                {
+                    verticesPerFace = 0;
 
-        pVertex0->normal[0] += normal[0];
-        pVertex0->normal[1] += normal[1];
-        pVertex0->normal[2] += normal[2];
+                    for (p = SkipBlanks(p, pEnd); p < pEnd && *p != '\n'; p = SkipBlanks(p, pEnd))
+                    {
+                        p = SkipToken(p, pEnd);
+                        ++verticesPerFace;
+                    }
 
-        pVertex1->normal[0] += normal[0];
-        pVertex1->normal[1] += normal[1];
-        pVertex1->normal[2] += normal[2];
+                    chunk.numFaceVertices += verticesPerFace;
 
-        pVertex2->normal[0] += normal[0];
-        pVertex2->normal[1] += normal[1];
-        pVertex2->normal[2] += normal[2];
+                    if (verticesPerFace > 2)
+                        chunk.numTriangles += verticesPerFace - 2;
+                }
+            }
+            else if (TokenEquals(pCommand, pCommandEnd, "vt"))
+            {
+                ++chunk.numTextureCoords;
+            }
+            else if (TokenEquals(pCommand, pCommandEnd, "vn"))
+            {
+                ++chunk.numNormals;
+            }
+        }
     }
 
-    // Normalize the vertex normals.
-    for (int i = 0; i < totalVertices; ++i)
+    void ParseChunk(ImportChunk &chunk, float *pVertexCoords, float *pTextureCoords, float *pNormals)
     {
-        pVertex0 = &m_vertexBuffer[i];
+        // Parses a chunk's coordinates straight into the model wide coordinate
+        // arrays at the chunk's base offsets. Faces are stored as resolved zero
+        // based indices because the coordinates they refer to may belong to a
+        // chunk that is still being parsed by another thread.
+
+        const char *p = chunk.pBegin;
+        const char *pEnd = chunk.pEnd;
+        const char *pCommand = 0;
+        const char *pCommandEnd = 0;
+        const char *pNext = 0;
+        float *pVertexCoord = pVertexCoords + chunk.vertexCoordBase * 3;
+        float *pTextureCoord = pTextureCoords + chunk.textureCoordBase * 2;
+        float *pNormal = pNormals + chunk.normalBase * 3;
+        int numVertexCoords = chunk.vertexCoordBase;
+        int numTextureCoords = chunk.textureCoordBase;
+        int numNormals = chunk.normalBase;
+        int posIndex = 0;
+        int texCoordIndex = 0;
+        int normalIndex = 0;
+        int verticesPerFace = 0;
+        ImportCommand command;
+
+        chunk.faceVertices.reserve(chunk.numFaceVertices * 3);
+        chunk.verticesPerFace.reserve(chunk.numFaceVertices / 3);
+        chunk.failed = false;
+
+        for (; p < pEnd; p = SkipLine(p, pEnd))
+        {
+            pCommand = SkipBlanks(p, pEnd);
+            pCommandEnd = SkipToken(pCommand, pEnd);
+            p = pCommandEnd;
 
-        length = 1.0f / sqrtf(pVertex0->normal[0] * pVertex0->normal[0] +
-                              pVertex0->normal[1] * pVertex0->normal[1] +
-                              pVertex0->normal[2] * pVertex0->normal[2]);
+            if (pCommandEnd == pCommand)
+                continue;
 
-        pVertex0->normal[0] *= length;
-        pVertex0->normal[1] *= length;
-        pVertex0->normal[2] *= length;
-    }
-}
+            switch (*pCommand)
+            {
+            case 'v':
+                if (pCommandEnd - pCommand == 1)
+                {
+                    pVertexCoord[0] = pVertexCoord[1] = pVertexCoord[2] = 0.0f;
 
-void ModelOBJ::importGeometryFirstPass(std::ifstream &stream)
-{
-    m_hasTextureCoords = false;
-    m_hasVertexNormals = false;
+                    for (int i = 0; i < 3 && (pNext = ParseFloat(p, pEnd, pVertexCoord[i])) != 0; ++i)
+                        p = pNext;
 
-    m_numberOfVertexCoords = 0;
-    m_numberOfTextureCoords = 0;
-    m_numberOfNormals = 0;
-    m_numberOfFaces = 0;
+                    pVertexCoord += 3;
+                    ++numVertexCoords;
+                }
+                else if (TokenEquals(pCommand, pCommandEnd, "vt"))
+                {
+                    pTextureCoord[0] = pTextureCoord[1] = 0.0f;
 
-    std::istringstream strStream;
-    std::string line;
-    std::string token;
-    int ch = 0;
-    int verticesPerFace = 0;
+                    for (int i = 0; i < 2 && (pNext = ParseFloat(p, pEnd, pTextureCoord[i])) != 0; ++i)
+                        p = pNext;
 
-    while (!stream.eof())
-    {
-        line.clear();
-        std::getline(stream, line);
+                    pTextureCoord += 2;
+                    ++numTextureCoords;
+                }
+                else if (TokenEquals(pCommand, pCommandEnd, "vn"))
+                {
+                    pNormal[0] = pNormal[1] = pNormal[2] = 0.0f;
 
-        if (line.empty())
-            continue;
+                    for (int i = 0; i < 3 && (pNext = ParseFloat(p, pEnd, pNormal[i])) != 0; ++i)
+                        p = pNext;
 
-        strStream.clear();
-        strStream.str(line);
+                    pNormal += 3;
+                    ++numNormals;
+                }
+                break;
 
-        ch = strStream.get();
+            case 'f':
+                if (pCommandEnd - pCommand != 1)
+                    break;
 
-        switch (ch)
-        {
-        case 'v':
-            ch = strStream.get();
+                verticesPerFace = 0;
+
+                while ((pNext = ParseFaceVertex(p, pEnd, posIndex, texCoordIndex, normalIndex)) != 0)
+                {
+                    p = pNext;
+
+                    if (!ResolveIndex(posIndex, numVertexCoords))
+                    {
+                        chunk.failed = true;
+                        return;
+                    }
+
+                    if (texCoordIndex != MISSING_INDEX && !ResolveIndex(texCoordIndex, numTextureCoords))
+                    {
+                        chunk.failed = true;
+                        return;
+                    }
+
+                    if (normalIndex != MISSING_INDEX && !ResolveIndex(normalIndex, numNormals))
+                    {
+                        chunk.failed = true;
+                        return;
+                    }
+
+                    chunk.faceVertices.push_back(posIndex - 1);
+                    chunk.faceVertices.push_back((texCoordIndex == MISSING_INDEX) ? -1 : texCoordIndex - 1);
+                    chunk.faceVertices.push_back((normalIndex == MISSING_INDEX) ? -1 : normalIndex - 1);
+                    ++verticesPerFace;
+                }
+
+                // Faces with fewer than three vertices are dropped here so
+                // they never reach the merge in importGeometryParallel().
+
+                if (verticesPerFace < 3)
+                    chunk.faceVertices.resize(chunk.faceVertices.size() - verticesPerFace * 3);
+                else
+                    chunk.verticesPerFace.push_back(verticesPerFace);
+
+                break;
+
+            case 'm':
+            case 'u':
+                command.isMaterialLibrary = TokenEquals(pCommand, pCommandEnd, "mtllib");
+
+                if (command.isMaterialLibrary || TokenEquals(pCommand, pCommandEnd, "usemtl"))
+                {
+                    pNext = SkipBlanks(p, pEnd);
+                    command.name.assign(pNext, SkipToken(pNext, pEnd));
+                    command.faceIndex = static_cast<int>(chunk.verticesPerFace.size());
+                    chunk.commands.push_back(command);
+                }
+                break;
+
+            default:
+                break;
+            }
+        }
+    }
+
+    // Streaming import. See ModelOBJ::importStreaming().
+
+    const int STREAM_PAGE_SIZE = 16384;             // coordinates per page
+    const size_t STREAM_MIN_WINDOW_SIZE = 4096;
+
+    class SpillFile
+    {
+        // A scratch file that coordinate pages are appended to when they're
+        // evicted from memory. The file is created the first time a page is
+        // written and deleted by close().
+
+    public:
+        SpillFile() : m_pFile(0), m_size(0) {}
+        ~SpillFile() { close(); }
+
+        void close()
+        {
+            if (m_pFile)
+            {
+                fclose(m_pFile);
+                remove(m_filename.c_str());
+                m_pFile = 0;
+            }
+
+            m_size = 0;
+        }
+
+        bool read(long long offset, void *pData, size_t size)
+        {
+            return m_pFile && seek(offset) && fread(pData, 1, size, m_pFile) == size;
+        }
+
+        bool write(const void *pData, size_t size, long long &offset)
+        {
+            if (!m_pFile && (m_pFile = fopen(m_filename.c_str(), "w+b")) == 0)
+                return false;
+
+            if (!seek(m_size) || fwrite(pData, 1, size, m_pFile) != size)
+                return false;
+
+            offset = m_size;
+            m_size += static_cast<long long>(size);
+            return true;
+        }
+
+        void setFilename(const std::string &filename)
+        {
+            m_filename = filename;
+        }
+
+    private:
+        SpillFile(const SpillFile &);
+        SpillFile &operator=(const SpillFile &);
+
+        bool seek(long long offset)
+        {
+#if defined(_WIN32)
+            return _fseeki64(m_pFile, offset, SEEK_SET) == 0;
+#else
+            return fseeko(m_pFile, static_cast<off_t>(offset), SEEK_SET) == 0;
+#endif
+        }
+
+        FILE *m_pFile;
+        long long m_size;
+        std::string m_filename;
+    };
+
+    class CoordinateTable
+    {
+        // An append only list of coordinates of which at most maxPages pages
+        // are held in memory. The page being appended to always stays in
+        // memory. A full page never changes, so it's written to the spill
+        // file only the first time it's evicted. Pages are evicted least
+        // recently used first.
+
+    public:
+        CoordinateTable(int components, int maxPages, SpillFile *pSpillFile)
+            : m_components(components), m_count(0), m_maxPages(maxPages),
+              m_clock(0), m_pSpillFile(pSpillFile)
+        {
+            m_slots.reserve(maxPages);
+        }
+
+        bool append(const float *pCoord)
+        {
+            int page = m_count / STREAM_PAGE_SIZE;
+            float *pPage = acquire(page);
+
+            if (!pPage)
+                return false;
+
+            memcpy(pPage + (m_count % STREAM_PAGE_SIZE) * m_components, pCoord, m_components * sizeof(float));
+            ++m_count;
+            return true;
+        }
+
+        const float *get(int index)
+        {
+            // Returns the zero based coordinate index, or null if its page
+            // couldn't be read back. The pointer is valid until the next call.
+
+            const float *pPage = acquire(index / STREAM_PAGE_SIZE);
+            return pPage ? pPage + (index % STREAM_PAGE_SIZE) * m_components : 0;
+        }
+
+        size_t getResidentBytes() const
+        {
+            return m_slots.size() * STREAM_PAGE_SIZE * m_components * sizeof(float);
+        }
+
+        int size() const
+        {
+            return m_count;
+        }
+
+    private:
+        struct Slot
+        {
+            int page;
+            unsigned long long lastUse;
+            std::vector<float> coords;
+        };
+
+        float *acquire(int page)
+        {
+            if (page >= static_cast<int>(m_pageSlots.size()))
+            {
+                m_pageSlots.resize(page + 1, -1);
+                m_pageOffsets.resize(page + 1, -1);
+            }
+
+            int slot = m_pageSlots[page];
+
+            if (slot == -1)
+            {
+                if ((slot = evict()) == -1)
+                    return 0;
+
+                Slot &s = m_slots[slot];
+                long long offset = m_pageOffsets[page];
+
+                if (offset != -1 && !m_pSpillFile->read(offset, &s.coords[0], s.coords.size() * sizeof(float)))
+                    return 0;
+
+                s.page = page;
+                m_pageSlots[page] = slot;
+            }
+
+            m_slots[slot].lastUse = ++m_clock;
+            return &m_slots[slot].coords[0];
+        }
+
+        int evict()
+        {
+            // Returns a free slot, adding one while under the limit and
+            // otherwise spilling the least recently used full page.
+
+            if (static_cast<int>(m_slots.size()) < m_maxPages)
+            {
+                m_slots.push_back(Slot());
+                m_slots.back().page = -1;
+                m_slots.back().lastUse = 0;
+                m_slots.back().coords.resize(STREAM_PAGE_SIZE * m_components);
+                return static_cast<int>(m_slots.size()) - 1;
+            }
+
+            int fillPage = m_count / STREAM_PAGE_SIZE;
+            int victim = -1;
+
+            for (int i = 0; i < static_cast<int>(m_slots.size()); ++i)
+            {
+                if (m_slots[i].page == fillPage)
+                    continue;
+
+                if (victim == -1 || m_slots[i].lastUse < m_slots[victim].lastUse)
+                    victim = i;
+            }
+
+            Slot &s = m_slots[victim];
+            long long &offset = m_pageOffsets[s.page];
+
+            if (offset == -1 && !m_pSpillFile->write(&s.coords[0], s.coords.size() * sizeof(float), offset))
+                return -1;
+
+            m_pageSlots[s.page] = -1;
+            s.page = -1;
+            return victim;
+        }
+
+        int m_components;
+        int m_count;
+        int m_maxPages;
+        unsigned long long m_clock;
+        SpillFile *m_pSpillFile;
+        std::vector<Slot> m_slots;
+        std::vector<int> m_pageSlots;           // -1 = not in memory
+        std::vector<long long> m_pageOffsets;   // -1 = never spilled
+    };
+
+    // Vertex normal generation. See ModelOBJ::generateNormals().
+
+    const int NORMALS_BLOCK_SIZE = 16384;
+
+    void CalculateFaceNormals(const ModelOBJ::Vertex *pVertices, const int *pIndices,
+                              int count, float *pX, float *pY, float *pZ)
+    {
+        // Writes the unnormalized normals of count triangles. The SIMD path
+        // performs exactly the same operations as the scalar path so both
+        // produce identical results.
+
+        int i = 0;
+        int last = count;
+
+#if PERFORM_SIMD_NORMALS
+        for (; i + 4 <= last; i += 4)
+        {
+            // Each position is loaded along with the texture coordinate that
+            // follows it and the 4x4 blocks are transposed into x, y, and z
+            // rows. The fourth row is unused.
+
+            const int *pTriangle = &pIndices[i * 3];
+            __m128 x0 = _mm_loadu_ps(pVertices[pTriangle[0]].position);
+            __m128 y0 = _mm_loadu_ps(pVertices[pTriangle[3]].position);
+            __m128 z0 = _mm_loadu_ps(pVertices[pTriangle[6]].position);
+            __m128 w0 = _mm_loadu_ps(pVertices[pTriangle[9]].position);
+            __m128 x1 = _mm_loadu_ps(pVertices[pTriangle[1]].position);
+            __m128 y1 = _mm_loadu_ps(pVertices[pTriangle[4]].position);
+            __m128 z1 = _mm_loadu_ps(pVertices[pTriangle[7]].position);
+            __m128 w1 = _mm_loadu_ps(pVertices[pTriangle[10]].position);
+            __m128 x2 = _mm_loadu_ps(pVertices[pTriangle[2]].position);
+            __m128 y2 = _mm_loadu_ps(pVertices[pTriangle[5]].position);
+            __m128 z2 = _mm_loadu_ps(pVertices[pTriangle[8]].position);
+            __m128 w2 = _mm_loadu_ps(pVertices[pTriangle[11]].position);
+
+            _MM_TRANSPOSE4_PS(x0, y0, z0, w0);
+            _MM_TRANSPOSE4_PS(x1, y1, z1, w1);
+            _MM_TRANSPOSE4_PS(x2, y2, z2, w2);
+
+            __m128 edge1X = _mm_sub_ps(x1, x0);
+            __m128 edge1Y = _mm_sub_ps(y1, y0);
+            __m128 edge1Z = _mm_sub_ps(z1, z0);
+
+            __m128 edge2X = _mm_sub_ps(x2, x0);
+            __m128 edge2Y = _mm_sub_ps(y2, y0);
+            __m128 edge2Z = _mm_sub_ps(z2, z0);
+
+            _mm_storeu_ps(pX + i, _mm_sub_ps(_mm_mul_ps(edge1Y, edge2Z), _mm_mul_ps(edge1Z, edge2Y)));
+            _mm_storeu_ps(pY + i, _mm_sub_ps(_mm_mul_ps(edge1Z, edge2X), _mm_mul_ps(edge1X, edge2Z)));
+            _mm_storeu_ps(pZ + i, _mm_sub_ps(_mm_mul_ps(edge1X, edge2Y), _mm_mul_ps(edge1Y, edge2X)));
+        }
+#endif
+
+        for (; i < last; ++i)
+        {
+            const int *pTriangle = &pIndices[i * 3];
+            const float *p0 = pVertices[pTriangle[0]].position;
+            const float *p1 = pVertices[pTriangle[1]].position;
+            const float *p2 = pVertices[pTriangle[2]].position;
+
+            float edge1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float edge2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+
+            pX[i] = (edge1[1] * edge2[2]) - (edge1[2] * edge2[1]);
+            pY[i] = (edge1[2] * edge2[0]) - (edge1[0] * edge2[2]);
+            pZ[i] = (edge1[0] * edge2[1]) - (edge1[1] * edge2[0]);
+        }
+    }
+
+    float CornerAngle(const float *pCorner, const float *pNext, const float *pPrevious)
+    {
+        float a[3] = {pNext[0] - pCorner[0], pNext[1] - pCorner[1], pNext[2] - pCorner[2]};
+        float b[3] = {pPrevious[0] - pCorner[0], pPrevious[1] - pCorner[1], pPrevious[2] - pCorner[2]};
+        float cross[3] =
+        {
+            a[1] * b[2] - a[2] * b[1],
+            a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0]
+        };
+
+        float sine = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+        float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+
+        return atan2f(sine, cosine);
+    }
+
+    void CalculateCornerAngles(const ModelOBJ::Vertex *pVertices, const int *pIndices,
+                               int count, float *pAngles)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            const int *pTriangle = &pIndices[i * 3];
+            const float *p0 = pVertices[pTriangle[0]].position;
+            const float *p1 = pVertices[pTriangle[1]].position;
+            const float *p2 = pVertices[pTriangle[2]].position;
+
+            pAngles[i * 3 + 0] = CornerAngle(p0, p1, p2);
+            pAngles[i * 3 + 1] = CornerAngle(p1, p2, p0);
+            pAngles[i * 3 + 2] = CornerAngle(p2, p0, p1);
+        }
+    }
+
+    void NormalizeFaceNormals(int count, float *pX, float *pY, float *pZ)
+    {
+        // Degenerate triangles get a zero normal so they don't contribute.
+
+        int i = 0;
+        int last = count;
+
+#if PERFORM_SIMD_NORMALS
+        __m128 zero = _mm_setzero_ps();
+        __m128 one = _mm_set1_ps(1.0f);
+
+        for (; i + 4 <= last; i += 4)
+        {
+            __m128 x = _mm_loadu_ps(pX + i);
+            __m128 y = _mm_loadu_ps(pY + i);
+            __m128 z = _mm_loadu_ps(pZ + i);
+            __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            __m128 scale = _mm_and_ps(_mm_cmpgt_ps(lengthSq, zero), _mm_div_ps(one, _mm_sqrt_ps(lengthSq)));
+
+            _mm_storeu_ps(pX + i, _mm_mul_ps(x, scale));
+            _mm_storeu_ps(pY + i, _mm_mul_ps(y, scale));
+            _mm_storeu_ps(pZ + i, _mm_mul_ps(z, scale));
+        }
+#endif
+
+        for (; i < last; ++i)
+        {
+            float lengthSq = pX[i] * pX[i] + pY[i] * pY[i] + pZ[i] * pZ[i];
+            float scale = (lengthSq > 0.0f) ? 1.0f / sqrtf(lengthSq) : 0.0f;
+
+            pX[i] *= scale;
+            pY[i] *= scale;
+            pZ[i] *= scale;
+        }
+    }
+
+    void CalculateFaceNormals(const ModelOBJ::Vertex *pVertices, const int *pIndices, int count,
+                              std::vector<float> &faceNormals, std::vector<float> &cornerAngles)
+    {
+        // Single threaded version for one block. faceNormals holds the x, y,
+        // and z components of NORMALS_BLOCK_SIZE normals one after another.
+
+        float *pX = &faceNormals[0];
+        float *pY = pX + NORMALS_BLOCK_SIZE;
+        float *pZ = pY + NORMALS_BLOCK_SIZE;
+
+        CalculateFaceNormals(pVertices, pIndices, count, pX, pY, pZ);
+
+        if (!cornerAngles.empty())
+        {
+            CalculateCornerAngles(pVertices, pIndices, count, &cornerAngles[0]);
+            NormalizeFaceNormals(count, pX, pY, pZ);
+        }
+    }
+
+    void AccumulateFaceNormals(ModelOBJ::Vertex *pVertices, const int *pIndices, int count,
+                               const std::vector<float> &faceNormals, const std::vector<float> &cornerAngles)
+    {
+        const float *pX = &faceNormals[0];
+        const float *pY = pX + NORMALS_BLOCK_SIZE;
+        const float *pZ = pY + NORMALS_BLOCK_SIZE;
+
+        for (int i = 0; i < count * 3; ++i)
+        {
+            int triangle = i / 3;
+            float *pNormal = pVertices[pIndices[i]].normal;
+
+            if (cornerAngles.empty())
+            {
+                pNormal[0] += pX[triangle];
+                pNormal[1] += pY[triangle];
+                pNormal[2] += pZ[triangle];
+            }
+            else
+            {
+                pNormal[0] += pX[triangle] * cornerAngles[i];
+                pNormal[1] += pY[triangle] * cornerAngles[i];
+                pNormal[2] += pZ[triangle] * cornerAngles[i];
+            }
+        }
+    }
+
+    void NormalizeVertexNormals(ModelOBJ::Vertex *pVertices, int count)
+    {
+        // Vertices that aren't used by any triangle end up with a NaN normal
+        // just as they always have.
+
+        int i = 0;
+
+#if PERFORM_SIMD_NORMALS
+        __m128 one = _mm_set1_ps(1.0f);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            float *pNormal[4] =
+            {
+                pVertices[i + 0].normal, pVertices[i + 1].normal,
+                pVertices[i + 2].normal, pVertices[i + 3].normal
+            };
+
+            __m128 x = _mm_setr_ps(pNormal[0][0], pNormal[1][0], pNormal[2][0], pNormal[3][0]);
+            __m128 y = _mm_setr_ps(pNormal[0][1], pNormal[1][1], pNormal[2][1], pNormal[3][1]);
+            __m128 z = _mm_setr_ps(pNormal[0][2], pNormal[1][2], pNormal[2][2], pNormal[3][2]);
+            __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+            __m128 scale = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+
+            float result[3][4];
+
+            _mm_storeu_ps(result[0], _mm_mul_ps(x, scale));
+            _mm_storeu_ps(result[1], _mm_mul_ps(y, scale));
+            _mm_storeu_ps(result[2], _mm_mul_ps(z, scale));
+
+            for (int j = 0; j < 4; ++j)
+            {
+                pNormal[j][0] = result[0][j];
+                pNormal[j][1] = result[1][j];
+                pNormal[j][2] = result[2][j];
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            float *pNormal = pVertices[i].normal;
+            float length = 1.0f / sqrtf(pNormal[0] * pNormal[0] +
+                                        pNormal[1] * pNormal[1] +
+                                        pNormal[2] * pNormal[2]);
+
+            pNormal[0] *= length;
+            pNormal[1] *= length;
+            pNormal[2] *= length;
+        }
+    }
+
+    void BuildVertexCorners(const int *pIndices, int indexCount, int vertexCount,
+                            std::vector<int> &cornerOffsets, std::vector<int> &corners)
+    {
+        // Builds a vertex to triangle corner adjacency table in compressed
+        // sparse row form. The corners of vertex i are corners[cornerOffsets[i]]
+        // up to corners[cornerOffsets[i + 1]] and are listed in index order.
+
+        cornerOffsets.assign(vertexCount + 1, 0);
+        corners.resize(indexCount);
+
+        for (int i = 0; i < indexCount; ++i)
+            ++cornerOffsets[pIndices[i] + 1];
+
+        for (int i = 0; i < vertexCount; ++i)
+            cornerOffsets[i + 1] += cornerOffsets[i];
+
+        std::vector<int> cornerCursor(cornerOffsets.begin(), cornerOffsets.end() - 1);
+
+        for (int i = 0; i < indexCount; ++i)
+            corners[cornerCursor[pIndices[i]]++] = i;
+    }
+
+    void ProjectOntoPlane(float v[3], const float normal[3])
+    {
+        // Removes the component of v along the unit vector normal and
+        // normalizes the result. Zero length vectors are left as they are.
+
+        float d = v[0] * normal[0] + v[1] * normal[1] + v[2] * normal[2];
+
+        v[0] -= normal[0] * d;
+        v[1] -= normal[1] * d;
+        v[2] -= normal[2] * d;
+
+        float lengthSq = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+
+        if (lengthSq > 0.0f)
+        {
+            float scale = 1.0f / sqrtf(lengthSq);
+
+            v[0] *= scale;
+            v[1] *= scale;
+            v[2] *= scale;
+        }
+    }
+
+    void CalculateCornerTangents(const ModelOBJ::Vertex *pVertices, const int *pIndices,
+                                 int count, float *pCornerTangents)
+    {
+        // Writes four floats per triangle corner: the corner's tangent scaled
+        // by the corner angle, and the corner angle with the sign of the
+        // triangle's texture space orientation. Triangles with no texture
+        // space area get zero weight.
+
+        for (int i = 0; i < count; ++i)
+        {
+            const int *pTriangle = &pIndices[i * 3];
+            const ModelOBJ::Vertex *pCorner[3] =
+            {
+                &pVertices[pTriangle[0]], &pVertices[pTriangle[1]], &pVertices[pTriangle[2]]
+            };
+
+            const float *p0 = pCorner[0]->position;
+            const float *p1 = pCorner[1]->position;
+            const float *p2 = pCorner[2]->position;
+            const float *uv0 = pCorner[0]->texCoord;
+            const float *uv1 = pCorner[1]->texCoord;
+            const float *uv2 = pCorner[2]->texCoord;
+
+            float edge1[3] = {p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2]};
+            float edge2[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
+            float s1 = uv1[0] - uv0[0];
+            float t1 = uv1[1] - uv0[1];
+            float s2 = uv2[0] - uv0[0];
+            float t2 = uv2[1] - uv0[1];
+            float signedArea = s1 * t2 - t1 * s2;
+
+            float *pOut = &pCornerTangents[i * 12];
+
+            if (fabsf(signedArea) <= FLT_MIN)
+            {
+                memset(pOut, 0, sizeof(float) * 12);
+                continue;
+            }
+
+            float orientation = (signedArea > 0.0f) ? 1.0f : -1.0f;
+            float faceTangent[3] =
+            {
+                (t2 * edge1[0] - t1 * edge2[0]) * orientation,
+                (t2 * edge1[1] - t1 * edge2[1]) * orientation,
+                (t2 * edge1[2] - t1 * edge2[2]) * orientation
+            };
+
+            for (int j = 0; j < 3; ++j)
+            {
+                const float *pNormal = pCorner[j]->normal;
+                const float *pPosition = pCorner[j]->position;
+                const float *pNext = pCorner[(j + 1) % 3]->position;
+                const float *pPrevious = pCorner[(j + 2) % 3]->position;
+
+                float tangent[3] = {faceTangent[0], faceTangent[1], faceTangent[2]};
+                float a[3] = {pNext[0] - pPosition[0], pNext[1] - pPosition[1], pNext[2] - pPosition[2]};
+                float b[3] = {pPrevious[0] - pPosition[0], pPrevious[1] - pPosition[1], pPrevious[2] - pPosition[2]};
+
+                ProjectOntoPlane(tangent, pNormal);
+                ProjectOntoPlane(a, pNormal);
+                ProjectOntoPlane(b, pNormal);
+
+                float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+                float angle = acosf((cosine > 1.0f) ? 1.0f : ((cosine < -1.0f) ? -1.0f : cosine));
+
+                pOut[j * 4 + 0] = tangent[0] * angle;
+                pOut[j * 4 + 1] = tangent[1] * angle;
+                pOut[j * 4 + 2] = tangent[2] * angle;
+                pOut[j * 4 + 3] = angle * orientation;
+            }
+        }
+    }
+
+    float TextureOrientation(const ModelOBJ::Vertex *pVertices, const int *pTriangle)
+    {
+        // Returns 1 or -1 for the winding of the triangle's texture
+        // coordinates, or 0 if it has no texture space area.
+
+        const float *uv0 = pVertices[pTriangle[0]].texCoord;
+        const float *uv1 = pVertices[pTriangle[1]].texCoord;
+        const float *uv2 = pVertices[pTriangle[2]].texCoord;
+        float signedArea = (uv1[0] - uv0[0]) * (uv2[1] - uv0[1]) - (uv1[1] - uv0[1]) * (uv2[0] - uv0[0]);
+
+        if (fabsf(signedArea) <= FLT_MIN)
+            return 0.0f;
+
+        return (signedArea > 0.0f) ? 1.0f : -1.0f;
+    }
+
+    void SplitMirroredVertices(const int *pCornerOffsets, const int *pCorners, int vertexCount,
+                               const float *pCornerTangents, int *pIndices,
+                               std::vector<int> &splitVertices, std::vector<float> &splitOrientations)
+    {
+        // A vertex whose corners have both texture space orientations lies on
+        // a mirror seam. The corners of the orientation carrying less weight
+        // are moved to a new vertex, numbered from vertexCount up. For each
+        // new vertex splitVertices holds the vertex it copies and
+        // splitOrientations the orientation of the corners that moved.
+        // Corners with zero weight stay where they are.
+
+        for (int vertex = 0; vertex < vertexCount; ++vertex)
+        {
+            float positiveWeight = 0.0f;
+            float negativeWeight = 0.0f;
+
+            for (int i = pCornerOffsets[vertex]; i < pCornerOffsets[vertex + 1]; ++i)
+            {
+                float weight = pCornerTangents[pCorners[i] * 4 + 3];
+
+                if (weight > 0.0f)
+                    positiveWeight += weight;
+                else
+                    negativeWeight -= weight;
+            }
+
+            if (!(positiveWeight > 0.0f) || !(negativeWeight > 0.0f))
+                continue;
+
+            // Ties keep the positive side, as in ResolveVertexTangent().
+            float moved = (positiveWeight >= negativeWeight) ? -1.0f : 1.0f;
+            int newVertex = vertexCount + static_cast<int>(splitVertices.size());
+
+            for (int i = pCornerOffsets[vertex]; i < pCornerOffsets[vertex + 1]; ++i)
+            {
+                if (pCornerTangents[pCorners[i] * 4 + 3] * moved > 0.0f)
+                    pIndices[pCorners[i]] = newVertex;
+            }
+
+            splitVertices.push_back(vertex);
+            splitOrientations.push_back(moved);
+        }
+    }
+
+    void ResolveVertexTangent(const float *pNormal, const int *pCorners, int count,
+                              const float *pCornerTangents, float tangent[4])
+    {
+        // Sums the corners whose orientation carries the most weight and
+        // orthonormalizes the sum against the vertex normal. Vertices without
+        // any usable corners get an arbitrary tangent perpendicular to the
+        // normal.
+
+        float positiveWeight = 0.0f;
+        float negativeWeight = 0.0f;
+
+        for (int i = 0; i < count; ++i)
+        {
+            float weight = pCornerTangents[pCorners[i] * 4 + 3];
+
+            if (weight > 0.0f)
+                positiveWeight += weight;
+            else
+                negativeWeight -= weight;
+        }
+
+        float sign = (positiveWeight >= negativeWeight) ? 1.0f : -1.0f;
+
+        tangent[0] = 0.0f;
+        tangent[1] = 0.0f;
+        tangent[2] = 0.0f;
+        tangent[3] = sign;
+
+        for (int i = 0; i < count; ++i)
+        {
+            const float *pCorner = &pCornerTangents[pCorners[i] * 4];
+
+            if (pCorner[3] * sign > 0.0f)
+            {
+                tangent[0] += pCorner[0];
+                tangent[1] += pCorner[1];
+                tangent[2] += pCorner[2];
+            }
+        }
+
+        ProjectOntoPlane(tangent, pNormal);
+
+        if (tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2] > 0.5f)
+            return;
+
+        // Start from the axis least aligned with the normal.
+
+        bool useX = !(fabsf(pNormal[0]) > 0.9f);
+
+        tangent[0] = useX ? 1.0f : 0.0f;
+        tangent[1] = useX ? 0.0f : 1.0f;
+        tangent[2] = 0.0f;
+
+        ProjectOntoPlane(tangent, pNormal);
+
+        if (!(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2] > 0.5f))
+        {
+            tangent[0] = 1.0f;
+            tangent[1] = 0.0f;
+            tangent[2] = 0.0f;
+        }
+    }
+
+    // Mesh bounds.
+
+    void SetMeshBounds(ModelOBJ::Mesh &mesh, const MeshBounds::Bounds &bounds)
+    {
+        memcpy(mesh.boundsMin, bounds.minimum, sizeof(mesh.boundsMin));
+        memcpy(mesh.boundsMax, bounds.maximum, sizeof(mesh.boundsMax));
+        memcpy(mesh.center, bounds.center, sizeof(mesh.center));
+        mesh.radius = bounds.radius;
+    }
+
+    void TransformMeshBounds(std::vector<ModelOBJ::Mesh> &meshes, float scaleFactor, const float offset[3])
+    {
+        for (int i = 0; i < static_cast<int>(meshes.size()); ++i)
+        {
+            ModelOBJ::Mesh &mesh = meshes[i];
+            MeshBounds::Bounds bounds;
+
+            memcpy(bounds.minimum, mesh.boundsMin, sizeof(bounds.minimum));
+            memcpy(bounds.maximum, mesh.boundsMax, sizeof(bounds.maximum));
+            memset(bounds.centroid, 0, sizeof(bounds.centroid));
+            memcpy(bounds.center, mesh.center, sizeof(bounds.center));
+            bounds.radius = mesh.radius;
+
+            MeshBounds::transformBounds(bounds, scaleFactor, offset);
+            SetMeshBounds(mesh, bounds);
+        }
+    }
+
+    // Binary model cache file format. See ModelOBJ::saveCache().
+
+    const char CACHE_MAGIC[8] = {'O', 'B', 'J', 'C', 'A', 'C', 'H', 'E'};
+    const unsigned int CACHE_VERSION = 11;
+    const unsigned int CACHE_MAX_SECTIONS = 64;
+    const unsigned int CACHE_ALIGNMENT = 16;
+
+    const unsigned int CACHE_FLAG_TEXTURE_COORDS = 1;
+    const unsigned int CACHE_FLAG_VERTEX_NORMALS = 2;
+
+    enum CacheSectionId
+    {
+        CACHE_SECTION_DEPENDENCIES = 1,
+        CACHE_SECTION_STRINGS = 2,
+        CACHE_SECTION_MATERIALS = 3,
+        CACHE_SECTION_MESHES = 4,
+        CACHE_SECTION_VERTICES = 5,
+        CACHE_SECTION_INDICES = 6,
+        CACHE_SECTION_SHORT_INDICES = 7,
+        CACHE_SECTION_TANGENTS = 8,
+        CACHE_SECTION_LODS = 9,
+        CACHE_SECTION_LOD_MESHES = 10,
+        CACHE_SECTION_CLUSTERS = 11,
+        CACHE_SECTION_CLUSTER_OFFSETS = 12,
+        CACHE_SECTION_ENCODED_VERTICES = 13,
+        CACHE_SECTION_ENCODED_INDICES = 14,
+        CACHE_SECTION_ENCODED_TANGENTS = 15,
+        CACHE_SECTION_QUANTIZATION = 16,
+        CACHE_SECTION_QUANTIZED_VERTICES = 17,
+        CACHE_SECTION_ENCODED_QUANTIZED_VERTICES = 18
+    };
+
+    struct CacheHeader
+    {
+        char magic[8];
+        unsigned int version;
+        unsigned int vertexSize;
+        unsigned int flags;
+        unsigned int sectionCount;
+        MeshBounds::Bounds bounds;
+        unsigned int reserved;  // keeps the section table 8 byte aligned
+    };
+
+    struct CacheSection
+    {
+        unsigned int id;
+        unsigned int count;
+        unsigned long long offset;
+        unsigned long long size;
+    };
+
+    struct CacheDependency
+    {
+        unsigned long long size;
+        long long modificationTime;
+        unsigned long long hash;
+        unsigned int pathOffset;
+        unsigned int pathLength;
+        unsigned int exists;
+        unsigned int reserved;
+    };
+
+    struct CacheMaterial
+    {
+        float ambient[4];
+        float diffuse[4];
+        float specular[4];
+        float shininess;
+        float alpha;
+        unsigned int colorMapOffset;
+        unsigned int colorMapLength;
+        unsigned int nameOffset;
+        unsigned int nameLength;
+    };
+
+    struct CacheQuantization
+    {
+        float positionCenter[3];
+        float positionExtent[3];
+        float texCoordMin[2];
+        float texCoordRange[2];
+        unsigned int normalFormat;
+        unsigned int texCoordFormat;
+    };
+
+    inline unsigned long long AlignCacheOffset(unsigned long long offset)
+    {
+        return (offset + CACHE_ALIGNMENT - 1) & ~static_cast<unsigned long long>(CACHE_ALIGNMENT - 1);
+    }
+
+    void AddCacheSection(CacheSection *pSections, const void **ppSectionData, int &sectionCount,
+                         unsigned int id, const void *pData, size_t count, size_t elementSize)
+    {
+        CacheSection &section = pSections[sectionCount];
+
+        section.id = id;
+        section.count = static_cast<unsigned int>(count);
+        section.offset = 0;
+        section.size = static_cast<unsigned long long>(count) * elementSize;
+        ppSectionData[sectionCount++] = pData;
+    }
+
+    bool IsValidMesh(const ModelOBJ::Mesh &mesh, unsigned long long firstIndex,
+                     unsigned long long lastIndex, int materialCount)
+    {
+        // Checks that a cached mesh lies within [firstIndex, lastIndex) of the
+        // index buffer and refers to an existing material.
+
+        return mesh.startIndex >= 0 && mesh.triangleCount >= 0 &&
+               static_cast<unsigned long long>(mesh.startIndex) >= firstIndex &&
+               static_cast<unsigned long long>(mesh.startIndex) + mesh.triangleCount * 3ULL <= lastIndex &&
+               mesh.materialIndex >= 0 && mesh.materialIndex < materialCount;
+    }
+
+    const CacheSection *FindCacheSection(const CacheSection *pSections, unsigned int sectionCount,
+                                         unsigned int id, size_t elementSize, size_t fileSize)
+    {
+        // Returns the section with the given id if it lies completely within
+        // the file, is aligned, and holds exactly count elements.
+
+        for (unsigned int i = 0; i < sectionCount; ++i)
+        {
+            const CacheSection &section = pSections[i];
+
+            if (section.id != id)
+                continue;
+
+            if (section.offset % CACHE_ALIGNMENT != 0 || section.offset > fileSize ||
+                section.size > fileSize - section.offset ||
+                section.size != static_cast<unsigned long long>(section.count) * elementSize)
+            {
+                return 0;
+            }
+
+            return &section;
+        }
+
+        return 0;
+    }
+
+    const CacheSection *FindEncodedCacheSection(const CacheSection *pSections, unsigned int sectionCount,
+                                                unsigned int id, size_t fileSize)
+    {
+        // Returns the MeshCodec encoded section with the given id if it lies
+        // completely within the file and is aligned. Its count is the number
+        // of elements it decodes to.
+
+        for (unsigned int i = 0; i < sectionCount; ++i)
+        {
+            const CacheSection &section = pSections[i];
+
+            if (section.id != id)
+                continue;
+
+            if (section.offset % CACHE_ALIGNMENT != 0 || section.offset > fileSize ||
+                section.size > fileSize - section.offset)
+            {
+                return 0;
+            }
+
+            return &section;
+        }
+
+        return 0;
+    }
+}
+
+int ModelOBJ::m_faceIndexCache[FACE_INDEX_CACHE_SIZE];
+
+ModelOBJ::ModelOBJ()
+{
+    m_hasTextureCoords = false;
+    m_hasVertexNormals = false;
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfFaces = 0;
+
+    m_pImportArena = 0;
+    m_pMaterialCache = 0;
+    m_pVertexCache = 0;
+    m_vertexCacheSize = 0;
+    m_vertexCacheCount = 0;
+
+    m_pImportAllocator = 0;
+    m_importMemoryLimit = 0;
+    m_importPeakBytes = 0;
+    m_importTotalBytes = 0;
+
+    m_pVertexStreams = 0;
+    m_pVertexQuantizer = 0;
+
+    memset(&m_bounds, 0, sizeof(m_bounds));
+}
+
+ModelOBJ::~ModelOBJ()
+{
+    destroy();
+    releaseVertexStreams();
+}
+
+void ModelOBJ::buildClusters()
+{
+    // Replaces any existing clusters. Each mesh is clustered on its own so a
+    // cluster never spans two materials. The triangles within each mesh are
+    // reordered so every cluster is a contiguous run of the index buffer.
+    // The meshes are clustered in parallel and their clusters are then
+    // stored in mesh order, which keeps the result the same no matter how
+    // many threads did the work.
+    //
+    // A cluster has at most MeshClusterizer::MAX_VERTICES vertices and
+    // MAX_TRIANGLES triangles, a bounding sphere, and a normal cone, so
+    // clusters outside the view frustum or facing away from the camera can
+    // be skipped. Only the full detail model is clustered. Because the
+    // triangles are reordered, call this after optimizeVertexCache() (which
+    // rebuilds existing clusters) and before optimizeVertexFetch().
+
+    int meshCount = static_cast<int>(m_meshes.size());
+
+    m_clusters.clear();
+    m_meshClusterOffsets.clear();
+
+    if (meshCount == 0)
+        return;
+
+    std::vector<Vertex> vertices;
+    const Vertex *pVertices = decodeVertices(vertices);
+
+    if (!pVertices)
+        return;
+
+    widenIndexBuffer();
+
+    std::vector<std::vector<Cluster> > meshClusters(meshCount);
+    std::vector<Cluster> *pMeshClusters = &meshClusters[0];
+    int *pIndices = m_indexBuffer.begin();
+    const Mesh *pMeshes = &m_meshes[0];
+    const float *pPositions = pVertices->position;
+
+    Parallel::forEach(meshCount, [pMeshClusters, pIndices, pMeshes, pPositions](int i)
+    {
+        const Mesh &mesh = pMeshes[i];
+        std::vector<Cluster> &clusters = pMeshClusters[i];
+
+        MeshClusterizer::buildClusters(pIndices + mesh.startIndex, mesh.triangleCount * 3,
+            pPositions, static_cast<int>(sizeof(Vertex)), clusters);
+
+        for (int j = 0; j < static_cast<int>(clusters.size()); ++j)
+            clusters[j].startIndex += mesh.startIndex;
+    });
+
+    m_meshClusterOffsets.resize(meshCount + 1);
+    m_meshClusterOffsets[0] = 0;
+
+    for (int i = 0; i < meshCount; ++i)
+    {
+        m_meshClusterOffsets[i + 1] = m_meshClusterOffsets[i] + static_cast<int>(meshClusters[i].size());
+        m_clusters.insert(m_clusters.end(), meshClusters[i].begin(), meshClusters[i].end());
+    }
+
+    narrowIndexBuffer();
+}
+
+float ModelOBJ::calculateACMR() const
+{
+    std::vector<int> indices;
+    const int *pIndices = widenIndices(indices);
+
+    if (!pIndices)
+        return 0.0f;
+
+    return MeshOptimizer::calculateACMR(pIndices,
+        getNumberOfIndices(), getNumberOfVertices());
+}
+
+float ModelOBJ::calculateFetchedBytesPerTriangle() const
+{
+    std::vector<int> indices;
+    const int *pIndices = widenIndices(indices);
+
+    if (!pIndices)
+        return 0.0f;
+
+    return MeshOptimizer::calculateFetchedBytesPerTriangle(pIndices,
+        getNumberOfIndices(), getNumberOfVertices(), getVertexSize());
+}
+
+void ModelOBJ::buildVertexStreams()
+{
+    // Keeps a structure of arrays copy of the vertices (see VertexStreams)
+    // until releaseVertexStreams() is called. The copy is rebuilt whenever
+    // the vertices change and after every import() or loadCache(), and the
+    // bounds and scale() run on it with SIMD. The interleaved vertex buffer
+    // stays the one that's drawn. Quantized vertices have no streams.
+
+    if (!m_pVertexStreams)
+        m_pVertexStreams = new VertexStreams;
+
+    updateVertexStreams();
+}
+
+void ModelOBJ::destroy()
+{
+    m_hasTextureCoords = false;
+    m_hasVertexNormals = false;
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfFaces = 0;
+
+    m_directoryPath.clear();
+    m_materialLibraries.clear();
+
+    m_meshes.clear();
+    m_lodMeshes.clear();
+    m_lods.clear();
+    m_clusters.clear();
+    m_meshClusterOffsets.clear();
+    m_materials.clear();
+    m_vertexBuffer.clear();
+    m_tangentBuffer.clear();
+    m_indexBuffer.clear();
+    m_shortIndexBuffer.clear();
+    m_attributeBuffer.clear();
+    memset(&m_bounds, 0, sizeof(m_bounds));
+
+    delete m_pVertexQuantizer;
+    m_pVertexQuantizer = 0;
+
+    // Vertex streams that have been asked for stay on for the next model.
+    if (m_pVertexStreams)
+        m_pVertexStreams->destroy();
+
+    // The vertex and index buffers may refer to the mapped cache file.
+    // They've been cleared above so it's now safe to unmap it.
+    m_cacheFile.close();
+}
+
+void ModelOBJ::generateNormals(NormalWeighting weighting)
+{
+    // Vertex normals are built in three passes, each of which runs in
+    // parallel without any atomics or shared writes:
+    //
+    // 1. Face normals are calculated for blocks of triangles and stored in
+    //    structure of arrays form, several triangles at a time with SIMD.
+    // 2. A vertex to triangle corner adjacency table (in compressed sparse row
+    //    form) is built. Corners are listed in triangle order.
+    // 3. Every vertex gathers the face normals of its corners and normalizes
+    //    the sum. Because the corners are gathered in triangle order the sums
+    //    are identical to those of a serial loop over the triangles.
+    //
+    // Building the adjacency table costs more than it saves on a single core.
+    // There each block's face normals are added straight to the vertices while
+    // the block is still in the cache, which gives the same sums.
+    //
+    // Area weighting sums the unnormalized face normals, whose lengths are
+    // twice the triangle areas. Angle weighting sums unit face normals scaled
+    // by the angle of the triangle at the vertex.
+
+    dequantizeVertices();
+
+    int totalVertices = getNumberOfVertices();
+    int totalTriangles = getNumberOfTriangles();
+    bool angleWeighted = (weighting == NORMALS_ANGLE_WEIGHTED);
+    std::vector<int> indices;
+    const int *pIndices = widenIndices(indices);
+    Vertex *pVertices = m_vertexBuffer.begin();
+
+    int blockCount = (totalTriangles + NORMALS_BLOCK_SIZE - 1) / NORMALS_BLOCK_SIZE;
+
+    if (Parallel::getThreadCount() == 1)
+    {
+        std::vector<float> faceNormals(NORMALS_BLOCK_SIZE * 3);
+        std::vector<float> cornerAngles(angleWeighted ? NORMALS_BLOCK_SIZE * 3 : 0);
+
+        for (int i = 0; i < totalVertices; ++i)
+        {
+            pVertices[i].normal[0] = 0.0f;
+            pVertices[i].normal[1] = 0.0f;
+            pVertices[i].normal[2] = 0.0f;
+        }
+
+        for (int i = 0; i < blockCount; ++i)
+        {
+            int first = i * NORMALS_BLOCK_SIZE;
+            int count = (totalTriangles - first < NORMALS_BLOCK_SIZE) ? totalTriangles - first : NORMALS_BLOCK_SIZE;
+            const int *pBlockIndices = pIndices + first * 3;
+
+            CalculateFaceNormals(pVertices, pBlockIndices, count, faceNormals, cornerAngles);
+            AccumulateFaceNormals(pVertices, pBlockIndices, count, faceNormals, cornerAngles);
+        }
+
+        NormalizeVertexNormals(pVertices, totalVertices);
+        return;
+    }
+
+    std::vector<float> faceNormals(totalTriangles * 3);
+    std::vector<float> cornerAngles(angleWeighted ? totalTriangles * 3 : 0);
+    float *pFaceNormals = faceNormals.empty() ? 0 : &faceNormals[0];
+    float *pCornerAngles = cornerAngles.empty() ? 0 : &cornerAngles[0];
+
+    Parallel::forEach(blockCount, [pVertices, pIndices, pFaceNormals, pCornerAngles, totalTriangles](int i)
+    {
+        int first = i * NORMALS_BLOCK_SIZE;
+        int count = (totalTriangles - first < NORMALS_BLOCK_SIZE) ? totalTriangles - first : NORMALS_BLOCK_SIZE;
+        const int *pBlockIndices = pIndices + first * 3;
+
+        CalculateFaceNormals(pVertices, pBlockIndices, count, pFaceNormals + first,
+            pFaceNormals + totalTriangles + first, pFaceNormals + totalTriangles * 2 + first);
+
+        if (pCornerAngles)
+        {
+            CalculateCornerAngles(pVertices, pBlockIndices, count, pCornerAngles + first * 3);
+            NormalizeFaceNormals(count, pFaceNormals + first,
+                pFaceNormals + totalTriangles + first, pFaceNormals + totalTriangles * 2 + first);
+        }
+    });
+
+    std::vector<int> cornerOffsets;
+    std::vector<int> corners;
+
+    BuildVertexCorners(pIndices, totalTriangles * 3, totalVertices, cornerOffsets, corners);
+
+    const int *pCornerOffsets = &cornerOffsets[0];
+    const int *pCorners = corners.empty() ? 0 : &corners[0];
+
+    blockCount = (totalVertices + NORMALS_BLOCK_SIZE - 1) / NORMALS_BLOCK_SIZE;
+
+    Parallel::forEach(blockCount, [pVertices, pCornerOffsets, pCorners, pFaceNormals, pCornerAngles, totalVertices, totalTriangles](int i)
+    {
+        int first = i * NORMALS_BLOCK_SIZE;
+        int last = (totalVertices - first < NORMALS_BLOCK_SIZE) ? totalVertices : first + NORMALS_BLOCK_SIZE;
+        const float *pFaceX = pFaceNormals;
+        const float *pFaceY = pFaceNormals + totalTriangles;
+        const float *pFaceZ = pFaceNormals + totalTriangles * 2;
+
+        for (int vertex = first; vertex < last; ++vertex)
+        {
+            float normal[3] = {0.0f, 0.0f, 0.0f};
+
+            if (pCornerAngles)
+            {
+                for (int j = pCornerOffsets[vertex]; j < pCornerOffsets[vertex + 1]; ++j)
+                {
+                    int triangle = pCorners[j] / 3;
+                    float angle = pCornerAngles[pCorners[j]];
+
+                    normal[0] += pFaceX[triangle] * angle;
+                    normal[1] += pFaceY[triangle] * angle;
+                    normal[2] += pFaceZ[triangle] * angle;
+                }
+            }
+            else
+            {
+                for (int j = pCornerOffsets[vertex]; j < pCornerOffsets[vertex + 1]; ++j)
+                {
+                    int triangle = pCorners[j] / 3;
+
+                    normal[0] += pFaceX[triangle];
+                    normal[1] += pFaceY[triangle];
+                    normal[2] += pFaceZ[triangle];
+                }
+            }
+
+            pVertices[vertex].normal[0] = normal[0];
+            pVertices[vertex].normal[1] = normal[1];
+            pVertices[vertex].normal[2] = normal[2];
+        }
+
+        NormalizeVertexNormals(pVertices + first, last - first);
+    });
+
+    // While importStreaming() is running the vertex buffer only holds the
+    // current chunk.
+    if (!m_pImportArena)
+        updateVertexStreams();
+}
+
+int ModelOBJ::generateLods(const float *pTriangleRatios, int count)
+{
+    // Replaces any existing levels of detail with one level for each ratio
+    // of the full detail model's triangles (e.g., 0.5f for half). Every
+    // level is simplified from the full detail model rather than from the
+    // previous level so errors don't build up. Levels that don't have fewer
+    // triangles than the previous level are dropped. Returns the number of
+    // levels generated.
+    //
+    // Each mesh is simplified on its own by MeshSimplifier so every level
+    // keeps the model's materials. Positions shared by more than one mesh
+    // are locked so the boundaries between materials don't open up. Each
+    // level gets its own range of the index buffer after the full detail
+    // model, its own meshes (see getLodMesh()), and the largest geometric
+    // error of its simplification in model units. The levels share the
+    // vertex buffer. The methods that change the indices keep them up to
+    // date and they're written to the cache file.
+    //
+    // Call it before optimizeVertexCache() and optimizeVertexFetch() so the
+    // new index ranges get optimized as well.
+
+    widenIndexBuffer();
+
+    if (!m_lods.empty())
+    {
+        m_indexBuffer.resize(m_lods[0].startIndex);
+        m_lods.clear();
+        m_lodMeshes.clear();
+    }
+
+    int vertexCount = getNumberOfVertices();
+    int meshCount = getNumberOfMeshes();
+    int baseIndexCount = getNumberOfIndices();
+
+    if (vertexCount == 0 || meshCount == 0)
+    {
+        narrowIndexBuffer();
+        return 0;
+    }
+
+    // Lock every position that's used by more than one mesh. A vertex on the
+    // boundary between two materials then stays where it is in both meshes.
+
+    std::vector<Vertex> vertices;
+    const Vertex *pVertices = decodeVertices(vertices);
+    std::vector<int> positionRemap(vertexCount);
+    std::vector<int> positionMesh(vertexCount, -1);
+    std::vector<unsigned char> locked(vertexCount, 0);
+
+    MeshSimplifier::generatePositionRemap(pVertices->position, vertexCount,
+        static_cast<int>(sizeof(Vertex)), &positionRemap[0]);
+
+    for (int i = 0; i < meshCount; ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+
+        for (int j = mesh.startIndex; j < mesh.startIndex + mesh.triangleCount * 3; ++j)
+        {
+            int position = positionRemap[m_indexBuffer[j]];
+
+            if (positionMesh[position] == -1)
+                positionMesh[position] = i;
+            else if (positionMesh[position] != i)
+                locked[position] = 1;
+        }
+    }
+
+    for (int i = 0; i < vertexCount; ++i)
+        locked[i] = locked[positionRemap[i]];
+
+    // Each mesh is simplified into its own range of lodIndices.
+
+    std::vector<int> lodIndices(baseIndexCount);
+    std::vector<int> lodIndexCounts(meshCount);
+    std::vector<float> lodErrors(meshCount);
+
+    const Mesh *pMeshes = &m_meshes[0];
+    const unsigned char *pLocked = &locked[0];
+    int *pLodIndices = &lodIndices[0];
+    int *pLodIndexCounts = &lodIndexCounts[0];
+    float *pLodErrors = &lodErrors[0];
+    int previousTriangleCount = getNumberOfTriangles();
+
+    for (int level = 0; level < count; ++level)
+    {
+        const int *pIndices = m_indexBuffer.begin();
+        float ratio = pTriangleRatios[level];
+
+        Parallel::forEach(meshCount, [pMeshes, pVertices, pIndices, pLocked, pLodIndices, pLodIndexCounts, pLodErrors, ratio](int i)
+        {
+            const Mesh &mesh = pMeshes[i];
+            int targetIndexCount = static_cast<int>(mesh.triangleCount * ratio) * 3;
+
+            pLodIndexCounts[i] = MeshSimplifier::simplify(pLodIndices + mesh.startIndex,
+                pIndices + mesh.startIndex, mesh.triangleCount * 3, pVertices->position,
+                static_cast<int>(sizeof(Vertex)), targetIndexCount, FLT_MAX, pLocked,
+                &pLodErrors[i]);
+        });
+
+        Lod lod;
+
+        lod.startIndex = static_cast<int>(m_indexBuffer.size());
+        lod.triangleCount = 0;
+        lod.firstMesh = static_cast<int>(m_lodMeshes.size());
+        lod.meshCount = 0;
+        lod.error = 0.0f;
+
+        for (int i = 0; i < meshCount; ++i)
+            lod.triangleCount += lodIndexCounts[i] / 3;
+
+        if (lod.triangleCount >= previousTriangleCount)
+            continue;
+
+        for (int i = 0; i < meshCount; ++i)
+        {
+            if (lodIndexCounts[i] == 0)
+                continue;
+
+            Mesh mesh;
+
+            mesh.startIndex = static_cast<int>(m_indexBuffer.size());
+            mesh.triangleCount = lodIndexCounts[i] / 3;
+            mesh.materialIndex = m_meshes[i].materialIndex;
+
+            m_indexBuffer.resize(mesh.startIndex + lodIndexCounts[i]);
+            memcpy(&m_indexBuffer[mesh.startIndex], &lodIndices[m_meshes[i].startIndex],
+                lodIndexCounts[i] * sizeof(int));
+
+            m_lodMeshes.push_back(mesh);
+            ++lod.meshCount;
+
+            if (lodErrors[i] > lod.error)
+                lod.error = lodErrors[i];
+        }
+
+        m_lods.push_back(lod);
+        previousTriangleCount = lod.triangleCount;
+    }
+
+    updateMeshBounds(m_lodMeshes);
+    narrowIndexBuffer();
+    return static_cast<int>(m_lods.size());
+}
+
+bool ModelOBJ::generateTangents()
+{
+    // Tangents are built in four passes like the normals in generateNormals():
+    //
+    // 1. Every triangle corner gets a tangent from the triangle's position and
+    //    texture coordinate derivatives, projected onto the plane of the
+    //    corner's vertex normal and weighted by the corner angle. The meshes
+    //    are split into blocks of triangles which are processed in parallel.
+    // 2. The vertex to triangle corner adjacency table is built.
+    // 3. Vertices on mirror seams are split, the way MikkTSpace splits them,
+    //    and the adjacency table is built again. The levels of detail share
+    //    the vertices, so their triangles are pointed at the copy whose side
+    //    of the seam matches their own orientation. Clusters are rebuilt
+    //    since they may now use more vertices.
+    // 4. Every vertex sums the tangents of its corners in triangle order and
+    //    orthonormalizes the sum against its normal. Vertices are processed
+    //    in parallel blocks.
+    //
+    // Each tangent's w component is the bitangent sign:
+    // bitangent = w * cross(normal, tangent.xyz). The tangents are kept in a
+    // stream parallel to the vertex buffer so models that aren't normal
+    // mapped don't pay for them. The seam copies are added to the end of the
+    // vertex buffer and weldVertices() would merge them again, so call this
+    // after weldVertices() and before optimizeVertexFetch().
+    //
+    // Returns false and discards any existing tangents if the model has no
+    // texture coordinates.
+
+    m_tangentBuffer.clear();
+    dequantizeVertices();
+
+    if (!m_hasTextureCoords || m_vertexBuffer.empty())
+        return false;
+
+    widenIndexBuffer();
+
+    int totalVertices = getNumberOfVertices();
+    int totalTriangles = getNumberOfTriangles();
+    int *pIndices = m_indexBuffer.begin();
+    const Vertex *pVertices = m_vertexBuffer.begin();
+
+    std::vector<int> blockTriangles;
+    std::vector<int> blockCounts;
+
+    for (int i = 0; i < static_cast<int>(m_meshes.size()); ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+        int firstTriangle = mesh.startIndex / 3;
+
+        for (int j = 0; j < mesh.triangleCount; j += NORMALS_BLOCK_SIZE)
+        {
+            blockTriangles.push_back(firstTriangle + j);
+            blockCounts.push_back((mesh.triangleCount - j < NORMALS_BLOCK_SIZE) ? mesh.triangleCount - j : NORMALS_BLOCK_SIZE);
+        }
+    }
+
+    // Corners that don't belong to any mesh keep zero weight.
+    std::vector<float> cornerTangents(totalTriangles * 12, 0.0f);
+    float *pCornerTangents = cornerTangents.empty() ? 0 : &cornerTangents[0];
+    const int *pBlockTriangles = blockTriangles.empty() ? 0 : &blockTriangles[0];
+    const int *pBlockCounts = blockCounts.empty() ? 0 : &blockCounts[0];
+
+    Parallel::forEach(static_cast<int>(blockTriangles.size()), [pVertices, pIndices, pCornerTangents, pBlockTriangles, pBlockCounts](int i)
+    {
+        int first = pBlockTriangles[i];
+
+        CalculateCornerTangents(pVertices, pIndices + first * 3, pBlockCounts[i],
+            pCornerTangents + first * 12);
+    });
+
+    std::vector<int> cornerOffsets;
+    std::vector<int> corners;
+    std::vector<int> splitVertices;
+    std::vector<float> splitOrientations;
+
+    BuildVertexCorners(pIndices, totalTriangles * 3, totalVertices, cornerOffsets, corners);
+    SplitMirroredVertices(&cornerOffsets[0], corners.empty() ? 0 : &corners[0], totalVertices,
+        pCornerTangents, pIndices, splitVertices, splitOrientations);
+
+    if (!splitVertices.empty())
+    {
+        int splitCount = static_cast<int>(splitVertices.size());
+        std::vector<int> vertexSplits(totalVertices, -1);
+
+        m_vertexBuffer.resize(totalVertices + splitCount);
+
+        for (int i = 0; i < splitCount; ++i)
+        {
+            m_vertexBuffer[totalVertices + i] = m_vertexBuffer[splitVertices[i]];
+            vertexSplits[splitVertices[i]] = i;
+        }
+
+        pVertices = m_vertexBuffer.begin();
+
+        for (int i = getNumberOfIndices(); i < static_cast<int>(m_indexBuffer.size()); i += 3)
+        {
+            int *pTriangle = &pIndices[i];
+            float orientation = TextureOrientation(pVertices, pTriangle);
+
+            for (int j = 0; j < 3; ++j)
+            {
+                int split = vertexSplits[pTriangle[j]];
+
+                if (split >= 0 && orientation == splitOrientations[split])
+                    pTriangle[j] = totalVertices + split;
+            }
+        }
+
+        totalVertices += splitCount;
+        BuildVertexCorners(pIndices, totalTriangles * 3, totalVertices, cornerOffsets, corners);
+    }
+
+    m_tangentBuffer.resize(totalVertices);
+
+    Tangent *pTangents = m_tangentBuffer.begin();
+    const int *pCornerOffsets = &cornerOffsets[0];
+    const int *pCorners = corners.empty() ? 0 : &corners[0];
+    int blockCount = (totalVertices + NORMALS_BLOCK_SIZE - 1) / NORMALS_BLOCK_SIZE;
+
+    Parallel::forEach(blockCount, [pVertices, pTangents, pCornerOffsets, pCorners, pCornerTangents, totalVertices](int i)
+    {
+        int first = i * NORMALS_BLOCK_SIZE;
+        int last = (totalVertices - first < NORMALS_BLOCK_SIZE) ? totalVertices : first + NORMALS_BLOCK_SIZE;
+
+        for (int vertex = first; vertex < last; ++vertex)
+        {
+            ResolveVertexTangent(pVertices[vertex].normal, pCorners + pCornerOffsets[vertex],
+                pCornerOffsets[vertex + 1] - pCornerOffsets[vertex], pCornerTangents,
+                pTangents[vertex].tangent);
+        }
+    });
+
+    narrowIndexBuffer();
+
+    if (!splitVertices.empty())
+    {
+        updateVertexStreams();
+
+        if (!m_clusters.empty())
+            buildClusters();
+    }
+
+    return true;
+}
+
+void ModelOBJ::getIndices(int first, int count, int *pIndices) const
+{
+    // Copies count indices starting at first, widened to 32 bits.
+
+    if (m_shortIndexBuffer.empty())
+    {
+        memcpy(pIndices, m_indexBuffer.begin() + first, count * sizeof(int));
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+        pIndices[i] = m_shortIndexBuffer[first + i];
+}
+
+int ModelOBJ::getNumberOfVertices() const
+{
+    if (m_pVertexQuantizer)
+        return m_pVertexQuantizer->getNumberOfVertices();
+
+    return static_cast<int>(m_vertexBuffer.size());
+}
+
+int ModelOBJ::getVertexSize() const
+{
+    if (m_pVertexQuantizer)
+        return m_pVertexQuantizer->getVertexSize();
+
+    return static_cast<int>(sizeof(Vertex));
+}
+
+void ModelOBJ::getVertices(int first, int count, Vertex *pVertices) const
+{
+    // Copies count vertices starting at first, decoded to floats if they're
+    // quantized.
+
+    if (!m_pVertexQuantizer)
+    {
+        memcpy(pVertices, m_vertexBuffer.begin() + first, count * sizeof(Vertex));
+        return;
+    }
+
+    for (int i = 0; i < count; ++i)
+        m_pVertexQuantizer->dequantize(first + i, pVertices[i]);
+}
+
+bool ModelOBJ::import(const char *pszFilename)
+{
+    destroy();
+
+#if PERFORM_MEMORY_MAPPED_LOADING
+    MappedFile file;
+
+    if (!file.open(pszFilename))
+        return false;
+#else
+    std::ifstream stream(pszFilename);
+
+    if (!stream.is_open())
+        return false;
+#endif
+
+    // Extract the directory the OBJ file is in from the file name.
+    // This directory path will be used to load the OBJ's associated MTL file.
+
+    setDirectoryPath(pszFilename);
+
+    // All of the import's temporaries (the coordinate lists, the vertex
+    // de-duplication table, the material name lookup, and the parallel
+    // loader's chunks) come from one linear allocator and are released
+    // together once the geometry has been imported. Running out of memory,
+    // or going over the allocator's limit, fails the import. An allocator set
+    // with setImportAllocator() is reused by every import, which saves
+    // allocating new blocks each time; its limit is set on the allocator
+    // itself. The model's own buffers aren't counted and aren't limited.
+
+    LinearAllocator localAllocator;
+    LinearAllocator &allocator = m_pImportAllocator ? *m_pImportAllocator : localAllocator;
+    bool imported = false;
+
+    if (!m_pImportAllocator)
+        localAllocator.setLimit(m_importMemoryLimit);
+
+    allocator.reset();
+    m_pImportArena = &allocator;
+
+    try
+    {
+        MaterialCacheAllocator materialCacheAllocator(&allocator);
+        MaterialCache materialCache(std::less<ImportString>(), materialCacheAllocator);
+
+        m_pMaterialCache = &materialCache;
+
+        // Import the geometry and materials.
+        // This is done with either two passes or a single pass. Two pass
+        // loading goes through the file once to determine the amount of memory
+        // required. Single pass loading relies on the STL vector and map
+        // classes dynamically growing itself as more elements are added.
+
+#if PERFORM_MEMORY_MAPPED_LOADING
+        const char *pBegin = file.getData();
+        const char *pEnd = pBegin + file.getSize();
+
+#if PERFORM_PARALLEL_LOADING
+        imported = importGeometryParallel(pBegin, pEnd);
+#else
+#if PERFORM_TWO_PASS_LOADING
+        importGeometryFirstPass(pBegin, pEnd);
+#endif
+
+        imported = importGeometrySecondPass(pBegin, pEnd);
+#endif
+#else
+#if PERFORM_TWO_PASS_LOADING
+        importGeometryFirstPass(stream);
+#endif
+
+        importGeometrySecondPass(stream);
+        imported = true;
+#endif
+    }
+    catch (const std::bad_alloc &)
+    {
+        imported = false;
+    }
+
+    m_pMaterialCache = 0;
+    m_pVertexCache = 0;
+    m_vertexCacheSize = 0;
+    m_vertexCacheCount = 0;
+    m_pImportArena = 0;
+
+    // The peak is the size of the allocator's blocks rather than its peak
+    // allocation. Buffers that grew left their old copies in the blocks, and
+    // the blocks are what the memory limit caps.
+
+    m_importPeakBytes = allocator.getReservedBytes();
+    m_importTotalBytes = allocator.getTotalBytes();
+    allocator.reset();
+
+#if PERFORM_MEMORY_MAPPED_LOADING
+    file.close();
+#endif
+
+    if (!imported)
+        return false;
+
+    if (!buildMeshes())
+        return false;
+
+    updateVertexStreams();
+    updateBounds();
+
+#if REBUILD_NORMALS_DURING_IMPORT
+    generateNormals();
+#else
+    if (!hasVertexNormals())
+        generateNormals();
+#endif
+
+    narrowIndexBuffer();
+    return true;
+}
+
+ModelOBJ::StreamOptions::StreamOptions()
+    : memoryLimit(256 * 1024 * 1024), windowSize(4 * 1024 * 1024), chunkVertices(65536)
+{
+}
+
+struct ModelOBJ::StreamState
+{
+    StreamState(int maxPages, SpillFile *pSpillFile)
+        : vertexCoords(3, maxPages, pSpillFile),
+          textureCoords(2, maxPages, pSpillFile),
+          normals(3, maxPages, pSpillFile),
+          pCallback(0), chunkVertices(0), chunkIndices(0),
+          activeMaterial(0), chunkMaterial(0), chunkHasNormals(false),
+          boundsVertexCount(0)
+    {
+        memset(&bounds, 0, sizeof(bounds));
+    }
+
+    CoordinateTable vertexCoords;
+    CoordinateTable textureCoords;
+    CoordinateTable normals;
+
+    const StreamCallback *pCallback;
+    int chunkVertices;
+    int chunkIndices;
+    int activeMaterial;
+    int chunkMaterial;
+    bool chunkHasNormals;
+
+    // The face being read. It's only added to the chunk once it's known
+    // whether the chunk has room for it.
+    std::vector<Vertex> faceVertices;
+    std::vector<int> facePositions;
+
+    // The bounds of every chunk handed out so far.
+    MeshBounds::Bounds bounds;
+    int boundsVertexCount;
+};
+
+bool ModelOBJ::importStreaming(const char *pszFilename, const StreamOptions &options,
+                               const StreamCallback &callback)
+{
+    // Imports OBJ files that are too large to hold in memory. The file is
+    // read a window at a time and the triangles are handed to the callback
+    // in file order, in chunks that each use a single material and have
+    // their own vertex and index buffers. The same material may appear in
+    // many chunks. Chunks without vertex normals get normals generated from
+    // their own triangles, so there are seams along chunk boundaries.
+    //
+    // The coordinate lists are kept in pages. Only as many pages as fit in
+    // the memory limit stay in memory; the least recently used page is
+    // written to a spill file and read back when a face refers to it again.
+    // The material name lookup and the table of page locations aren't
+    // counted against the limit. Afterwards the model holds only the
+    // materials and the bounds of everything streamed. The bounding sphere
+    // is merged from the chunks' spheres, so it's looser than import()'s.
+    //
+    // The working memory is sized up front. Whatever the read window and a
+    // full chunk (its vertices, indices, and vertex de-duplication table)
+    // leave of the limit is split evenly into coordinate pages between the
+    // position, texture coordinate, and normal lists.
+
+    destroy();
+
+    if (options.chunkVertices < FACE_INDEX_CACHE_SIZE)
+        return false;
+
+    size_t windowSize = (options.windowSize > STREAM_MIN_WINDOW_SIZE) ? options.windowSize : STREAM_MIN_WINDOW_SIZE;
+    int chunkVertices = options.chunkVertices;
+    int chunkIndices = chunkVertices * 6;
+    size_t chunkBytes = static_cast<size_t>(chunkVertices) * (sizeof(Vertex) + 4 * sizeof(VertexCacheEntry)) +
+                        static_cast<size_t>(chunkIndices) * sizeof(int);
+    size_t pageBytes = STREAM_PAGE_SIZE * (3 + 2 + 3) * sizeof(float);
+
+    if (options.memoryLimit < windowSize + chunkBytes)
+        return false;
+
+    int maxPages = static_cast<int>((options.memoryLimit - windowSize - chunkBytes) / pageBytes);
+
+    if (maxPages < 2)
+        return false;
+
+    FILE *pFile = fopen(pszFilename, "rb");
+
+    if (!pFile)
+        return false;
+
+    setDirectoryPath(pszFilename);
+
+    SpillFile spillFile;
+    StreamState state(maxPages, &spillFile);
+    std::vector<char> window(windowSize);
+    LinearAllocator localAllocator;
+    LinearAllocator &allocator = m_pImportAllocator ? *m_pImportAllocator : localAllocator;
+    bool imported = false;
+
+    spillFile.setFilename(options.spillFilename.empty() ? std::string(pszFilename) + ".spill" : options.spillFilename);
+
+    state.pCallback = &callback;
+    state.chunkVertices = chunkVertices;
+    state.chunkIndices = chunkIndices;
+
+    if (!m_pImportAllocator)
+        localAllocator.setLimit(m_importMemoryLimit);
+
+    allocator.reset();
+    m_pImportArena = &allocator;
+
+    try
+    {
+        MaterialCacheAllocator materialCacheAllocator(&allocator);
+        MaterialCache materialCache(std::less<ImportString>(), materialCacheAllocator);
+
+        m_pMaterialCache = &materialCache;
+
+        importDefaultMaterial();
+        growVertexCache(chunkVertices * 2);
+        m_vertexBuffer.reserve(chunkVertices);
+        m_indexBuffer.reserve(chunkIndices);
+
+        // Each window is parsed up to its last complete line. The partial
+        // line at the end is moved to the front of the window and completed
+        // by the next read. A line that doesn't fit in the window fails the
+        // import.
+
+        size_t used = 0;
+        bool endOfFile = false;
+
+        imported = true;
+
+        while (imported && !endOfFile)
+        {
+            used += fread(&window[used], 1, window.size() - used, pFile);
+
+            if (ferror(pFile))
+            {
+                imported = false;
+                break;
+            }
+
+            endOfFile = (used < window.size());
+
+            const char *pBegin = &window[0];
+            const char *pEnd = pBegin + used;
+            const char *pLinesEnd = pEnd;
+
+            if (!endOfFile)
+            {
+                while (pLinesEnd > pBegin && pLinesEnd[-1] != '\n')
+                    --pLinesEnd;
+
+                if (pLinesEnd == pBegin)
+                {
+                    imported = false;
+                    break;
+                }
+            }
+
+            imported = importStreamLines(pBegin, pLinesEnd, state);
+            used = pEnd - pLinesEnd;
+            memmove(&window[0], pLinesEnd, used);
+        }
+
+        if (imported)
+            imported = flushStreamChunk(state);
+    }
+    catch (const std::bad_alloc &)
+    {
+        imported = false;
+    }
+
+    m_pMaterialCache = 0;
+    m_pVertexCache = 0;
+    m_vertexCacheSize = 0;
+    m_vertexCacheCount = 0;
+    m_pImportArena = 0;
+
+    size_t residentBytes = window.size() + m_vertexBuffer.capacity() * sizeof(Vertex) +
+                           m_indexBuffer.capacity() * sizeof(int) +
+                           state.vertexCoords.getResidentBytes() +
+                           state.textureCoords.getResidentBytes() +
+                           state.normals.getResidentBytes();
+
+    // Coordinate pages are never freed before the end, so the pages held at
+    // the end are also the most that were held at once. The allocator's
+    // blocks are counted the same way as in import().
+    m_importPeakBytes = residentBytes + allocator.getReservedBytes();
+    m_importTotalBytes = residentBytes + allocator.getTotalBytes();
+    allocator.reset();
+
+    MeshBuffer<Vertex>().swap(m_vertexBuffer);
+    MeshBuffer<int>().swap(m_indexBuffer);
+    spillFile.close();
+    fclose(pFile);
+
+    if (!imported)
+    {
+        destroy();
+        return false;
+    }
+
+    m_hasTextureCoords = state.textureCoords.size() > 0;
+    m_hasVertexNormals = state.normals.size() > 0;
+    m_numberOfVertexCoords = state.vertexCoords.size();
+    m_numberOfTextureCoords = state.textureCoords.size();
+    m_numberOfNormals = state.normals.size();
+
+    m_bounds = state.bounds;
+
+    return true;
+}
+
+bool ModelOBJ::loadCache(const char *pszCacheFilename, const char *pszFilename)
+{
+    // Loads a model previously written by saveCache(). The cache file is
+    // memory mapped (copy-on-write) and the vertex and index buffers refer
+    // directly to the mapped bytes, so nothing is parsed or copied. Encoded
+    // buffers are decoded straight into the model's own buffers. Changed MTL
+    // files are imported again by reloadMaterials(). Returns false if the
+    // cache doesn't exist, is damaged, was written for another OBJ file, or
+    // is out of date. In that case the model is left empty and the caller
+    // should import() the OBJ file again.
+    //
+    // The cache records the size, modification time, and content hash of the
+    // OBJ file and of every MTL file it refers to. Only the OBJ file makes it
+    // out of date. Changed MTL files replace the cached materials but the
+    // cache file itself isn't updated.
+
+    destroy();
+
+    // A cache saveCache() couldn't put in place is moved there now. If the
+    // old cache is still mapped the new one is loaded from where it was
+    // saved instead.
+
+    std::string pendingFilename = std::string(pszCacheFilename) + ".pending";
+    FileSystem::FileInfo pendingInfo;
+
+    if (FileSystem::getFileInfo(pendingFilename.c_str(), pendingInfo) &&
+        !FileSystem::replaceFile(pendingFilename.c_str(), pszCacheFilename))
+    {
+        pszCacheFilename = pendingFilename.c_str();
+    }
+
+    if (!m_cacheFile.open(pszCacheFilename, true))
+        return false;
+
+    const char *pBase = m_cacheFile.getData();
+    size_t fileSize = m_cacheFile.getSize();
+
+    if (fileSize < sizeof(CacheHeader))
+    {
+        destroy();
+        return false;
+    }
+
+    CacheHeader header;
+    memcpy(&header, pBase, sizeof(header));
+
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != CACHE_VERSION || header.vertexSize != sizeof(Vertex) ||
+        header.sectionCount > CACHE_MAX_SECTIONS ||
+        fileSize < sizeof(CacheHeader) + header.sectionCount * sizeof(CacheSection))
+    {
+        destroy();
+        return false;
+    }
+
+    const CacheSection *pSections = reinterpret_cast<const CacheSection *>(pBase + sizeof(CacheHeader));
+    const CacheSection *pDependencies = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_DEPENDENCIES, sizeof(CacheDependency), fileSize);
+    const CacheSection *pStrings = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_STRINGS, 1, fileSize);
+    const CacheSection *pMaterials = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_MATERIALS, sizeof(CacheMaterial), fileSize);
+    const CacheSection *pMeshes = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_MESHES, sizeof(Mesh), fileSize);
+    const CacheSection *pVertices = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_VERTICES, sizeof(Vertex), fileSize);
+    const CacheSection *pIndices = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_INDICES, sizeof(int), fileSize);
+    const CacheSection *pShortIndices = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_SHORT_INDICES, sizeof(unsigned short), fileSize);
+    const CacheSection *pTangents = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_TANGENTS, sizeof(Tangent), fileSize);
+    const CacheSection *pLods = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_LODS, sizeof(Lod), fileSize);
+    const CacheSection *pLodMeshes = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_LOD_MESHES, sizeof(Mesh), fileSize);
+    const CacheSection *pClusters = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_CLUSTERS, sizeof(Cluster), fileSize);
+    const CacheSection *pClusterOffsets = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_CLUSTER_OFFSETS, sizeof(int), fileSize);
+    const CacheSection *pEncodedVertices = FindEncodedCacheSection(pSections, header.sectionCount, CACHE_SECTION_ENCODED_VERTICES, fileSize);
+    const CacheSection *pEncodedIndices = FindEncodedCacheSection(pSections, header.sectionCount, CACHE_SECTION_ENCODED_INDICES, fileSize);
+    const CacheSection *pEncodedTangents = FindEncodedCacheSection(pSections, header.sectionCount, CACHE_SECTION_ENCODED_TANGENTS, fileSize);
+    const CacheSection *pQuantization = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_QUANTIZATION, sizeof(CacheQuantization), fileSize);
+    const CacheSection *pQuantizedVertices = 0;
+    const CacheSection *pEncodedQuantizedVertices = 0;
+    CacheQuantization quantization;
+
+    // Quantized vertices are only ever written in the layout that
+    // quantizeVertices() uses.
+
+    if (pQuantization && pQuantization->count == 1)
+    {
+        memcpy(&quantization, pBase + pQuantization->offset, sizeof(quantization));
+
+        if (quantization.normalFormat == VertexQuantizer::NORMAL_SNORM8 &&
+            quantization.texCoordFormat == VertexQuantizer::TEXCOORD_SNORM16)
+        {
+            VertexQuantizer quantizer;
+
+            quantizer.setNormalFormat(VertexQuantizer::NORMAL_SNORM8);
+            quantizer.setTexCoordFormat(VertexQuantizer::TEXCOORD_SNORM16);
+            pQuantizedVertices = FindCacheSection(pSections, header.sectionCount, CACHE_SECTION_QUANTIZED_VERTICES, quantizer.getVertexSize(), fileSize);
+            pEncodedQuantizedVertices = FindEncodedCacheSection(pSections, header.sectionCount, CACHE_SECTION_ENCODED_QUANTIZED_VERTICES, fileSize);
+        }
+    }
+
+    if (!pVertices)
+        pVertices = pEncodedVertices;
+
+    if (!pVertices)
+        pVertices = pQuantizedVertices;
+
+    if (!pVertices)
+        pVertices = pEncodedQuantizedVertices;
+
+    if (!pTangents)
+        pTangents = pEncodedTangents;
+
+    if (!pDependencies || !pStrings || !pMaterials || !pMeshes || !pVertices ||
+        (!pIndices && !pShortIndices && !pEncodedIndices) || pDependencies->count == 0 ||
+        (pTangents && pTangents->count != pVertices->count) || (!pLods != !pLodMeshes) ||
+        (!pClusters != !pClusterOffsets) || (pClusterOffsets && pClusterOffsets->count != pMeshes->count + 1))
+    {
+        destroy();
+        return false;
+    }
+
+    unsigned int indexCount = pIndices ? pIndices->count : (pShortIndices ? pShortIndices->count : pEncodedIndices->count);
+
+    const char *pStringData = pBase + pStrings->offset;
+    std::vector<std::string> dependencyPaths;
+    std::vector<int> touchedDependencies;
+    bool materialsChanged = false;
+
+    // The first dependency is the OBJ file itself. The others are the MTL
+    // files it referred to, including ones that couldn't be opened.
+
+    for (unsigned int i = 0; i < pDependencies->count; ++i)
+    {
+        CacheDependency dependency;
+        memcpy(&dependency, pBase + pDependencies->offset + i * sizeof(CacheDependency), sizeof(dependency));
+
+        if (static_cast<unsigned long long>(dependency.pathOffset) + dependency.pathLength > pStrings->size)
+        {
+            destroy();
+            return false;
+        }
+
+        std::string path(pStringData + dependency.pathOffset, dependency.pathLength);
+        FileSystem::FileInfo info;
+        bool exists = FileSystem::getFileInfo(path.c_str(), info);
+
+        if ((i == 0 && path != pszFilename) || exists != (dependency.exists != 0))
+        {
+            destroy();
+            return false;
+        }
+
+        dependencyPaths.push_back(path);
+
+        if (!exists || (info.size == dependency.size && info.modificationTime == dependency.modificationTime))
+            continue;
+
+        // The file has been touched. It's only out of date if its contents
+        // have changed as well. A changed MTL file only invalidates the
+        // materials.
+
+        unsigned long long hash = 0;
+
+        if (info.size != dependency.size || !FileSystem::hashFile(path.c_str(), hash) || hash != dependency.hash)
+        {
+            if (i == 0)
+            {
+                destroy();
+                return false;
+            }
+
+            materialsChanged = true;
+            continue;
+        }
+
+        touchedDependencies.push_back(i);
+    }
+
+    // Everything checks out. Point the model at the cached data.
+
+    m_hasTextureCoords = (header.flags & CACHE_FLAG_TEXTURE_COORDS) != 0;
+    m_hasVertexNormals = (header.flags & CACHE_FLAG_VERTEX_NORMALS) != 0;
+
+    m_bounds = header.bounds;
+
+    for (unsigned int i = 0; i < pMaterials->count; ++i)
+    {
+        CacheMaterial cached;
+        memcpy(&cached, pBase + pMaterials->offset + i * sizeof(CacheMaterial), sizeof(cached));
+
+        if (static_cast<unsigned long long>(cached.colorMapOffset) + cached.colorMapLength > pStrings->size ||
+            static_cast<unsigned long long>(cached.nameOffset) + cached.nameLength > pStrings->size)
+        {
+            destroy();
+            return false;
+        }
+
+        Material material;
+        memcpy(material.ambient, cached.ambient, sizeof(material.ambient));
+        memcpy(material.diffuse, cached.diffuse, sizeof(material.diffuse));
+        memcpy(material.specular, cached.specular, sizeof(material.specular));
+        material.shininess = cached.shininess;
+        material.alpha = cached.alpha;
+        material.colorMapFilename.assign(pStringData + cached.colorMapOffset, cached.colorMapLength);
+        material.name.assign(pStringData + cached.nameOffset, cached.nameLength);
+        m_materials.push_back(material);
+    }
+
+    m_materialLibraries.assign(dependencyPaths.begin() + 1, dependencyPaths.end());
+
+    if (materialsChanged && !reloadMaterials())
+    {
+        destroy();
+        return false;
+    }
+
+    const Mesh *pMesh = reinterpret_cast<const Mesh *>(pBase + pMeshes->offset);
+    m_meshes.assign(pMesh, pMesh + pMeshes->count);
+
+    if (pLods)
+    {
+        const Lod *pLod = reinterpret_cast<const Lod *>(pBase + pLods->offset);
+        const Mesh *pLodMesh = reinterpret_cast<const Mesh *>(pBase + pLodMeshes->offset);
+
+        m_lods.assign(pLod, pLod + pLods->count);
+        m_lodMeshes.assign(pLodMesh, pLodMesh + pLodMeshes->count);
+    }
+
+    if (pClusters)
+    {
+        const Cluster *pCluster = reinterpret_cast<const Cluster *>(pBase + pClusters->offset);
+        const int *pClusterOffset = reinterpret_cast<const int *>(pBase + pClusterOffsets->offset);
+
+        m_clusters.assign(pCluster, pCluster + pClusters->count);
+        m_meshClusterOffsets.assign(pClusterOffset, pClusterOffset + pClusterOffsets->count);
+    }
+
+    // The levels of detail follow the full detail model in the index buffer
+    // in order and each level's meshes lie within its range.
+
+    int materialCount = static_cast<int>(m_materials.size());
+    unsigned long long rangeEnd = m_lods.empty() ? indexCount : static_cast<unsigned int>(m_lods[0].startIndex);
+
+    for (int i = 0; i < static_cast<int>(m_meshes.size()); ++i)
+    {
+        if (!IsValidMesh(m_meshes[i], 0, rangeEnd, materialCount))
+        {
+            destroy();
+            return false;
+        }
+    }
+
+    for (int i = 0; i < static_cast<int>(m_lods.size()); ++i)
+    {
+        const Lod &lod = m_lods[i];
+        unsigned long long lodStart = static_cast<unsigned int>(lod.startIndex);
+
+        if (lod.startIndex < 0 || lod.triangleCount < 0 || lod.firstMesh < 0 || lod.meshCount < 0 ||
+            lodStart < rangeEnd || lodStart + lod.triangleCount * 3ULL > indexCount ||
+            static_cast<unsigned long long>(lod.firstMesh) + lod.meshCount > m_lodMeshes.size())
+        {
+            destroy();
+            return false;
+        }
+
+        rangeEnd = lodStart + lod.triangleCount * 3ULL;
+
+        for (int j = lod.firstMesh; j < lod.firstMesh + lod.meshCount; ++j)
+        {
+            if (!IsValidMesh(m_lodMeshes[j], lodStart, rangeEnd, materialCount))
+            {
+                destroy();
+                return false;
+            }
+        }
+    }
+
+    // Each mesh's clusters lie within the mesh.
+
+    if (!m_meshClusterOffsets.empty() &&
+        (m_meshClusterOffsets.front() != 0 || m_meshClusterOffsets.back() != static_cast<int>(m_clusters.size())))
+    {
+        destroy();
+        return false;
+    }
+
+    for (int i = 0; i + 1 < static_cast<int>(m_meshClusterOffsets.size()); ++i)
+    {
+        const Mesh &mesh = m_meshes[i];
+
+        if (m_meshClusterOffsets[i + 1] < m_meshClusterOffsets[i] ||
+            m_meshClusterOffsets[i + 1] > static_cast<int>(m_clusters.size()))
+        {
+            destroy();
+            return false;
+        }
+
+        for (int j = m_meshClusterOffsets[i]; j < m_meshClusterOffsets[i + 1]; ++j)
+        {
+            const Cluster &cluster = m_clusters[j];
+
+            if (cluster.startIndex < mesh.startIndex || cluster.triangleCount <= 0 ||
+                cluster.triangleCount > MeshClusterizer::MAX_TRIANGLES ||
+                cluster.startIndex - mesh.startIndex > (mesh.triangleCount - cluster.triangleCount) * 3)
+            {
+                destroy();
+                return false;
+            }
+        }
+    }
+
+    char *pWritableBase = m_cacheFile.getWritableData();
+    const unsigned char *pEncodedBase = reinterpret_cast<const unsigned char *>(pBase);
+
+    if (pVertices == pQuantizedVertices || pVertices == pEncodedQuantizedVertices)
+    {
+        m_pVertexQuantizer = new VertexQuantizer;
+        m_pVertexQuantizer->setNormalFormat(VertexQuantizer::NORMAL_SNORM8);
+        m_pVertexQuantizer->setTexCoordFormat(VertexQuantizer::TEXCOORD_SNORM16);
+        m_pVertexQuantizer->setUniformPositionScale(true);
+        m_pVertexQuantizer->setPositionBounds(quantization.positionCenter, quantization.positionExtent);
+        m_pVertexQuantizer->setTexCoordBounds(quantization.texCoordMin, quantization.texCoordRange);
+
+        if (pVertices == pQuantizedVertices)
+        {
+            m_pVertexQuantizer->attach(reinterpret_cast<unsigned char *>(pWritableBase + pVertices->offset), pVertices->count);
+        }
+        else
+        {
+            int vertexSize = m_pVertexQuantizer->getVertexSize();
+            std::vector<unsigned char> vertices(static_cast<size_t>(pVertices->count) * vertexSize);
+
+            if (!MeshCodec::decodeVertexBuffer(vertices.empty() ? 0 : &vertices[0], pVertices->count, vertexSize,
+                                               pEncodedBase + pVertices->offset, static_cast<size_t>(pVertices->size)))
+            {
+                destroy();
+                return false;
+            }
+
+            m_pVertexQuantizer->assign(vertices.empty() ? 0 : &vertices[0], pVertices->count);
+        }
+    }
+    else if (pVertices != pEncodedVertices)
+    {
+        m_vertexBuffer.attach(reinterpret_cast<Vertex *>(pWritableBase + pVertices->offset), pVertices->count);
+    }
+    else
+    {
+        m_vertexBuffer.resize(pVertices->count);
+
+        if (!MeshCodec::decodeVertexBuffer(m_vertexBuffer.begin(), pVertices->count, sizeof(Vertex),
+                                           pEncodedBase + pVertices->offset, static_cast<size_t>(pVertices->size)))
+        {
+            destroy();
+            return false;
+        }
+    }
+
+    if (pTangents && pTangents != pEncodedTangents)
+    {
+        m_tangentBuffer.attach(reinterpret_cast<Tangent *>(pWritableBase + pTangents->offset), pTangents->count);
+    }
+    else if (pTangents)
+    {
+        m_tangentBuffer.resize(pTangents->count);
+
+        if (!MeshCodec::decodeVertexBuffer(m_tangentBuffer.begin(), pTangents->count, sizeof(Tangent),
+                                           pEncodedBase + pTangents->offset, static_cast<size_t>(pTangents->size)))
+        {
+            destroy();
+            return false;
+        }
+    }
+
+    if (pIndices)
+    {
+        m_indexBuffer.attach(reinterpret_cast<int *>(pWritableBase + pIndices->offset), pIndices->count);
+    }
+    else if (!pShortIndices)
+    {
+        m_indexBuffer.resize(indexCount);
+
+        if (!MeshCodec::decodeIndexBuffer(m_indexBuffer.begin(), static_cast<int>(indexCount),
+                                          pEncodedBase + pEncodedIndices->offset, static_cast<size_t>(pEncodedIndices->size)))
+        {
+            destroy();
+            return false;
+        }
+    }
+    else
+    {
+        m_shortIndexBuffer.attach(reinterpret_cast<unsigned short *>(pWritableBase + pShortIndices->offset), pShortIndices->count);
+    }
+
+    for (int i = 0; i < static_cast<int>(indexCount); ++i)
+    {
+        if (static_cast<unsigned int>(getIndex(i)) >= pVertices->count)
+        {
+            destroy();
+            return false;
+        }
+    }
+
+    // Decoded indices, and 32-bit indices cached for a model that fits in
+    // 16 bits, are narrowed.
+
+    narrowIndexBuffer();
+    updateVertexStreams();
+
+    setDirectoryPath(pszFilename);
+
+    // Record the new modification times of touched but unchanged files so the
+    // next load doesn't need to hash them again. This is only an optimization
+    // so failures are ignored.
+
+    if (!touchedDependencies.empty())
+    {
+        FILE *pFile = fopen(pszCacheFilename, "r+b");
+
+        if (pFile)
+        {
+            for (int i = 0; i < static_cast<int>(touchedDependencies.size()); ++i)
+            {
+                size_t offset = static_cast<size_t>(pDependencies->offset) +
+                                touchedDependencies[i] * sizeof(CacheDependency);
+                CacheDependency dependency;
+                FileSystem::FileInfo info;
+
+                memcpy(&dependency, pBase + offset, sizeof(dependency));
+
+                if (FileSystem::getFileInfo(dependencyPaths[touchedDependencies[i]].c_str(), info))
+                {
+                    dependency.modificationTime = info.modificationTime;
+
+                    if (fseek(pFile, static_cast<long>(offset), SEEK_SET) == 0)
+                        fwrite(&dependency, sizeof(dependency), 1, pFile);
+                }
+            }
+
+            fclose(pFile);
+        }
+    }
+
+    return true;
+}
+
+void ModelOBJ::normalize(float scaleTo, bool center)
+{
+    // The bounds are always up to date, so the model doesn't need to be
+    // measured first, and scale() transforms them afterwards.
+
+    float scalingFactor = scaleTo / m_bounds.radius;
+    float offset[3];
+
+    if (center)
+    {
+        offset[0] = -m_bounds.center[0];
+        offset[1] = -m_bounds.center[1];
+        offset[2] = -m_bounds.center[2];
+    }
+    else
+    {
+        offset[0] = 0.0f;
+        offset[1] = 0.0f;
+        offset[2] = 0.0f;
+    }
+
+    scale(scalingFactor, offset);
+}
+
+void ModelOBJ::optimizeVertexCache()
+{
+    // Reorders each mesh's triangles for the post transform vertex cache.
+    // Each mesh is a separate range of the index buffer so the meshes can be
+    // optimized independently and in parallel, and triangles never move
+    // between meshes. The meshes of the levels of detail are optimized along
+    // with the full detail ones. Clusters follow the triangle order so
+    // they're rebuilt if there are any.
+
+    widenIndexBuffer();
+
+    int vertexCount = getNumberOfVertices();
+    int meshCount = static_cast<int>(m_meshes.size());
+    int *pIndices = m_indexBuffer.begin();
+    const Mesh *pMeshes = m_meshes.empty() ? 0 : &m_meshes[0];
+    const Mesh *pLodMeshes = m_lodMeshes.empty() ? 0 : &m_lodMeshes[0];
+
+    Parallel::forEach(meshCount + static_cast<int>(m_lodMeshes.size()), [pIndices, pMeshes, pLodMeshes, meshCount, vertexCount](int i)
+    {
+        const Mesh &mesh = (i < meshCount) ? pMeshes[i] : pLodMeshes[i - meshCount];
+
+        MeshOptimizer::optimizeVertexCache(pIndices + mesh.startIndex,
+            mesh.triangleCount * 3, vertexCount);
+    });
+
+    narrowIndexBuffer();
+
+    if (!m_clusters.empty())
+        buildClusters();
+}
+
+void ModelOBJ::optimizeVertexFetch()
+{
+    // Renumbers the vertices in the order they're first drawn so vertex
+    // fetches walk through the vertex buffer in order. Call it after
+    // optimizeVertexCache(). The meshes share the vertex buffer so the whole
+    // index buffer is processed at once. The vertices end up grouped by mesh
+    // in draw order. The tangents, if any, are moved along with their
+    // vertices.
+
+    dequantizeVertices();
+
+    int vertexCount = static_cast<int>(m_vertexBuffer.size());
+
+    if (vertexCount == 0)
+        return;
+
+    std::vector<int> remap(vertexCount);
+
+    widenIndexBuffer();
+
+    MeshOptimizer::generateVertexFetchRemap(m_indexBuffer.begin(),
+        static_cast<int>(m_indexBuffer.size()), vertexCount, &remap[0]);
+    MeshOptimizer::remapIndexBuffer(m_indexBuffer.begin(),
+        static_cast<int>(m_indexBuffer.size()), &remap[0]);
+    MeshOptimizer::remapVertexBuffer(m_vertexBuffer.begin(), vertexCount,
+        static_cast<int>(sizeof(Vertex)), &remap[0]);
+
+    if (!m_tangentBuffer.empty())
+    {
+        MeshOptimizer::remapVertexBuffer(m_tangentBuffer.begin(), vertexCount,
+            static_cast<int>(sizeof(Tangent)), &remap[0]);
+    }
+
+    narrowIndexBuffer();
+    updateVertexStreams();
+}
+
+bool ModelOBJ::quantizeVertices(float maxPositionError, float maxTexCoordError, float maxNormalError)
+{
+    // Replaces the 32 byte float vertices with 16 byte quantized ones (see
+    // VertexQuantizer): positions as 3 x snorm16 with one scale for all three
+    // axes, texture coordinates as 2 x snorm16, and normals as 3 x snorm8.
+    // The fixed function pipeline draws them directly with the quantizer's
+    // bounds in the modelview and texture matrices. Fails and keeps the float
+    // vertices if any attribute's error is larger than its bound. The methods
+    // that change the vertices turn them back into floats first, so quantize
+    // last. The tangents stay floats.
+    //
+    // Quantized vertices are decoded and quantized again with the new bounds.
+
+    dequantizeVertices();
+
+    if (m_vertexBuffer.empty())
+        return false;
+
+    std::unique_ptr<VertexQuantizer> pQuantizer(new VertexQuantizer);
+
+    pQuantizer->setNormalFormat(VertexQuantizer::NORMAL_SNORM8);
+    pQuantizer->setTexCoordFormat(VertexQuantizer::TEXCOORD_SNORM16);
+    pQuantizer->setUniformPositionScale(true);
+    pQuantizer->setErrorBound(maxPositionError, maxTexCoordError, maxNormalError);
+
+    if (!pQuantizer->quantize(m_vertexBuffer.begin(), static_cast<int>(m_vertexBuffer.size())))
+        return false;
+
+    m_pVertexQuantizer = pQuantizer.release();
+    MeshBuffer<Vertex>().swap(m_vertexBuffer);
+
+    if (m_pVertexStreams)
+        m_pVertexStreams->destroy();
+
+    // The decoded positions are up to the position error away from the
+    // originals on each axis, which can move them out of the bounding boxes
+    // and spheres. The boxes are measured again. Measuring the cluster
+    // spheres again would need the clusters rebuilt, so they grow instead.
+
+    updateBounds();
+
+    float positionError = m_pVertexQuantizer->getPositionError() * sqrtf(3.0f);
+
+    for (int i = 0; i < static_cast<int>(m_clusters.size()); ++i)
+        m_clusters[i].radius += positionError;
+
+    return true;
+}
+
+void ModelOBJ::releaseVertexStreams()
+{
+    delete m_pVertexStreams;
+    m_pVertexStreams = 0;
+}
+
+void ModelOBJ::reverseWinding()
+{
+    int swap = 0;
+
+    dequantizeVertices();
+    widenIndexBuffer();
+
+    // Reverse face winding.
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); i += 3)
+    {
+        swap = m_indexBuffer[i + 1];
+        m_indexBuffer[i + 1] = m_indexBuffer[i + 2];
+        m_indexBuffer[i + 2] = swap;
+    }
+
+    narrowIndexBuffer();
+
+    float *pNormal = 0;
+
+    // Invert normals.
+    for (int i = 0; i < static_cast<int>(m_vertexBuffer.size()); ++i)
+    {
+        pNormal = m_vertexBuffer[i].normal;
+        pNormal[0] = -pNormal[0];
+        pNormal[1] = -pNormal[1];
+        pNormal[2] = -pNormal[2];
+    }
+
+    updateVertexStreams();
+
+    // The texture space orientation of every face flips with the winding.
+    for (int i = 0; i < static_cast<int>(m_tangentBuffer.size()); ++i)
+        m_tangentBuffer[i].tangent[3] = -m_tangentBuffer[i].tangent[3];
+
+    // So do the clusters' normal cones.
+    for (int i = 0; i < static_cast<int>(m_clusters.size()); ++i)
+    {
+        float *pAxis = m_clusters[i].coneAxis;
+        pAxis[0] = -pAxis[0];
+        pAxis[1] = -pAxis[1];
+        pAxis[2] = -pAxis[2];
+    }
+}
+
+bool ModelOBJ::saveCache(const char *pszCacheFilename, const char *pszFilename, bool compress) const
+{
+    // Writes the imported model to a binary cache file that loadCache() can
+    // map back into memory. pszFilename is the OBJ file the model was
+    // imported from. The cache is written to a temporary file which then
+    // replaces pszCacheFilename, so a cache that's being loaded by someone
+    // else is never seen half written.
+    //
+    // Windows won't replace a file while another model still has it mapped,
+    // which is the case when a model is reloaded. The new cache is then left
+    // next to the old one with a ".pending" suffix and loadCache() moves it
+    // into place once the old cache is no longer mapped.
+    //
+    // With compress set the vertices, indices, and tangents are encoded with
+    // MeshCodec. Their sections count the elements they decode to. Quantized
+    // vertices are encoded the same way. The encoding is lossless. Once
+    // optimizeVertexCache() and optimizeVertexFetch() have been run the file
+    // usually ends up 1.5 to 3.5 times smaller. The indices are stored at the
+    // model's index width.
+    //
+    // Cache file layout. All sections start on a 16 byte boundary.
+    //
+    //  CacheHeader
+    //  CacheSection[sectionCount]
+    //  Dependencies    CacheDependency per file (OBJ first, then MTL files)
+    //  Strings         file names referred to by the other sections
+    //  Materials       CacheMaterial per material
+    //  Meshes          Mesh per mesh
+    //  Vertices        Vertex per vertex, or encoded (only if not quantized)
+    //  Quantization    one CacheQuantization (only if quantized)
+    //  Quantized       VertexQuantizer vertex per vertex, or encoded (only if
+    //                  quantized)
+    //  Indices         int or unsigned short per index, or encoded
+    //  Tangents        Tangent per vertex, or encoded (only if generated)
+    //  Lods            Lod per level of detail (only if generated)
+    //  LodMeshes       Mesh per level of detail mesh (only if generated)
+    //  Clusters        Cluster per cluster (only if built)
+    //  ClusterOffsets  first Cluster of each Mesh plus the total (only if built)
+
+    std::vector<std::string> dependencyPaths;
+    std::vector<CacheDependency> dependencies;
+    std::vector<CacheMaterial> materials;
+    std::vector<unsigned char> encodedVertices;
+    std::vector<unsigned char> encodedIndices;
+    std::vector<unsigned char> encodedTangents;
+    CacheQuantization quantization;
+    std::string strings;
+
+    dependencyPaths.push_back(pszFilename);
+    dependencyPaths.insert(dependencyPaths.end(), m_materialLibraries.begin(), m_materialLibraries.end());
+
+    for (int i = 0; i < static_cast<int>(dependencyPaths.size()); ++i)
+    {
+        const std::string &path = dependencyPaths[i];
+        CacheDependency dependency;
+        FileSystem::FileInfo info;
+
+        memset(&dependency, 0, sizeof(dependency));
+        dependency.pathOffset = static_cast<unsigned int>(strings.size());
+        dependency.pathLength = static_cast<unsigned int>(path.size());
+        strings.append(path);
+        strings.push_back('\0');
+
+        if (FileSystem::getFileInfo(path.c_str(), info))
+        {
+            if (!FileSystem::hashFile(path.c_str(), dependency.hash))
+                return false;
+
+            dependency.exists = 1;
+            dependency.size = info.size;
+            dependency.modificationTime = info.modificationTime;
+        }
+        else if (i == 0)
+        {
+            return false;
+        }
+
+        dependencies.push_back(dependency);
+    }
+
+    for (int i = 0; i < static_cast<int>(m_materials.size()); ++i)
+    {
+        const Material &material = m_materials[i];
+        CacheMaterial cached;
+
+        memset(&cached, 0, sizeof(cached));
+        memcpy(cached.ambient, material.ambient, sizeof(cached.ambient));
+        memcpy(cached.diffuse, material.diffuse, sizeof(cached.diffuse));
+        memcpy(cached.specular, material.specular, sizeof(cached.specular));
+        cached.shininess = material.shininess;
+        cached.alpha = material.alpha;
+        cached.colorMapOffset = static_cast<unsigned int>(strings.size());
+        cached.colorMapLength = static_cast<unsigned int>(material.colorMapFilename.size());
+        strings.append(material.colorMapFilename);
+        strings.push_back('\0');
+        cached.nameOffset = static_cast<unsigned int>(strings.size());
+        cached.nameLength = static_cast<unsigned int>(material.name.size());
+        strings.append(material.name);
+        strings.push_back('\0');
+        materials.push_back(cached);
+    }
+
+    CacheHeader header;
+    CacheSection sections[12];
+    const void *pSectionData[12];
+    int sectionCount = 0;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+    header.version = CACHE_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.flags = (m_hasTextureCoords ? CACHE_FLAG_TEXTURE_COORDS : 0) |
+                   (m_hasVertexNormals ? CACHE_FLAG_VERTEX_NORMALS : 0);
+    header.bounds = m_bounds;
+
+    AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_DEPENDENCIES,
+        dependencies.empty() ? 0 : &dependencies[0], dependencies.size(), sizeof(CacheDependency));
+    AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_STRINGS,
+        strings.data(), strings.size(), 1);
+    AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_MATERIALS,
+        materials.empty() ? 0 : &materials[0], materials.size(), sizeof(CacheMaterial));
+    AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_MESHES,
+        m_meshes.empty() ? 0 : &m_meshes[0], m_meshes.size(), sizeof(Mesh));
+    if (m_pVertexQuantizer)
+    {
+        memset(&quantization, 0, sizeof(quantization));
+        memcpy(quantization.positionCenter, m_pVertexQuantizer->getPositionCenter(), sizeof(quantization.positionCenter));
+        memcpy(quantization.positionExtent, m_pVertexQuantizer->getPositionExtent(), sizeof(quantization.positionExtent));
+        memcpy(quantization.texCoordMin, m_pVertexQuantizer->getTexCoordMin(), sizeof(quantization.texCoordMin));
+        memcpy(quantization.texCoordRange, m_pVertexQuantizer->getTexCoordRange(), sizeof(quantization.texCoordRange));
+        quantization.normalFormat = m_pVertexQuantizer->getNormalFormat();
+        quantization.texCoordFormat = m_pVertexQuantizer->getTexCoordFormat();
+
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_QUANTIZATION,
+            &quantization, 1, sizeof(CacheQuantization));
+    }
+    if (m_pVertexQuantizer && compress)
+    {
+        MeshCodec::encodeVertexBuffer(encodedVertices, m_pVertexQuantizer->getVertexBuffer(),
+            m_pVertexQuantizer->getNumberOfVertices(), m_pVertexQuantizer->getVertexSize());
+
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_ENCODED_QUANTIZED_VERTICES,
+            encodedVertices.empty() ? 0 : &encodedVertices[0], encodedVertices.size(), 1);
+        sections[sectionCount - 1].count = static_cast<unsigned int>(m_pVertexQuantizer->getNumberOfVertices());
+    }
+    else if (m_pVertexQuantizer)
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_QUANTIZED_VERTICES,
+            m_pVertexQuantizer->getVertexBuffer(), m_pVertexQuantizer->getNumberOfVertices(),
+            m_pVertexQuantizer->getVertexSize());
+    }
+    else if (compress)
+    {
+        MeshCodec::encodeVertexBuffer(encodedVertices, m_vertexBuffer.begin(),
+            static_cast<int>(m_vertexBuffer.size()), sizeof(Vertex));
+
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_ENCODED_VERTICES,
+            encodedVertices.empty() ? 0 : &encodedVertices[0], encodedVertices.size(), 1);
+        sections[sectionCount - 1].count = static_cast<unsigned int>(m_vertexBuffer.size());
+    }
+    else
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_VERTICES,
+            m_vertexBuffer.begin(), m_vertexBuffer.size(), sizeof(Vertex));
+    }
+    if (compress)
+    {
+        std::vector<int> indices;
+        const int *pIndices = widenIndices(indices);
+        size_t indexCount = m_indexBuffer.size() + m_shortIndexBuffer.size();
+
+        MeshCodec::encodeIndexBuffer(encodedIndices, pIndices, static_cast<int>(indexCount));
+
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_ENCODED_INDICES,
+            encodedIndices.empty() ? 0 : &encodedIndices[0], encodedIndices.size(), 1);
+        sections[sectionCount - 1].count = static_cast<unsigned int>(indexCount);
+    }
+    else if (m_shortIndexBuffer.empty())
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_INDICES,
+            m_indexBuffer.begin(), m_indexBuffer.size(), sizeof(int));
+    }
+    else
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_SHORT_INDICES,
+            m_shortIndexBuffer.begin(), m_shortIndexBuffer.size(), sizeof(unsigned short));
+    }
+    if (!m_tangentBuffer.empty() && compress)
+    {
+        MeshCodec::encodeVertexBuffer(encodedTangents, m_tangentBuffer.begin(),
+            static_cast<int>(m_tangentBuffer.size()), sizeof(Tangent));
+
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_ENCODED_TANGENTS,
+            &encodedTangents[0], encodedTangents.size(), 1);
+        sections[sectionCount - 1].count = static_cast<unsigned int>(m_tangentBuffer.size());
+    }
+    else if (!m_tangentBuffer.empty())
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_TANGENTS,
+            m_tangentBuffer.begin(), m_tangentBuffer.size(), sizeof(Tangent));
+    }
+    if (!m_lods.empty())
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_LODS,
+            &m_lods[0], m_lods.size(), sizeof(Lod));
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_LOD_MESHES,
+            m_lodMeshes.empty() ? 0 : &m_lodMeshes[0], m_lodMeshes.size(), sizeof(Mesh));
+    }
+    if (!m_clusters.empty())
+    {
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_CLUSTERS,
+            &m_clusters[0], m_clusters.size(), sizeof(Cluster));
+        AddCacheSection(sections, pSectionData, sectionCount, CACHE_SECTION_CLUSTER_OFFSETS,
+            &m_meshClusterOffsets[0], m_meshClusterOffsets.size(), sizeof(int));
+    }
+
+    header.sectionCount = sectionCount;
+
+    unsigned long long offset = sizeof(CacheHeader) + sectionCount * sizeof(CacheSection);
+
+    for (int i = 0; i < sectionCount; ++i)
+    {
+        offset = AlignCacheOffset(offset);
+        sections[i].offset = offset;
+        offset += sections[i].size;
+    }
+
+    std::string tempFilename = std::string(pszCacheFilename) + ".tmp";
+    FILE *pFile = fopen(tempFilename.c_str(), "wb");
+
+    if (!pFile)
+        return false;
+
+    static const char padding[CACHE_ALIGNMENT] = {0};
+    bool succeeded = fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+                     fwrite(sections, sizeof(CacheSection), sectionCount, pFile) == static_cast<size_t>(sectionCount);
+
+    offset = sizeof(CacheHeader) + sectionCount * sizeof(CacheSection);
+
+    for (int i = 0; succeeded && i < sectionCount; ++i)
+    {
+        size_t paddingSize = static_cast<size_t>(sections[i].offset - offset);
+
+        succeeded = fwrite(padding, 1, paddingSize, pFile) == paddingSize &&
+                    fwrite(pSectionData[i], 1, static_cast<size_t>(sections[i].size), pFile) == sections[i].size;
+
+        offset = sections[i].offset + sections[i].size;
+    }
+
+    succeeded = (fclose(pFile) == 0) && succeeded;
+
+    std::string pendingFilename = std::string(pszCacheFilename) + ".pending";
+
+    if (succeeded && FileSystem::replaceFile(tempFilename.c_str(), pszCacheFilename))
+    {
+        remove(pendingFilename.c_str());
+        return true;
+    }
+
+    if (succeeded && FileSystem::replaceFile(tempFilename.c_str(), pendingFilename.c_str()))
+        return true;
+
+    remove(tempFilename.c_str());
+    return false;
+}
+
+void ModelOBJ::scale(float scaleFactor, float offset[3])
+{
+    if (m_pVertexQuantizer)
+    {
+        m_pVertexQuantizer->transformPositions(scaleFactor, offset);
+    }
+    else if (m_pVertexStreams)
+    {
+        m_pVertexStreams->scalePositions(scaleFactor, offset);
+        m_pVertexStreams->interleavePositions(m_vertexBuffer.begin());
+    }
+    else
+    {
+        float *pPosition = 0;
+
+        for (int i = 0; i < static_cast<int>(m_vertexBuffer.size()); ++i)
+        {
+            pPosition = m_vertexBuffer[i].position;
+
+            pPosition[0] += offset[0];
+            pPosition[1] += offset[1];
+            pPosition[2] += offset[2];
+
+            pPosition[0] *= scaleFactor;
+            pPosition[1] *= scaleFactor;
+            pPosition[2] *= scaleFactor;
+        }
+    }
+
+    MeshBounds::transformBounds(m_bounds, scaleFactor, offset);
+    TransformMeshBounds(m_meshes, scaleFactor, offset);
+    TransformMeshBounds(m_lodMeshes, scaleFactor, offset);
+
+    for (int i = 0; i < static_cast<int>(m_lods.size()); ++i)
+        m_lods[i].error *= scaleFactor;
+
+    float *pCenter = 0;
+
+    for (int i = 0; i < static_cast<int>(m_clusters.size()); ++i)
+    {
+        pCenter = m_clusters[i].center;
+
+        pCenter[0] = (pCenter[0] + offset[0]) * scaleFactor;
+        pCenter[1] = (pCenter[1] + offset[1]) * scaleFactor;
+        pCenter[2] = (pCenter[2] + offset[2]) * scaleFactor;
+
+        // The positions and the center are rounded separately, so allow for
+        // a few units in the last place of either.
+
+        m_clusters[i].radius = m_clusters[i].radius * scaleFactor * (1.0f + 4.0f * FLT_EPSILON) +
+            (fabsf(pCenter[0]) + fabsf(pCenter[1]) + fabsf(pCenter[2])) * 4.0f * FLT_EPSILON;
+    }
+}
+
+void ModelOBJ::setDirectoryPath(const char *pszFilename)
+{
+    m_directoryPath.clear();
+
+    std::string filename = pszFilename;
+    std::string::size_type offset = filename.find_last_of('\\');
+
+    if (offset != std::string::npos)
+    {
+        m_directoryPath = filename.substr(0, ++offset);
+    }
+    else
+    {
+        offset = filename.find_last_of('/');
+
+        if (offset != std::string::npos)
+            m_directoryPath = filename.substr(0, ++offset);
+    }
+}
+
+int ModelOBJ::weldVertices(float positionTolerance, float texCoordTolerance, float normalTolerance)
+{
+    // Merges vertices whose positions, texture coordinates, and normals each
+    // differ by no more than the tolerances (see MeshWelder) and returns the
+    // number of vertices removed. Exporters often write the same position
+    // several times with slightly different float values, which keeps the
+    // exact comparison made during import from merging them. The whole index
+    // buffer is rewritten, levels of detail included. Triangles that collapse
+    // are kept as degenerate triangles. Tangents move with their vertices and
+    // clusters are rebuilt if there are any. Call generateNormals() afterwards
+    // to smooth the normals across seams that have been closed.
+
+    dequantizeVertices();
+
+    int vertexCount = static_cast<int>(m_vertexBuffer.size());
+
+    if (vertexCount == 0)
+        return 0;
+
+    const float tolerances[8] =
+    {
+        positionTolerance, positionTolerance, positionTolerance,
+        texCoordTolerance, texCoordTolerance,
+        normalTolerance, normalTolerance, normalTolerance
+    };
+
+    std::vector<int> remap(vertexCount);
+    int weldedCount = MeshWelder::generateWeldRemap(m_vertexBuffer[0].position, vertexCount,
+        static_cast<int>(sizeof(Vertex)), tolerances, 8, &remap[0]);
+
+    if (weldedCount == vertexCount)
+        return 0;
+
+    widenIndexBuffer();
+
+    MeshOptimizer::remapIndexBuffer(m_indexBuffer.begin(),
+        static_cast<int>(m_indexBuffer.size()), &remap[0]);
+    MeshWelder::compactVertexBuffer(m_vertexBuffer.begin(), vertexCount,
+        static_cast<int>(sizeof(Vertex)), &remap[0]);
+    m_vertexBuffer.resize(weldedCount);
+
+    if (!m_tangentBuffer.empty())
+    {
+        MeshWelder::compactVertexBuffer(m_tangentBuffer.begin(), vertexCount,
+            static_cast<int>(sizeof(Tangent)), &remap[0]);
+        m_tangentBuffer.resize(weldedCount);
+    }
+
+    updateVertexStreams();
+    updateBounds();
+    narrowIndexBuffer();
+
+    if (!m_clusters.empty())
+        buildClusters();
+
+    return vertexCount - weldedCount;
+}
+
+void ModelOBJ::addVertex(int posIndex, const Vertex *pVertex)
+{
+    // The vertex cache is an open addressing hash table (with linear probing)
+    // keyed on the vertex's OBJ position index together with the vertex's
+    // attributes. A face vertex is merged with an existing vertex only if both
+    // refer to the same position index and have bitwise identical attributes.
+    //
+    // The attributes are part of the key, rather than just the texture
+    // coordinate and normal indices, because some exporters (bigship2.obj is
+    // one) write a separate normal for every face vertex. Keying on the
+    // indices alone would stop those duplicate vertices from being merged.
+
+    if ((m_vertexCacheCount + 1) * 2 > m_vertexCacheSize)
+        growVertexCache(m_vertexCacheSize * 2);
+
+    unsigned int hash = hashVertex(posIndex, pVertex);
+    unsigned int mask = static_cast<unsigned int>(m_vertexCacheSize) - 1;
+    unsigned int slot = hash & mask;
+    VertexCacheEntry *pEntry = 0;
+
+    while (true)
+    {
+        pEntry = &m_pVertexCache[slot];
+
+        if (pEntry->vertexIndex == -1)
+            break;
+
+        if (pEntry->hash == hash && pEntry->posIndex == posIndex &&
+            memcmp(&m_vertexBuffer[pEntry->vertexIndex], pVertex, sizeof(Vertex)) == 0)
+        {
+            // Vertex already exists.
+            m_indexBuffer.push_back(pEntry->vertexIndex);
+            return;
+        }
+
+        slot = (slot + 1) & mask;
+    }
+
+    int index = static_cast<int>(m_vertexBuffer.size());
+
+    pEntry->hash = hash;
+    pEntry->posIndex = posIndex;
+    pEntry->vertexIndex = index;
+    ++m_vertexCacheCount;
+
+    m_vertexBuffer.push_back(*pVertex);
+    m_indexBuffer.push_back(index);
+}
+
+bool ModelOBJ::buildMeshes()
+{
+    // Group the OBJ file triangles based on material type. The triangles are
+    // first sorted by the state key (color map, material) so that each
+    // material ends up in a single mesh and meshes sharing a color map are
+    // next to each other. Color maps are numbered in the order materials
+    // first use them. Materials without one come first.
+
+    int materialCount = static_cast<int>(m_materials.size());
+    int triangleCount = static_cast<int>(m_attributeBuffer.size());
+    std::map<std::string, int> colorMaps;
+
+    // The importers only add whole triangles, each with one attribute. The
+    // sort below relies on that, so anything else fails the import.
+
+    assert(m_indexBuffer.size() == m_attributeBuffer.size() * 3);
+
+    if (m_indexBuffer.size() != m_attributeBuffer.size() * 3)
+        return false;
+    std::vector<std::pair<int, int> > keys(materialCount);
+
+    for (int i = 0; i < materialCount; ++i)
+    {
+        const std::string &name = m_materials[i].colorMapFilename;
+        int colorMap = -1;
+
+        if (!name.empty())
+        {
+            std::map<std::string, int>::iterator j = colorMaps.find(name);
+
+            if (j == colorMaps.end())
+                j = colorMaps.insert(std::make_pair(name, static_cast<int>(colorMaps.size()))).first;
+
+            colorMap = j->second;
+        }
+
+        keys[i] = std::make_pair(colorMap, i);
+    }
+
+    std::sort(keys.begin(), keys.end());
+
+    // Counting sort of the triangles by the rank of their material's key.
+    // Triangles keep their file order within a material.
+
+    std::vector<int> offsets(materialCount + 1, 0);
+    std::vector<int> ranks(materialCount);
+
+    for (int i = 0; i < materialCount; ++i)
+        ranks[keys[i].second] = i;
+
+    for (int i = 0; i < triangleCount; ++i)
+        ++offsets[ranks[m_attributeBuffer[i]] + 1];
+
+    for (int i = 0; i < materialCount; ++i)
+        offsets[i + 1] += offsets[i];
+
+    std::vector<int> indices(m_indexBuffer.size());
+    std::vector<int> attributes(triangleCount);
+
+    for (int i = 0; i < triangleCount; ++i)
+    {
+        int triangle = offsets[ranks[m_attributeBuffer[i]]]++;
+
+        attributes[triangle] = m_attributeBuffer[i];
+        indices[triangle * 3 + 0] = m_indexBuffer[i * 3 + 0];
+        indices[triangle * 3 + 1] = m_indexBuffer[i * 3 + 1];
+        indices[triangle * 3 + 2] = m_indexBuffer[i * 3 + 2];
+    }
+
+    if (!indices.empty())
+        m_indexBuffer.assign(&indices[0], &indices[0] + indices.size());
+
+    m_attributeBuffer.swap(attributes);
+
+    Mesh *pMesh = 0;
+    int materialId = -1;
+
+    for (int i = 0; i < static_cast<int>(m_attributeBuffer.size()); ++i)
+    {
+        if (m_attributeBuffer[i] != materialId)
+        {
+            materialId = m_attributeBuffer[i];
+
+            m_meshes.push_back(Mesh());
+            pMesh = &m_meshes[m_meshes.size() - 1];
+            pMesh->materialIndex = materialId;
+            pMesh->startIndex = i * 3;
+            ++pMesh->triangleCount;
+        }
+        else
+        {
+            ++pMesh->triangleCount;
+        }
+    }
+
+    return true;
+}
+
+const ModelOBJ::Vertex *ModelOBJ::decodeVertices(std::vector<Vertex> &vertices) const
+{
+    // Returns the float vertices for the passes that only read them,
+    // decoding quantized vertices into vertices first. Returns null if there
+    // are none.
+
+    if (m_pVertexQuantizer)
+    {
+        vertices.resize(m_pVertexQuantizer->getNumberOfVertices());
+        getVertices(0, static_cast<int>(vertices.size()), vertices.empty() ? 0 : &vertices[0]);
+        return vertices.empty() ? 0 : &vertices[0];
+    }
+
+    return m_vertexBuffer.empty() ? 0 : m_vertexBuffer.begin();
+}
+
+void ModelOBJ::dequantizeVertices()
+{
+    // The methods that change the vertices work on float vertices. They call
+    // this first and the vertices stay floats afterwards.
+
+    if (!m_pVertexQuantizer)
+        return;
+
+    m_vertexBuffer.resize(m_pVertexQuantizer->getNumberOfVertices());
+    getVertices(0, static_cast<int>(m_vertexBuffer.size()), m_vertexBuffer.begin());
+
+    delete m_pVertexQuantizer;
+    m_pVertexQuantizer = 0;
+
+    updateVertexStreams();
+}
+
+bool ModelOBJ::flushStreamChunk(StreamState &state)
+{
+    // Hands the chunk being built to the callback and starts a new one.
+    // Returns the callback's result.
+
+    if (m_indexBuffer.empty())
+        return true;
+
+#if REBUILD_NORMALS_DURING_IMPORT
+    generateNormals();
+#else
+    if (!state.chunkHasNormals)
+        generateNormals();
+#endif
+
+    int vertexCount = static_cast<int>(m_vertexBuffer.size());
+    MeshBounds::Bounds chunkBounds;
+
+    MeshBounds::calculateBounds(m_vertexBuffer[0].position, vertexCount,
+        static_cast<int>(sizeof(Vertex)), chunkBounds);
+    MeshBounds::mergeBounds(state.bounds, state.boundsVertexCount, chunkBounds, vertexCount);
+    state.boundsVertexCount += vertexCount;
+
+    StreamChunk chunk;
+
+    chunk.materialIndex = state.chunkMaterial;
+    chunk.vertexCount = vertexCount;
+    chunk.indexCount = static_cast<int>(m_indexBuffer.size());
+    chunk.pVertices = m_vertexBuffer.begin();
+    chunk.pIndices = m_indexBuffer.begin();
+
+    bool keepGoing = (*state.pCallback)(chunk);
+
+    VertexCacheEntry emptyEntry = {0, 0, -1};
+
+    std::fill(m_pVertexCache, m_pVertexCache + m_vertexCacheSize, emptyEntry);
+    m_vertexCacheCount = 0;
+    m_vertexBuffer.clear();
+    m_indexBuffer.clear();
+    state.chunkHasNormals = false;
+
+    return keepGoing;
+}
+
+void ModelOBJ::growVertexCache(int capacity)
+{
+    // Rehashes the vertex cache into a table with at least capacity slots.
+    // The number of slots is always a power of two. The table is allocated
+    // from the import allocator.
+
+    int size = 64;
+
+    while (size < capacity)
+        size *= 2;
+
+    if (size <= m_vertexCacheSize)
+        return;
+
+    void *pTable = m_pImportArena->allocate(size * sizeof(VertexCacheEntry));
+
+    if (!pTable)
+        throw std::bad_alloc();
+
+    VertexCacheEntry emptyEntry = {0, 0, -1};
+    VertexCacheEntry *pOldCache = m_pVertexCache;
+    int oldSize = m_vertexCacheSize;
+    unsigned int mask = static_cast<unsigned int>(size) - 1;
+    unsigned int slot = 0;
+
+    m_pVertexCache = static_cast<VertexCacheEntry *>(pTable);
+    m_vertexCacheSize = size;
+    std::fill(m_pVertexCache, m_pVertexCache + size, emptyEntry);
+
+    for (int i = 0; i < oldSize; ++i)
+    {
+        const VertexCacheEntry &entry = pOldCache[i];
+
+        if (entry.vertexIndex == -1)
+            continue;
+
+        slot = entry.hash & mask;
+
+        while (m_pVertexCache[slot].vertexIndex != -1)
+            slot = (slot + 1) & mask;
+
+        m_pVertexCache[slot] = entry;
+    }
+
+    m_pImportArena->deallocate(pOldCache, oldSize * sizeof(VertexCacheEntry));
+}
+
+unsigned int ModelOBJ::hashVertex(int posIndex, const Vertex *pVertex)
+{
+    // Mixes the position index and the vertex's attributes 32 bits at a time,
+    // then finishes with the MurmurHash3 32-bit finalizer.
+
+    const int WORDS = sizeof(Vertex) / sizeof(unsigned int);
+
+    unsigned int words[WORDS];
+    unsigned int h = static_cast<unsigned int>(posIndex) * 0x9E3779B1u;
+
+    memcpy(words, pVertex, sizeof(words));
+
+    for (int i = 0; i < WORDS; ++i)
+    {
+        h ^= words[i] * 0xCC9E2D51u;
+        h = ((h << 13) | (h >> 19)) * 5u + 0xE6546B64u;
+    }
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+
+    return h;
+}
+
+void ModelOBJ::importGeometryFirstPass(std::ifstream &stream)
+{
+    m_hasTextureCoords = false;
+    m_hasVertexNormals = false;
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfFaces = 0;
+
+    std::istringstream strStream;
+    std::string line;
+    std::string token;
+    int ch = 0;
+    int verticesPerFace = 0;
+
+    while (!stream.eof())
+    {
+        line.clear();
+        std::getline(stream, line);
+
+        if (line.empty())
+            continue;
+
+        strStream.clear();
+        strStream.str(line);
+
+        ch = strStream.get();
+
+        switch (ch)
+        {
+        case 'v':
+            ch = strStream.get();
 
             if (ch == ' ')
                 ++m_numberOfVertexCoords;
@@ -490,7 +3944,9 @@ void ModelOBJ::importGeometryFirstPass(std::ifstream &stream)
             // Therefore the number of triangles per face is:
             //  number of triangles per face = (vertices per face - 3) + 1
 
-            m_numberOfFaces += verticesPerFace - 2;
+            if (verticesPerFace > 2)
+                m_numberOfFaces += verticesPerFace - 2;
+
             break;
 
         default:
@@ -514,13 +3970,16 @@ void ModelOBJ::importGeometrySecondPass(std::ifstream &stream)
     float texCoord[2] = {0.0f};
     float normal[3] = {0.0f};
     Vertex vertex;
+    std::vector<Vertex> faceVertices;
+    std::vector<int> facePositions;
     std::string command;
-    std::string name;
+    ImportString name(m_pMaterialCache->get_allocator());
     std::string line;
-    std::vector<float> vertexCoords;
-    std::vector<float> textureCoords;
-    std::vector<float> normals;
-    std::map<std::string, int>::const_iterator iter;
+    LinearAllocatorAdapter<float> floatAllocator(m_pImportArena);
+    ImportFloatArray vertexCoords(floatAllocator);
+    ImportFloatArray textureCoords(floatAllocator);
+    ImportFloatArray normals(floatAllocator);
+    MaterialCache::const_iterator iter;
     std::istringstream strStream;
 
 #if PERFORM_TWO_PASS_LOADING
@@ -529,20 +3988,10 @@ void ModelOBJ::importGeometrySecondPass(std::ifstream &stream)
     normals.reserve(m_numberOfNormals * 3);
     m_indexBuffer.reserve(m_numberOfFaces * 3);
     m_attributeBuffer.reserve(m_numberOfFaces);
+    reserveVertexCache();
 #endif
 
-    Material defaultMaterial =
-    {
-        0.2f, 0.2f, 0.2f, 1.0f,
-        0.8f, 0.8f, 0.8f, 1.0f,
-        0.0f, 0.0f, 0.0f, 1.0f,
-        0.0f,
-        1.0f,
-        std::string()
-    };
-
-    m_materials.push_back(defaultMaterial);
-    m_materialCache["default"] = 0;
+    importDefaultMaterial();
 
     while (!stream.eof())
     {
@@ -563,14 +4012,13 @@ void ModelOBJ::importGeometrySecondPass(std::ifstream &stream)
         else if (command == "mtllib")
         {
             strStream >> name;
-            name = m_directoryPath + name;
-            importMaterials(name);
+            importMaterials(m_directoryPath + name.c_str());
         }
         else if (command == "usemtl")
         {
             strStream >> name;
-            iter = m_materialCache.find(name);
-            activeMaterial = (iter == m_materialCache.end()) ? 0 : iter->second;
+            iter = m_pMaterialCache->find(name);
+            activeMaterial = (iter == m_pMaterialCache->end()) ? 0 : iter->second;
         }
         else if (command == "v")
         {
@@ -594,134 +4042,599 @@ void ModelOBJ::importGeometrySecondPass(std::ifstream &stream)
         }
         else if (command == "f")
         {
-            verticesPerFace = 0;
+            faceVertices.clear();
+            facePositions.clear();
+
+            while (true)
+            {
+                vertex.position[0] = vertex.position[1] = vertex.position[2] = 0.0f;
+                vertex.texCoord[0] = vertex.texCoord[1] = 0.0f;
+                vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+
+                strStream >> posIndex;
+
+                if (strStream.fail())
+                    break;
+
+                vertex.position[0] = vertexCoords[(posIndex - 1) * 3];
+                vertex.position[1] = vertexCoords[(posIndex - 1) * 3 + 1];
+                vertex.position[2] = vertexCoords[(posIndex - 1) * 3 + 2];
+
+                if (strStream.peek() == '/')
+                {
+                    strStream.ignore();
+
+                    if (strStream.peek() != '/')
+                    {
+                        strStream >> texCoordIndex;
+                        vertex.texCoord[0] = textureCoords[(texCoordIndex - 1) * 2];
+                        vertex.texCoord[1] = textureCoords[(texCoordIndex - 1) * 2 + 1];
+                    }
+
+                    if (strStream.peek() == '/')
+                    {
+                        strStream.ignore();
+                        strStream >> normalIndex;
+                        vertex.normal[0] = normals[(normalIndex - 1) * 3];
+                        vertex.normal[1] = normals[(normalIndex - 1) * 3 + 1];
+                        vertex.normal[2] = normals[(normalIndex - 1) * 3 + 2];
+                    }
+                }
+
+                faceVertices.push_back(vertex);
+                facePositions.push_back(posIndex);
+            }
+
+            // Faces with fewer than three vertices are dropped, as they are by
+            // every other import path. The face's vertices are only added once
+            // the whole face has been read so a dropped face leaves nothing
+            // behind in the vertex or index buffers.
+
+            verticesPerFace = static_cast<int>(faceVertices.size());
+
+            if (verticesPerFace >= 3)
+            {
+                for (int i = 0; i < verticesPerFace; ++i)
+                    addVertex(facePositions[i], &faceVertices[i]);
+
+                if (verticesPerFace > 3)
+                {
+                    int triangles = triangulateLastInsertedFace(verticesPerFace);
+
+                    for (int i = 0; i < triangles; ++i)
+                        m_attributeBuffer.push_back(activeMaterial);
+                }
+                else
+                {
+                    m_attributeBuffer.push_back(activeMaterial);
+                }
+            }
+        }
+    }
+
+    m_hasVertexNormals = !normals.empty();
+    m_hasTextureCoords = !textureCoords.empty();
+}
+
+void ModelOBJ::importGeometryFirstPass(const char *pBegin, const char *pEnd)
+{
+    // Memory mapped version of importGeometryFirstPass(std::ifstream &).
+
+    m_hasTextureCoords = false;
+    m_hasVertexNormals = false;
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfFaces = 0;
+
+    const char *p = pBegin;
+    int verticesPerFace = 0;
+
+    while (p < pEnd)
+    {
+        p = SkipBlanks(p, pEnd);
+
+        if (p + 1 < pEnd)
+        {
+            switch (*p)
+            {
+            case 'v':
+                if (p[1] == ' ')
+                    ++m_numberOfVertexCoords;
+                else if (p[1] == 't')
+                    ++m_numberOfTextureCoords;
+                else if (p[1] == 'n')
+                    ++m_numberOfNormals;
+
+                break;
+
+            case 'f':
+                verticesPerFace = 0;
+
+                for (p = SkipBlanks(p + 1, pEnd); p < pEnd && *p != '\n'; p = SkipBlanks(p, pEnd))
+                {
+                    p = SkipToken(p, pEnd);
+                    ++verticesPerFace;
+                }
+
+                // See importGeometryFirstPass(std::ifstream &) for the
+                // number of triangles each face is split into.
+
+                if (verticesPerFace > 2)
+                    m_numberOfFaces += verticesPerFace - 2;
+
+                break;
+
+            default:
+                break;
+            }
+        }
+
+        p = SkipLine(p, pEnd);
+    }
+}
+
+bool ModelOBJ::importGeometryParallel(const char *pBegin, const char *pEnd)
+{
+    // Multithreaded version of importGeometrySecondPass(const char *, const
+    // char *). The mapped file is split at line boundaries into chunks that
+    // are processed in three steps:
+    //
+    // 1. Count the coordinates and faces in every chunk (in parallel).
+    // 2. Parse every chunk (in parallel). Prefix sums of the step 1 counts
+    //    tell each chunk where its coordinates go and which coordinates its
+    //    negative indices refer to.
+    // 3. Merge the chunks' faces in file order (serially). The merge performs
+    //    the same vertex de-duplication and triangulation steps as the serial
+    //    loader so the output is identical to the serial loader's output.
+    //
+    // Small files and single core machines use the serial loader.
+
+    const size_t MIN_CHUNK_SIZE = 1 << 20;
+
+    size_t fileSize = pEnd - pBegin;
+    int threadCount = Parallel::getThreadCount();
+    int chunkCount = threadCount * 4;
+
+    if (static_cast<size_t>(chunkCount) > fileSize / MIN_CHUNK_SIZE)
+        chunkCount = static_cast<int>(fileSize / MIN_CHUNK_SIZE);
+
+    if (threadCount < 2 || chunkCount < 2)
+    {
+        importGeometryFirstPass(pBegin, pEnd);
+        return importGeometrySecondPass(pBegin, pEnd);
+    }
+
+    std::vector<ImportChunk> chunks(chunkCount, ImportChunk(LinearAllocatorAdapter<int>(m_pImportArena)));
+    const char *pChunkBegin = pBegin;
+
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        const char *pChunkEnd = pEnd;
+
+        if (i < chunkCount - 1)
+        {
+            pChunkEnd = pBegin + fileSize / chunkCount * (i + 1);
+
+            if (pChunkEnd < pChunkBegin)
+                pChunkEnd = pChunkBegin;
+
+            pChunkEnd = SkipLine(pChunkEnd, pEnd);
+        }
+
+        chunks[i].pBegin = pChunkBegin;
+        chunks[i].pEnd = pChunkEnd;
+        pChunkBegin = pChunkEnd;
+    }
+
+    Parallel::forEach(chunkCount, [&chunks](int i) { CountChunk(chunks[i]); });
+
+    m_numberOfVertexCoords = 0;
+    m_numberOfTextureCoords = 0;
+    m_numberOfNormals = 0;
+    m_numberOfFaces = 0;
+
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        chunks[i].vertexCoordBase = m_numberOfVertexCoords;
+        chunks[i].textureCoordBase = m_numberOfTextureCoords;
+        chunks[i].normalBase = m_numberOfNormals;
+
+        m_numberOfVertexCoords += chunks[i].numVertexCoords;
+        m_numberOfTextureCoords += chunks[i].numTextureCoords;
+        m_numberOfNormals += chunks[i].numNormals;
+        m_numberOfFaces += chunks[i].numTriangles;
+    }
+
+    LinearAllocatorAdapter<float> floatAllocator(m_pImportArena);
+    ImportFloatArray vertexCoords(m_numberOfVertexCoords * 3 + 1, 0.0f, floatAllocator);
+    ImportFloatArray textureCoords(m_numberOfTextureCoords * 2 + 1, 0.0f, floatAllocator);
+    ImportFloatArray normals(m_numberOfNormals * 3 + 1, 0.0f, floatAllocator);
+    float *pVertexCoords = &vertexCoords[0];
+    float *pTextureCoords = &textureCoords[0];
+    float *pNormals = &normals[0];
+
+    Parallel::forEach(chunkCount, [&chunks, pVertexCoords, pTextureCoords, pNormals](int i)
+    {
+        ParseChunk(chunks[i], pVertexCoords, pTextureCoords, pNormals);
+    });
+
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        if (chunks[i].failed)
+            return false;
+    }
+
+    // Merge the chunks.
+
+    int activeMaterial = 0;
+    int verticesPerFace = 0;
+    const int *pFaceVertex = 0;
+    Vertex vertex;
+    ImportString name(m_pMaterialCache->get_allocator());
+    MaterialCache::const_iterator iter;
+
+    m_indexBuffer.reserve(m_numberOfFaces * 3);
+    m_attributeBuffer.reserve(m_numberOfFaces);
+    reserveVertexCache();
+
+    importDefaultMaterial();
+
+    for (int i = 0; i < chunkCount; ++i)
+    {
+        ImportChunk &chunk = chunks[i];
+        int numFaces = static_cast<int>(chunk.verticesPerFace.size());
+        int numCommands = static_cast<int>(chunk.commands.size());
+        int command = 0;
+
+        pFaceVertex = chunk.faceVertices.empty() ? 0 : &chunk.faceVertices[0];
+
+        for (int face = 0; face <= numFaces; ++face)
+        {
+            for (; command < numCommands && chunk.commands[command].faceIndex == face; ++command)
+            {
+                name.assign(chunk.commands[command].name.begin(), chunk.commands[command].name.end());
+
+                if (chunk.commands[command].isMaterialLibrary)
+                {
+                    importMaterials(m_directoryPath + name.c_str());
+                }
+                else
+                {
+                    iter = m_pMaterialCache->find(name);
+                    activeMaterial = (iter == m_pMaterialCache->end()) ? 0 : iter->second;
+                }
+            }
+
+            if (face == numFaces)
+                break;
+
+            verticesPerFace = chunk.verticesPerFace[face];
+
+            for (int j = 0; j < verticesPerFace; ++j, pFaceVertex += 3)
+            {
+                const float *pPosition = pVertexCoords + pFaceVertex[0] * 3;
+
+                vertex.position[0] = pPosition[0];
+                vertex.position[1] = pPosition[1];
+                vertex.position[2] = pPosition[2];
+
+                if (pFaceVertex[1] >= 0)
+                {
+                    vertex.texCoord[0] = pTextureCoords[pFaceVertex[1] * 2];
+                    vertex.texCoord[1] = pTextureCoords[pFaceVertex[1] * 2 + 1];
+                }
+                else
+                {
+                    vertex.texCoord[0] = vertex.texCoord[1] = 0.0f;
+                }
+
+                if (pFaceVertex[2] >= 0)
+                {
+                    vertex.normal[0] = pNormals[pFaceVertex[2] * 3];
+                    vertex.normal[1] = pNormals[pFaceVertex[2] * 3 + 1];
+                    vertex.normal[2] = pNormals[pFaceVertex[2] * 3 + 2];
+                }
+                else
+                {
+                    vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+                }
+
+                addVertex(pFaceVertex[0] + 1, &vertex);
+            }
+
+            if (verticesPerFace > 3)
+            {
+                int triangles = triangulateLastInsertedFace(verticesPerFace);
+
+                for (int j = 0; j < triangles; ++j)
+                    m_attributeBuffer.push_back(activeMaterial);
+            }
+            else
+            {
+                m_attributeBuffer.push_back(activeMaterial);
+            }
+        }
+
+        // Release the chunk's faces as soon as they have been merged.
+        ImportIntArray(chunk.faceVertices.get_allocator()).swap(chunk.faceVertices);
+        ImportIntArray(chunk.verticesPerFace.get_allocator()).swap(chunk.verticesPerFace);
+    }
+
+    m_hasVertexNormals = m_numberOfNormals > 0;
+    m_hasTextureCoords = m_numberOfTextureCoords > 0;
+    return true;
+}
+
+bool ModelOBJ::importGeometrySecondPass(const char *pBegin, const char *pEnd)
+{
+    // Memory mapped version of importGeometrySecondPass(std::ifstream &).
+    // Each line is scanned in place. Face indices are validated and negative
+    // indices are resolved relative to the most recently read coordinates.
+    // Returns false if a face refers to a coordinate that doesn't exist.
+
+    int activeMaterial = 0;
+    int posIndex = 0;
+    int texCoordIndex = 0;
+    int normalIndex = 0;
+    int numVertexCoords = 0;
+    int numTextureCoords = 0;
+    int numNormals = 0;
+    int verticesPerFace = 0;
+    Vertex vertex;
+    std::vector<Vertex> faceVertices;
+    std::vector<int> facePositions;
+    ImportString name(m_pMaterialCache->get_allocator());
+    LinearAllocatorAdapter<float> floatAllocator(m_pImportArena);
+    ImportFloatArray vertexCoords(floatAllocator);
+    ImportFloatArray textureCoords(floatAllocator);
+    ImportFloatArray normals(floatAllocator);
+    MaterialCache::const_iterator iter;
+    const char *p = pBegin;
+    const char *pCommand = 0;
+    const char *pCommandEnd = 0;
+    const char *pNext = 0;
+
+#if PERFORM_TWO_PASS_LOADING
+    vertexCoords.reserve(m_numberOfVertexCoords * 3);
+    textureCoords.reserve(m_numberOfTextureCoords * 2);
+    normals.reserve(m_numberOfNormals * 3);
+    m_indexBuffer.reserve(m_numberOfFaces * 3);
+    m_attributeBuffer.reserve(m_numberOfFaces);
+    reserveVertexCache();
+#endif
+
+    importDefaultMaterial();
+
+    for (; p < pEnd; p = SkipLine(p, pEnd))
+    {
+        pCommand = SkipBlanks(p, pEnd);
+        pCommandEnd = SkipToken(pCommand, pEnd);
+        p = pCommandEnd;
+
+        if (pCommandEnd == pCommand)
+            continue;
+
+        switch (*pCommand)
+        {
+        case 'v':
+            if (pCommandEnd - pCommand == 1)
+            {
+                float position[3] = {0.0f, 0.0f, 0.0f};
 
-            while (true)
+                for (int i = 0; i < 3 && (pNext = ParseFloat(p, pEnd, position[i])) != 0; ++i)
+                    p = pNext;
+
+                vertexCoords.insert(vertexCoords.end(), position, position + 3);
+                ++numVertexCoords;
+            }
+            else if (TokenEquals(pCommand, pCommandEnd, "vt"))
+            {
+                float texCoord[2] = {0.0f, 0.0f};
+
+                for (int i = 0; i < 2 && (pNext = ParseFloat(p, pEnd, texCoord[i])) != 0; ++i)
+                    p = pNext;
+
+                textureCoords.insert(textureCoords.end(), texCoord, texCoord + 2);
+                ++numTextureCoords;
+            }
+            else if (TokenEquals(pCommand, pCommandEnd, "vn"))
+            {
+                float normal[3] = {0.0f, 0.0f, 0.0f};
+
+                for (int i = 0; i < 3 && (pNext = ParseFloat(p, pEnd, normal[i])) != 0; ++i)
+                    p = pNext;
+
+                normals.insert(normals.end(), normal, normal + 3);
+                ++numNormals;
+            }
+            break;
+
+        case 'f':
+            if (pCommandEnd - pCommand != 1)
+                break;
+
+            faceVertices.clear();
+            facePositions.clear();
+
+            while ((pNext = ParseFaceVertex(p, pEnd, posIndex, texCoordIndex, normalIndex)) != 0)
             {
+                p = pNext;
+
                 vertex.position[0] = vertex.position[1] = vertex.position[2] = 0.0f;
                 vertex.texCoord[0] = vertex.texCoord[1] = 0.0f;
                 vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
 
-                strStream >> posIndex;
-
-                if (strStream.fail())
-                    break;
+                if (!ResolveIndex(posIndex, numVertexCoords))
+                    return false;
 
                 vertex.position[0] = vertexCoords[(posIndex - 1) * 3];
                 vertex.position[1] = vertexCoords[(posIndex - 1) * 3 + 1];
                 vertex.position[2] = vertexCoords[(posIndex - 1) * 3 + 2];
 
-                if (strStream.peek() == '/')
+                if (texCoordIndex != MISSING_INDEX)
                 {
-                    strStream.ignore();
+                    if (!ResolveIndex(texCoordIndex, numTextureCoords))
+                        return false;
 
-                    if (strStream.peek() != '/')
-                    {
-                        strStream >> texCoordIndex;
-                        vertex.texCoord[0] = textureCoords[(texCoordIndex - 1) * 2];
-                        vertex.texCoord[1] = textureCoords[(texCoordIndex - 1) * 2 + 1];
-                    }
+                    vertex.texCoord[0] = textureCoords[(texCoordIndex - 1) * 2];
+                    vertex.texCoord[1] = textureCoords[(texCoordIndex - 1) * 2 + 1];
+                }
 
-                    if (strStream.peek() == '/')
-                    {
-                        strStream.ignore();
-                        strStream >> normalIndex;
-                        vertex.normal[0] = normals[(normalIndex - 1) * 3];
-                        vertex.normal[1] = normals[(normalIndex - 1) * 3 + 1];
-                        vertex.normal[2] = normals[(normalIndex - 1) * 3 + 2];
-                    }
+                if (normalIndex != MISSING_INDEX)
+                {
+                    if (!ResolveIndex(normalIndex, numNormals))
+                        return false;
+
+                    vertex.normal[0] = normals[(normalIndex - 1) * 3];
+                    vertex.normal[1] = normals[(normalIndex - 1) * 3 + 1];
+                    vertex.normal[2] = normals[(normalIndex - 1) * 3 + 2];
                 }
 
-                addVertex(posIndex, &vertex);
-                ++verticesPerFace;
+                faceVertices.push_back(vertex);
+                facePositions.push_back(posIndex);
             }
 
-            if (verticesPerFace > 0)
+            verticesPerFace = static_cast<int>(faceVertices.size());
+
+            if (verticesPerFace < 3)
+                break;
+
+            for (int i = 0; i < verticesPerFace; ++i)
+                addVertex(facePositions[i], &faceVertices[i]);
+
+            if (verticesPerFace > 3)
             {
-                if (verticesPerFace > 3)
-                {
-                    int triangles = triangulateLastInsertedFace(verticesPerFace);
+                int triangles = triangulateLastInsertedFace(verticesPerFace);
 
-                    for (int i = 0; i < triangles; ++i)
-                        m_attributeBuffer.push_back(activeMaterial);
-                }
-                else
-                {
+                for (int i = 0; i < triangles; ++i)
                     m_attributeBuffer.push_back(activeMaterial);
-                }
             }
+            else
+            {
+                m_attributeBuffer.push_back(activeMaterial);
+            }
+            break;
+
+        case 'm':
+            if (TokenEquals(pCommand, pCommandEnd, "mtllib"))
+            {
+                pNext = SkipBlanks(p, pEnd);
+                name.assign(pNext, SkipToken(pNext, pEnd));
+                importMaterials(m_directoryPath + name.c_str());
+            }
+            break;
+
+        case 'u':
+            if (TokenEquals(pCommand, pCommandEnd, "usemtl"))
+            {
+                pNext = SkipBlanks(p, pEnd);
+                name.assign(pNext, SkipToken(pNext, pEnd));
+                iter = m_pMaterialCache->find(name);
+                activeMaterial = (iter == m_pMaterialCache->end()) ? 0 : iter->second;
+            }
+            break;
+
+        default:
+            break;
         }
     }
 
     m_hasVertexNormals = !normals.empty();
     m_hasTextureCoords = !textureCoords.empty();
+    return true;
+}
+
+void ModelOBJ::importDefaultMaterial()
+{
+    Material defaultMaterial =
+    {
+        0.2f, 0.2f, 0.2f, 1.0f,
+        0.8f, 0.8f, 0.8f, 1.0f,
+        0.0f, 0.0f, 0.0f, 1.0f,
+        0.0f,
+        1.0f,
+        std::string(),
+        "default"
+    };
+
+    m_materials.push_back(defaultMaterial);
+    (*m_pMaterialCache)[ImportString("default", m_pMaterialCache->get_allocator())] = 0;
 }
 
 bool ModelOBJ::importMaterials(const std::string &filename)
 {
-    std::ifstream stream(filename.c_str());
+    // Remember every MTL file the OBJ file refers to, even ones that fail to
+    // load. A cached copy of the model is out of date once any of them change.
+    m_materialLibraries.push_back(filename);
 
-    if (!stream.is_open())
+    MappedFile file;
+
+    if (!file.open(filename.c_str()))
         return false;
 
+    // The file is parsed in place by the same tokenizer as the OBJ file.
+    // Unknown commands, and anything before the first newmtl, are skipped.
+
     Material *pMaterial = 0;
-    int materialIndex = 0;
     int illum = 0;
-    std::string command;
-    std::string materialName;
+    ImportString materialName(m_pMaterialCache->get_allocator());
+    const char *p = file.getData();
+    const char *pEnd = p + file.getSize();
+    const char *pCommand = 0;
+    const char *pCommandEnd = 0;
 
-    while (!stream.eof())
+    for (; p < pEnd; p = SkipLine(p, pEnd))
     {
-        stream >> command;
+        pCommand = SkipBlanks(p, pEnd);
+        pCommandEnd = SkipToken(pCommand, pEnd);
+        p = pCommandEnd;
 
-        if (command == "newmtl")
+        if (TokenEquals(pCommand, pCommandEnd, "newmtl"))
         {
-            materialIndex = static_cast<int>(m_materials.size());
+            const char *pName = SkipBlanks(p, pEnd);
+            const char *pNameEnd = SkipToken(pName, pEnd);
+            int materialIndex = static_cast<int>(m_materials.size());
+
             m_materials.push_back(Material());
             pMaterial = &m_materials[materialIndex];
 
-            stream >> materialName;
-            m_materialCache[materialName] = materialIndex;
+            materialName.assign(pName, pNameEnd);
+            (*m_pMaterialCache)[materialName] = materialIndex;
+            pMaterial->name.assign(pName, pNameEnd);
+        }
+        else if (!pMaterial)
+        {
+            continue;
         }
-        else if (command == "Ka")
+        else if (TokenEquals(pCommand, pCommandEnd, "Ka"))
         {
-            stream >> pMaterial->ambient[0]
-            >> pMaterial->ambient[1]
-            >> pMaterial->ambient[2];
-            pMaterial->ambient[3] = 1.0f;
+            ParseColor(p, pEnd, pMaterial->ambient);
         }
-        else if (command == "Kd")
+        else if (TokenEquals(pCommand, pCommandEnd, "Kd"))
         {
-            stream >> pMaterial->diffuse[0]
-            >> pMaterial->diffuse[1]
-            >> pMaterial->diffuse[2];
-            pMaterial->diffuse[3] = 1.0f;
+            ParseColor(p, pEnd, pMaterial->diffuse);
         }
-        else if (command == "Ks")
+        else if (TokenEquals(pCommand, pCommandEnd, "Ks"))
         {
-            stream >> pMaterial->specular[0]
-            >> pMaterial->specular[1]
-            >> pMaterial->specular[2];
-            pMaterial->specular[3] = 1.0f;
+            ParseColor(p, pEnd, pMaterial->specular);
         }
-        else if (command == "Ns")
+        else if (TokenEquals(pCommand, pCommandEnd, "Ns"))
         {
-            stream >> pMaterial->shininess;
-
             // Wavefront .MTL file shininess is from [0,1000].
             // Scale back to a generic [0,1] range.
 
-            pMaterial->shininess /= 1000.0f;
+            if (ParseFloat(p, pEnd, pMaterial->shininess))
+                pMaterial->shininess /= 1000.0f;
         }
-        else if (command == "Tr" || command == "d")
+        else if (TokenEquals(pCommand, pCommandEnd, "Tr") || TokenEquals(pCommand, pCommandEnd, "d"))
         {
-            stream >> pMaterial->alpha;
+            ParseFloat(p, pEnd, pMaterial->alpha);
         }
-        else if (command == "illum")
+        else if (TokenEquals(pCommand, pCommandEnd, "illum"))
         {
-            stream >> illum;
-
-            if (illum == 1)
+            if (ParseInt(p, pEnd, illum) && illum == 1)
             {
                 pMaterial->specular[0] = 0.0f;
                 pMaterial->specular[1] = 0.0f;
@@ -729,17 +4642,300 @@ bool ModelOBJ::importMaterials(const std::string &filename)
                 pMaterial->specular[3] = 1.0f;
             }
         }
-        else if (command == "map_Kd")
+        else if (TokenEquals(pCommand, pCommandEnd, "map_Kd"))
         {
-            stream >> pMaterial->colorMapFilename;
+            // Options such as -s or -o come before the file name, so the
+            // file name is the last token on the line.
+
+            const char *pName = 0;
+            const char *pNameEnd = 0;
+
+            for (const char *pToken = SkipBlanks(p, pEnd); pToken < pEnd && *pToken != '\n';
+                 pToken = SkipBlanks(pNameEnd, pEnd))
+            {
+                pName = pToken;
+                pNameEnd = SkipToken(pToken, pEnd);
+            }
+
+            if (pName)
+                pMaterial->colorMapFilename.assign(pName, pNameEnd);
         }
+    }
+
+    return true;
+}
+
+bool ModelOBJ::importStreamLines(const char *pBegin, const char *pEnd, StreamState &state)
+{
+    // Streaming version of importGeometrySecondPass(const char *, const char
+    // *). Parses complete lines only. Each face is read before it's added so
+    // that the chunk can be flushed first if the face doesn't fit. Returns
+    // false if a face refers to a coordinate that doesn't exist, a spilled
+    // page can't be written or read, or the callback stops the import.
+
+    int posIndex = 0;
+    int texCoordIndex = 0;
+    int normalIndex = 0;
+    int verticesPerFace = 0;
+    bool faceHasNormals = false;
+    Vertex vertex;
+    ImportString name(m_pMaterialCache->get_allocator());
+    MaterialCache::const_iterator iter;
+    const float *pCoord = 0;
+    const char *p = pBegin;
+    const char *pCommand = 0;
+    const char *pCommandEnd = 0;
+    const char *pNext = 0;
+
+    for (; p < pEnd; p = SkipLine(p, pEnd))
+    {
+        pCommand = SkipBlanks(p, pEnd);
+        pCommandEnd = SkipToken(pCommand, pEnd);
+        p = pCommandEnd;
+
+        if (pCommandEnd == pCommand)
+            continue;
+
+        switch (*pCommand)
+        {
+        case 'v':
+            if (pCommandEnd - pCommand == 1)
+            {
+                float position[3] = {0.0f, 0.0f, 0.0f};
+
+                for (int i = 0; i < 3 && (pNext = ParseFloat(p, pEnd, position[i])) != 0; ++i)
+                    p = pNext;
+
+                if (!state.vertexCoords.append(position))
+                    return false;
+            }
+            else if (TokenEquals(pCommand, pCommandEnd, "vt"))
+            {
+                float texCoord[2] = {0.0f, 0.0f};
 
-        stream.ignore(std::numeric_limits<int>::max(), '\n');
+                for (int i = 0; i < 2 && (pNext = ParseFloat(p, pEnd, texCoord[i])) != 0; ++i)
+                    p = pNext;
+
+                if (!state.textureCoords.append(texCoord))
+                    return false;
+            }
+            else if (TokenEquals(pCommand, pCommandEnd, "vn"))
+            {
+                float normal[3] = {0.0f, 0.0f, 0.0f};
+
+                for (int i = 0; i < 3 && (pNext = ParseFloat(p, pEnd, normal[i])) != 0; ++i)
+                    p = pNext;
+
+                if (!state.normals.append(normal))
+                    return false;
+            }
+            break;
+
+        case 'f':
+            if (pCommandEnd - pCommand != 1)
+                break;
+
+            state.faceVertices.clear();
+            state.facePositions.clear();
+            faceHasNormals = false;
+
+            while ((pNext = ParseFaceVertex(p, pEnd, posIndex, texCoordIndex, normalIndex)) != 0)
+            {
+                p = pNext;
+
+                vertex.position[0] = vertex.position[1] = vertex.position[2] = 0.0f;
+                vertex.texCoord[0] = vertex.texCoord[1] = 0.0f;
+                vertex.normal[0] = vertex.normal[1] = vertex.normal[2] = 0.0f;
+
+                if (!ResolveIndex(posIndex, state.vertexCoords.size()))
+                    return false;
+
+                if ((pCoord = state.vertexCoords.get(posIndex - 1)) == 0)
+                    return false;
+
+                vertex.position[0] = pCoord[0];
+                vertex.position[1] = pCoord[1];
+                vertex.position[2] = pCoord[2];
+
+                if (texCoordIndex != MISSING_INDEX)
+                {
+                    if (!ResolveIndex(texCoordIndex, state.textureCoords.size()))
+                        return false;
+
+                    if ((pCoord = state.textureCoords.get(texCoordIndex - 1)) == 0)
+                        return false;
+
+                    vertex.texCoord[0] = pCoord[0];
+                    vertex.texCoord[1] = pCoord[1];
+                }
+
+                if (normalIndex != MISSING_INDEX)
+                {
+                    if (!ResolveIndex(normalIndex, state.normals.size()))
+                        return false;
+
+                    if ((pCoord = state.normals.get(normalIndex - 1)) == 0)
+                        return false;
+
+                    vertex.normal[0] = pCoord[0];
+                    vertex.normal[1] = pCoord[1];
+                    vertex.normal[2] = pCoord[2];
+                    faceHasNormals = true;
+                }
+
+                state.faceVertices.push_back(vertex);
+                state.facePositions.push_back(posIndex);
+            }
+
+            verticesPerFace = static_cast<int>(state.faceVertices.size());
+
+            if (verticesPerFace < 3)
+                break;
+
+            if (verticesPerFace > FACE_INDEX_CACHE_SIZE)
+                return false;
+
+            if (state.activeMaterial != state.chunkMaterial ||
+                static_cast<int>(m_vertexBuffer.size()) + verticesPerFace > state.chunkVertices ||
+                static_cast<int>(m_indexBuffer.size()) + (verticesPerFace - 2) * 3 > state.chunkIndices)
+            {
+                if (!flushStreamChunk(state))
+                    return false;
+            }
+
+            state.chunkMaterial = state.activeMaterial;
+            state.chunkHasNormals = state.chunkHasNormals || faceHasNormals;
+
+            for (int i = 0; i < verticesPerFace; ++i)
+                addVertex(state.facePositions[i], &state.faceVertices[i]);
+
+            if (verticesPerFace > 3)
+                triangulateLastInsertedFace(verticesPerFace);
+
+            break;
+
+        case 'm':
+            if (TokenEquals(pCommand, pCommandEnd, "mtllib"))
+            {
+                pNext = SkipBlanks(p, pEnd);
+                name.assign(pNext, SkipToken(pNext, pEnd));
+                importMaterials(m_directoryPath + name.c_str());
+            }
+            break;
+
+        case 'u':
+            if (TokenEquals(pCommand, pCommandEnd, "usemtl"))
+            {
+                pNext = SkipBlanks(p, pEnd);
+                name.assign(pNext, SkipToken(pNext, pEnd));
+                iter = m_pMaterialCache->find(name);
+                state.activeMaterial = (iter == m_pMaterialCache->end()) ? 0 : iter->second;
+            }
+            break;
+
+        default:
+            break;
+        }
     }
 
     return true;
 }
 
+void ModelOBJ::narrowIndexBuffer()
+{
+    // 16-bit indices replace the 32-bit ones whenever they can address every
+    // vertex, and the 32-bit buffer is freed. Larger models keep their 32-bit
+    // indices.
+
+    if (m_indexBuffer.empty() || getNumberOfVertices() > MAX_SHORT_INDEX_VERTICES)
+        return;
+
+    m_shortIndexBuffer.resize(m_indexBuffer.size());
+
+    for (int i = 0; i < static_cast<int>(m_indexBuffer.size()); ++i)
+        m_shortIndexBuffer[i] = static_cast<unsigned short>(m_indexBuffer[i]);
+
+    MeshBuffer<int>().swap(m_indexBuffer);
+}
+
+bool ModelOBJ::reloadMaterials()
+{
+    // Imports the MTL files again for loadCache() when only they have
+    // changed. The meshes refer to their materials by index, so each cached
+    // material is replaced by the new material with the same name and the
+    // indexes stay valid. The meshes keep their order even if color maps have
+    // changed. Returns false if the set of names has changed, because faces
+    // could then resolve to other materials and the OBJ file has to be
+    // imported again.
+
+    std::vector<std::string> libraries(m_materialLibraries);
+    std::vector<Material> materials;
+    std::map<std::string, int> names;
+    LinearAllocator allocator;
+    bool reloaded = false;
+
+    // Like the import, a name that's defined more than once refers to the
+    // last material with that name.
+
+    materials.swap(m_materials);
+    m_materialLibraries.clear();
+
+    for (int i = 0; i < static_cast<int>(materials.size()); ++i)
+        names[materials[i].name] = i;
+
+    try
+    {
+        MaterialCacheAllocator materialCacheAllocator(&allocator);
+        MaterialCache materialCache(std::less<ImportString>(), materialCacheAllocator);
+
+        m_pMaterialCache = &materialCache;
+
+        importDefaultMaterial();
+
+        for (int i = 0; i < static_cast<int>(libraries.size()); ++i)
+            importMaterials(libraries[i]);
+
+        reloaded = materialCache.size() == names.size();
+
+        for (MaterialCache::const_iterator i = materialCache.begin(); reloaded && i != materialCache.end(); ++i)
+        {
+            std::map<std::string, int>::const_iterator name = names.find(std::string(i->first.c_str(), i->first.size()));
+
+            if (name == names.end())
+                reloaded = false;
+            else
+                materials[name->second] = m_materials[i->second];
+        }
+    }
+    catch (const std::bad_alloc &)
+    {
+        reloaded = false;
+    }
+
+    m_pMaterialCache = 0;
+    m_materials.swap(materials);
+    m_materialLibraries.swap(libraries);
+    return reloaded;
+}
+
+void ModelOBJ::reserveVertexCache()
+{
+    // Most models have roughly as many unique vertices as they have entries
+    // in their largest coordinate list. The table keeps at most half its slots
+    // in use so reserve twice that many slots up front.
+
+    int expected = m_numberOfVertexCoords;
+
+    if (m_numberOfTextureCoords > expected)
+        expected = m_numberOfTextureCoords;
+
+    if (m_numberOfNormals > expected)
+        expected = m_numberOfNormals;
+
+    growVertexCache(expected * 2);
+    m_vertexBuffer.reserve(expected);
+}
+
 int ModelOBJ::triangulateLastInsertedFace(int verticesPerFace)
 {
     // Triangulate the most recently inserted face in the index buffer. It is
@@ -784,4 +4980,103 @@ int ModelOBJ::triangulateLastInsertedFace(int verticesPerFace)
     }
 
     return triangles;
-}
\ No newline at end of file
+}
+
+void ModelOBJ::updateBounds()
+{
+    // The model's bounding box, centroid, and bounding sphere are found
+    // together by MeshBounds, then every mesh's, levels of detail included,
+    // so whole meshes can be culled. The methods that move vertices call
+    // this. scale() transforms the bounds instead of measuring them again.
+
+    int vertexCount = getNumberOfVertices();
+
+    if (m_pVertexQuantizer)
+    {
+        std::vector<Vertex> vertices;
+        const Vertex *pVertices = decodeVertices(vertices);
+
+        MeshBounds::calculateBounds(pVertices ? pVertices->position : 0,
+            vertexCount, static_cast<int>(sizeof(Vertex)), m_bounds);
+    }
+    else if (m_pVertexStreams)
+    {
+        MeshBounds::calculateBounds(m_pVertexStreams->getStream(VertexStreams::POSITION_X),
+            m_pVertexStreams->getStream(VertexStreams::POSITION_Y),
+            m_pVertexStreams->getStream(VertexStreams::POSITION_Z), vertexCount, m_bounds);
+    }
+    else
+    {
+        MeshBounds::calculateBounds((vertexCount > 0) ? m_vertexBuffer[0].position : 0,
+            vertexCount, static_cast<int>(sizeof(Vertex)), m_bounds);
+    }
+
+    updateMeshBounds(m_meshes);
+    updateMeshBounds(m_lodMeshes);
+}
+
+void ModelOBJ::updateMeshBounds(std::vector<Mesh> &meshes) const
+{
+    // Each mesh's bounds only cover the vertices its triangles use. The
+    // meshes are done in parallel.
+
+    if (meshes.empty())
+        return;
+
+    std::vector<Vertex> vertices;
+    const Vertex *pVertices = decodeVertices(vertices);
+
+    if (!pVertices)
+        return;
+
+    Mesh *pMeshes = &meshes[0];
+    std::vector<int> indices;
+    const int *pIndices = widenIndices(indices);
+    const float *pPositions = pVertices->position;
+
+    Parallel::forEach(static_cast<int>(meshes.size()), [pMeshes, pIndices, pPositions](int i)
+    {
+        Mesh &mesh = pMeshes[i];
+        MeshBounds::Bounds bounds;
+
+        MeshBounds::calculateBounds(pIndices + mesh.startIndex, mesh.triangleCount * 3,
+            pPositions, static_cast<int>(sizeof(Vertex)), bounds);
+        SetMeshBounds(mesh, bounds);
+    });
+}
+
+void ModelOBJ::updateVertexStreams()
+{
+    if (m_pVertexStreams)
+        m_pVertexStreams->build(m_vertexBuffer.begin(), static_cast<int>(m_vertexBuffer.size()));
+}
+
+void ModelOBJ::widenIndexBuffer()
+{
+    // The methods that change the indices work on 32-bit indices. They call
+    // this first and narrowIndexBuffer() once they're done.
+
+    if (m_shortIndexBuffer.empty())
+        return;
+
+    m_indexBuffer.resize(m_shortIndexBuffer.size());
+
+    for (int i = 0; i < static_cast<int>(m_shortIndexBuffer.size()); ++i)
+        m_indexBuffer[i] = m_shortIndexBuffer[i];
+
+    MeshBuffer<unsigned short>().swap(m_shortIndexBuffer);
+}
+
+const int *ModelOBJ::widenIndices(std::vector<int> &indices) const
+{
+    // Returns the 32-bit indices for the passes that only read them, copying
+    // 16-bit indices into indices first. Returns null if there are none.
+
+    if (!m_shortIndexBuffer.empty())
+    {
+        indices.assign(m_shortIndexBuffer.begin(), m_shortIndexBuffer.end());
+        return &indices[0];
+    }
+
+    return m_indexBuffer.empty() ? 0 : m_indexBuffer.begin();
+}
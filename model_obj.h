@@ -23,10 +23,17 @@
 #if !defined(MODEL_OBJ_H)
 #define MODEL_OBJ_H
 
+#include <cassert>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <string>
 #include <vector>
+#include "linear_allocator.h"
+#include "mapped_file.h"
+#include "mesh_bounds.h"
+#include "mesh_buffer.h"
+#include "mesh_clusterizer.h"
 
 //-----------------------------------------------------------------------------
 // Alias|Wavefront OBJ file loader.
@@ -42,6 +49,9 @@
 // 4. This loader triangulates all polygonal faces during importing.
 //-----------------------------------------------------------------------------
 
+class VertexQuantizer;
+class VertexStreams;
+
 class ModelOBJ
 {
 public:
@@ -54,6 +64,7 @@ public:
         float alpha;            // [0 = fully transparent, 1 = fully opaque]
 
         std::string colorMapFilename;
+        std::string name;
     };
 
     struct Vertex
@@ -68,54 +79,234 @@ public:
         int startIndex;
         int triangleCount;
         int materialIndex;
+        float boundsMin[3];
+        float boundsMax[3];
+        float center[3];        // bounding sphere
+        float radius;
+    };
+
+    struct Tangent
+    {
+        float tangent[4];       // [xyz = unit tangent, w = bitangent sign]
+    };
+
+    typedef MeshClusterizer::Cluster Cluster;
+
+    struct Lod
+    {
+        int startIndex;
+        int triangleCount;
+        int firstMesh;          // first of this level's meshes in getLodMesh()
+        int meshCount;
+        float error;            // largest geometric error in model units
+    };
+
+    enum NormalWeighting
+    {
+        NORMALS_AREA_WEIGHTED,
+        NORMALS_ANGLE_WEIGHTED
+    };
+
+    struct StreamChunk
+    {
+        int materialIndex;
+        int vertexCount;
+        int indexCount;
+        const Vertex *pVertices;
+        const int *pIndices;        // indices into pVertices
     };
 
+    struct StreamOptions
+    {
+        StreamOptions();
+
+        size_t memoryLimit;         // bytes of working memory
+        size_t windowSize;          // bytes of the file read at a time
+        int chunkVertices;          // most vertices in a chunk
+        std::string spillFilename;  // empty = OBJ file name + ".spill"
+    };
+
+    // Returning false stops the import.
+    typedef std::function<bool (const StreamChunk &chunk)> StreamCallback;
+
     ModelOBJ();
     ~ModelOBJ();
 
+    // Splits each mesh into clusters for culling. Call it between
+    // optimizeVertexCache() and optimizeVertexFetch().
+    void buildClusters();
+
+    // Keeps a structure of arrays copy of the vertices for SIMD bounds and
+    // scaling until releaseVertexStreams().
+    void buildVertexStreams();
+
+    // Average vertices transformed per triangle and vertex bytes read per
+    // triangle, to measure optimizeVertexCache() and optimizeVertexFetch().
+    float calculateACMR() const;
+    float calculateFetchedBytesPerTriangle() const;
+
+    void destroy();
+
+    // Called by import() if the OBJ file has no normals.
+    void generateNormals(NormalWeighting weighting = NORMALS_AREA_WEIGHTED);
+
+    // One simplified level of detail per ratio of the model's triangles.
+    int generateLods(const float *pTriangleRatios, int count);
+
+    // Tangents for normal mapping, w = bitangent sign. Call after
+    // weldVertices(), before optimizeVertexFetch().
+    bool generateTangents();
+
     bool import(const char *pszFilename);
+
+    // Hands the triangles of a file too large for memory to callback in
+    // chunks, within options.memoryLimit.
+    bool importStreaming(const char *pszFilename, const StreamOptions &options,
+                         const StreamCallback &callback);
+
+    // Binary cache of an imported model. loadCache() memory maps it and
+    // fails once the OBJ file has changed.
+    bool loadCache(const char *pszCacheFilename, const char *pszFilename);
+    bool saveCache(const char *pszCacheFilename, const char *pszFilename, bool compress = false) const;
+
+    // Scales the model to a bounding sphere of radius scaleTo and optionally
+    // moves the sphere's center to the origin.
     void normalize(float scaleTo = 1.0f, bool center = true);
+
+    // Reorder the triangles for the vertex cache, then the vertices for
+    // fetch locality.
+    void optimizeVertexCache();
+    void optimizeVertexFetch();
+
+    // 16 byte vertices within the given errors. Call last; the methods that
+    // change the vertices turn them back into floats.
+    bool quantizeVertices(float maxPositionError, float maxTexCoordError, float maxNormalError);
+
+    void releaseVertexStreams();
     void reverseWinding();
 
+    // Merges vertices within the tolerances. Returns the number removed.
+    int weldVertices(float positionTolerance, float texCoordTolerance = 0.0f,
+                     float normalTolerance = 0.0f);
+
     // Getter methods.
 
+    const MeshBounds::Bounds &getBounds() const;
     void getCenter(float &x, float &y, float &z) const;
     float getWidth() const;
     float getHeight() const;
     float getLength() const;
 
+    const Cluster &getCluster(int i) const;
+    int getIndex(int i) const;
+
+    // Models with at most 65536 vertices keep 16-bit indices, others 32-bit.
+    // Only one of the two buffers is non-null. getIndices() reads either.
     const int *getIndexBuffer() const;
+    void getIndices(int first, int count, int *pIndices) const;
+    int getIndexSize() const;
+    const unsigned short *getShortIndexBuffer() const;
+
+    const Lod &getLod(int i) const;
+    const Mesh &getLodMesh(int i) const;
     const Material &getMaterial(int i) const;
-    const Mesh &getMesh(int i) const;
 
-    int getNumberOfIndices() const;
+    // Every MTL file the OBJ file refers to, ones that couldn't be opened too.
+    const std::string &getMaterialLibrary(int i) const;
+
+    // One mesh per material, sorted by color map and then by material.
+    const Mesh &getMesh(int i) const;
+    void getMeshClusters(int mesh, int &firstCluster, int &clusterCount) const;
+    const Tangent &getTangent(int i) const;
+    const Tangent *getTangentBuffer() const;
+
+    int getNumberOfClusters() const;
+    int getNumberOfIndices() const;       // full detail model only
+    int getNumberOfLods() const;
+    int getNumberOfMaterialLibraries() const;
     int getNumberOfMaterials() const;
     int getNumberOfMeshes() const;
-    int getNumberOfTriangles() const;
+    int getNumberOfTriangles() const;     // full detail model only
     int getNumberOfVertices() const;
 
+    // Only valid while the vertices aren't quantized. getVertices() works
+    // either way, decoding quantized vertices.
     const Vertex &getVertex(int i) const;
     const Vertex *getVertexBuffer() const;
+    const VertexQuantizer *getVertexQuantizer() const;
+    void getVertices(int first, int count, Vertex *pVertices) const;
     int getVertexSize() const;
+    const VertexStreams *getVertexStreams() const;
+
+    // Temporary memory the last import held at once (the allocator's blocks)
+    // and allocated in total.
+    size_t getImportPeakBytes() const;
+    size_t getImportTotalBytes() const;
 
+    bool hasClusters() const;
+    bool hasQuantizedVertices() const;
+    bool hasTangents() const;
     bool hasTextureCoords() const;
     bool hasVertexNormals() const;
+    bool hasVertexStreams() const;
+
+    // Setter methods.
+
+    // Reuse one allocator for every import's temporaries, or cap the default
+    // allocator. An import that needs more memory fails.
+    void setImportAllocator(LinearAllocator *pAllocator);
+    void setImportMemoryLimit(size_t bytes);
 
 private:
-    void addVertex(int hash, const Vertex *pVertex);
-    void bounds(float center[3], float &radius) const;
-    void bounds(float center[3], float &width, float &height, float &length) const;
-    void buildMeshes();
-    void generateNormals();
+    struct VertexCacheEntry
+    {
+        unsigned int hash;
+        int posIndex;
+        int vertexIndex;
+    };
+
+    struct StreamState;
+
+    typedef std::basic_string<char, std::char_traits<char>, LinearAllocatorAdapter<char> > ImportString;
+    typedef LinearAllocatorAdapter<std::pair<const ImportString, int> > MaterialCacheAllocator;
+    typedef std::map<ImportString, int, std::less<ImportString>, MaterialCacheAllocator> MaterialCache;
+
+    ModelOBJ(const ModelOBJ &);
+    ModelOBJ &operator=(const ModelOBJ &);
+
+    void addVertex(int posIndex, const Vertex *pVertex);
+    bool buildMeshes();
+    const Vertex *decodeVertices(std::vector<Vertex> &vertices) const;
+    void dequantizeVertices();
+    bool flushStreamChunk(StreamState &state);
+    void growVertexCache(int capacity);
+    void importDefaultMaterial();
     void importGeometryFirstPass(std::ifstream &stream);
+    void importGeometryFirstPass(const char *pBegin, const char *pEnd);
+    bool importGeometryParallel(const char *pBegin, const char *pEnd);
     void importGeometrySecondPass(std::ifstream &stream);
+    bool importGeometrySecondPass(const char *pBegin, const char *pEnd);
     bool importMaterials(const std::string &filename);
+    bool importStreamLines(const char *pBegin, const char *pEnd, StreamState &state);
+    void narrowIndexBuffer();
+    bool reloadMaterials();
+    void reserveVertexCache();
     void scale(float scaleFactor, float offset[3]);
+    void setDirectoryPath(const char *pszFilename);
     int triangulateLastInsertedFace(int verticesPerFace);
+    void updateBounds();
+    void updateMeshBounds(std::vector<Mesh> &meshes) const;
+    void updateVertexStreams();
+    void widenIndexBuffer();
+    const int *widenIndices(std::vector<int> &indices) const;
+
+    static unsigned int hashVertex(int posIndex, const Vertex *pVertex);
 
     static const int FACE_INDEX_CACHE_SIZE = 32;
     static int m_faceIndexCache[FACE_INDEX_CACHE_SIZE];
 
+    static const int MAX_SHORT_INDEX_VERTICES = 65536;
+
     bool m_hasTextureCoords;
     bool m_hasVertexNormals;
 
@@ -124,48 +315,111 @@ private:
     int m_numberOfNormals;
     int m_numberOfFaces;
 
-    float m_center[3];
-    float m_width;
-    float m_height;
-    float m_length;
+    MeshBounds::Bounds m_bounds;
 
     std::string m_directoryPath;
+    std::vector<std::string> m_materialLibraries;
+    MappedFile m_cacheFile;
 
     std::vector<Mesh> m_meshes;
+    std::vector<Mesh> m_lodMeshes;
+    std::vector<Lod> m_lods;
+    std::vector<Cluster> m_clusters;
+    std::vector<int> m_meshClusterOffsets;
     std::vector<Material> m_materials;
-    std::vector<Vertex> m_vertexBuffer;
-    std::vector<int> m_indexBuffer;
+    MeshBuffer<Vertex> m_vertexBuffer;
+    MeshBuffer<Tangent> m_tangentBuffer;
+    MeshBuffer<int> m_indexBuffer;
+    MeshBuffer<unsigned short> m_shortIndexBuffer;
     std::vector<int> m_attributeBuffer;
-
-    std::map<std::string, int> m_materialCache;
-    std::map<int, std::vector<int> > m_vertexCache;
+    VertexStreams *m_pVertexStreams;
+    VertexQuantizer *m_pVertexQuantizer;
+
+    // Import temporaries. These only exist while import() or importStreaming()
+    // is running.
+    LinearAllocator *m_pImportArena;
+    MaterialCache *m_pMaterialCache;
+    VertexCacheEntry *m_pVertexCache;
+    int m_vertexCacheSize;
+    int m_vertexCacheCount;
+
+    LinearAllocator *m_pImportAllocator;
+    size_t m_importMemoryLimit;
+    size_t m_importPeakBytes;
+    size_t m_importTotalBytes;
 };
 
 //-----------------------------------------------------------------------------
 
+inline const MeshBounds::Bounds &ModelOBJ::getBounds() const
+{ return m_bounds; }
+
 inline void ModelOBJ::getCenter(float &x, float &y, float &z) const
-{ x = m_center[0]; y = m_center[1]; z = m_center[2]; }
+{
+    x = (m_bounds.minimum[0] + m_bounds.maximum[0]) / 2.0f;
+    y = (m_bounds.minimum[1] + m_bounds.maximum[1]) / 2.0f;
+    z = (m_bounds.minimum[2] + m_bounds.maximum[2]) / 2.0f;
+}
 
 inline float ModelOBJ::getWidth() const
-{ return m_width; }
+{ return m_bounds.maximum[0] - m_bounds.minimum[0]; }
 
 inline float ModelOBJ::getHeight() const
-{ return m_height; }
+{ return m_bounds.maximum[1] - m_bounds.minimum[1]; }
 
 inline float ModelOBJ::getLength() const
-{ return m_length; }
+{ return m_bounds.maximum[2] - m_bounds.minimum[2]; }
+
+inline const ModelOBJ::Cluster &ModelOBJ::getCluster(int i) const
+{ return m_clusters[i]; }
+
+inline int ModelOBJ::getIndex(int i) const
+{ return m_shortIndexBuffer.empty() ? m_indexBuffer[i] : m_shortIndexBuffer[i]; }
 
 inline const int *ModelOBJ::getIndexBuffer() const
-{ return &m_indexBuffer[0]; }
+{ return m_indexBuffer.empty() ? 0 : m_indexBuffer.begin(); }
+
+inline int ModelOBJ::getIndexSize() const
+{ return m_shortIndexBuffer.empty() ? static_cast<int>(sizeof(int)) : static_cast<int>(sizeof(unsigned short)); }
+
+inline const unsigned short *ModelOBJ::getShortIndexBuffer() const
+{ return m_shortIndexBuffer.empty() ? 0 : m_shortIndexBuffer.begin(); }
+
+inline const ModelOBJ::Lod &ModelOBJ::getLod(int i) const
+{ return m_lods[i]; }
+
+inline const ModelOBJ::Mesh &ModelOBJ::getLodMesh(int i) const
+{ return m_lodMeshes[i]; }
 
 inline const ModelOBJ::Material &ModelOBJ::getMaterial(int i) const
 { return m_materials[i]; }
 
+inline const std::string &ModelOBJ::getMaterialLibrary(int i) const
+{ return m_materialLibraries[i]; }
+
 inline const ModelOBJ::Mesh &ModelOBJ::getMesh(int i) const
 { return m_meshes[i]; }
 
+inline void ModelOBJ::getMeshClusters(int mesh, int &firstCluster, int &clusterCount) const
+{ firstCluster = m_meshClusterOffsets[mesh]; clusterCount = m_meshClusterOffsets[mesh + 1] - firstCluster; }
+
+inline const ModelOBJ::Tangent &ModelOBJ::getTangent(int i) const
+{ return m_tangentBuffer[i]; }
+
+inline const ModelOBJ::Tangent *ModelOBJ::getTangentBuffer() const
+{ return m_tangentBuffer.empty() ? 0 : m_tangentBuffer.begin(); }
+
+inline int ModelOBJ::getNumberOfClusters() const
+{ return static_cast<int>(m_clusters.size()); }
+
 inline int ModelOBJ::getNumberOfIndices() const
-{ return static_cast<int>(m_indexBuffer.size()); }
+{ return m_lods.empty() ? static_cast<int>(m_indexBuffer.size() + m_shortIndexBuffer.size()) : m_lods[0].startIndex; }
+
+inline int ModelOBJ::getNumberOfLods() const
+{ return static_cast<int>(m_lods.size()); }
+
+inline int ModelOBJ::getNumberOfMaterialLibraries() const
+{ return static_cast<int>(m_materialLibraries.size()); }
 
 inline int ModelOBJ::getNumberOfMaterials() const
 { return static_cast<int>(m_materials.size()); }
@@ -174,19 +428,34 @@ inline int ModelOBJ::getNumberOfMeshes() const
 { return static_cast<int>(m_meshes.size()); }
 
 inline int ModelOBJ::getNumberOfTriangles() const
-{ return static_cast<int>(m_indexBuffer.size() / 3); }
-
-inline int ModelOBJ::getNumberOfVertices() const
-{ return static_cast<int>(m_vertexBuffer.size()); }
+{ return getNumberOfIndices() / 3; }
 
 inline const ModelOBJ::Vertex &ModelOBJ::getVertex(int i) const
-{ return m_vertexBuffer[i]; }
+{ assert(!m_pVertexQuantizer); return m_vertexBuffer[i]; }
 
 inline const ModelOBJ::Vertex *ModelOBJ::getVertexBuffer() const
-{ return &m_vertexBuffer[0]; }
+{ return m_vertexBuffer.empty() ? 0 : m_vertexBuffer.begin(); }
 
-inline int ModelOBJ::getVertexSize() const
-{ return static_cast<int>(sizeof(Vertex)); }
+inline const VertexQuantizer *ModelOBJ::getVertexQuantizer() const
+{ return m_pVertexQuantizer; }
+
+inline const VertexStreams *ModelOBJ::getVertexStreams() const
+{ return m_pVertexStreams; }
+
+inline size_t ModelOBJ::getImportPeakBytes() const
+{ return m_importPeakBytes; }
+
+inline size_t ModelOBJ::getImportTotalBytes() const
+{ return m_importTotalBytes; }
+
+inline bool ModelOBJ::hasClusters() const
+{ return !m_clusters.empty(); }
+
+inline bool ModelOBJ::hasQuantizedVertices() const
+{ return m_pVertexQuantizer != 0; }
+
+inline bool ModelOBJ::hasTangents() const
+{ return !m_tangentBuffer.empty(); }
 
 inline bool ModelOBJ::hasTextureCoords() const
 { return m_hasTextureCoords; }
@@ -194,4 +463,13 @@ inline bool ModelOBJ::hasTextureCoords() const
 inline bool ModelOBJ::hasVertexNormals() const
 { return m_hasVertexNormals; }
 
+inline bool ModelOBJ::hasVertexStreams() const
+{ return m_pVertexStreams != 0; }
+
+inline void ModelOBJ::setImportAllocator(LinearAllocator *pAllocator)
+{ m_pImportAllocator = pAllocator; }
+
+inline void ModelOBJ::setImportMemoryLimit(size_t bytes)
+{ m_importMemoryLimit = bytes; }
+
 #endif
\ No newline at end of file
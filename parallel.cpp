@@ -0,0 +1,64 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include "parallel.h"
+
+namespace
+{
+    // Helper threads currently started by forEach() across the process.
+
+    std::atomic<int> g_helperThreads(0);
+}
+
+int Parallel::getThreadCount()
+{
+    int count = static_cast<int>(std::thread::hardware_concurrency());
+    return (count > 0) ? count : 1;
+}
+
+int Parallel::acquireHelperThreads(int count)
+{
+    // Claims up to count helper threads. Helpers started by every forEach()
+    // in the process share one less than the hardware threads between them,
+    // so calls made at the same time from AsyncLoader's workers don't each
+    // start a full set of threads. Returns the number claimed, maybe 0.
+
+    int limit = getThreadCount() - 1;
+    int busy = g_helperThreads.load();
+    int claimed = 0;
+
+    do
+    {
+        claimed = (count < limit - busy) ? count : limit - busy;
+
+        if (claimed <= 0)
+            return 0;
+    }
+    while (!g_helperThreads.compare_exchange_weak(busy, busy + claimed));
+
+    return claimed;
+}
+
+void Parallel::releaseHelperThreads(int count)
+{
+    g_helperThreads -= count;
+}
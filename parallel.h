@@ -0,0 +1,132 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+
+#if !defined(PARALLEL_H)
+#define PARALLEL_H
+
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//-----------------------------------------------------------------------------
+// Simple fork-join helpers.
+//
+// forEach() calls a function once for every item in the range [0, count). The
+// items are handed out to one thread per hardware thread, including the
+// calling thread, and forEach() returns once every item has been processed.
+// Calls running at the same time share the hardware threads, so a call may
+// get fewer threads, or only the calling thread, while another is running.
+// Items are claimed one at a time so callers should split their work into a
+// few more items than there are threads. The first exception thrown by an
+// item is rethrown on the calling thread after all the threads have finished.
+//
+// Items run concurrently and in no particular order. Any output that must be
+// deterministic should be written to per item storage and combined by the
+// caller afterwards.
+//-----------------------------------------------------------------------------
+
+class Parallel
+{
+public:
+    static int getThreadCount();
+
+    template <typename Function>
+    static void forEach(int count, const Function &function)
+    {
+        int threadCount = getThreadCount();
+
+        if (threadCount > count)
+            threadCount = count;
+
+        if (threadCount > 1)
+            threadCount = 1 + acquireHelperThreads(threadCount - 1);
+
+        if (threadCount <= 1)
+        {
+            for (int i = 0; i < count; ++i)
+                function(i);
+
+            return;
+        }
+
+        Worker<Function> worker(count, function);
+        std::vector<std::thread> threads;
+
+        threads.reserve(threadCount - 1);
+
+        for (int i = 1; i < threadCount; ++i)
+            threads.push_back(std::thread(&Worker<Function>::run, &worker));
+
+        worker.run();
+
+        for (int i = 0; i < static_cast<int>(threads.size()); ++i)
+            threads[i].join();
+
+        releaseHelperThreads(threadCount - 1);
+
+        if (worker.error)
+            std::rethrow_exception(worker.error);
+    }
+
+private:
+    static int acquireHelperThreads(int count);
+    static void releaseHelperThreads(int count);
+
+    template <typename Function>
+    struct Worker
+    {
+        Worker(int count, const Function &function) : count(count), function(function)
+        { next = 0; }
+
+        void run()
+        {
+            for (int i = next++; i < count; i = next++)
+            {
+                try
+                {
+                    function(i);
+                }
+                catch (...)
+                {
+                    std::lock_guard<std::mutex> lock(errorLock);
+
+                    if (!error)
+                        error = std::current_exception();
+                }
+            }
+        }
+
+        int count;
+        const Function &function;
+        std::atomic<int> next;
+        std::mutex errorLock;
+        std::exception_ptr error;
+
+    private:
+        Worker &operator=(const Worker &);
+    };
+};
+
+#endif
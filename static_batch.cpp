@@ -0,0 +1,385 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define PERFORM_SIMD_TRANSFORM          1
+#else
+#define PERFORM_SIMD_TRANSFORM          0
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include "material_table.h"
+#include "parallel.h"
+#include "static_batch.h"
+
+#if PERFORM_SIMD_TRANSFORM
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+    const int VERTEX_BLOCK_SIZE = 16384;
+    const int INDEX_BLOCK_SIZE = 3 * 16384;
+
+    struct Transform
+    {
+        float position[4][3];       // rows 0-2 rotate and scale, row 3 moves
+        float normal[3][3];         // inverse transpose of rows 0-2
+    };
+
+    struct ModelInfo
+    {
+        std::vector<int> meshMaterials;     // batch material of each mesh
+    };
+
+    struct Job
+    {
+        int item;
+        int first;                  // first source vertex or index
+        int count;
+        int dest;                   // first destination vertex or index
+    };
+
+    void TransformVertices(const ModelOBJ::Vertex *pSource, ModelOBJ::Vertex *pDest,
+                           int count, const Transform &transform)
+    {
+        const float (*p)[3] = transform.position;
+        const float (*n)[3] = transform.normal;
+        int i = 0;
+
+#if PERFORM_SIMD_TRANSFORM
+        if (sizeof(ModelOBJ::Vertex) == 8 * sizeof(float))
+        {
+            // A vertex is eight floats: position, texture coordinate, and
+            // normal. Four vertices are loaded as two 4x4 blocks that are
+            // transposed so each register holds one component of all four
+            // vertices, and transposed back before they're stored.
+
+            __m128 p00 = _mm_set1_ps(p[0][0]), p01 = _mm_set1_ps(p[0][1]), p02 = _mm_set1_ps(p[0][2]);
+            __m128 p10 = _mm_set1_ps(p[1][0]), p11 = _mm_set1_ps(p[1][1]), p12 = _mm_set1_ps(p[1][2]);
+            __m128 p20 = _mm_set1_ps(p[2][0]), p21 = _mm_set1_ps(p[2][1]), p22 = _mm_set1_ps(p[2][2]);
+            __m128 p30 = _mm_set1_ps(p[3][0]), p31 = _mm_set1_ps(p[3][1]), p32 = _mm_set1_ps(p[3][2]);
+            __m128 n00 = _mm_set1_ps(n[0][0]), n01 = _mm_set1_ps(n[0][1]), n02 = _mm_set1_ps(n[0][2]);
+            __m128 n10 = _mm_set1_ps(n[1][0]), n11 = _mm_set1_ps(n[1][1]), n12 = _mm_set1_ps(n[1][2]);
+            __m128 n20 = _mm_set1_ps(n[2][0]), n21 = _mm_set1_ps(n[2][1]), n22 = _mm_set1_ps(n[2][2]);
+            __m128 zero = _mm_setzero_ps();
+            __m128 one = _mm_set1_ps(1.0f);
+
+            for (; i + 4 <= count; i += 4)
+            {
+                const float *pIn = pSource[i].position;
+                float *pOut = pDest[i].position;
+
+                __m128 x = _mm_loadu_ps(pIn);
+                __m128 y = _mm_loadu_ps(pIn + 8);
+                __m128 z = _mm_loadu_ps(pIn + 16);
+                __m128 u = _mm_loadu_ps(pIn + 24);
+                __m128 v = _mm_loadu_ps(pIn + 4);
+                __m128 nx = _mm_loadu_ps(pIn + 12);
+                __m128 ny = _mm_loadu_ps(pIn + 20);
+                __m128 nz = _mm_loadu_ps(pIn + 28);
+
+                _MM_TRANSPOSE4_PS(x, y, z, u);
+                _MM_TRANSPOSE4_PS(v, nx, ny, nz);
+
+                __m128 tx = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, p00), _mm_mul_ps(y, p10)), _mm_mul_ps(z, p20)), p30);
+                __m128 ty = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, p01), _mm_mul_ps(y, p11)), _mm_mul_ps(z, p21)), p31);
+                __m128 tz = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, p02), _mm_mul_ps(y, p12)), _mm_mul_ps(z, p22)), p32);
+                __m128 tnx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, n00), _mm_mul_ps(ny, n10)), _mm_mul_ps(nz, n20));
+                __m128 tny = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, n01), _mm_mul_ps(ny, n11)), _mm_mul_ps(nz, n21));
+                __m128 tnz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, n02), _mm_mul_ps(ny, n12)), _mm_mul_ps(nz, n22));
+                __m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(tnx, tnx), _mm_mul_ps(tny, tny)), _mm_mul_ps(tnz, tnz));
+                __m128 scale = _mm_and_ps(_mm_cmpgt_ps(lengthSq, zero), _mm_div_ps(one, _mm_sqrt_ps(lengthSq)));
+
+                tnx = _mm_mul_ps(tnx, scale);
+                tny = _mm_mul_ps(tny, scale);
+                tnz = _mm_mul_ps(tnz, scale);
+
+                _MM_TRANSPOSE4_PS(tx, ty, tz, u);
+                _MM_TRANSPOSE4_PS(v, tnx, tny, tnz);
+
+                _mm_storeu_ps(pOut, tx);
+                _mm_storeu_ps(pOut + 4, v);
+                _mm_storeu_ps(pOut + 8, ty);
+                _mm_storeu_ps(pOut + 12, tnx);
+                _mm_storeu_ps(pOut + 16, tz);
+                _mm_storeu_ps(pOut + 20, tny);
+                _mm_storeu_ps(pOut + 24, u);
+                _mm_storeu_ps(pOut + 28, tnz);
+            }
+        }
+#endif
+
+        for (; i < count; ++i)
+        {
+            const ModelOBJ::Vertex &in = pSource[i];
+            ModelOBJ::Vertex &out = pDest[i];
+            float normal[3];
+
+            for (int j = 0; j < 3; ++j)
+            {
+                out.position[j] = ((in.position[0] * p[0][j] + in.position[1] * p[1][j]) + in.position[2] * p[2][j]) + p[3][j];
+                normal[j] = (in.normal[0] * n[0][j] + in.normal[1] * n[1][j]) + in.normal[2] * n[2][j];
+            }
+
+            float lengthSq = (normal[0] * normal[0] + normal[1] * normal[1]) + normal[2] * normal[2];
+            float scale = (lengthSq > 0.0f) ? 1.0f / sqrtf(lengthSq) : 0.0f;
+
+            out.texCoord[0] = in.texCoord[0];
+            out.texCoord[1] = in.texCoord[1];
+            out.normal[0] = normal[0] * scale;
+            out.normal[1] = normal[1] * scale;
+            out.normal[2] = normal[2] * scale;
+        }
+    }
+}
+
+StaticBatch::StaticBatch() : m_hasTextureCoords(false), m_hasVertexNormals(false)
+{
+}
+
+StaticBatch::~StaticBatch()
+{
+    destroy();
+}
+
+void StaticBatch::build(const Item *pItems, int count)
+{
+    destroy();
+
+    // Give each distinct model's meshes a batch material. Materials are
+    // interned so a material is identified by its pair of lighting and
+    // texture handles, and are numbered in the order they're first seen.
+
+    typedef std::map<std::pair<int, int>, int> BatchMaterials;
+
+    MaterialTable table;
+    BatchMaterials batchMaterials;
+    std::map<const ModelOBJ *, int> modelIds;
+    std::vector<ModelInfo> models;
+    std::vector<int> itemModels(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const ModelOBJ &model = *pItems[i].pModel;
+        std::map<const ModelOBJ *, int>::iterator found = modelIds.find(&model);
+
+        if (found != modelIds.end())
+        {
+            itemModels[i] = found->second;
+            continue;
+        }
+
+        ModelInfo info;
+
+        info.meshMaterials.resize(model.getNumberOfMeshes());
+
+        for (int j = 0; j < model.getNumberOfMeshes(); ++j)
+        {
+            const ModelOBJ::Material &material = model.getMaterial(model.getMesh(j).materialIndex);
+            std::pair<int, int> key(table.intern(material), table.internTexture(material.colorMapFilename));
+            BatchMaterials::iterator found = batchMaterials.find(key);
+
+            if (found == batchMaterials.end())
+            {
+                int batchMaterial = static_cast<int>(m_materials.size());
+
+                found = batchMaterials.insert(std::make_pair(key, batchMaterial)).first;
+                m_materials.push_back(material);
+            }
+
+            info.meshMaterials[j] = found->second;
+        }
+
+        itemModels[i] = static_cast<int>(models.size());
+        modelIds[&model] = itemModels[i];
+        models.push_back(info);
+
+        m_hasTextureCoords = m_hasTextureCoords || model.hasTextureCoords();
+        m_hasVertexNormals = m_hasVertexNormals || model.hasVertexNormals();
+    }
+
+    // Lay out one index range per material, then hand out the vertex and
+    // index blocks that each copy writes to. Large meshes and vertex buffers
+    // are split so the work spreads evenly over the threads.
+
+    int materialCount = static_cast<int>(m_materials.size());
+    std::vector<int> materialIndices(materialCount, 0);
+    int vertexCount = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const ModelOBJ &model = *pItems[i].pModel;
+        const ModelInfo &info = models[itemModels[i]];
+
+        for (int j = 0; j < model.getNumberOfMeshes(); ++j)
+            materialIndices[info.meshMaterials[j]] += model.getMesh(j).triangleCount * 3;
+
+        vertexCount += model.getNumberOfVertices();
+    }
+
+    std::vector<int> cursors(materialCount, 0);
+    int indexCount = 0;
+
+    for (int i = 0; i < materialCount; ++i)
+    {
+        if (materialIndices[i] > 0)
+        {
+            Range range;
+
+            range.startIndex = indexCount;
+            range.triangleCount = materialIndices[i] / 3;
+            range.materialIndex = i;
+            m_ranges.push_back(range);
+        }
+
+        cursors[i] = indexCount;
+        indexCount += materialIndices[i];
+    }
+
+    std::vector<Job> vertexJobs;
+    std::vector<Job> indexJobs;
+    std::vector<int> baseVertices(count);
+    int baseVertex = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const ModelOBJ &model = *pItems[i].pModel;
+        const ModelInfo &info = models[itemModels[i]];
+        Job job;
+
+        job.item = i;
+        baseVertices[i] = baseVertex;
+
+        for (int first = 0; first < model.getNumberOfVertices(); first += VERTEX_BLOCK_SIZE)
+        {
+            job.first = first;
+            job.count = std::min(VERTEX_BLOCK_SIZE, model.getNumberOfVertices() - first);
+            job.dest = baseVertex + first;
+            vertexJobs.push_back(job);
+        }
+
+        for (int j = 0; j < model.getNumberOfMeshes(); ++j)
+        {
+            const ModelOBJ::Mesh &mesh = model.getMesh(j);
+            int &cursor = cursors[info.meshMaterials[j]];
+
+            for (int first = 0; first < mesh.triangleCount * 3; first += INDEX_BLOCK_SIZE)
+            {
+                job.first = mesh.startIndex + first;
+                job.count = std::min(INDEX_BLOCK_SIZE, mesh.triangleCount * 3 - first);
+                job.dest = cursor;
+                cursor += job.count;
+                indexJobs.push_back(job);
+            }
+        }
+
+        baseVertex += model.getNumberOfVertices();
+    }
+
+    // Positions are transformed by the item's matrix and normals by the
+    // inverse transpose of its upper 3x3 part. Matrix4 uses row vectors.
+
+    std::vector<Transform> transforms(count);
+
+    for (int i = 0; i < count; ++i)
+    {
+        const Matrix4 &m = pItems[i].transform;
+        Matrix4 inverse = m.inverse();
+        Transform &transform = transforms[i];
+
+        for (int row = 0; row < 4; ++row)
+        {
+            for (int column = 0; column < 3; ++column)
+                transform.position[row][column] = m[row][column];
+        }
+
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 3; ++column)
+                transform.normal[row][column] = inverse[column][row];
+        }
+    }
+
+    m_vertexBuffer.resize(vertexCount);
+    m_indexBuffer.resize(indexCount);
+
+    if (vertexCount == 0 || indexCount == 0)
+        return;
+
+    const Item *pItemList = pItems;
+    const Transform *pTransforms = &transforms[0];
+    const Job *pVertexJobs = vertexJobs.empty() ? 0 : &vertexJobs[0];
+    const Job *pIndexJobs = indexJobs.empty() ? 0 : &indexJobs[0];
+    const int *pBaseVertices = &baseVertices[0];
+    ModelOBJ::Vertex *pVertices = &m_vertexBuffer[0];
+    int *pIndices = &m_indexBuffer[0];
+
+    Parallel::forEach(static_cast<int>(vertexJobs.size()), [pItemList, pTransforms, pVertexJobs, pVertices](int i)
+    {
+        const Job &job = pVertexJobs[i];
+        const ModelOBJ &model = *pItemList[job.item].pModel;
+        const ModelOBJ::Vertex *pSource = model.getVertexBuffer();
+        std::vector<ModelOBJ::Vertex> decoded;
+
+        // Quantized vertices are decoded first. TransformVertices() can't
+        // work in place, so they go into a temporary.
+        if (pSource)
+        {
+            pSource += job.first;
+        }
+        else
+        {
+            decoded.resize(job.count);
+            model.getVertices(job.first, job.count, &decoded[0]);
+            pSource = &decoded[0];
+        }
+
+        TransformVertices(pSource, pVertices + job.dest, job.count, pTransforms[job.item]);
+    });
+
+    Parallel::forEach(static_cast<int>(indexJobs.size()), [pItemList, pIndexJobs, pBaseVertices, pIndices](int i)
+    {
+        const Job &job = pIndexJobs[i];
+        int *pDest = pIndices + job.dest;
+        int base = pBaseVertices[job.item];
+
+        // The indices are widened from the model's own width first.
+        pItemList[job.item].pModel->getIndices(job.first, job.count, pDest);
+
+        for (int j = 0; j < job.count; ++j)
+            pDest[j] += base;
+    });
+}
+
+void StaticBatch::destroy()
+{
+    m_hasTextureCoords = false;
+    m_hasVertexNormals = false;
+
+    m_vertexBuffer.clear();
+    m_indexBuffer.clear();
+    m_materials.clear();
+    m_ranges.clear();
+}
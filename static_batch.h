@@ -0,0 +1,136 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(STATIC_BATCH_H)
+#define STATIC_BATCH_H
+
+#include <vector>
+#include "mathlib.h"
+#include "model_obj.h"
+
+//-----------------------------------------------------------------------------
+// Merges static copies of models into one vertex buffer and one index buffer.
+//
+// build() takes a list of models, each with its own model to world
+// transform. A model can be listed any number of times. Every copy's
+// vertices are transformed into world space: positions by the transform and
+// normals by its inverse transpose, after which they're normalized again.
+// The indices are grouped by material so the whole batch is drawn with one
+// range per distinct material instead of one draw per mesh per copy.
+// Materials are compared by value, so identical materials from different
+// models share a range. Within a range the copies appear in list order.
+//
+// The vertices are transformed in blocks on all available cores. With
+// PERFORM_SIMD_TRANSFORM four vertices are transformed at a time using SSE.
+// The SIMD path performs exactly the same operations as the scalar path so
+// both produce identical results.
+//
+// Only the full detail model is batched. Levels of detail and clusters are
+// left out. The batch copies everything it needs, so the models may be
+// changed or destroyed afterwards.
+//-----------------------------------------------------------------------------
+
+class StaticBatch
+{
+public:
+    struct Item
+    {
+        const ModelOBJ *pModel;
+        Matrix4 transform;
+    };
+
+    struct Range
+    {
+        int startIndex;
+        int triangleCount;
+        int materialIndex;
+    };
+
+    StaticBatch();
+    ~StaticBatch();
+
+    void build(const Item *pItems, int count);
+    void destroy();
+
+    // Getter methods.
+
+    const int *getIndexBuffer() const;
+    const ModelOBJ::Material &getMaterial(int i) const;
+    int getNumberOfIndices() const;
+    int getNumberOfMaterials() const;
+    int getNumberOfRanges() const;
+    int getNumberOfTriangles() const;
+    int getNumberOfVertices() const;
+    const Range &getRange(int i) const;
+    const ModelOBJ::Vertex *getVertexBuffer() const;
+    int getVertexSize() const;
+    bool hasTextureCoords() const;
+    bool hasVertexNormals() const;
+
+private:
+    std::vector<ModelOBJ::Vertex> m_vertexBuffer;
+    std::vector<int> m_indexBuffer;
+    std::vector<ModelOBJ::Material> m_materials;
+    std::vector<Range> m_ranges;
+    bool m_hasTextureCoords;
+    bool m_hasVertexNormals;
+};
+
+//-----------------------------------------------------------------------------
+
+inline const int *StaticBatch::getIndexBuffer() const
+{ return m_indexBuffer.empty() ? 0 : &m_indexBuffer[0]; }
+
+inline const ModelOBJ::Material &StaticBatch::getMaterial(int i) const
+{ return m_materials[i]; }
+
+inline int StaticBatch::getNumberOfIndices() const
+{ return static_cast<int>(m_indexBuffer.size()); }
+
+inline int StaticBatch::getNumberOfMaterials() const
+{ return static_cast<int>(m_materials.size()); }
+
+inline int StaticBatch::getNumberOfRanges() const
+{ return static_cast<int>(m_ranges.size()); }
+
+inline int StaticBatch::getNumberOfTriangles() const
+{ return getNumberOfIndices() / 3; }
+
+inline int StaticBatch::getNumberOfVertices() const
+{ return static_cast<int>(m_vertexBuffer.size()); }
+
+inline const StaticBatch::Range &StaticBatch::getRange(int i) const
+{ return m_ranges[i]; }
+
+inline const ModelOBJ::Vertex *StaticBatch::getVertexBuffer() const
+{ return m_vertexBuffer.empty() ? 0 : &m_vertexBuffer[0]; }
+
+inline int StaticBatch::getVertexSize() const
+{ return static_cast<int>(sizeof(ModelOBJ::Vertex)); }
+
+inline bool StaticBatch::hasTextureCoords() const
+{ return m_hasTextureCoords; }
+
+inline bool StaticBatch::hasVertexNormals() const
+{ return m_hasVertexNormals; }
+
+#endif
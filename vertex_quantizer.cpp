@@ -0,0 +1,567 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include "vertex_quantizer.h"
+
+namespace
+{
+    inline float Clamp(float value, float minValue, float maxValue)
+    {
+        return (value < minValue) ? minValue : ((value > maxValue) ? maxValue : value);
+    }
+
+    inline int QuantizeSnorm(float value, int maxValue)
+    {
+        return static_cast<int>(floorf(Clamp(value, -1.0f, 1.0f) * maxValue + 0.5f));
+    }
+
+    inline float DequantizeSnorm(int value, int maxValue)
+    {
+        float result = static_cast<float>(value) / static_cast<float>(maxValue);
+        return (result < -1.0f) ? -1.0f : result;
+    }
+
+    inline int QuantizeUnorm(float value, int maxValue)
+    {
+        return static_cast<int>(floorf(Clamp(value, 0.0f, 1.0f) * maxValue + 0.5f));
+    }
+
+    inline float DequantizeUnorm(int value, int maxValue)
+    {
+        return static_cast<float>(value) / static_cast<float>(maxValue);
+    }
+
+    unsigned short FloatToHalf(float value)
+    {
+        // Rounds to nearest even. Overflows become infinity and NaNs stay
+        // NaNs. Based on Fabian Giesen's float_to_half_fast3_rtne().
+
+        const unsigned int F16_MAX = (127 + 16) << 23;
+        const unsigned int F32_INFINITY = 255 << 23;
+        const unsigned int DENORM_MAGIC = ((127 - 15) + (23 - 10) + 1) << 23;
+
+        unsigned int bits = 0;
+        memcpy(&bits, &value, sizeof(bits));
+
+        unsigned int sign = bits & 0x80000000u;
+        unsigned int result = 0;
+
+        bits ^= sign;
+
+        if (bits >= F16_MAX)
+        {
+            result = (bits > F32_INFINITY) ? 0x7e00 : 0x7c00;
+        }
+        else if (bits < (113 << 23))
+        {
+            // Subnormal or zero. Adding the magic number lets the FPU do the
+            // rounding.
+
+            float magnitude = 0.0f;
+            float magic = 0.0f;
+
+            memcpy(&magnitude, &bits, sizeof(magnitude));
+            memcpy(&magic, &DENORM_MAGIC, sizeof(magic));
+            magnitude += magic;
+            memcpy(&bits, &magnitude, sizeof(bits));
+            result = bits - DENORM_MAGIC;
+        }
+        else
+        {
+            unsigned int odd = (bits >> 13) & 1;
+
+            bits -= (127 - 15) << 23;
+            bits += 0xfff + odd;
+            result = bits >> 13;
+        }
+
+        return static_cast<unsigned short>(result | (sign >> 16));
+    }
+
+    float HalfToFloat(unsigned short value)
+    {
+        const unsigned int SHIFTED_EXPONENT = 0x7c00 << 13;
+        const unsigned int MAGIC = 113 << 23;
+
+        unsigned int bits = (value & 0x7fff) << 13;
+        unsigned int exponent = bits & SHIFTED_EXPONENT;
+        float result = 0.0f;
+
+        bits += (127 - 15) << 23;
+
+        if (exponent == SHIFTED_EXPONENT)
+        {
+            // Infinity or NaN.
+            bits += (128 - 16) << 23;
+            memcpy(&result, &bits, sizeof(result));
+        }
+        else if (exponent == 0)
+        {
+            // Zero or subnormal.
+            float magic = 0.0f;
+
+            bits += 1 << 23;
+            memcpy(&result, &bits, sizeof(result));
+            memcpy(&magic, &MAGIC, sizeof(magic));
+            result -= magic;
+        }
+        else
+        {
+            memcpy(&result, &bits, sizeof(result));
+        }
+
+        return (value & 0x8000) ? -result : result;
+    }
+
+    void OctahedralDecode(float u, float v, float normal[3])
+    {
+        float x = u;
+        float y = v;
+        float z = 1.0f - fabsf(u) - fabsf(v);
+
+        if (z < 0.0f)
+        {
+            x = (1.0f - fabsf(v)) * ((u >= 0.0f) ? 1.0f : -1.0f);
+            y = (1.0f - fabsf(u)) * ((v >= 0.0f) ? 1.0f : -1.0f);
+        }
+
+        float length = sqrtf(x * x + y * y + z * z);
+
+        normal[0] = x / length;
+        normal[1] = y / length;
+        normal[2] = z / length;
+    }
+
+    void OctahedralEncode(const float normal[3], int maxValue, int &u, int &v)
+    {
+        // Project onto the octahedron and fold the lower hemisphere over the
+        // upper one. Of the four nearest grid points the one that decodes
+        // closest to the original normal is chosen. This halves the worst
+        // case error compared to plain rounding.
+
+        float length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+
+        if (length == 0.0f)
+        {
+            u = 0;
+            v = 0;
+            return;
+        }
+
+        float x = normal[0] / length;
+        float y = normal[1] / length;
+
+        if (normal[2] < 0.0f)
+        {
+            float foldedX = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+            float foldedY = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+
+            x = foldedX;
+            y = foldedY;
+        }
+
+        float scaledX = Clamp(x, -1.0f, 1.0f) * maxValue;
+        float scaledY = Clamp(y, -1.0f, 1.0f) * maxValue;
+        float bestDot = -FLT_MAX;
+        float decoded[3];
+
+        for (int i = 0; i < 4; ++i)
+        {
+            int candidateU = static_cast<int>((i & 1) ? ceilf(scaledX) : floorf(scaledX));
+            int candidateV = static_cast<int>((i & 2) ? ceilf(scaledY) : floorf(scaledY));
+
+            OctahedralDecode(DequantizeSnorm(candidateU, maxValue),
+                DequantizeSnorm(candidateV, maxValue), decoded);
+
+            float dot = decoded[0] * normal[0] + decoded[1] * normal[1] + decoded[2] * normal[2];
+
+            if (dot > bestDot)
+            {
+                bestDot = dot;
+                u = candidateU;
+                v = candidateV;
+            }
+        }
+    }
+
+    float AngleBetween(const float a[3], const float b[3])
+    {
+        // atan2() stays accurate for the tiny angles we're measuring where
+        // acos() of the dot product doesn't.
+
+        float cross[3] =
+        {
+            a[1] * b[2] - a[2] * b[1],
+            a[2] * b[0] - a[0] * b[2],
+            a[0] * b[1] - a[1] * b[0]
+        };
+
+        float sine = sqrtf(cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2]);
+        float cosine = a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+
+        return atan2f(sine, cosine);
+    }
+}
+
+VertexQuantizer::VertexQuantizer()
+{
+    m_normalFormat = NORMAL_OCTAHEDRAL_SNORM16;
+    m_texCoordFormat = TEXCOORD_HALF;
+    m_uniformPositionScale = false;
+
+    m_maxPositionError = FLT_MAX;
+    m_maxTexCoordError = FLT_MAX;
+    m_maxNormalError = FLT_MAX;
+
+    m_positionError = 0.0f;
+    m_texCoordError = 0.0f;
+    m_normalError = 0.0f;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        m_positionCenter[i] = 0.0f;
+        m_positionExtent[i] = 1.0f;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        m_texCoordMin[i] = 0.0f;
+        m_texCoordRange[i] = 1.0f;
+    }
+
+    m_numberOfVertices = 0;
+}
+
+VertexQuantizer::~VertexQuantizer()
+{
+}
+
+bool VertexQuantizer::quantize(const ModelOBJ::Vertex *pVertices, int vertexCount)
+{
+    float positionMin[3] = {FLT_MAX, FLT_MAX, FLT_MAX};
+    float positionMax[3] = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+    float texCoordMin[2] = {FLT_MAX, FLT_MAX};
+    float texCoordMax[2] = {-FLT_MAX, -FLT_MAX};
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const ModelOBJ::Vertex &vertex = pVertices[i];
+
+        for (int j = 0; j < 3; ++j)
+        {
+            positionMin[j] = (vertex.position[j] < positionMin[j]) ? vertex.position[j] : positionMin[j];
+            positionMax[j] = (vertex.position[j] > positionMax[j]) ? vertex.position[j] : positionMax[j];
+        }
+
+        for (int j = 0; j < 2; ++j)
+        {
+            texCoordMin[j] = (vertex.texCoord[j] < texCoordMin[j]) ? vertex.texCoord[j] : texCoordMin[j];
+            texCoordMax[j] = (vertex.texCoord[j] > texCoordMax[j]) ? vertex.texCoord[j] : texCoordMax[j];
+        }
+    }
+
+    // A flat axis still needs a non-zero extent to divide by.
+
+    for (int i = 0; i < 3; ++i)
+    {
+        m_positionCenter[i] = (vertexCount > 0) ? (positionMin[i] + positionMax[i]) * 0.5f : 0.0f;
+        m_positionExtent[i] = (vertexCount > 0) ? (positionMax[i] - positionMin[i]) * 0.5f : 0.0f;
+
+        if (m_positionExtent[i] <= 0.0f)
+            m_positionExtent[i] = 1.0f;
+    }
+
+    if (m_uniformPositionScale && vertexCount > 0)
+    {
+        float extent = 0.0f;
+
+        for (int i = 0; i < 3; ++i)
+        {
+            float axisExtent = (positionMax[i] - positionMin[i]) * 0.5f;
+            extent = (axisExtent > extent) ? axisExtent : extent;
+        }
+
+        for (int i = 0; i < 3; ++i)
+            m_positionExtent[i] = (extent > 0.0f) ? extent : 1.0f;
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        m_texCoordMin[i] = (vertexCount > 0) ? texCoordMin[i] : 0.0f;
+        m_texCoordRange[i] = (vertexCount > 0) ? texCoordMax[i] - texCoordMin[i] : 0.0f;
+
+        if (m_texCoordRange[i] <= 0.0f)
+            m_texCoordRange[i] = 1.0f;
+    }
+
+    m_numberOfVertices = vertexCount;
+    m_vertexBuffer.resize(static_cast<size_t>(vertexCount) * getVertexSize());
+
+    // Zero the padding so the same vertices always give the same bytes.
+    if (!m_vertexBuffer.empty())
+        memset(m_vertexBuffer.begin(), 0, m_vertexBuffer.size());
+
+    m_positionError = 0.0f;
+    m_texCoordError = 0.0f;
+    m_normalError = 0.0f;
+
+    ModelOBJ::Vertex decoded;
+
+    for (int i = 0; i < vertexCount; ++i)
+    {
+        const ModelOBJ::Vertex &vertex = pVertices[i];
+
+        quantizeVertex(vertex, &m_vertexBuffer[static_cast<size_t>(i) * getVertexSize()]);
+        dequantize(i, decoded);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            float error = fabsf(decoded.position[j] - vertex.position[j]);
+            m_positionError = (error > m_positionError) ? error : m_positionError;
+        }
+
+        for (int j = 0; j < 2; ++j)
+        {
+            float error = fabsf(decoded.texCoord[j] - vertex.texCoord[j]);
+            m_texCoordError = (error > m_texCoordError) ? error : m_texCoordError;
+        }
+
+        float error = AngleBetween(decoded.normal, vertex.normal);
+        m_normalError = (error > m_normalError) ? error : m_normalError;
+    }
+
+    return m_positionError <= m_maxPositionError &&
+           m_texCoordError <= m_maxTexCoordError &&
+           m_normalError <= m_maxNormalError;
+}
+
+void VertexQuantizer::dequantize(int i, ModelOBJ::Vertex &vertex) const
+{
+    const unsigned char *pVertex = &m_vertexBuffer[static_cast<size_t>(i) * getVertexSize()];
+    short position[3];
+    unsigned short texCoord[2];
+
+    memcpy(position, pVertex, sizeof(position));
+    memcpy(texCoord, pVertex + getTexCoordOffset(), sizeof(texCoord));
+
+    for (int j = 0; j < 3; ++j)
+        vertex.position[j] = m_positionCenter[j] + m_positionExtent[j] * DequantizeSnorm(position[j], 32767);
+
+    for (int j = 0; j < 2; ++j)
+    {
+        if (m_texCoordFormat == TEXCOORD_HALF)
+        {
+            vertex.texCoord[j] = HalfToFloat(texCoord[j]);
+        }
+        else if (m_texCoordFormat == TEXCOORD_UNORM16)
+        {
+            vertex.texCoord[j] = m_texCoordMin[j] + m_texCoordRange[j] * DequantizeUnorm(texCoord[j], 65535);
+        }
+        else
+        {
+            float value = DequantizeSnorm(static_cast<short>(texCoord[j]), 32767);
+            vertex.texCoord[j] = m_texCoordMin[j] + m_texCoordRange[j] * (value + 1.0f) * 0.5f;
+        }
+    }
+
+    if (m_normalFormat == NORMAL_SNORM8)
+    {
+        signed char normal[3];
+
+        memcpy(normal, pVertex + getNormalOffset(), sizeof(normal));
+
+        for (int j = 0; j < 3; ++j)
+            vertex.normal[j] = DequantizeSnorm(normal[j], 127);
+
+        float length = sqrtf(vertex.normal[0] * vertex.normal[0] +
+            vertex.normal[1] * vertex.normal[1] + vertex.normal[2] * vertex.normal[2]);
+
+        if (length > 0.0f)
+        {
+            for (int j = 0; j < 3; ++j)
+                vertex.normal[j] /= length;
+        }
+    }
+    else if (m_normalFormat == NORMAL_OCTAHEDRAL_SNORM8)
+    {
+        signed char normal[2];
+
+        memcpy(normal, pVertex + getNormalOffset(), sizeof(normal));
+        OctahedralDecode(DequantizeSnorm(normal[0], 127), DequantizeSnorm(normal[1], 127), vertex.normal);
+    }
+    else
+    {
+        short normal[2];
+
+        memcpy(normal, pVertex + getNormalOffset(), sizeof(normal));
+        OctahedralDecode(DequantizeSnorm(normal[0], 32767), DequantizeSnorm(normal[1], 32767), vertex.normal);
+    }
+}
+
+void VertexQuantizer::assign(const unsigned char *pVertices, int vertexCount)
+{
+    m_numberOfVertices = vertexCount;
+    m_vertexBuffer.assign(pVertices, pVertices + static_cast<size_t>(vertexCount) * getVertexSize());
+
+    m_positionError = 0.0f;
+    m_texCoordError = 0.0f;
+    m_normalError = 0.0f;
+}
+
+void VertexQuantizer::attach(unsigned char *pVertices, int vertexCount)
+{
+    // The vertices must stay valid until they're replaced by quantize(),
+    // attach(), or a format change, or the quantizer is destroyed.
+
+    m_numberOfVertices = vertexCount;
+    m_vertexBuffer.attach(pVertices, static_cast<size_t>(vertexCount) * getVertexSize());
+
+    m_positionError = 0.0f;
+    m_texCoordError = 0.0f;
+    m_normalError = 0.0f;
+}
+
+void VertexQuantizer::transformPositions(float scaleFactor, const float offset[3])
+{
+    // Decoded positions become (position + offset) * scaleFactor.
+
+    for (int i = 0; i < 3; ++i)
+    {
+        m_positionCenter[i] = (m_positionCenter[i] + offset[i]) * scaleFactor;
+        m_positionExtent[i] *= scaleFactor;
+    }
+
+    m_positionError *= scaleFactor;
+}
+
+void VertexQuantizer::setErrorBound(float maxPositionError, float maxTexCoordError, float maxNormalError)
+{
+    m_maxPositionError = maxPositionError;
+    m_maxTexCoordError = maxTexCoordError;
+    m_maxNormalError = maxNormalError;
+}
+
+void VertexQuantizer::setNormalFormat(NormalFormat format)
+{
+    if (format != m_normalFormat)
+    {
+        m_normalFormat = format;
+        m_numberOfVertices = 0;
+        m_vertexBuffer.clear();
+    }
+}
+
+void VertexQuantizer::setPositionBounds(const float center[3], const float extent[3])
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        m_positionCenter[i] = center[i];
+        m_positionExtent[i] = extent[i];
+    }
+}
+
+void VertexQuantizer::setTexCoordBounds(const float minimum[2], const float range[2])
+{
+    for (int i = 0; i < 2; ++i)
+    {
+        m_texCoordMin[i] = minimum[i];
+        m_texCoordRange[i] = range[i];
+    }
+}
+
+void VertexQuantizer::setTexCoordFormat(TexCoordFormat format)
+{
+    if (format != m_texCoordFormat)
+    {
+        m_texCoordFormat = format;
+        m_numberOfVertices = 0;
+        m_vertexBuffer.clear();
+    }
+}
+
+void VertexQuantizer::setUniformPositionScale(bool uniform)
+{
+    m_uniformPositionScale = uniform;
+}
+
+void VertexQuantizer::quantizeVertex(const ModelOBJ::Vertex &vertex, unsigned char *pVertex) const
+{
+    short position[3];
+    unsigned short texCoord[2];
+
+    for (int i = 0; i < 3; ++i)
+    {
+        float value = (vertex.position[i] - m_positionCenter[i]) / m_positionExtent[i];
+        position[i] = static_cast<short>(QuantizeSnorm(value, 32767));
+    }
+
+    for (int i = 0; i < 2; ++i)
+    {
+        if (m_texCoordFormat == TEXCOORD_HALF)
+        {
+            texCoord[i] = FloatToHalf(vertex.texCoord[i]);
+        }
+        else if (m_texCoordFormat == TEXCOORD_UNORM16)
+        {
+            float value = (vertex.texCoord[i] - m_texCoordMin[i]) / m_texCoordRange[i];
+            texCoord[i] = static_cast<unsigned short>(QuantizeUnorm(value, 65535));
+        }
+        else
+        {
+            float value = (vertex.texCoord[i] - m_texCoordMin[i]) / m_texCoordRange[i] * 2.0f - 1.0f;
+            texCoord[i] = static_cast<unsigned short>(static_cast<short>(QuantizeSnorm(value, 32767)));
+        }
+    }
+
+    memcpy(pVertex, position, sizeof(position));
+    memcpy(pVertex + getTexCoordOffset(), texCoord, sizeof(texCoord));
+
+    int u = 0;
+    int v = 0;
+
+    if (m_normalFormat == NORMAL_SNORM8)
+    {
+        signed char normal[3];
+
+        for (int i = 0; i < 3; ++i)
+            normal[i] = static_cast<signed char>(QuantizeSnorm(vertex.normal[i], 127));
+
+        memcpy(pVertex + getNormalOffset(), normal, sizeof(normal));
+    }
+    else if (m_normalFormat == NORMAL_OCTAHEDRAL_SNORM8)
+    {
+        OctahedralEncode(vertex.normal, 127, u, v);
+
+        signed char normal[2] = {static_cast<signed char>(u), static_cast<signed char>(v)};
+        memcpy(pVertex + getNormalOffset(), normal, sizeof(normal));
+    }
+    else
+    {
+        OctahedralEncode(vertex.normal, 32767, u, v);
+
+        short normal[2] = {static_cast<short>(u), static_cast<short>(v)};
+        memcpy(pVertex + getNormalOffset(), normal, sizeof(normal));
+    }
+}
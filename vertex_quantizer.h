@@ -0,0 +1,201 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(VERTEX_QUANTIZER_H)
+#define VERTEX_QUANTIZER_H
+
+#include "mesh_buffer.h"
+#include "model_obj.h"
+
+//-----------------------------------------------------------------------------
+// Compact vertex storage for ModelOBJ vertices.
+//
+// quantize() packs full float vertices into 12 or 16 bytes per vertex:
+//
+//  position    3 x snorm16 relative to the bounding box of the vertices
+//  texCoord    2 x half float, or 2 x unorm16 or 2 x snorm16 relative to the
+//              bounding box of the texture coordinates
+//  normal      octahedral encoding in 2 x snorm8 or 2 x snorm16, or 3 x snorm8
+//
+// With octahedral snorm8 normals the layout is position (offset 0), normal
+// (offset 6), texCoord (offset 8), 12 bytes in all. With the other two it's
+// position (offset 0), two bytes of padding, texCoord (offset 8), normal
+// (offset 12), 16 bytes in all. The bounding boxes are shared by every vertex
+// rather than stored per mesh since ModelOBJ's meshes share vertices.
+//
+// The octahedral normals and the half float and unorm16 texture coordinates
+// need a vertex shader to decode them. The fixed function pipeline can draw
+// NORMAL_SNORM8 normals (glNormalPointer() with GL_BYTE) and TEXCOORD_SNORM16
+// texture coordinates (glTexCoordPointer() with GL_SHORT and the texture
+// matrix mapping [-32767, 32767] onto the bounding box). Positions are drawn
+// with GL_SHORT and a modelview translation and scale. That scale must be the
+// same on every axis or the normals would be skewed, so
+// setUniformPositionScale() makes quantize() use the largest extent for all
+// three axes.
+//
+// The largest error of each attribute is measured while quantizing:
+// positions and texture coordinates per component in model and texture
+// units, and normals as an angle in radians. quantize() returns false if any
+// of them is larger than the bound set with setErrorBound(). The quantized
+// vertices are kept either way so the caller can decide. Changing either
+// format discards the quantized vertices.
+//
+// dequantize() decodes a vertex using the OpenGL conversion rules for
+// normalized integers (snorm values are divided by 2^(n-1) - 1 and clamped to
+// -1) so the CPU sees the same values a vertex shader decoding the data
+// would. NORMAL_SNORM8 normals are renormalized the way GL_NORMALIZE does.
+//
+// attach() refers to vertices quantized earlier, such as the ones in a memory
+// mapped cache file, without copying them, and assign() copies them. The
+// formats and the bounding boxes they were quantized with are restored first
+// with setNormalFormat(), setTexCoordFormat(), setPositionBounds(), and
+// setTexCoordBounds(). transformPositions() moves and scales the decoded
+// positions by changing the position bounding box only.
+//-----------------------------------------------------------------------------
+
+class VertexQuantizer
+{
+public:
+    enum NormalFormat
+    {
+        NORMAL_OCTAHEDRAL_SNORM8,
+        NORMAL_OCTAHEDRAL_SNORM16,
+        NORMAL_SNORM8
+    };
+
+    enum TexCoordFormat
+    {
+        TEXCOORD_HALF,
+        TEXCOORD_UNORM16,
+        TEXCOORD_SNORM16
+    };
+
+    VertexQuantizer();
+    ~VertexQuantizer();
+
+    bool quantize(const ModelOBJ::Vertex *pVertices, int vertexCount);
+    void dequantize(int i, ModelOBJ::Vertex &vertex) const;
+    void assign(const unsigned char *pVertices, int vertexCount);
+    void attach(unsigned char *pVertices, int vertexCount);
+    void transformPositions(float scaleFactor, const float offset[3]);
+
+    void setErrorBound(float maxPositionError, float maxTexCoordError, float maxNormalError);
+    void setNormalFormat(NormalFormat format);
+    void setPositionBounds(const float center[3], const float extent[3]);
+    void setTexCoordBounds(const float minimum[2], const float range[2]);
+    void setTexCoordFormat(TexCoordFormat format);
+    void setUniformPositionScale(bool uniform);
+
+    // Getter methods.
+
+    float getPositionError() const;
+    float getTexCoordError() const;
+    float getNormalError() const;
+
+    const float *getPositionCenter() const;
+    const float *getPositionExtent() const;
+    const float *getTexCoordMin() const;
+    const float *getTexCoordRange() const;
+
+    NormalFormat getNormalFormat() const;
+    TexCoordFormat getTexCoordFormat() const;
+    bool hasUniformPositionScale() const;
+
+    int getNormalOffset() const;
+    int getTexCoordOffset() const;
+
+    int getNumberOfVertices() const;
+    const void *getVertexBuffer() const;
+    int getVertexSize() const;
+
+private:
+    void quantizeVertex(const ModelOBJ::Vertex &vertex, unsigned char *pVertex) const;
+
+    NormalFormat m_normalFormat;
+    TexCoordFormat m_texCoordFormat;
+    bool m_uniformPositionScale;
+
+    float m_maxPositionError;
+    float m_maxTexCoordError;
+    float m_maxNormalError;
+
+    float m_positionError;
+    float m_texCoordError;
+    float m_normalError;
+
+    float m_positionCenter[3];
+    float m_positionExtent[3];
+    float m_texCoordMin[2];
+    float m_texCoordRange[2];
+
+    int m_numberOfVertices;
+    MeshBuffer<unsigned char> m_vertexBuffer;
+};
+
+//-----------------------------------------------------------------------------
+
+inline float VertexQuantizer::getPositionError() const
+{ return m_positionError; }
+
+inline float VertexQuantizer::getTexCoordError() const
+{ return m_texCoordError; }
+
+inline float VertexQuantizer::getNormalError() const
+{ return m_normalError; }
+
+inline const float *VertexQuantizer::getPositionCenter() const
+{ return m_positionCenter; }
+
+inline const float *VertexQuantizer::getPositionExtent() const
+{ return m_positionExtent; }
+
+inline const float *VertexQuantizer::getTexCoordMin() const
+{ return m_texCoordMin; }
+
+inline const float *VertexQuantizer::getTexCoordRange() const
+{ return m_texCoordRange; }
+
+inline VertexQuantizer::NormalFormat VertexQuantizer::getNormalFormat() const
+{ return m_normalFormat; }
+
+inline VertexQuantizer::TexCoordFormat VertexQuantizer::getTexCoordFormat() const
+{ return m_texCoordFormat; }
+
+inline bool VertexQuantizer::hasUniformPositionScale() const
+{ return m_uniformPositionScale; }
+
+inline int VertexQuantizer::getNormalOffset() const
+{ return (m_normalFormat == NORMAL_OCTAHEDRAL_SNORM8) ? 6 : 12; }
+
+inline int VertexQuantizer::getTexCoordOffset() const
+{ return 8; }
+
+inline int VertexQuantizer::getNumberOfVertices() const
+{ return m_numberOfVertices; }
+
+inline const void *VertexQuantizer::getVertexBuffer() const
+{ return m_vertexBuffer.empty() ? 0 : m_vertexBuffer.begin(); }
+
+inline int VertexQuantizer::getVertexSize() const
+{ return (m_normalFormat == NORMAL_OCTAHEDRAL_SNORM8) ? 12 : 16; }
+
+#endif
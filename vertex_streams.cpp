@@ -0,0 +1,191 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#define PERFORM_SIMD_STREAMS            1
+#else
+#define PERFORM_SIMD_STREAMS            0
+#endif
+
+#include <cstdlib>
+#include <new>
+#include "vertex_streams.h"
+
+#if PERFORM_SIMD_STREAMS
+#include <xmmintrin.h>
+#endif
+
+VertexStreams::VertexStreams()
+{
+    m_pAllocation = 0;
+
+    for (int i = 0; i < STREAM_COUNT; ++i)
+        m_pStreams[i] = 0;
+
+    m_numberOfVertices = 0;
+    m_capacity = 0;
+}
+
+VertexStreams::~VertexStreams()
+{
+    destroy();
+}
+
+void VertexStreams::build(const ModelOBJ::Vertex *pVertices, int vertexCount)
+{
+    // All eight streams share one allocation. Each stream's size is a
+    // multiple of 8 floats (32 bytes) so every stream stays aligned. The
+    // allocation is kept when the vertices still fit.
+
+    int capacity = (vertexCount + WIDTH - 1) / WIDTH * WIDTH;
+
+    if (capacity > m_capacity)
+    {
+        destroy();
+
+        m_pAllocation = malloc(static_cast<size_t>(capacity) * STREAM_COUNT * sizeof(float) + ALIGNMENT - 1);
+
+        if (!m_pAllocation)
+            throw std::bad_alloc();
+
+        size_t address = reinterpret_cast<size_t>(m_pAllocation);
+        float *pBase = reinterpret_cast<float *>((address + ALIGNMENT - 1) & ~static_cast<size_t>(ALIGNMENT - 1));
+
+        for (int i = 0; i < STREAM_COUNT; ++i)
+            m_pStreams[i] = pBase + static_cast<size_t>(capacity) * i;
+
+        m_capacity = capacity;
+    }
+
+    m_numberOfVertices = vertexCount;
+
+    if (vertexCount == 0)
+        return;
+
+    float *pX = m_pStreams[POSITION_X];
+    float *pY = m_pStreams[POSITION_Y];
+    float *pZ = m_pStreams[POSITION_Z];
+    float *pU = m_pStreams[TEXCOORD_U];
+    float *pV = m_pStreams[TEXCOORD_V];
+    float *pNormalX = m_pStreams[NORMAL_X];
+    float *pNormalY = m_pStreams[NORMAL_Y];
+    float *pNormalZ = m_pStreams[NORMAL_Z];
+
+    // The padding repeats the last vertex, so kernels that work on whole
+    // blocks of 8 vertices don't need a separate loop for the last few and
+    // can't be thrown off by values that aren't in the model.
+
+    for (int i = 0; i < capacity; ++i)
+    {
+        const ModelOBJ::Vertex &vertex = pVertices[(i < vertexCount) ? i : vertexCount - 1];
+
+        pX[i] = vertex.position[0];
+        pY[i] = vertex.position[1];
+        pZ[i] = vertex.position[2];
+        pU[i] = vertex.texCoord[0];
+        pV[i] = vertex.texCoord[1];
+        pNormalX[i] = vertex.normal[0];
+        pNormalY[i] = vertex.normal[1];
+        pNormalZ[i] = vertex.normal[2];
+    }
+}
+
+void VertexStreams::destroy()
+{
+    free(m_pAllocation);
+    m_pAllocation = 0;
+
+    for (int i = 0; i < STREAM_COUNT; ++i)
+        m_pStreams[i] = 0;
+
+    m_numberOfVertices = 0;
+    m_capacity = 0;
+}
+
+void VertexStreams::interleave(ModelOBJ::Vertex *pVertices) const
+{
+    const float *pU = m_pStreams[TEXCOORD_U];
+    const float *pV = m_pStreams[TEXCOORD_V];
+
+    interleavePositions(pVertices);
+    interleaveNormals(pVertices);
+
+    for (int i = 0; i < m_numberOfVertices; ++i)
+    {
+        pVertices[i].texCoord[0] = pU[i];
+        pVertices[i].texCoord[1] = pV[i];
+    }
+}
+
+void VertexStreams::interleaveNormals(ModelOBJ::Vertex *pVertices) const
+{
+    const float *pNormalX = m_pStreams[NORMAL_X];
+    const float *pNormalY = m_pStreams[NORMAL_Y];
+    const float *pNormalZ = m_pStreams[NORMAL_Z];
+
+    for (int i = 0; i < m_numberOfVertices; ++i)
+    {
+        pVertices[i].normal[0] = pNormalX[i];
+        pVertices[i].normal[1] = pNormalY[i];
+        pVertices[i].normal[2] = pNormalZ[i];
+    }
+}
+
+void VertexStreams::interleavePositions(ModelOBJ::Vertex *pVertices) const
+{
+    const float *pX = m_pStreams[POSITION_X];
+    const float *pY = m_pStreams[POSITION_Y];
+    const float *pZ = m_pStreams[POSITION_Z];
+
+    for (int i = 0; i < m_numberOfVertices; ++i)
+    {
+        pVertices[i].position[0] = pX[i];
+        pVertices[i].position[1] = pY[i];
+        pVertices[i].position[2] = pZ[i];
+    }
+}
+
+void VertexStreams::scalePositions(float scaleFactor, const float offset[3])
+{
+    // position = (position + offset) * scaleFactor. The padding is scaled
+    // along with the vertices so it still repeats the last vertex.
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        float *pValues = m_pStreams[POSITION_X + axis];
+        int i = 0;
+
+#if PERFORM_SIMD_STREAMS
+        __m128 add = _mm_set1_ps(offset[axis]);
+        __m128 mul = _mm_set1_ps(scaleFactor);
+
+        for (; i < m_capacity; i += WIDTH)
+        {
+            _mm_store_ps(pValues + i, _mm_mul_ps(_mm_add_ps(_mm_load_ps(pValues + i), add), mul));
+            _mm_store_ps(pValues + i + 4, _mm_mul_ps(_mm_add_ps(_mm_load_ps(pValues + i + 4), add), mul));
+        }
+#endif
+
+        for (; i < m_capacity; ++i)
+            pValues[i] = (pValues[i] + offset[axis]) * scaleFactor;
+    }
+}
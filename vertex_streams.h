@@ -0,0 +1,112 @@
+//-----------------------------------------------------------------------------
+// Copyright (c) 2007 dhpoware. All Rights Reserved.
+//
+// Permission is hereby granted, free of charge, to any person obtaining a
+// copy of this software and associated documentation files (the "Software"),
+// to deal in the Software without restriction, including without limitation
+// the rights to use, copy, modify, merge, publish, distribute, sublicense,
+// and/or sell copies of the Software, and to permit persons to whom the
+// Software is furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+// OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//-----------------------------------------------------------------------------
+
+#if !defined(VERTEX_STREAMS_H)
+#define VERTEX_STREAMS_H
+
+#include "model_obj.h"
+
+//-----------------------------------------------------------------------------
+// Structure of arrays copy of ModelOBJ vertices.
+//
+// build() splits the vertices into eight separate float streams: position x,
+// y, and z, texture coordinate u and v, and normal x, y, and z. Each stream
+// starts on a 32 byte boundary and is padded to a multiple of 8 vertices with
+// copies of the last vertex, so kernels can always work on 8 whole vertices
+// at a time with aligned loads. interleave() writes the streams back into
+// ModelOBJ vertices, and interleavePositions() and interleaveNormals() write
+// back just those attributes.
+//
+// Code that only needs some attributes reads only those streams: MeshBounds
+// reads 12 bytes per vertex from the position streams instead of 32.
+// scalePositions() scales the positions with SSE, 8 vertices per loop
+// iteration, and gives exactly the same results as the scalar code.
+//
+// ModelOBJ::buildVertexStreams() keeps a VertexStreams up to date alongside
+// the model's vertex buffer and hands its bounds and scaling work to these
+// streams.
+//-----------------------------------------------------------------------------
+
+class VertexStreams
+{
+public:
+    static const int ALIGNMENT = 32;
+    static const int WIDTH = 8;
+
+    enum Stream
+    {
+        POSITION_X,
+        POSITION_Y,
+        POSITION_Z,
+        TEXCOORD_U,
+        TEXCOORD_V,
+        NORMAL_X,
+        NORMAL_Y,
+        NORMAL_Z,
+        STREAM_COUNT
+    };
+
+    VertexStreams();
+    ~VertexStreams();
+
+    void build(const ModelOBJ::Vertex *pVertices, int vertexCount);
+    void destroy();
+    void interleave(ModelOBJ::Vertex *pVertices) const;
+    void interleaveNormals(ModelOBJ::Vertex *pVertices) const;
+    void interleavePositions(ModelOBJ::Vertex *pVertices) const;
+
+    // Kernels.
+
+    void scalePositions(float scaleFactor, const float offset[3]);
+
+    // Getter methods.
+
+    int getCapacity() const;
+    int getNumberOfVertices() const;
+    float *getStream(Stream stream);
+    const float *getStream(Stream stream) const;
+
+private:
+    VertexStreams(const VertexStreams &);
+    VertexStreams &operator=(const VertexStreams &);
+
+    void *m_pAllocation;
+    float *m_pStreams[STREAM_COUNT];
+    int m_numberOfVertices;
+    int m_capacity;
+};
+
+//-----------------------------------------------------------------------------
+
+inline int VertexStreams::getCapacity() const
+{ return m_capacity; }
+
+inline int VertexStreams::getNumberOfVertices() const
+{ return m_numberOfVertices; }
+
+inline float *VertexStreams::getStream(Stream stream)
+{ return m_pStreams[stream]; }
+
+inline const float *VertexStreams::getStream(Stream stream) const
+{ return m_pStreams[stream]; }
+
+#endif